@@ -0,0 +1,787 @@
+/// --------------------
+/// Algorithm analysis
+/// --------------------
+
+#include "analysis.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "node.h"
+#include "token.h"
+
+namespace {
+
+bool is_pure_numeric_node(const std::shared_ptr<Node>& node, const std::string& algo_name,
+                          const std::unordered_set<std::string>& arg_names) {
+    if (!node) return false;
+
+    std::string type = node->get_type();
+    if (type == NODE_VALUE) {
+        std::string token_type = node->get_tok()->get_type();
+        return token_type == TOKEN_INT || token_type == TOKEN_FLOAT;
+    }
+    if (type == NODE_VARACCESS) {
+        return arg_names.count(node->get_name()) != 0;
+    }
+    if (type == NODE_BINOP) {
+        NodeList child = node->get_child();
+        return child.size() == 2 && is_pure_numeric_node(child[0], algo_name, arg_names) &&
+               is_pure_numeric_node(child[1], algo_name, arg_names);
+    }
+    if (type == NODE_UNARYOP) {
+        NodeList child = node->get_child();
+        return child.size() == 1 && is_pure_numeric_node(child[0], algo_name, arg_names);
+    }
+    if (type == NODE_RETURN) {
+        NodeList child = node->get_child();
+        return child.size() == 1 && is_pure_numeric_node(child[0], algo_name, arg_names);
+    }
+    if (type == NODE_IF) {
+        IfNode* if_node = dynamic_cast<IfNode*>(node.get());
+        if (!is_pure_numeric_node(if_node->get_condition(), algo_name, arg_names)) return false;
+        for (const auto& expr : if_node->get_expr()) {
+            if (!is_pure_numeric_node(expr, algo_name, arg_names)) return false;
+        }
+        for (const auto& expr : if_node->get_else()) {
+            if (!is_pure_numeric_node(expr, algo_name, arg_names)) return false;
+        }
+        return true;
+    }
+    if (type == NODE_ALGOCALL) {
+        AlgorithmCallNode* call_node = dynamic_cast<AlgorithmCallNode*>(node.get());
+        if (call_node->get_call()->get_type() != NODE_VARACCESS ||
+            call_node->get_name() != algo_name) {
+            return false;
+        }
+        for (const auto& arg : call_node->get_args()) {
+            if (!is_pure_numeric_node(arg, algo_name, arg_names)) return false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+bool has_self_call(const std::shared_ptr<Node>& node, const std::string& algo_name) {
+    if (!node) return false;
+
+    if (node->get_type() == NODE_ALGOCALL) {
+        AlgorithmCallNode* call_node = dynamic_cast<AlgorithmCallNode*>(node.get());
+        if (call_node->get_call()->get_type() == NODE_VARACCESS &&
+            call_node->get_name() == algo_name) {
+            return true;
+        }
+        for (const auto& arg : call_node->get_args()) {
+            if (has_self_call(arg, algo_name)) return true;
+        }
+        return false;
+    }
+
+    if (node->get_type() == NODE_IF) {
+        IfNode* if_node = dynamic_cast<IfNode*>(node.get());
+        if (has_self_call(if_node->get_condition(), algo_name)) return true;
+        for (const auto& expr : if_node->get_expr()) {
+            if (has_self_call(expr, algo_name)) return true;
+        }
+        for (const auto& expr : if_node->get_else()) {
+            if (has_self_call(expr, algo_name)) return true;
+        }
+        return false;
+    }
+
+    for (const auto& child : node->get_child()) {
+        if (has_self_call(child, algo_name)) return true;
+    }
+    return false;
+}
+
+// Visits the direct children of `node`, including both branches of an if.
+template <typename F>
+void for_each_child(const std::shared_ptr<Node>& node, F&& visit) {
+    if (node->get_type() == NODE_IF) {
+        IfNode* if_node = dynamic_cast<IfNode*>(node.get());
+        visit(if_node->get_condition());
+        for (const auto& expr : if_node->get_expr()) visit(expr);
+        for (const auto& expr : if_node->get_else()) visit(expr);
+        return;
+    }
+    for (const auto& child : node->get_child()) visit(child);
+}
+
+// Names bound in the running frame: assignments, loop variables and local
+// definitions, without entering nested Algorithm bodies.
+void collect_bound_names(const std::shared_ptr<Node>& node,
+                         std::unordered_set<std::string>& names) {
+    if (!node) return;
+    std::string type = node->get_type();
+    if (type == NODE_VARASSIGN || type == NODE_ALGODEF || type == NODE_STRUCTDEF) {
+        names.insert(node->get_name());
+    }
+    if (type == NODE_ALGODEF || type == NODE_STRUCTDEF) return;
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) {
+        collect_bound_names(child, names);
+    });
+}
+
+// Variable reads evaluated in the running frame. Member names are not reads.
+void collect_reads(const std::shared_ptr<Node>& node, std::vector<VarAccessNode*>& reads) {
+    if (!node) return;
+    std::string type = node->get_type();
+    if (type == NODE_VARACCESS) {
+        reads.push_back(static_cast<VarAccessNode*>(node.get()));
+        return;
+    }
+    if (type == NODE_ALGODEF || type == NODE_STRUCTDEF) return;
+    if (type == NODE_MEMACCESS) {
+        collect_reads(static_cast<MemberAccessNode*>(node.get())->get_obj(), reads);
+        return;
+    }
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) { collect_reads(child, reads); });
+}
+
+std::unordered_set<std::string> frame_bound_names(AlgorithmDefNode& algo_node) {
+    std::unordered_set<std::string> bound{"self"};
+    for (const auto& tok : algo_node.get_toks()) bound.insert(tok->get_value());
+    for (const auto& expr : algo_node.get_body()) collect_bound_names(expr, bound);
+    return bound;
+}
+
+bool is_builtin_read(VarAccessNode* read) {
+    return read->get_tok()->get_type() == TOKEN_BUILTIN_ALGO;
+}
+
+// Builtins can never be rebound. In a top-level Algorithm, every other name
+// not bound by the frame itself lives in the global table under lexical
+// scoping; elsewhere reads keep the ordinary scope-chain lookup.
+void resolve_frame(const NodeList& statements, const std::unordered_set<std::string>& bound,
+                   bool top_level_algorithm) {
+    std::vector<VarAccessNode*> reads;
+    for (const auto& statement : statements) collect_reads(statement, reads);
+    for (VarAccessNode* read : reads) {
+        if (is_builtin_read(read)) {
+            read->set_scope(VarScope::Builtin);
+        } else if (top_level_algorithm && !bound.count(read->get_name())) {
+            read->set_scope(VarScope::Global);
+        } else {
+            read->set_scope(VarScope::Local);
+        }
+    }
+}
+
+// Conversions are the only builtins without side effects.
+bool is_pure_builtin(const std::string& name) {
+    return name == "int" || name == "float" || name == "string";
+}
+
+struct SubtreeFacts {
+    bool has_assignment{false};
+    bool pure{true};
+    bool constant{false};
+};
+
+SubtreeFacts annotate_node(const std::shared_ptr<Node>& node, bool used,
+                           const std::string& algo_name);
+
+SubtreeFacts merge(SubtreeFacts facts, const SubtreeFacts& child) {
+    facts.has_assignment = facts.has_assignment || child.has_assignment;
+    facts.pure = facts.pure && child.pure;
+    return facts;
+}
+
+// Only the last statement of a block can become the block's value.
+SubtreeFacts annotate_block(const NodeList& statements, bool used, const std::string& algo_name) {
+    SubtreeFacts facts;
+    for (std::size_t i = 0; i < statements.size(); ++i) {
+        facts = merge(facts, annotate_node(statements[i], used && i + 1 == statements.size(),
+                                           algo_name));
+    }
+    return facts;
+}
+
+// Loop bodies contribute to the result array only when they are a single
+// statement; longer bodies are evaluated for their side effects.
+SubtreeFacts annotate_loop(const NodeList& child, std::size_t body_start, bool used,
+                           const std::string& algo_name) {
+    SubtreeFacts facts;
+    bool single = child.size() == body_start + 1;
+    for (std::size_t i = 0; i < child.size(); ++i) {
+        facts = merge(facts, annotate_node(child[i], i < body_start || (used && single),
+                                           algo_name));
+    }
+    return facts;
+}
+
+void annotate_algo_def(const std::shared_ptr<Node>& node, bool top_level) {
+    AlgorithmDefNode* algo_node = dynamic_cast<AlgorithmDefNode*>(node.get());
+    resolve_frame(algo_node->get_body(), frame_bound_names(*algo_node), top_level);
+    std::string name = node->get_name();
+    std::vector<std::string> args;
+    for (const auto& tok : node->get_toks()) args.push_back(tok->get_value());
+
+    // Plain assignments inside the body only touch the call's own scope.
+    SubtreeFacts body = annotate_block(algo_node->get_body(), true, name);
+    bool recursive = false;
+    for (const auto& expr : algo_node->get_body()) {
+        recursive = recursive || has_self_call(expr, name);
+    }
+    node->set_flag(NODE_FLAG_PURE, body.pure);
+    node->set_flag(NODE_FLAG_SELF_RECURSIVE, recursive);
+    node->set_flag(NODE_FLAG_MEMOIZABLE, is_memoizable_numeric_algo(node, name, args));
+    node->set_flag(NODE_FLAG_SINGLE_RETURN,
+                   single_return_numeric_expr(node, name, args) != nullptr);
+    node->set_flag(NODE_FLAG_ASSOCIATIVE, is_associative_combiner(node));
+}
+
+SubtreeFacts annotate_node(const std::shared_ptr<Node>& node, bool used,
+                           const std::string& algo_name) {
+    SubtreeFacts facts;
+    if (!node) return facts;
+
+    std::string type = node->get_type();
+    if (type == NODE_FOR) {
+        facts = annotate_loop(node->get_child(), 3, used, algo_name);
+    } else if (type == NODE_WHILE || type == NODE_REPEAT) {
+        facts = annotate_loop(node->get_child(), 1, used, algo_name);
+    } else if (type == NODE_IF) {
+        IfNode* if_node = dynamic_cast<IfNode*>(node.get());
+        facts = merge(facts, annotate_node(if_node->get_condition(), true, algo_name));
+        facts = merge(facts, annotate_block(if_node->get_expr(), used, algo_name));
+        facts = merge(facts, annotate_block(if_node->get_else(), used, algo_name));
+    } else if (type == NODE_ALGODEF) {
+        annotate_algo_def(node, algo_name.empty());
+    } else if (type == NODE_ALGOCALL) {
+        AlgorithmCallNode* call_node = dynamic_cast<AlgorithmCallNode*>(node.get());
+        facts = merge(facts, annotate_node(call_node->get_call(), true, algo_name));
+        for (const auto& arg : call_node->get_args()) {
+            facts = merge(facts, annotate_node(arg, true, algo_name));
+        }
+        std::string callee = call_node->get_call()->get_type() == NODE_VARACCESS
+                                 ? call_node->get_name()
+                                 : std::string();
+        if (callee.empty() || (callee != algo_name && !is_pure_builtin(callee))) {
+            facts.pure = false;
+        }
+    } else if (type == NODE_STRUCTDEF) {
+        for (const auto& method : node->get_child()) annotate_node(method, true, algo_name);
+    } else {
+        bool constant = type == NODE_BINOP || type == NODE_UNARYOP;
+        for (const auto& child : node->get_child()) {
+            SubtreeFacts child_facts = annotate_node(child, true, algo_name);
+            facts = merge(facts, child_facts);
+            constant = constant && child_facts.constant;
+        }
+        if (type == NODE_VALUE) {
+            std::string token_type = node->get_tok()->get_type();
+            constant = token_type == TOKEN_INT || token_type == TOKEN_FLOAT ||
+                       token_type == TOKEN_STRING;
+        }
+        facts.constant = constant;
+        if (type == NODE_VARASSIGN || type == NODE_ARRASSIGN) facts.has_assignment = true;
+        // Array stores and member access (which may call a mutating method)
+        // reach values shared with the caller.
+        if (type == NODE_ARRASSIGN || type == NODE_MEMACCESS) facts.pure = false;
+        if (type == NODE_SPAWN) facts.pure = false;
+    }
+
+    node->set_flag(NODE_FLAG_RESULT_USED, used);
+    node->set_flag(NODE_FLAG_HAS_ASSIGNMENT, facts.has_assignment);
+    node->set_flag(NODE_FLAG_CONSTANT, facts.constant);
+    node->set_flag(NODE_FLAG_JIT_ROOT,
+                   type == NODE_BINOP || type == NODE_UNARYOP || type == NODE_ALGOCALL);
+    if (type != NODE_ALGODEF) node->set_flag(NODE_FLAG_PURE, facts.pure);
+
+    // Defining a nested algorithm or struct does not make the enclosing code
+    // impure or assigning.
+    if (type == NODE_ALGODEF || type == NODE_STRUCTDEF) return SubtreeFacts{};
+    return facts;
+}
+
+// How a parallel loop body uses a name: only as the accumulator of
+// `v <- v op e` updates with `op`, or also some other way.
+struct ReductionUse {
+    BinaryOp op{BINARY_COUNT};
+    bool other_use{false};
+};
+
+void scan_reductions(const std::shared_ptr<Node>& node,
+                     std::unordered_map<SymbolId, ReductionUse>& uses,
+                     std::vector<SymbolId>& order) {
+    if (!node) return;
+    std::string type = node->get_type();
+    if (type == NODE_ALGODEF || type == NODE_STRUCTDEF) return;
+    if (type != NODE_VARACCESS && type != NODE_VARASSIGN) {
+        for_each_child(node, [&uses, &order](const std::shared_ptr<Node>& child) {
+            scan_reductions(child, uses, order);
+        });
+        return;
+    }
+
+    SymbolId symbol = node->get_symbol();
+    auto [use, inserted] = uses.try_emplace(symbol);
+    if (inserted) order.push_back(symbol);
+    if (type == NODE_VARACCESS) {
+        use->second.other_use = true;
+        return;
+    }
+    std::shared_ptr<Node> value = node->get_child()[0];
+    BinOpNode* update =
+        value->get_type() == NODE_BINOP ? static_cast<BinOpNode*>(value.get()) : nullptr;
+    if (update && (update->get_op() == BINARY_ADD || update->get_op() == BINARY_MUL) &&
+        update->get_left()->get_type() == NODE_VARACCESS &&
+        update->get_left()->get_symbol() == symbol &&
+        (inserted || use->second.op == update->get_op())) {
+        use->second.op = update->get_op();
+        scan_reductions(update->get_right(), uses, order);
+        return;
+    }
+    use->second.other_use = true;
+    scan_reductions(value, uses, order);
+}
+
+// The variable a chain of member and element accesses starts from, or
+// nullptr when it starts from something else. Sets `indexed` when the chain
+// goes through an element.
+VarAccessNode* access_root(const std::shared_ptr<Node>& node, bool& indexed) {
+    std::string type = node->get_type();
+    if (type == NODE_VARACCESS) return static_cast<VarAccessNode*>(node.get());
+    if (type == NODE_MEMACCESS) {
+        return access_root(static_cast<MemberAccessNode*>(node.get())->get_obj(), indexed);
+    }
+    if (type == NODE_ARRACCESS) {
+        indexed = true;
+        return access_root(static_cast<ArrayAccessNode*>(node.get())->get_array(), indexed);
+    }
+    return nullptr;
+}
+
+// `node` as written, with indexes elided, for messages.
+std::string access_text(const std::shared_ptr<Node>& node) {
+    std::string type = node->get_type();
+    if (type == NODE_VARACCESS) return node->get_name();
+    if (type == NODE_MEMACCESS) {
+        MemberAccessNode* member = static_cast<MemberAccessNode*>(node.get());
+        return access_text(member->get_obj()) + "." + member->get_member_name();
+    }
+    if (type == NODE_ARRACCESS) {
+        return access_text(static_cast<ArrayAccessNode*>(node.get())->get_array()) + "[...]";
+    }
+    return "...";
+}
+
+bool is_mutating_method(MethodId method) {
+    switch (method) {
+        case METHOD_PUSH:
+        case METHOD_POP:
+        case METHOD_RESIZE:
+        case METHOD_INSERT:
+        case METHOD_REMOVE:
+        case METHOD_SET:
+        case METHOD_CLEAR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void collect_assignments(const std::shared_ptr<Node>& node, std::vector<Node*>& assignments) {
+    if (!node) return;
+    std::string type = node->get_type();
+    if (type == NODE_ALGODEF || type == NODE_STRUCTDEF) return;
+    if (type == NODE_VARASSIGN) assignments.push_back(node.get());
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) {
+        collect_assignments(child, assignments);
+    });
+}
+
+// What a parallel loop body binds: the names private to a chunk, and those
+// of them it binds to a shared container as a whole.
+struct BodyNames {
+    std::unordered_set<std::string> bound;
+    std::unordered_set<std::string> aliases;
+    bool outer(const std::string& name) const { return !bound.count(name); }
+    bool shared(const std::string& name) const { return outer(name) || aliases.count(name); }
+};
+
+void scan_shared_writes(const std::shared_ptr<Node>& node, const BodyNames& names,
+                        SharedWrites& writes) {
+    if (!node || !writes.error.empty()) return;
+    std::string type = node->get_type();
+    if (type == NODE_ALGODEF || type == NODE_STRUCTDEF) return;
+    if (type == NODE_ALGOCALL) {
+        const std::shared_ptr<Node>& call = static_cast<AlgorithmCallNode*>(node.get())->get_call();
+        if (call->get_type() == NODE_MEMACCESS) {
+            MemberAccessNode* method = static_cast<MemberAccessNode*>(call.get());
+            bool indexed = false;
+            VarAccessNode* root = access_root(method->get_obj(), indexed);
+            if (root && !indexed && names.shared(root->get_name()) &&
+                is_mutating_method(method->get_method_id())) {
+                writes.error = "\"" + access_text(call) + "\" changes a container shared by "
+                               "the iterations of a parallel for loop";
+                return;
+            }
+        }
+        scan_shared_writes(call, names, writes);
+    } else if (type == NODE_ARRASSIGN) {
+        std::shared_ptr<Node> target = node->get_child()[0];
+        if (target->get_type() == NODE_MEMACCESS) {
+            bool indexed = false;
+            VarAccessNode* root =
+                access_root(static_cast<MemberAccessNode*>(target.get())->get_obj(), indexed);
+            if (root && !indexed && names.shared(root->get_name())) {
+                writes.error = "Assigning \"" + access_text(target) + "\" changes a value shared "
+                               "by the iterations of a parallel for loop";
+                return;
+            }
+        } else if (target->get_type() == NODE_ARRACCESS) {
+            const std::shared_ptr<Node>& array =
+                static_cast<ArrayAccessNode*>(target.get())->get_array();
+            if (array->get_type() == NODE_VARACCESS && names.outer(array->get_name())) {
+                writes.element_writes.push_back(array->get_symbol());
+            }
+        }
+    }
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) {
+        scan_shared_writes(child, names, writes);
+    });
+}
+
+std::atomic<std::uint32_t> next_tree{1};
+
+// Gives the nodes under `node` that are not numbered yet the next ordinals
+// in `tree`, taking a new tree number on the first one.
+void number_subtree(const std::shared_ptr<Node>& node, std::uint32_t& tree,
+                    std::uint32_t& ordinal) {
+    if (!node) return;
+    if (node->get_tree() == 0) {
+        if (tree == 0) tree = next_tree.fetch_add(1, std::memory_order_relaxed);
+        node->number(tree, ordinal++);
+    }
+    // A call's callee is not among its children.
+    if (node->get_type() == NODE_ALGOCALL) {
+        number_subtree(static_cast<AlgorithmCallNode*>(node.get())->get_call(), tree, ordinal);
+    }
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) {
+        number_subtree(child, tree, ordinal);
+    });
+}
+
+void number_nodes(const NodeList& statements) {
+    std::uint32_t tree = 0, ordinal = 0;
+    for (const auto& statement : statements) number_subtree(statement, tree, ordinal);
+}
+
+}  // namespace
+
+SharedWrites find_shared_writes(const NodeList& body, const std::string& loop_name) {
+    BodyNames names;
+    names.bound.insert(loop_name);
+    std::vector<Node*> assignments;
+    for (const auto& statement : body) {
+        collect_bound_names(statement, names.bound);
+        collect_assignments(statement, assignments);
+    }
+    // Followed through chains of aliases.
+    for (bool grew = true; grew;) {
+        grew = false;
+        for (Node* assignment : assignments) {
+            bool indexed = false;
+            VarAccessNode* root = access_root(assignment->get_child()[0], indexed);
+            if (root && !indexed && names.shared(root->get_name()) &&
+                names.aliases.insert(assignment->get_name()).second) {
+                grew = true;
+            }
+        }
+    }
+
+    SharedWrites writes;
+    for (const auto& statement : body) scan_shared_writes(statement, names, writes);
+    return writes;
+}
+
+std::vector<LoopReduction> find_loop_reductions(const NodeList& body) {
+    std::unordered_map<SymbolId, ReductionUse> uses;
+    std::vector<SymbolId> order;
+    for (const auto& statement : body) scan_reductions(statement, uses, order);
+    std::vector<LoopReduction> reductions;
+    for (SymbolId symbol : order) {
+        const ReductionUse& use = uses[symbol];
+        if (!use.other_use) reductions.push_back(LoopReduction{symbol, use.op});
+    }
+    return reductions;
+}
+
+namespace {
+
+// What a frame binds outside its parallel loop bodies, the parallel loops
+// it runs, and the Algorithms it defines, whose bodies are frames of their own.
+struct FrameScan {
+    std::unordered_set<std::string> bound;
+    std::vector<ForNode*> loops;
+    std::vector<AlgorithmDefNode*> algorithms;
+};
+
+void scan_frame(const std::shared_ptr<Node>& node, bool in_parallel_body, FrameScan& frame) {
+    if (!node) return;
+    std::string type = node->get_type();
+    if (type == NODE_ALGODEF || type == NODE_STRUCTDEF) {
+        if (!in_parallel_body) frame.bound.insert(node->get_name());
+        if (type == NODE_ALGODEF) {
+            frame.algorithms.push_back(static_cast<AlgorithmDefNode*>(node.get()));
+        } else {
+            for (const auto& method : node->get_child()) scan_frame(method, true, frame);
+        }
+        return;
+    }
+    if (type == NODE_VARASSIGN && !in_parallel_body) frame.bound.insert(node->get_name());
+    if (type == NODE_FOR && static_cast<ForNode*>(node.get())->is_parallel()) {
+        ForNode* loop = static_cast<ForNode*>(node.get());
+        frame.loops.push_back(loop);
+        NodeList child = node->get_child();
+        for (std::size_t i = 0; i < 3; ++i) scan_frame(child[i], in_parallel_body, frame);
+        for (const auto& statement : loop->get_body()) scan_frame(statement, true, frame);
+        return;
+    }
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) {
+        scan_frame(child, in_parallel_body, frame);
+    });
+}
+
+void collect_loop_variables(const std::shared_ptr<Node>& node, std::unordered_set<Node*>& variables) {
+    if (!node) return;
+    std::string type = node->get_type();
+    if (type == NODE_ALGODEF || type == NODE_STRUCTDEF) return;
+    if (type == NODE_FOR) variables.insert(node->get_child()[0].get());
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) {
+        collect_loop_variables(child, variables);
+    });
+}
+
+void find_lost_in_frame(const NodeList& statements, std::unordered_set<std::string> bound,
+                        std::vector<LostAssignment>& lost) {
+    FrameScan frame;
+    frame.bound = std::move(bound);
+    for (const auto& statement : statements) scan_frame(statement, false, frame);
+
+    for (ForNode* loop : frame.loops) {
+        const NodeList& body = loop->get_body();
+        std::unordered_set<SymbolId> reductions;
+        for (const LoopReduction& reduction : find_loop_reductions(body)) {
+            reductions.insert(reduction.symbol);
+        }
+        std::unordered_set<Node*> loop_variables;
+        std::vector<Node*> assignments;
+        for (const auto& statement : body) {
+            collect_loop_variables(statement, loop_variables);
+            collect_assignments(statement, assignments);
+        }
+        for (Node* assignment : assignments) {
+            if (!loop_variables.count(assignment) && !reductions.count(assignment->get_symbol()) &&
+                frame.bound.count(assignment->get_name())) {
+                lost.push_back(LostAssignment{loop, assignment->get_name()});
+                break;
+            }
+        }
+    }
+    for (AlgorithmDefNode* algorithm : frame.algorithms) {
+        std::unordered_set<std::string> parameters;
+        for (const auto& tok : algorithm->get_toks()) parameters.insert(tok->get_value());
+        find_lost_in_frame(algorithm->get_body(), std::move(parameters), lost);
+    }
+}
+
+}  // namespace
+
+std::vector<LostAssignment> find_lost_assignments(const NodeList& statements) {
+    std::vector<LostAssignment> lost;
+    find_lost_in_frame(statements, {}, lost);
+    return lost;
+}
+
+bool is_memoizable_numeric_algo(const std::shared_ptr<Node>& node, const std::string& algo_name,
+                                const std::vector<std::string>& args) {
+    AlgorithmDefNode* algo_node = dynamic_cast<AlgorithmDefNode*>(node.get());
+    if (!algo_node || args.empty()) return false;
+
+    bool recursive = false;
+    std::unordered_set<std::string> arg_set(args.begin(), args.end());
+    for (const auto& expr : algo_node->get_body()) {
+        if (!is_pure_numeric_node(expr, algo_name, arg_set)) return false;
+        recursive = recursive || has_self_call(expr, algo_name);
+    }
+    return recursive;
+}
+
+std::shared_ptr<Node> single_return_numeric_expr(const std::shared_ptr<Node>& node,
+                                                 const std::string& algo_name,
+                                                 const std::vector<std::string>& args) {
+    AlgorithmDefNode* algo_node = dynamic_cast<AlgorithmDefNode*>(node.get());
+    if (!algo_node || algo_node->get_body().size() != 1) return nullptr;
+
+    std::shared_ptr<Node> ret = algo_node->get_body()[0];
+    if (ret->get_type() != NODE_RETURN || has_self_call(ret, algo_name)) return nullptr;
+
+    NodeList child = ret->get_child();
+    if (child.size() != 1) return nullptr;
+
+    std::unordered_set<std::string> arg_set(args.begin(), args.end());
+    if (!is_pure_numeric_node(child[0], algo_name, arg_set)) return nullptr;
+    return child[0];
+}
+
+bool is_associative_combiner(const std::shared_ptr<Node>& node) {
+    AlgorithmDefNode* algo_node = dynamic_cast<AlgorithmDefNode*>(node.get());
+    if (!algo_node || algo_node->get_toks().size() != 2 || algo_node->get_body().size() != 1) {
+        return false;
+    }
+    std::shared_ptr<Node> ret = algo_node->get_body()[0];
+    if (ret->get_type() != NODE_RETURN || ret->get_child().size() != 1) return false;
+    std::shared_ptr<Node> expr = ret->get_child()[0];
+    if (expr->get_type() != NODE_BINOP) return false;
+
+    BinOpNode* combine = static_cast<BinOpNode*>(expr.get());
+    if (combine->get_op() != BINARY_ADD && combine->get_op() != BINARY_MUL) return false;
+    std::shared_ptr<Node> left = combine->get_left();
+    std::shared_ptr<Node> right = combine->get_right();
+    if (left->get_type() != NODE_VARACCESS || right->get_type() != NODE_VARACCESS) return false;
+    // Either operand order is associative; both arguments must appear.
+    SymbolId first = algo_node->get_toks()[0]->get_symbol();
+    SymbolId second = algo_node->get_toks()[1]->get_symbol();
+    return first != second &&
+           ((left->get_symbol() == first && right->get_symbol() == second) ||
+            (left->get_symbol() == second && right->get_symbol() == first));
+}
+
+void annotate_ast(const NodeList& statements, bool observed) {
+    number_nodes(statements);
+    resolve_frame(statements, {}, false);
+    for (const auto& statement : statements) annotate_node(statement, observed, "");
+}
+
+namespace {
+
+void collect_top_level_algorithms(const std::shared_ptr<Node>& node,
+                                  std::vector<AlgorithmDefNode*>& algorithms) {
+    if (!node) return;
+    if (node->get_type() == NODE_ALGODEF) {
+        algorithms.push_back(static_cast<AlgorithmDefNode*>(node.get()));
+        return;
+    }
+    if (node->get_type() == NODE_STRUCTDEF) {
+        for (const auto& method : node->get_child()) {
+            algorithms.push_back(static_cast<AlgorithmDefNode*>(method.get()));
+        }
+        return;
+    }
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) {
+        collect_top_level_algorithms(child, algorithms);
+    });
+}
+
+void collect_callees(const std::shared_ptr<Node>& node, std::unordered_set<std::string>& callees) {
+    if (!node) return;
+    std::string type = node->get_type();
+    if (type == NODE_ALGODEF || type == NODE_STRUCTDEF) return;
+    if (type == NODE_ALGOCALL) {
+        AlgorithmCallNode* call_node = static_cast<AlgorithmCallNode*>(node.get());
+        if (call_node->get_call()->get_type() == NODE_VARACCESS) {
+            callees.insert(call_node->get_name());
+        }
+    }
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) {
+        collect_callees(child, callees);
+    });
+}
+
+}  // namespace
+
+std::vector<std::string> check_lexical_scoping(const NodeList& statements) {
+    std::unordered_set<std::string> globals;
+    std::vector<AlgorithmDefNode*> algorithms;
+    for (const auto& statement : statements) {
+        collect_bound_names(statement, globals);
+        collect_top_level_algorithms(statement, algorithms);
+    }
+
+    std::unordered_map<std::string, std::unordered_set<std::string>> callees;
+    std::vector<std::unordered_set<std::string>> bound;
+    for (AlgorithmDefNode* algo : algorithms) {
+        for (const auto& expr : algo->get_body()) collect_callees(expr, callees[algo->get_name()]);
+        bound.push_back(frame_bound_names(*algo));
+    }
+    auto reaches = [&](const std::string& from, const std::string& to) {
+        std::unordered_set<std::string> seen{from};
+        std::vector<std::string> pending{from};
+        while (!pending.empty()) {
+            std::string name = pending.back();
+            pending.pop_back();
+            for (const auto& callee : callees[name]) {
+                if (callee == to) return true;
+                if (seen.insert(callee).second) pending.push_back(callee);
+            }
+        }
+        return false;
+    };
+
+    std::vector<std::string> warnings;
+    for (std::size_t i = 0; i < algorithms.size(); ++i) {
+        std::string algo_name = algorithms[i]->get_name();
+        std::vector<VarAccessNode*> reads;
+        for (const auto& expr : algorithms[i]->get_body()) collect_reads(expr, reads);
+
+        std::unordered_set<std::string> reported;
+        for (VarAccessNode* read : reads) {
+            std::string name = read->get_name();
+            if (is_builtin_read(read) || bound[i].count(name) || !reported.insert(name).second) {
+                continue;
+            }
+            std::string where = "line " + std::to_string(read->get_tok()->get_pos().line() + 1) +
+                                ": Algorithm \"" + algo_name + "\" reads \"" + name + "\"";
+            if (!globals.count(name)) {
+                warnings.push_back(where + ", which is not defined globally and can only come "
+                                           "from a caller's scope");
+                continue;
+            }
+            for (std::size_t j = 0; j < algorithms.size(); ++j) {
+                if (j != i && bound[j].count(name) &&
+                    reaches(algorithms[j]->get_name(), algo_name)) {
+                    warnings.push_back(where + ", which its caller \"" +
+                                       algorithms[j]->get_name() + "\" shadows");
+                }
+            }
+        }
+    }
+    return warnings;
+}
+
+void collect_references(const std::shared_ptr<Node>& node,
+                        std::unordered_set<std::string>& names) {
+    if (!node) return;
+    std::string type = node->get_type();
+    if (type == NODE_VARACCESS) {
+        names.insert(node->get_name());
+        return;
+    }
+    if (type == NODE_ALGODEF) {
+        // Defining `Struct::method` looks the Struct up.
+        std::string name = node->get_name();
+        std::size_t scope = name.find("::");
+        if (scope != std::string::npos) names.insert(name.substr(0, scope));
+    }
+    if (type == NODE_MEMACCESS) {
+        collect_references(static_cast<MemberAccessNode*>(node.get())->get_obj(), names);
+        return;
+    }
+    if (type == NODE_ALGOCALL) {
+        collect_references(static_cast<AlgorithmCallNode*>(node.get())->get_call(), names);
+    }
+    for_each_child(node, [&](const std::shared_ptr<Node>& child) {
+        collect_references(child, names);
+    });
+}
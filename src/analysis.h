@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "node.h"
@@ -18,4 +19,79 @@
 bool is_memoizable_numeric_algo(const std::shared_ptr<Node>& node, const std::string& algo_name,
                                 const std::vector<std::string>& args);
 
+// The returned expression of an algorithm whose whole body is a single
+// non-recursive numeric `return`, or nullptr.
+std::shared_ptr<Node> single_return_numeric_expr(const std::shared_ptr<Node>& node,
+                                                 const std::string& algo_name,
+                                                 const std::vector<std::string>& args);
+
+// True for two-argument algorithms whose whole body is `return a + b` or
+// `return a * b` over both arguments. On Ints such an algorithm is
+// associative, so reduce can fold chunks of an array separately.
+bool is_associative_combiner(const std::shared_ptr<Node>& node);
+
+// A name the body of a parallel loop only updates as `v <- v + e` or
+// `v <- v * e` (always with the same operator) and never reads otherwise.
+// Chunks of iterations can each accumulate it from the operator's identity,
+// and the partial results combine in iteration order afterwards.
+struct LoopReduction {
+    SymbolId symbol;
+    BinaryOp op;
+};
+
+// Reductions of a loop body, in order of first appearance.
+std::vector<LoopReduction> find_loop_reductions(const NodeList& body);
+
+// How a parallel loop body changes containers bound outside the loop, which
+// its iterations share without synchronization. Names the body binds itself
+// are private to a chunk of iterations, unless it binds them to a shared
+// container as a whole (`b <- a`).
+struct SharedWrites {
+    // The first change that would race with other iterations: a push, pop,
+    // resize, insert, remove, set or clear call on a shared container, or an
+    // assignment to a member of one. Empty when there is none. Containers
+    // reached through an element (`a[i].push(x)`) and Algorithms the body
+    // calls are not looked into: their changes are refused as the loop runs
+    // (ContainerValue::check_change).
+    std::string error;
+    // Outer names the body assigns elements of, as `a[k] <- v`. Iterations
+    // may write distinct elements of an Array, but storing into a HashTable
+    // changes the table, so these are checked when the loop starts.
+    std::vector<SymbolId> element_writes;
+};
+
+SharedWrites find_shared_writes(const NodeList& body, const std::string& loop_name);
+
+// A name a parallel loop body assigns although the loop's frame binds it
+// too. Names other than reductions are private to a chunk of iterations, so
+// the assignment would never reach the frame's variable. Loop variables of
+// loops in the body are not counted.
+struct LostAssignment {
+    Node* loop;
+    std::string name;
+};
+
+// The lost assignments of the parallel loops in `statements` and the
+// Algorithms they define, one per loop at most.
+std::vector<LostAssignment> find_lost_assignments(const NodeList& statements);
+
+// Annotates every node with its NodeFlag facts, and numbers the nodes no
+// earlier call numbered as one tree (Node::get_tree). Called once by
+// Parser::parse.
+// A loop's value is observed when it is a top-level statement and `observed`
+// is true (REPL echo), an Algorithm's implicit return, or any expression
+// operand; other loops run without building a result array.
+void annotate_ast(const NodeList& statements, bool observed = true);
+
+// Reports reads in top-level Algorithms that would resolve differently under
+// lexical scoping (SymbolTable::set_lexical_scoping): names that are not
+// global and so could only come from a caller, and globals that a caller
+// shadows with a local of the same name.
+std::vector<std::string> check_lexical_scoping(const NodeList& statements);
+
+// Adds to `names` every global `node` may look up when it runs: the
+// variables it reads, in nested Algorithm bodies too, and the Struct a
+// `Struct::method` definition adds to. Member names are not included.
+void collect_references(const std::shared_ptr<Node>& node, std::unordered_set<std::string>& names);
+
 #endif
@@ -0,0 +1,678 @@
+/// --------------------
+/// Module AST cache
+/// --------------------
+
+#include "astcache.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+#include "analysis.h"
+#include "lexer.h"
+#include "pool.h"
+#include "position.h"
+#include "token.h"
+
+namespace ast_cache {
+
+class Image {
+   public:
+    Image(void* _mapped, std::size_t _size) : mapped(_mapped), size(_size) {}
+    ~Image() { munmap(mapped, size); }
+    Image(const Image&) = delete;
+    Image& operator=(const Image&) = delete;
+
+    void* mapped;
+    std::size_t size;
+    source_map::FileRef file;  // the positions in its trees are in
+    std::vector<std::string> strings;
+};
+
+namespace {
+
+// Bump whenever the lexer, the parser or the node classes change the tree a
+// source parses to, or the layout below changes.
+constexpr std::uint32_t FORMAT_VERSION = 2;
+constexpr char MAGIC[4] = {'P', 'S', 'A', 'C'};
+
+// A cache file is this header followed by the string table (a count, then
+// each string as its length and bytes), the module's imports (a count, then
+// each target's string index and statement index) and its statements (a
+// count, then for each: a byte telling whether it is a definition, the
+// defined name's string index if so, the count and string indices of its
+// references, then its node's length in bytes and the node). Numbers are
+// LEB128 varints; Int literals are zigzag encoded and Float literals are
+// their 8 bytes. `body_hash` covers everything after the header, so a
+// damaged file is caught on load rather than when a node is read later.
+struct Header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t fingerprint;
+    std::uint64_t source_hash;
+    std::uint64_t source_length;
+    std::uint64_t body_hash;
+};
+
+enum Tag : std::uint8_t {
+    TAG_NONE,  // an absent child, such as the step of a for loop without one
+    TAG_VALUE,
+    TAG_BINOP,
+    TAG_UNARYOP,
+    TAG_VARASSIGN,
+    TAG_VARACCESS,
+    TAG_IF,
+    TAG_FOR,
+    TAG_WHILE,
+    TAG_REPEAT,
+    TAG_ALGODEF,
+    TAG_ALGOCALL,
+    TAG_ARRAY,
+    TAG_ARRACCESS,
+    TAG_ARRASSIGN,
+    TAG_MEMACCESS,
+    TAG_STRUCTDEF,
+    TAG_RETURN,
+    TAG_SPAWN,
+    TAG_BREAK,
+    TAG_CONTINUE,
+};
+
+enum class TokenKind : std::uint8_t { Plain, Int, Float, String };
+
+std::uint64_t fnv1a(const char* data, std::size_t size,
+                    std::uint64_t hash = 14695981039346656037ull) {
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::uint64_t hash_string(const std::string& str, std::uint64_t hash) {
+    return fnv1a(str.c_str(), str.size() + 1, hash);  // with the '\0', so names stay apart
+}
+
+// The lexer's name tables: adding a keyword or builtin changes how existing
+// sources lex, without touching the parser.
+std::uint64_t language_fingerprint() {
+    static const std::uint64_t fingerprint = [] {
+        std::uint64_t hash = fnv1a(nullptr, 0);
+        for (const auto& keyword : KEYWORDS) hash = hash_string(keyword, hash);
+        for (const auto& constant : BUILTIN_CONST) {
+            hash = hash_string(constant.first + "=" + std::to_string(constant.second), hash);
+        }
+        for (const auto& algo : BUILTIN_ALGO) hash = hash_string(algo, hash);
+        for (const auto& symbol : TO_TOKEN_TYPE) {
+            hash = hash_string(std::string(1, symbol.first) + symbol.second, hash);
+        }
+        return hash;
+    }();
+    return fingerprint;
+}
+
+Header make_header(const std::string& text) {
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.fingerprint = language_fingerprint();
+    header.source_hash = fnv1a(text.data(), text.size());
+    header.source_length = text.size();
+    header.body_hash = 0;
+    return header;
+}
+
+// Thrown by Writer for a tree it cannot store, such as one with error nodes.
+struct Unsupported {};
+// Thrown by Reader on a truncated or malformed cache file.
+struct Corrupt {};
+
+class Writer {
+   public:
+    void module(const Module& module) {
+        varint(module.imports.size());
+        for (const auto& import : module.imports) {
+            string(import.target);
+            varint(import.index);
+        }
+        varint(module.statements.size());
+        for (const auto& statement : module.statements) {
+            bool definition = !statement.definition.empty();
+            byte(definition);
+            if (definition) string(statement.definition);
+            varint(statement.references.size());
+            for (const auto& name : statement.references) string(name);
+
+            std::string before = std::move(body);
+            body.clear();
+            node(statement.node);
+            std::string tree = std::move(body);
+            body = std::move(before);
+            varint(tree.size());
+            body += tree;
+        }
+    }
+
+    void tree(const std::shared_ptr<Node>& root) { node(root); }
+
+    // The string table, then everything written so far.
+    std::string encoded() {
+        std::string rest = std::move(body);
+        body.clear();
+        varint(strings.size());
+        for (const std::string* str : strings) {
+            varint(str->size());
+            body += *str;
+        }
+        return body + rest;
+    }
+
+    // The file: header, then the encoded body.
+    std::string finish(Header header) {
+        std::string encoded_body = encoded();
+        header.body_hash = fnv1a(encoded_body.data(), encoded_body.size());
+        return std::string(reinterpret_cast<const char*>(&header), sizeof(header)) + encoded_body;
+    }
+
+   private:
+    std::string body;
+    std::unordered_map<std::string, std::size_t> string_ids;
+    std::vector<const std::string*> strings;
+
+    void byte(std::uint8_t value) { body += static_cast<char>(value); }
+
+    void varint(std::uint64_t value) {
+        while (value >= 0x80) {
+            byte(static_cast<std::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        byte(static_cast<std::uint8_t>(value));
+    }
+
+    void string(const std::string& str) {
+        auto inserted = string_ids.emplace(str, strings.size());
+        if (inserted.second) strings.push_back(&inserted.first->first);
+        varint(inserted.first->second);
+    }
+
+    void token(const std::shared_ptr<Token>& tok) {
+        if (tok.get() == nullptr) throw Unsupported{};
+        Token* raw = tok.get();
+        if (auto* int_tok = dynamic_cast<TypedToken<int64_t>*>(raw)) {
+            byte(static_cast<std::uint8_t>(TokenKind::Int));
+            token_header(*tok);
+            std::int64_t value = int_tok->get_typed_value();
+            varint((static_cast<std::uint64_t>(value) << 1) ^
+                   static_cast<std::uint64_t>(value >> 63));
+        } else if (auto* float_tok = dynamic_cast<TypedToken<double>*>(raw)) {
+            byte(static_cast<std::uint8_t>(TokenKind::Float));
+            token_header(*tok);
+            double value = float_tok->get_typed_value();
+            body.append(reinterpret_cast<const char*>(&value), sizeof(value));
+        } else if (auto* string_tok = dynamic_cast<TypedToken<std::string>*>(raw)) {
+            byte(static_cast<std::uint8_t>(TokenKind::String));
+            token_header(*tok);
+            string(string_tok->get_typed_value());
+        } else if (typeid(*raw) == typeid(Token)) {
+            byte(static_cast<std::uint8_t>(TokenKind::Plain));
+            token_header(*tok);
+        } else {
+            throw Unsupported{};
+        }
+    }
+
+    void token_header(Token& tok) {
+        string(tok.get_type());
+        varint(tok.get_pos().offset);
+    }
+
+    void tokens(const TokenList& list) {
+        varint(list.size());
+        for (const auto& tok : list) token(tok);
+    }
+
+    void nodes(const NodeList& list) {
+        varint(list.size());
+        for (const auto& child : list) node(child);
+    }
+
+    void node(const std::shared_ptr<Node>& subtree) {
+        if (subtree.get() == nullptr) {
+            byte(TAG_NONE);
+            return;
+        }
+        std::string type = subtree->get_type();
+        if (type == NODE_VALUE) {
+            byte(TAG_VALUE);
+            token(subtree->get_tok());
+        } else if (type == NODE_BINOP) {
+            BinOpNode* binop = static_cast<BinOpNode*>(subtree.get());
+            byte(TAG_BINOP);
+            node(binop->get_left());
+            node(binop->get_right());
+            token(binop->get_tok());
+        } else if (type == NODE_UNARYOP) {
+            byte(TAG_UNARYOP);
+            node(subtree->get_child()[0]);
+            token(subtree->get_tok());
+        } else if (type == NODE_VARASSIGN) {
+            byte(TAG_VARASSIGN);
+            string(subtree->get_name());
+            node(subtree->get_child()[0]);
+        } else if (type == NODE_VARACCESS) {
+            byte(TAG_VARACCESS);
+            token(subtree->get_tok());
+        } else if (type == NODE_IF) {
+            IfNode* if_node = static_cast<IfNode*>(subtree.get());
+            byte(TAG_IF);
+            node(if_node->get_condition());
+            nodes(if_node->get_expr());
+            nodes(if_node->get_else());
+        } else if (type == NODE_FOR) {
+            ForNode* for_node = static_cast<ForNode*>(subtree.get());
+            NodeList child = subtree->get_child();
+            byte(TAG_FOR);
+            for (std::size_t i = 0; i < 3; ++i) node(child[i]);
+            nodes(for_node->get_body());
+            byte(for_node->is_parallel());
+        } else if (type == NODE_WHILE || type == NODE_REPEAT) {
+            // Both list the condition first, then the body.
+            NodeList child = subtree->get_child();
+            byte(type == NODE_WHILE ? TAG_WHILE : TAG_REPEAT);
+            node(child[0]);
+            nodes(NodeList(child.begin() + 1, child.end()));
+        } else if (type == NODE_ALGODEF) {
+            AlgorithmDefNode* algo_node = static_cast<AlgorithmDefNode*>(subtree.get());
+            byte(TAG_ALGODEF);
+            token(subtree->get_tok());
+            tokens(subtree->get_toks());
+            nodes(algo_node->get_body());
+        } else if (type == NODE_ALGOCALL) {
+            AlgorithmCallNode* call_node = static_cast<AlgorithmCallNode*>(subtree.get());
+            byte(TAG_ALGOCALL);
+            node(call_node->get_call());
+            nodes(call_node->get_args());
+        } else if (type == NODE_ARRAY) {
+            byte(TAG_ARRAY);
+            nodes(subtree->get_child());
+        } else if (type == NODE_ARRACCESS || type == NODE_ARRASSIGN || type == NODE_MEMACCESS) {
+            NodeList child = subtree->get_child();
+            byte(type == NODE_ARRACCESS ? TAG_ARRACCESS
+                                        : type == NODE_ARRASSIGN ? TAG_ARRASSIGN : TAG_MEMACCESS);
+            node(child[0]);
+            node(child[1]);
+        } else if (type == NODE_STRUCTDEF) {
+            byte(TAG_STRUCTDEF);
+            token(subtree->get_tok());
+            tokens(subtree->get_toks());
+            nodes(subtree->get_child());
+        } else if (type == NODE_RETURN || type == NODE_SPAWN) {
+            byte(type == NODE_RETURN ? TAG_RETURN : TAG_SPAWN);
+            node(subtree->get_child()[0]);
+        } else if (type == NODE_BREAK) {
+            byte(TAG_BREAK);
+        } else if (type == NODE_CONTINUE) {
+            byte(TAG_CONTINUE);
+        } else {
+            throw Unsupported{};
+        }
+    }
+};
+
+class Reader {
+   public:
+    Reader(const char* _data, const char* _end, const std::vector<std::string>& _strings,
+           std::uint32_t _file_id)
+        : data(_data), end(_end), strings(_strings), file_id(_file_id) {}
+
+    // Reads the string table into `table`, the vector this reader looks
+    // strings up in.
+    void string_table(std::vector<std::string>& table) {
+        std::size_t count = length();
+        table.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            std::size_t size = length();
+            table.emplace_back(take(size), size);
+        }
+    }
+
+    // Everything after the string table but the statements' nodes, whose
+    // offsets from `base` are recorded.
+    void module(Module& module, const char* base) {
+        module.imports.resize(length());
+        for (auto& import : module.imports) {
+            import.target = string();
+            import.index = varint();
+        }
+        module.statements.resize(length());
+        for (auto& statement : module.statements) {
+            if (byte()) statement.definition = string();
+            statement.references.resize(length());
+            for (auto& name : statement.references) name = string();
+            statement.size = length();
+            statement.offset = static_cast<std::size_t>(data - base);
+            take(statement.size);
+        }
+        if (data != end) throw Corrupt{};
+    }
+
+    std::shared_ptr<Node> statement() {
+        std::shared_ptr<Node> read = node();
+        if (read.get() == nullptr || data != end) throw Corrupt{};
+        return read;
+    }
+
+   private:
+    const char* data;
+    const char* end;
+    const std::vector<std::string>& strings;
+    std::uint32_t file_id;
+
+    const char* take(std::size_t size) {
+        if (static_cast<std::size_t>(end - data) < size) throw Corrupt{};
+        const char* at = data;
+        data += size;
+        return at;
+    }
+
+    std::uint8_t byte() { return static_cast<std::uint8_t>(*take(1)); }
+
+    std::uint64_t varint() {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t next = byte();
+            value |= static_cast<std::uint64_t>(next & 0x7F) << shift;
+            if (!(next & 0x80)) return value;
+        }
+        throw Corrupt{};
+    }
+
+    // A count of items that each take at least one more byte.
+    std::size_t length() {
+        std::uint64_t count = varint();
+        if (count > static_cast<std::uint64_t>(end - data)) throw Corrupt{};
+        return static_cast<std::size_t>(count);
+    }
+
+    const std::string& string() {
+        std::uint64_t id = varint();
+        if (id >= strings.size()) throw Corrupt{};
+        return strings[id];
+    }
+
+    std::shared_ptr<Token> token() {
+        std::uint8_t kind = byte();
+        const std::string& type = string();
+        Position pos(static_cast<std::uint32_t>(varint()), file_id);
+        switch (static_cast<TokenKind>(kind)) {
+            case TokenKind::Plain:
+                return make_pooled<Token>(type, pos);
+            case TokenKind::Int: {
+                std::uint64_t zigzag = varint();
+                std::int64_t value = static_cast<std::int64_t>(zigzag >> 1) ^
+                                     -static_cast<std::int64_t>(zigzag & 1);
+                return make_pooled<TypedToken<int64_t>>(type, pos, value);
+            }
+            case TokenKind::Float: {
+                double value;
+                std::memcpy(&value, take(sizeof(value)), sizeof(value));
+                return make_pooled<TypedToken<double>>(type, pos, value);
+            }
+            case TokenKind::String: {
+                const std::string& value = string();
+                std::shared_ptr<Token> tok = make_pooled<TypedToken<std::string>>(type, pos, value);
+                tok->set_symbol(intern_symbol(value));
+                return tok;
+            }
+        }
+        throw Corrupt{};
+    }
+
+    TokenList tokens() {
+        TokenList list(length());
+        for (auto& tok : list) tok = token();
+        return list;
+    }
+
+    NodeList nodes() {
+        NodeList list(length());
+        for (auto& child : list) child = node();
+        return list;
+    }
+
+    std::shared_ptr<Node> node() {
+        switch (byte()) {
+            case TAG_NONE:
+                return nullptr;
+            case TAG_VALUE:
+                return make_pooled<ValueNode>(token());
+            case TAG_BINOP: {
+                std::shared_ptr<Node> left = node();
+                std::shared_ptr<Node> right = node();
+                return make_pooled<BinOpNode>(left, right, token());
+            }
+            case TAG_UNARYOP: {
+                std::shared_ptr<Node> operand = node();
+                return make_pooled<UnaryOpNode>(operand, token());
+            }
+            case TAG_VARASSIGN: {
+                std::string name = string();
+                return make_pooled<VarAssignNode>(name, node());
+            }
+            case TAG_VARACCESS:
+                return make_pooled<VarAccessNode>(token());
+            case TAG_IF: {
+                std::shared_ptr<Node> condition = node();
+                NodeList expr = nodes();
+                return make_pooled<IfNode>(condition, expr, nodes());
+            }
+            case TAG_FOR: {
+                std::shared_ptr<Node> var_assign = node();
+                std::shared_ptr<Node> end_value = node();
+                std::shared_ptr<Node> step_value = node();
+                NodeList body = nodes();
+                bool parallel = byte() != 0;
+                return make_pooled<ForNode>(var_assign, end_value, step_value, body, parallel);
+            }
+            case TAG_WHILE: {
+                std::shared_ptr<Node> condition = node();
+                return make_pooled<WhileNode>(condition, nodes());
+            }
+            case TAG_REPEAT: {
+                std::shared_ptr<Node> condition = node();
+                return make_pooled<RepeatNode>(nodes(), condition);
+            }
+            case TAG_ALGODEF: {
+                std::shared_ptr<Token> name = token();
+                TokenList args = tokens();
+                return make_pooled<AlgorithmDefNode>(name, args, nodes());
+            }
+            case TAG_ALGOCALL: {
+                std::shared_ptr<Node> call = node();
+                return make_pooled<AlgorithmCallNode>(call, nodes());
+            }
+            case TAG_ARRAY:
+                return make_pooled<ArrayNode>(nodes());
+            case TAG_ARRACCESS: {
+                std::shared_ptr<Node> arr = node();
+                return make_pooled<ArrayAccessNode>(arr, node());
+            }
+            case TAG_ARRASSIGN: {
+                std::shared_ptr<Node> arr = node();
+                return make_pooled<ArrayAssignNode>(arr, node());
+            }
+            case TAG_MEMACCESS: {
+                std::shared_ptr<Node> obj = node();
+                std::shared_ptr<Node> member = node();
+                if (member.get() == nullptr) throw Corrupt{};
+                return make_pooled<MemberAccessNode>(obj, member);
+            }
+            case TAG_STRUCTDEF: {
+                std::shared_ptr<Token> name = token();
+                TokenList members = tokens();
+                return make_pooled<StructDefNode>(name, members, nodes());
+            }
+            case TAG_RETURN:
+                return make_pooled<ReturnNode>(node());
+            case TAG_SPAWN:
+                return make_pooled<SpawnNode>(node());
+            case TAG_BREAK:
+                return make_pooled<ControlNode>(NODE_BREAK);
+            case TAG_CONTINUE:
+                return make_pooled<ControlNode>(NODE_CONTINUE);
+        }
+        throw Corrupt{};
+    }
+};
+
+bool read_module(const std::string& path, const std::string& text, Image& image,
+                 Module& module) {
+    const char* data = static_cast<const char*>(image.mapped);
+    Header expected = make_header(text);
+    Header header;
+    if (image.size < sizeof(header)) return false;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, expected.magic, sizeof(MAGIC)) != 0 ||
+        header.version != expected.version || header.fingerprint != expected.fingerprint ||
+        header.source_hash != expected.source_hash ||
+        header.source_length != expected.source_length ||
+        header.body_hash != fnv1a(data + sizeof(header), image.size - sizeof(header))) {
+        return false;
+    }
+    image.file = source_map::add(path, text);
+    Reader reader(data + sizeof(header), data + image.size, image.strings, image.file.id());
+    try {
+        reader.string_table(image.strings);
+        reader.module(module, data);
+    } catch (const Corrupt&) {
+        module = Module();
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+std::string cache_path(const std::string& path) {
+    namespace fs = std::filesystem;
+    fs::path source(path);
+    std::string name = source.filename().string() + "c";
+    const char* dir = std::getenv("PSEUDO_CACHE_DIR");
+    if (dir && *dir) {
+        // Modules with the same file name in different directories share
+        // the cache directory.
+        std::ostringstream prefixed;
+        prefixed << std::hex << std::setw(16) << std::setfill('0')
+                 << fnv1a(path.data(), path.size()) << "-" << name;
+        return (fs::path(dir) / prefixed.str()).string();
+    }
+    return (source.parent_path() / "__pscache__" / name).string();
+}
+
+bool load(const std::string& path, const std::string& text, Module& module) {
+    int fd = open(cache_path(path).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    std::size_t size = static_cast<std::size_t>(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) return false;
+    auto image = std::make_shared<Image>(mapped, size);
+    if (!read_module(path, text, *image, module)) return false;
+    module.image = std::move(image);
+    return true;
+}
+
+std::shared_ptr<Node> read_statement(const Image& image, const ModuleStatement& statement) {
+    if (statement.offset > image.size || statement.size > image.size - statement.offset) {
+        return nullptr;
+    }
+    const char* data = static_cast<const char*>(image.mapped) + statement.offset;
+    std::shared_ptr<Node> node;
+    try {
+        node = Reader(data, data + statement.size, image.strings, image.file.id()).statement();
+    } catch (const Corrupt&) {
+        return nullptr;
+    }
+    annotate_ast(NodeList{node});
+    return node;
+}
+
+std::uint64_t tree_fingerprint() {
+    return hash_string(std::to_string(FORMAT_VERSION), language_fingerprint());
+}
+
+bool encode_tree(const std::shared_ptr<Node>& tree, std::string& bytes) {
+    try {
+        Writer writer;
+        writer.tree(tree);
+        bytes = writer.encoded();
+    } catch (const Unsupported&) {
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<Node> decode_tree(const char* data, std::size_t size, std::uint32_t file_id) {
+    std::vector<std::string> strings;
+    std::shared_ptr<Node> node;
+    try {
+        Reader reader(data, data + size, strings, file_id);
+        reader.string_table(strings);
+        node = reader.statement();
+    } catch (const Corrupt&) {
+        return nullptr;
+    }
+    annotate_ast(NodeList{node});
+    return node;
+}
+
+void store(const std::string& path, const std::string& text, const Module& module) {
+    namespace fs = std::filesystem;
+    std::string bytes;
+    try {
+        Writer writer;
+        writer.module(module);
+        bytes = writer.finish(make_header(text));
+    } catch (const Unsupported&) {
+        return;
+    }
+
+    // Written aside and renamed into place, so a run reading the cache
+    // never sees part of a file while another run writes it.
+    fs::path cache(cache_path(path));
+    std::error_code ec;
+    fs::create_directories(cache.parent_path(), ec);
+    std::size_t thread = std::hash<std::thread::id>()(std::this_thread::get_id());
+    std::string temporary =
+        cache.string() + ".tmp" + std::to_string(getpid()) + "-" + std::to_string(thread);
+    {
+        std::ofstream output(temporary, std::ios::binary);
+        if (!output.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+            output.close();
+            fs::remove(temporary, ec);
+            return;
+        }
+    }
+    fs::rename(temporary, cache, ec);
+    if (ec) fs::remove(temporary, ec);
+}
+
+}  // namespace ast_cache
@@ -0,0 +1,88 @@
+/// --------------------
+/// Module AST cache
+/// --------------------
+
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "node.h"
+
+// Parsed modules are saved in a compact binary form so later runs can skip
+// lexing and parsing them. A cache file is keyed by the module's source
+// text (its length and 64-bit FNV-1a hash) and by the interpreter: the
+// file format version, which is bumped whenever the lexer, parser or node
+// classes change what a source parses to, and a fingerprint of the
+// keyword and builtin tables the lexer classifies names with. A cache file
+// that does not match all of them is ignored and rewritten.
+//
+// Node flags and variable scopes are not stored; annotate_ast recomputes
+// them on load, so changes to the analysis need no new format version.
+//
+// Loading a module reads only what each top-level statement defines and
+// refers to. The trees stay in the mapped file until read_statement is
+// asked for them, so definitions a program never uses are never built.
+namespace ast_cache {
+
+// A loaded cache file, mapped for as long as statements may be read from it.
+class Image;
+
+// An `import` line removed from a module's source, and the index of the
+// statement the imported module's statements go before.
+struct ModuleImport {
+    std::string target;
+    std::size_t index;
+};
+
+struct ModuleStatement {
+    // The name a top-level Algorithm or Struct definition binds; empty for
+    // any other statement, `Struct::method` definitions included.
+    std::string definition;
+    // The globals the statement may look up (collect_references).
+    std::vector<std::string> references;
+    // The statement, or nullptr until read_statement reads it from `offset`.
+    std::shared_ptr<Node> node;
+    std::size_t offset{0};
+    std::size_t size{0};
+};
+
+struct Module {
+    std::vector<ModuleStatement> statements;
+    std::vector<ModuleImport> imports;
+    // The cache file the module was loaded from, or nullptr if it was parsed.
+    std::shared_ptr<const Image> image;
+};
+
+// Where the cache of the module at `path` lives: `__pscache__/<file>c`
+// next to the module, or in the directory named by PSEUDO_CACHE_DIR.
+std::string cache_path(const std::string& path);
+
+// Reads the cached parse of `text`, the source of the module at `path`,
+// into `module`. Returns false when there is no cache file or it does not
+// match, leaving `module` empty.
+bool load(const std::string& path, const std::string& text, Module& module);
+
+// Reads `statement` of a module loaded from `image`. Returns nullptr if the
+// file turns out to be damaged.
+std::shared_ptr<Node> read_statement(const Image& image, const ModuleStatement& statement);
+
+// The tree encoding on its own, for storing trees elsewhere (snapshot.h).
+// tree_fingerprint changes whenever cache files would be invalidated.
+// encode_tree returns false for a tree it cannot store; decode_tree returns
+// nullptr for damaged bytes and places the tree's positions in `file_id`.
+std::uint64_t tree_fingerprint();
+bool encode_tree(const std::shared_ptr<Node>& tree, std::string& bytes);
+std::shared_ptr<Node> decode_tree(const char* data, std::size_t size, std::uint32_t file_id);
+
+// Writes `module`, parsed from `text`, as the cache of the module at
+// `path`; every statement's node must be set. Failing to write it is not an
+// error: the module is then parsed again next time.
+void store(const std::string& path, const std::string& text, const Module& module);
+
+}  // namespace ast_cache
+
+#endif
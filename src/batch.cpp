@@ -0,0 +1,159 @@
+/// --------------------
+/// Batch runs
+/// --------------------
+
+#include "batch.h"
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "engine.h"
+#include "pool.h"
+#include "scheduler.h"
+
+namespace {
+
+struct BatchJob {
+    std::string program;
+    std::string input;   // empty: no input
+    std::string output;
+};
+
+struct JobReport {
+    std::string status;
+    double wall_ms{0};
+    double cpu_ms{0};
+    std::size_t runner_pool_peak_kb{0};
+};
+
+bool read_manifest(const std::string& manifest_path, std::vector<BatchJob>& jobs) {
+    namespace fs = std::filesystem;
+    std::ifstream manifest(manifest_path);
+    if (!manifest) return false;
+    fs::path base_dir = fs::path(manifest_path).parent_path();
+    auto resolve = [&base_dir](const std::string& name) {
+        fs::path path(name);
+        return path.is_absolute() ? path.string() : (base_dir / path).string();
+    };
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+        std::istringstream fields(line);
+        std::string program, input, output;
+        if (!(fields >> program) || program[0] == '#') continue;
+        fields >> input >> output;
+        BatchJob job;
+        job.program = resolve(program);
+        if (!input.empty() && input != "-") job.input = resolve(input);
+        job.output = output.empty() || output == "-" ? job.program + ".out" : resolve(output);
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
+double thread_cpu_ms() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+// Runs `job` on the calling thread in a fresh Engine.
+JobReport run_job(const BatchJob& job, bool lexical) {
+    using clock = std::chrono::steady_clock;
+    JobReport report;
+    clock::time_point start = clock::now();
+    double cpu_start = thread_cpu_ms();
+    std::int64_t tasks_start = sched::thread_task_cpu_ns();
+    std::ptrdiff_t baseline = pool::thread_bytes().live;
+    pool::reset_thread_peak();
+
+    std::ifstream source(job.program);
+    std::unique_ptr<std::istream> input;
+    if (job.input.empty()) {
+        input = std::make_unique<std::istringstream>();
+    } else {
+        input = std::make_unique<std::ifstream>(job.input);
+    }
+    // Opened last so a job missing its program or input leaves no output.
+    std::ofstream output;
+    if (source && *input) output.open(job.output);
+    if (!output.is_open()) {
+        report.status = "missing";
+    } else {
+        std::ostringstream text;
+        text << source.rdbuf();
+        Engine engine(lexical);
+        engine.redirect(*input, output);
+        std::shared_ptr<Value> result = engine.load(text.str(), job.program);
+        if (result->get_kind() == ValueKind::Error) {
+            output << result->get_num() << "\n";
+            report.status = "error";
+        } else {
+            report.status = "ok";
+        }
+        // Measured before the Engine frees the job's values.
+        std::ptrdiff_t peak = pool::thread_bytes().peak - baseline;
+        report.runner_pool_peak_kb =
+            static_cast<std::size_t>(std::max<std::ptrdiff_t>(0, peak)) / 1024;
+        // Tasks this thread ran are charged to their groups: the job's own
+        // come back through its group, with those pool threads ran for it.
+        report.cpu_ms = engine.task_group().task_cpu_ns.load() / 1e6 -
+                        (sched::thread_task_cpu_ns() - tasks_start) / 1e6;
+    }
+
+    report.cpu_ms += thread_cpu_ms() - cpu_start;
+    report.wall_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    return report;
+}
+
+}  // namespace
+
+bool run_batch(const std::string& manifest_path, const std::string& summary_path,
+               bool lexical, std::string& error) {
+    std::vector<BatchJob> jobs;
+    if (!read_manifest(manifest_path, jobs)) {
+        error = "Cannot open manifest " + manifest_path;
+        return false;
+    }
+    std::ofstream summary(summary_path);
+    if (!summary) {
+        error = "Cannot open summary " + summary_path;
+        return false;
+    }
+
+    // Jobs run on threads of their own rather than in the scheduler's pool:
+    // a job's own parallel constructs still use the pool, and the cycle
+    // collector and node quickening stay on while no job has tasks queued.
+    std::vector<JobReport> reports(jobs.size());
+    std::atomic<std::size_t> next{0};
+    auto work = [&] {
+        for (std::size_t i = next.fetch_add(1); i < jobs.size(); i = next.fetch_add(1)) {
+            reports[i] = run_job(jobs[i], lexical);
+        }
+    };
+    std::size_t runners = std::min(sched::thread_count(), jobs.size());
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < runners; ++i) threads.emplace_back(work);
+    work();
+    for (auto& thread : threads) thread.join();
+
+    summary << "job\tprogram\tstatus\twall_ms\tcpu_ms\trunner_pool_peak_kb\n";
+    summary << std::fixed << std::setprecision(3);
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        const JobReport& report = reports[i];
+        summary << i + 1 << "\t" << jobs[i].program << "\t" << report.status << "\t"
+                << report.wall_ms << "\t" << report.cpu_ms << "\t" << report.runner_pool_peak_kb
+                << "\n";
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+/// --------------------
+/// Batch runs
+/// --------------------
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+
+// Runs every program listed in the manifest file at `manifest_path` in this
+// process, several at a time, and writes one line per job to the summary
+// file at `summary_path`.
+//
+// Each manifest line names a program and optionally its input and output
+// files: `program [input] [output]`. `-` keeps the default for a field,
+// blank lines and lines starting with `#` are skipped, and relative paths
+// are resolved against the manifest's directory. A job reads no input by
+// default and writes to the program path with `.out` appended.
+//
+// Jobs run on up to sched::thread_count() threads, each in its own Engine
+// with its streams redirected to the job's files. A program error is
+// written to the job's output like `pseudo` prints it. The summary is
+// tab-separated with a header row:
+//
+//     job  program  status  wall_ms  cpu_ms  runner_pool_peak_kb
+//
+// where status is `ok`, `error` (the program failed) or `missing` (a file
+// could not be opened) and cpu_ms is the CPU time of the job: of the thread
+// that ran it and of the tasks its parallel constructs and spawns ran on
+// the scheduler's pool (its Engine's TaskGroup). runner_pool_peak_kb is the
+// most pool memory (pool.h) the thread that ran the job held for the job's
+// values at once; blocks pool threads allocated for it are not counted, as
+// a shared count would put an atomic on every allocation. It counts the
+// fixed-size Value blocks only, not what they own on the heap: a 16 MiB
+// string is one small block. It is no measure of the job's memory, which
+// the process shares with the jobs running beside it.
+//
+// Returns false with `error` set when the manifest or summary file cannot
+// be opened.
+bool run_batch(const std::string& manifest_path, const std::string& summary_path,
+               bool lexical, std::string& error);
+
+#endif
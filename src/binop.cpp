@@ -0,0 +1,141 @@
+/// --------------------
+/// Binary operators
+/// --------------------
+
+#include "binop.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include "pool.h"
+
+namespace {
+
+template <BinaryOp Op>
+std::shared_ptr<Value> general_kernel(const std::shared_ptr<Value>& a,
+                                      const std::shared_ptr<Value>& b) {
+    if constexpr (Op == BINARY_ADD) return a + b;
+    if constexpr (Op == BINARY_SUB) return a - b;
+    if constexpr (Op == BINARY_MUL) return a * b;
+    if constexpr (Op == BINARY_DIV) return a / b;
+    if constexpr (Op == BINARY_MOD) return a % b;
+    if constexpr (Op == BINARY_POW) return pow(a, b);  // NOLINT(misc-include-cleaner)
+    if constexpr (Op == BINARY_EQUAL) return a == b;
+    if constexpr (Op == BINARY_NOT_EQUAL) return a != b;
+    if constexpr (Op == BINARY_LESS) return a < b;
+    if constexpr (Op == BINARY_GREATER) return a > b;
+    if constexpr (Op == BINARY_LESS_EQUAL) return a <= b;
+    if constexpr (Op == BINARY_GREATER_EQUAL) return a >= b;
+    if constexpr (Op == BINARY_AND) return a && b;
+    if constexpr (Op == BINARY_OR) return a || b;
+}
+
+template <bool IsFloat>
+Number unbox(const std::shared_ptr<Value>& value) {
+    if constexpr (IsFloat) {
+        return Number::from_float(static_cast<const TypedValue<double>&>(*value).raw());
+    } else {
+        return Number::from_int(static_cast<const TypedValue<int64_t>&>(*value).raw());
+    }
+}
+
+template <BinaryOp Op, bool LhsFloat, bool RhsFloat>
+std::shared_ptr<Value> number_kernel(const std::shared_ptr<Value>& a,
+                                     const std::shared_ptr<Value>& b) {
+    Number out;
+    if (numeric_op<Op, LhsFloat, RhsFloat>(unbox<LhsFloat>(a), unbox<RhsFloat>(b), out) !=
+        NumericStatus::Ok) {
+        return general_kernel<Op>(a, b);
+    }
+    if (out.is_float) return make_pooled<TypedValue<double>>(VALUE_FLOAT, out.float_value);
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, out.int_value);
+}
+
+const std::string& raw_string(const std::shared_ptr<Value>& value) {
+    return static_cast<const TypedValue<std::string>&>(*value).raw();
+}
+
+template <BinaryOp Op>
+constexpr bool has_string_kernel() {
+    return Op == BINARY_ADD || (Op >= BINARY_EQUAL && Op <= BINARY_GREATER_EQUAL);
+}
+
+template <BinaryOp Op>
+std::shared_ptr<Value> string_kernel(const std::shared_ptr<Value>& a,
+                                     const std::shared_ptr<Value>& b) {
+    const std::string& lhs = raw_string(a);
+    const std::string& rhs = raw_string(b);
+    if constexpr (Op == BINARY_ADD) {
+        return make_pooled<TypedValue<std::string>>(VALUE_STRING, lhs + rhs);
+    } else {
+        bool result;
+        if constexpr (Op == BINARY_EQUAL) result = lhs == rhs;
+        if constexpr (Op == BINARY_NOT_EQUAL) result = lhs != rhs;
+        if constexpr (Op == BINARY_LESS) result = lhs < rhs;
+        if constexpr (Op == BINARY_GREATER) result = lhs > rhs;
+        if constexpr (Op == BINARY_LESS_EQUAL) result = lhs <= rhs;
+        if constexpr (Op == BINARY_GREATER_EQUAL) result = lhs >= rhs;
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, result);
+    }
+}
+
+std::shared_ptr<Value> repeat_kernel(const std::shared_ptr<Value>& a,
+                                     const std::shared_ptr<Value>& b) {
+    const std::string& str = raw_string(a);
+    int64_t times = static_cast<const TypedValue<int64_t>&>(*b).raw();
+    std::string ret;
+    if (times > 0) ret.reserve(str.size() * static_cast<std::size_t>(times));
+    for (int64_t i = 0; i < times; ++i) ret += str;
+    return make_pooled<TypedValue<std::string>>(VALUE_STRING, ret);
+}
+
+template <BinaryOp Op, ValueKind Lhs, ValueKind Rhs>
+constexpr BinaryKernel select_kernel() {
+    constexpr bool lhs_number = Lhs == ValueKind::Int || Lhs == ValueKind::Float;
+    constexpr bool rhs_number = Rhs == ValueKind::Int || Rhs == ValueKind::Float;
+    if constexpr (lhs_number && rhs_number) {
+        return &number_kernel<Op, Lhs == ValueKind::Float, Rhs == ValueKind::Float>;
+    } else if constexpr (Lhs == ValueKind::String && Rhs == ValueKind::String &&
+                         has_string_kernel<Op>()) {
+        return &string_kernel<Op>;
+    } else if constexpr (Op == BINARY_MUL && Lhs == ValueKind::String && Rhs == ValueKind::Int) {
+        return &repeat_kernel;
+    } else {
+        return &general_kernel<Op>;
+    }
+}
+
+template <BinaryOp Op, std::size_t Lhs, std::size_t... Rhs>
+constexpr std::array<BinaryKernel, VALUE_KIND_COUNT> kernel_row(std::index_sequence<Rhs...>) {
+    return {{select_kernel<Op, static_cast<ValueKind>(Lhs), static_cast<ValueKind>(Rhs)>()...}};
+}
+
+template <BinaryOp Op, std::size_t... Lhs>
+constexpr std::array<std::array<BinaryKernel, VALUE_KIND_COUNT>, VALUE_KIND_COUNT> kernel_plane(
+    std::index_sequence<Lhs...>) {
+    return {{kernel_row<Op, Lhs>(std::make_index_sequence<VALUE_KIND_COUNT>())...}};
+}
+
+template <std::size_t... Op>
+constexpr BinaryKernelTable make_binary_kernels(std::index_sequence<Op...>) {
+    return {{kernel_plane<static_cast<BinaryOp>(Op)>(
+        std::make_index_sequence<VALUE_KIND_COUNT>())...}};
+}
+
+template <std::size_t... Op>
+constexpr NumericKernelTable make_numeric_kernels(std::index_sequence<Op...>) {
+    return {{{{{{&numeric_op<static_cast<BinaryOp>(Op), false, false>,
+                 &numeric_op<static_cast<BinaryOp>(Op), false, true>}},
+               {{&numeric_op<static_cast<BinaryOp>(Op), true, false>,
+                 &numeric_op<static_cast<BinaryOp>(Op), true, true>}}}}...}};
+}
+
+}  // namespace
+
+constexpr BinaryKernelTable BINARY_KERNELS =
+    make_binary_kernels(std::make_index_sequence<BINARY_COUNT>());
+
+constexpr NumericKernelTable NUMERIC_KERNELS =
+    make_numeric_kernels(std::make_index_sequence<BINARY_COUNT>());
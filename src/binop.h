@@ -0,0 +1,108 @@
+/// --------------------
+/// Binary operators
+/// --------------------
+
+#ifndef BINOP_H
+#define BINOP_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "node.h"
+#include "value.h"
+
+// An unboxed Int or Float, as JitProgram keeps them on its stack.
+struct Number {
+    bool is_float{false};
+    int64_t int_value{0};
+    double float_value{0.0};
+
+    static Number from_int(int64_t value) {
+        return Number{false, value, static_cast<double>(value)};
+    }
+
+    static Number from_float(double value) {
+        return Number{true, static_cast<int64_t>(value), value};
+    }
+
+    double as_double() const { return is_float ? float_value : static_cast<double>(int_value); }
+
+    int64_t as_int() const { return is_float ? static_cast<int64_t>(float_value) : int_value; }
+};
+
+enum class NumericStatus : std::uint8_t { Ok, DivByZero, ZeroToTheZero, Unsupported };
+
+// Operator `Op` on an lhs that is a Float iff `LhsFloat` and an rhs that is a
+// Float iff `RhsFloat`. Either operand being a Float makes it float
+// arithmetic; comparisons and logic always produce an Int.
+template <BinaryOp Op, bool LhsFloat, bool RhsFloat>
+NumericStatus numeric_op(const Number& lhs, const Number& rhs, Number& out) {
+    constexpr bool use_float = LhsFloat || RhsFloat;
+    const double lf = LhsFloat ? lhs.float_value : static_cast<double>(lhs.int_value);
+    const double rf = RhsFloat ? rhs.float_value : static_cast<double>(rhs.int_value);
+    const int64_t li = lhs.int_value, ri = rhs.int_value;
+    if constexpr (Op == BINARY_ADD) {
+        out = use_float ? Number::from_float(lf + rf) : Number::from_int(li + ri);
+    } else if constexpr (Op == BINARY_SUB) {
+        out = use_float ? Number::from_float(lf - rf) : Number::from_int(li - ri);
+    } else if constexpr (Op == BINARY_MUL) {
+        out = use_float ? Number::from_float(lf * rf) : Number::from_int(li * ri);
+    } else if constexpr (Op == BINARY_DIV) {
+        if (rf == 0.0) return NumericStatus::DivByZero;
+        out = use_float ? Number::from_float(lf / rf) : Number::from_int(li / ri);
+    } else if constexpr (Op == BINARY_MOD) {
+        if constexpr (use_float) return NumericStatus::Unsupported;
+        out = Number::from_int(li % ri);
+    } else if constexpr (Op == BINARY_POW) {
+        if (lf == 0.0 && rf == 0.0) return NumericStatus::ZeroToTheZero;
+        out = use_float ? Number::from_float(std::pow(lf, rf))
+                        : Number::from_int(static_cast<int64_t>(std::pow(li, ri)));
+    } else if constexpr (Op == BINARY_EQUAL) {
+        out = Number::from_int(use_float ? lf == rf : li == ri);
+    } else if constexpr (Op == BINARY_NOT_EQUAL) {
+        out = Number::from_int(use_float ? lf != rf : li != ri);
+    } else if constexpr (Op == BINARY_LESS) {
+        out = Number::from_int(use_float ? lf < rf : li < ri);
+    } else if constexpr (Op == BINARY_GREATER) {
+        out = Number::from_int(use_float ? lf > rf : li > ri);
+    } else if constexpr (Op == BINARY_LESS_EQUAL) {
+        out = Number::from_int(use_float ? lf <= rf : li <= ri);
+    } else if constexpr (Op == BINARY_GREATER_EQUAL) {
+        out = Number::from_int(use_float ? lf >= rf : li >= ri);
+    } else if constexpr (Op == BINARY_AND) {
+        out = Number::from_int(lf != 0.0 && rf != 0.0);
+    } else {
+        static_assert(Op == BINARY_OR, "unhandled binary operator");
+        out = Number::from_int(lf != 0.0 || rf != 0.0);
+    }
+    return NumericStatus::Ok;
+}
+
+using NumericKernel = NumericStatus (*)(const Number&, const Number&, Number&);
+using NumericKernelTable = std::array<std::array<std::array<NumericKernel, 2>, 2>, BINARY_COUNT>;
+extern const NumericKernelTable NUMERIC_KERNELS;
+
+inline NumericKernel numeric_kernel(BinaryOp op, bool lhs_float, bool rhs_float) {
+    return NUMERIC_KERNELS[op][lhs_float][rhs_float];
+}
+
+// Boxed operators, indexed by (operator, lhs kind, rhs kind). Int, Float and
+// String pairs get kernels specialized at compile time; every other pair runs
+// the general operator from value.h, which also builds the error values.
+constexpr std::size_t VALUE_KIND_COUNT = static_cast<std::size_t>(ValueKind::Count);
+using BinaryKernel = std::shared_ptr<Value> (*)(const std::shared_ptr<Value>&,
+                                                const std::shared_ptr<Value>&);
+using BinaryKernelTable = std::array<
+    std::array<std::array<BinaryKernel, VALUE_KIND_COUNT>, VALUE_KIND_COUNT>, BINARY_COUNT>;
+extern const BinaryKernelTable BINARY_KERNELS;
+
+// `op` must be a real operator, not BINARY_COUNT.
+inline std::shared_ptr<Value> apply_binary(BinaryOp op, const std::shared_ptr<Value>& a,
+                                           const std::shared_ptr<Value>& b) {
+    return BINARY_KERNELS[op][static_cast<std::size_t>(a->get_kind())]
+                         [static_cast<std::size_t>(b->get_kind())](a, b);
+}
+
+#endif
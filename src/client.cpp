@@ -0,0 +1,138 @@
+/// --------------------
+/// Fork server client
+/// --------------------
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include "server.h"
+
+namespace {
+
+// Largest request the server accepts: a working directory and a path.
+constexpr std::uint32_t MAX_REQUEST = 1 << 16;
+
+}  // namespace
+
+namespace wire {
+
+bool socket_address(const std::string& path, sockaddr_un& address, std::string& error) {
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        error = "Invalid socket path " + path;
+        return false;
+    }
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+bool write_all(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+bool read_all(int fd, char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t got = read(fd, data, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        data += got;
+        size -= static_cast<std::size_t>(got);
+    }
+    return true;
+}
+
+bool send_request(int conn, const std::string& payload, const int fds[3]) {
+    std::uint32_t size = static_cast<std::uint32_t>(payload.size());
+    iovec part{&size, sizeof(size)};
+    alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    std::memcpy(CMSG_DATA(header), fds, 3 * sizeof(int));
+    ssize_t sent;
+    do {
+        sent = sendmsg(conn, &message, 0);
+    } while (sent < 0 && errno == EINTR);
+    return sent == static_cast<ssize_t>(sizeof(size)) &&
+           write_all(conn, payload.data(), payload.size());
+}
+
+bool receive_request(int conn, std::string& payload, int fds[3]) {
+    std::uint32_t size = 0;
+    iovec part{&size, sizeof(size)};
+    alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(int))] = {};
+    msghdr message{};
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t got;
+    do {
+        got = recvmsg(conn, &message, 0);
+    } while (got < 0 && errno == EINTR);
+    cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (header == nullptr || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(3 * sizeof(int))) {
+        return false;
+    }
+    std::memcpy(fds, CMSG_DATA(header), 3 * sizeof(int));
+    if (got != static_cast<ssize_t>(sizeof(size)) || size > MAX_REQUEST) {
+        for (int i = 0; i < 3; ++i) close(fds[i]);
+        return false;
+    }
+    payload.resize(size);
+    if (!read_all(conn, &payload[0], size)) {
+        for (int i = 0; i < 3; ++i) close(fds[i]);
+        return false;
+    }
+    return true;
+}
+
+}  // namespace wire
+
+int run_client(const std::string& socket_path, const std::string& file_name, int in, int out,
+               int err, std::string& error) {
+    sockaddr_un address;
+    if (!wire::socket_address(socket_path, address, error)) return -1;
+    int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn < 0 || connect(conn, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        error = "Cannot connect to " + socket_path + ": " + std::strerror(errno);
+        if (conn >= 0) close(conn);
+        return -1;
+    }
+
+    std::error_code ec;
+    std::string cwd = std::filesystem::current_path(ec).string();
+    std::string payload = cwd + '\0' + file_name + '\0';
+    const int fds[3] = {in, out, err};
+    char status = 0;
+    bool ended = false;
+    if (!wire::send_request(conn, payload, fds)) {
+        error = "Cannot send the request to " + socket_path;
+    } else if (!wire::read_all(conn, &status, 1)) {
+        error = "The run ended without a status";
+    } else {
+        ended = true;
+    }
+    close(conn);
+    return ended ? status : -1;
+}
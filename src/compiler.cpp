@@ -61,6 +61,7 @@ class CodeGen {
             }
         }
         if (!block_terminated()) {
+            builder.CreateCall(get_rt("rt_wait_tasks", builder.getVoidTy(), {}));
             builder.CreateRet(builder.getInt32(0));
         }
         return errors.empty();
@@ -74,6 +75,8 @@ class CodeGen {
         // `while` re-pushes its iteration frame in the header, so `continue`
         // must release first; `for`/`repeat` latches release it themselves.
         bool release_on_continue;
+        // The body of a `parallel for`, compiled into its own function.
+        bool parallel{false};
     };
 
     struct NativeI64Var {
@@ -167,7 +170,7 @@ class CodeGen {
         std::string suffix;
         std::shared_ptr<Token> tok = node ? node->get_tok() : nullptr;
         if (tok) {
-            suffix = " (line " + std::to_string(tok->get_pos().line + 1) + ")";
+            suffix = " (line " + std::to_string(tok->get_pos().line() + 1) + ")";
         }
         errors.push_back(message + suffix);
     }
@@ -248,6 +251,7 @@ class CodeGen {
         if (type == NODE_REPEAT) return gen_repeat(node);
         if (type == NODE_ALGODEF) return gen_algo_def(node);
         if (type == NODE_ALGOCALL) return gen_algo_call(node);
+        if (type == NODE_SPAWN) return gen_spawn(node);
         if (type == NODE_ARRAY) return gen_array(node);
         if (type == NODE_ARRACCESS) return gen_array_access(node);
         if (type == NODE_ARRASSIGN) return gen_array_assign(node);
@@ -945,6 +949,9 @@ class CodeGen {
     }
 
     llvm::Value* gen_for(const std::shared_ptr<Node>& node) {
+        if (static_cast<ForNode*>(node.get())->is_parallel()) {
+            return gen_parallel_for(node);
+        }
         if (llvm::Value* native = gen_native_for(node)) {
             return native;
         }
@@ -1019,6 +1026,92 @@ class CodeGen {
         return result;
     }
 
+    // `parallel for`: the body becomes a function the runtime calls once per
+    // iteration, in a chunk scope where the loop variable is already bound.
+    llvm::Value* gen_parallel_for(const std::shared_ptr<Node>& node) {
+        flush_native_vars();
+        clear_native_locals();
+        NodeList child = node->get_child();
+        // Evaluation order matches visit_parallel_for: assign, step, end.
+        llvm::Value* init = gen(child[0]);
+        if (init == nullptr) return nullptr;
+        llvm::Value* step = child[2] != nullptr ? gen(child[2]) : make_int(1);
+        if (step == nullptr) return nullptr;
+        llvm::Value* end = gen(child[1]);
+        if (end == nullptr) return nullptr;
+
+        const NodeList& body = static_cast<ForNode*>(node.get())->get_body();
+        SharedWrites writes = find_shared_writes(body, child[0]->get_name());
+        if (!writes.error.empty()) {
+            error("compile error: " + writes.error, node);
+            return nullptr;
+        }
+        std::vector<std::string> element_names;
+        for (SymbolId symbol : writes.element_writes) element_names.push_back(symbol_name(symbol));
+        llvm::Function* fn = emit_parallel_body(body);
+        if (fn == nullptr) return nullptr;
+
+        SymbolId loop_symbol = child[0]->get_symbol();
+        std::vector<std::string> reduction_names;
+        std::vector<llvm::Constant*> reduction_ops;
+        for (const LoopReduction& reduction : find_loop_reductions(body)) {
+            if (reduction.symbol == loop_symbol) continue;
+            reduction_names.push_back(symbol_name(reduction.symbol));
+            reduction_ops.push_back(builder.getInt64(reduction.op));
+        }
+        llvm::Value* ops = llvm::ConstantPointerNull::get(ptr_ty);
+        if (!reduction_ops.empty()) {
+            llvm::ArrayType* ops_ty = llvm::ArrayType::get(i64_ty, reduction_ops.size());
+            ops = new llvm::GlobalVariable(module, ops_ty, true, llvm::GlobalValue::PrivateLinkage,
+                                           llvm::ConstantArray::get(ops_ty, reduction_ops),
+                                           "reduction.ops");
+        }
+        builder.CreateCall(
+            get_rt("rt_parallel_for", ptr_ty,
+                   {ptr_ty, ptr_ty, ptr_ty, ptr_ty, ptr_ty, ptr_ty, ptr_ty, i64_ty, ptr_ty, i64_ty}),
+            {init, end, step, cstring(child[0]->get_name()), fn,
+             string_array(reduction_names, "reductions"), ops,
+             builder.getInt64(static_cast<int64_t>(reduction_names.size())),
+             string_array(element_names, "elements"),
+             builder.getInt64(static_cast<int64_t>(element_names.size()))});
+        return make_none();
+    }
+
+    llvm::Function* emit_parallel_body(const NodeList& body) {
+        llvm::Function* fn = llvm::Function::Create(
+            llvm::FunctionType::get(ptr_ty, false), llvm::Function::PrivateLinkage,
+            "ps.parallel." + std::to_string(algo_counter++), module);
+
+        llvm::IRBuilderBase::InsertPoint saved = builder.saveIP();
+        std::vector<LoopContext> saved_loops;
+        saved_loops.swap(loops);
+        bool saved_native_i64_enabled = native_i64_enabled;
+        native_i64_enabled = false;
+
+        llvm::BasicBlock* entry = llvm::BasicBlock::Create(ctx, "entry", fn);
+        // `continue` ends the iteration.
+        llvm::BasicBlock* next = llvm::BasicBlock::Create(ctx, "parallel.next", fn);
+        builder.SetInsertPoint(next);
+        builder.CreateRet(make_none());
+
+        builder.SetInsertPoint(entry);
+        loops.push_back({next, next, nullptr, false, true});
+        llvm::Value* last = gen_statements(body);
+        if (!block_terminated() && errors.empty()) {
+            builder.CreateRet(last != nullptr ? last : make_none());
+        }
+        loops.pop_back();
+
+        clear_native_locals();
+        native_i64_enabled = saved_native_i64_enabled;
+        loops.swap(saved_loops);
+        builder.restoreIP(saved);
+        if (!errors.empty()) {
+            return nullptr;
+        }
+        return fn;
+    }
+
     // Emits a loop body (one or more statements). Returns true when the body
     // terminated the current block (break/continue/return on every path).
     bool gen_body(const NodeList& body) {
@@ -1038,6 +1131,10 @@ class CodeGen {
             return nullptr;
         }
         const LoopContext& loop = loops.back();
+        if (is_break && loop.parallel) {
+            error("compile error: break is not allowed in a parallel for loop", node);
+            return nullptr;
+        }
         if (is_break) {
             frame_release(loop.iter_mark);
             builder.CreateBr(loop.exit);
@@ -1058,6 +1155,12 @@ class CodeGen {
             // Top-level `return` does not stop execution in the interpreter.
             return value;
         }
+        for (const LoopContext& loop : loops) {
+            if (loop.parallel) {
+                error("compile error: return is not allowed in a parallel for loop", node);
+                return nullptr;
+            }
+        }
         builder.CreateRet(value);
         return nullptr;
     }
@@ -1295,12 +1398,15 @@ class CodeGen {
             return nullptr;
         }
 
-        bool memoizable = is_memoizable_numeric_algo(node, name, arg_names);
+        int64_t flags = 0;
+        if (is_memoizable_numeric_algo(node, name, arg_names)) flags |= RT_ALGO_MEMOIZABLE;
+        if (node->has_flag(NODE_FLAG_PURE)) flags |= RT_ALGO_PURE;
+        if (node->has_flag(NODE_FLAG_ASSOCIATIVE)) flags |= RT_ALGO_ASSOCIATIVE;
         std::string rt_name = define_global ? "rt_define_algo" : "rt_make_algo";
         return builder.CreateCall(get_rt(rt_name, ptr_ty, {ptr_ty, ptr_ty, ptr_ty, i64_ty, i64_ty}),
                                   {cstring(name), fn, string_array(arg_names, "args"),
                                    builder.getInt64(static_cast<int64_t>(arg_names.size())),
-                                   builder.getInt64(memoizable ? 1 : 0)});
+                                   builder.getInt64(flags)});
     }
 
     llvm::Value* gen_algo_def(const std::shared_ptr<Node>& node) {
@@ -1351,8 +1457,20 @@ class CodeGen {
         }
 
         flush_native_vars();
-        AlgorithmCallNode* call = dynamic_cast<AlgorithmCallNode*>(node.get());
-        std::shared_ptr<Node> callee_node = call->get_call();
+        return gen_generic_call(*dynamic_cast<AlgorithmCallNode*>(node.get()), "rt_call");
+    }
+
+    llvm::Value* gen_spawn(const std::shared_ptr<Node>& node) {
+        flush_native_vars();
+        SpawnNode* spawn = static_cast<SpawnNode*>(node.get());
+        return gen_generic_call(*static_cast<AlgorithmCallNode*>(spawn->get_call().get()),
+                                "rt_spawn");
+    }
+
+    // Evaluates the callee and arguments of `call` and passes them to the
+    // runtime entry point `rt_name` (rt_call or rt_spawn).
+    llvm::Value* gen_generic_call(AlgorithmCallNode& call, const std::string& rt_name) {
+        std::shared_ptr<Node> callee_node = call.get_call();
         llvm::Value* callee;
         if (callee_node->get_type() == NODE_VARACCESS) {
             callee = gen_var_access(callee_node);
@@ -1361,7 +1479,7 @@ class CodeGen {
         }
         if (callee == nullptr) return nullptr;
 
-        const NodeList& args = call->get_args();
+        const NodeList& args = call.get_args();
         llvm::Value* argv;
         if (args.empty()) {
             argv = llvm::ConstantPointerNull::get(ptr_ty);
@@ -1378,7 +1496,7 @@ class CodeGen {
             argv = slots;
         }
         return builder.CreateCall(
-            get_rt("rt_call", ptr_ty, {ptr_ty, ptr_ty, i64_ty}),
+            get_rt(rt_name, ptr_ty, {ptr_ty, ptr_ty, i64_ty}),
             {callee, argv, builder.getInt64(static_cast<int64_t>(args.size()))});
     }
 
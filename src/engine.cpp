@@ -0,0 +1,101 @@
+/// --------------------
+/// Embedding API
+/// --------------------
+
+#include "engine.h"
+#include <memory>
+#include <string>
+#include "analysis.h"
+#include "node.h"
+#include "pseudo.h"
+
+bool running_in_engine() { return sched::installed_task_group() != nullptr; }
+
+Engine::Entered::Entered(Engine& engine)
+    : caches(use_execution_caches(engine.caches.get())),
+      heap(gc::use_heap(&engine.heap)),
+      group(sched::use_task_group(&engine.tasks)),
+      streams(io::use_streams(engine.streams.get())) {}
+
+Engine::Entered::~Entered() {
+    io::use_streams(streams);
+    sched::use_task_group(group);
+    gc::use_heap(heap);
+    use_execution_caches(caches);
+}
+
+Engine::Engine(bool _lexical) : lexical(_lexical) { reset(); }
+
+Engine::~Engine() {
+    global_table.reset();
+    caches.reset();
+    heap.collect();
+}
+
+std::shared_ptr<Value> Engine::load(const std::string& source, const std::string& file_name) {
+    Entered entered(*this);
+    NodeList ast;
+    std::string error;
+    if (!parse_program(file_name, source, *global_table, ast, error, nullptr, modules.get())) {
+        // Printed with a newline like other errors.
+        if (!error.empty() && error.back() == '\n') error.pop_back();
+        return make_pooled<ErrorValue>(VALUE_ERROR, error);
+    }
+    if (global_table->uses_lexical_scoping()) {
+        for (const std::string& warning : check_lexical_scoping(ast)) {
+            *diagnostics << "Warning: " << warning << "\n";
+        }
+    }
+
+    Interpreter interpreter(*global_table, false);
+    std::shared_ptr<Value> ret = make_pooled<Value>();
+    try {
+        for (const auto& node : ast) {
+            ret = interpreter.visit(node);
+            if (ret->get_kind() == ValueKind::Error) break;
+        }
+    } catch (const EngineQuit&) {
+        ret = make_pooled<Value>();
+    }
+    sched::wait_for_tasks();
+    return ret;
+}
+
+std::shared_ptr<Value> Engine::call(const std::string& name, const ValueList& args) {
+    Entered entered(*this);
+    std::shared_ptr<Value> algo = global_table->get_local(name);
+    if (algo.get() == nullptr && global_table->define_deferred(intern_symbol(name))) {
+        algo = global_table->get_local(name);
+    }
+    if (algo.get() == nullptr || algo->get_type() != VALUE_ALGO) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, "No Algorithm named " + name + "\n");
+    }
+    NodeList arg_nodes;
+    arg_nodes.reserve(args.size());
+    for (const auto& arg : args) arg_nodes.push_back(make_pooled<PrecomputedNode>(arg));
+    std::shared_ptr<Value> ret;
+    try {
+        ret = algo->execute(arg_nodes, global_table.get());
+    } catch (const EngineQuit&) {
+        ret = make_pooled<Value>();
+    }
+    sched::wait_for_tasks();
+    return ret;
+}
+
+void Engine::reset() {
+    global_table = std::make_unique<SymbolTable>();
+    global_table->set_lexical_scoping(lexical);
+    caches = std::make_unique<ExecutionCaches>();
+    heap.collect();
+}
+
+void Engine::redirect(std::istream& in, std::ostream& out) {
+    streams = std::make_unique<io::Streams>(in, out);
+}
+
+void Engine::redirect_diagnostics(std::ostream& _diagnostics) { diagnostics = &_diagnostics; }
+
+void Engine::use_modules(std::shared_ptr<const PreparsedModules> _modules) {
+    modules = std::move(_modules);
+}
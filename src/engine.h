@@ -0,0 +1,108 @@
+/// --------------------
+/// Embedding API
+/// --------------------
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "gc.h"
+#include "interpreter.h"
+#include "io.h"
+#include "scheduler.h"
+#include "symboltable.h"
+#include "value.h"
+
+struct PreparsedModules;
+
+// Thrown by quit() in code an Engine runs. The Engine's load or call then
+// returns None instead of the process exiting.
+struct EngineQuit {};
+
+// True while the calling thread runs code for an Engine.
+bool running_in_engine();
+
+// An isolated interpreter for C++ programs that embed pseudocode. An Engine
+// owns its global symbol table, its interpreter caches and memo tables, its
+// cycle-collector heap, the group its spawned tasks are counted in and its
+// program streams, and installs them on the thread that calls into it.
+// Engines share no mutable state beyond synchronized process-wide services
+// (symbol interning, the source map, the allocator's depot and the thread
+// pool), so separate Engines can run concurrently on separate threads. One
+// Engine must be used by one thread at a time, and values must not be
+// shared between Engines that run at the same time.
+class Engine {
+   public:
+    // `lexical` selects lexical scoping for top-level Algorithms, like
+    // `pseudo --lexical`.
+    explicit Engine(bool lexical = false);
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+    ~Engine();
+
+    // Parses and runs `source` in this Engine's globals, like a file passed
+    // to `pseudo`, and waits for the tasks it spawned. Returns the value of
+    // the last statement, or an Error with the message `pseudo` would print.
+    std::shared_ptr<Value> load(const std::string& source,
+                                const std::string& file_name = "engine");
+
+    // Calls the global Algorithm `name` with `args` and waits for the tasks
+    // it spawned. Returns its result or its error. An imported Algorithm no
+    // loaded code named is defined first.
+    std::shared_ptr<Value> call(const std::string& name, const ValueList& args = {});
+
+    // Forgets every global and cached result, as if freshly constructed.
+    void reset();
+
+    // Sends the output of print to `out` and reads read() and read_line()
+    // input from `in`, instead of standard output and input. Both must outlive
+    // the Engine's use of them.
+    void redirect(std::istream& in, std::ostream& out);
+
+    // Sends warnings about loaded code, such as those of lexical scoping, to
+    // `diagnostics` instead of standard error. It must outlive the Engine's
+    // use of it.
+    void redirect_diagnostics(std::ostream& diagnostics);
+
+    // Imported definitions no loaded code named are not in it yet.
+    SymbolTable& globals() { return *global_table; }
+
+    // The group the Engine's tasks are counted and charged CPU time in.
+    const sched::TaskGroup& task_group() const { return tasks; }
+
+    // Imports in code loaded from now on take their trees from `modules`
+    // when the file is unchanged (preparse_modules in imports.h).
+    void use_modules(std::shared_ptr<const PreparsedModules> modules);
+
+   private:
+    // Installs the Engine's caches, heap and task group on the calling
+    // thread for as long as it lives.
+    class Entered {
+       public:
+        explicit Entered(Engine& engine);
+        Entered(const Entered&) = delete;
+        Entered& operator=(const Entered&) = delete;
+        ~Entered();
+
+       private:
+        ExecutionCaches* caches;
+        gc::Heap* heap;
+        sched::TaskGroup* group;
+        io::Streams* streams;
+    };
+
+    // Declared first: values in the other members are tracked here.
+    gc::Heap heap;
+    sched::TaskGroup tasks;
+    std::unique_ptr<ExecutionCaches> caches;
+    std::unique_ptr<SymbolTable> global_table;
+    std::unique_ptr<io::Streams> streams;  // nullptr: standard input and output
+    std::ostream* diagnostics{&std::cerr};
+    std::shared_ptr<const PreparsedModules> modules;
+    bool lexical;
+};
+
+#endif
@@ -0,0 +1,246 @@
+/// --------------------
+/// File handles
+/// --------------------
+
+#include "files.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+namespace {
+
+constexpr std::size_t WRITE_BUFFER_BYTES = 64 * 1024;
+// Pages read are handed back once this much of the mapping is behind the
+// reader.
+constexpr std::size_t RELEASE_BYTES = 64 * 1024 * 1024;
+
+std::shared_ptr<Value> file_error(const std::string& message) {
+    return make_pooled<ErrorValue>(VALUE_ERROR, message + "\n");
+}
+
+std::shared_ptr<Value> make_string(const char* begin, std::size_t size) {
+    return make_pooled<TypedValue<std::string>>(VALUE_STRING, std::string(begin, size));
+}
+
+// Write handles not closed yet. Values a program leaves at the top level
+// live until exit, so their buffers are written by an exit handler.
+struct OpenWriters {
+    std::mutex mutex;
+    std::set<FileValue*> files;
+};
+
+OpenWriters& open_writers() {
+    // Leaked on purpose: the exit handler runs during static destruction.
+    static OpenWriters* shared = new OpenWriters;
+    return *shared;
+}
+
+}  // namespace
+
+FileValue::~FileValue() {
+    forget();
+    close_locked();
+}
+
+// Taken before the handle's own mutex, never while holding it.
+void FileValue::forget() {
+    if (!writing) return;
+    OpenWriters& writers = open_writers();
+    std::lock_guard<std::mutex> lock(writers.mutex);
+    writers.files.erase(this);
+}
+
+void FileValue::flush_open_writers() {
+    OpenWriters& writers = open_writers();
+    std::lock_guard<std::mutex> lock(writers.mutex);
+    for (FileValue* file : writers.files) {
+        std::lock_guard<std::mutex> file_lock(file->mutex);
+        file->flush();
+    }
+}
+
+bool FileValue::open(bool append, std::string& error) {
+    int flags = writing ? O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC) : O_RDONLY;
+    fd = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        error = "Cannot open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    if (writing) {
+        static std::once_flag registered;
+        std::call_once(registered, [] { std::atexit(flush_open_writers); });
+        OpenWriters& writers = open_writers();
+        std::lock_guard<std::mutex> lock(writers.mutex);
+        writers.files.insert(this);
+        return true;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        error = "Cannot open " + path + ": not a regular file";
+        close_locked();
+        return false;
+    }
+    length = static_cast<std::size_t>(info.st_size);
+    if (length == 0) return true;
+    void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        error = "Cannot map " + path + ": " + std::strerror(errno);
+        length = 0;
+        close_locked();
+        return false;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    data = static_cast<const char*>(mapping);
+    return true;
+}
+
+std::shared_ptr<Value> FileValue::check(bool for_writing) const {
+    if (fd < 0) return file_error("File " + path + " is closed");
+    if (for_writing && !writing) return file_error("File " + path + " was opened for reading");
+    if (!for_writing && writing) return file_error("File " + path + " was opened for writing");
+    return nullptr;
+}
+
+void FileValue::release_read_pages() {
+    if (pos - kept < RELEASE_BYTES) return;
+    static const std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    std::size_t end = pos / page * page;
+    madvise(const_cast<char*>(data) + kept, end - kept, MADV_DONTNEED);
+    kept = end;
+}
+
+std::shared_ptr<Value> FileValue::read_line() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::shared_ptr<Value> error = check(false)) return error;
+    if (pos == length) return make_pooled<TypedValue<std::string>>(VALUE_STRING, "");
+    const char* begin = data + pos;
+    const char* newline = static_cast<const char*>(std::memchr(begin, '\n', length - pos));
+    std::size_t size = newline == nullptr ? length - pos : static_cast<std::size_t>(newline - begin);
+    pos += newline == nullptr ? size : size + 1;
+    std::shared_ptr<Value> line = make_string(begin, size);
+    release_read_pages();
+    return line;
+}
+
+std::shared_ptr<Value> FileValue::read_fields(const std::shared_ptr<Value>& separator) {
+    if (separator->get_kind() != ValueKind::String || separator->as_string().size() != 1) {
+        return file_error("read_fields expects a one-character separator");
+    }
+    char sep = separator->as_string()[0];
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::shared_ptr<Value> error = check(false)) return error;
+    ValueList fields;
+    if (pos < length) {
+        const char* begin = data + pos;
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', length - pos));
+        const char* end = newline == nullptr ? data + length : newline;
+        for (;;) {
+            const char* cut =
+                static_cast<const char*>(std::memchr(begin, sep, static_cast<std::size_t>(end - begin)));
+            if (cut == nullptr) break;
+            fields.push_back(make_string(begin, static_cast<std::size_t>(cut - begin)));
+            begin = cut + 1;
+        }
+        fields.push_back(make_string(begin, static_cast<std::size_t>(end - begin)));
+        pos = static_cast<std::size_t>(end - data) + (newline == nullptr ? 0 : 1);
+        release_read_pages();
+    }
+    return make_pooled<ArrayValue>(std::move(fields));
+}
+
+std::shared_ptr<Value> FileValue::read_bytes(const std::shared_ptr<Value>& count) {
+    if (count->get_kind() != ValueKind::Int || count->as_int() < 0) {
+        return file_error("read_bytes expects a count that is a non-negative Int");
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::shared_ptr<Value> error = check(false)) return error;
+    std::size_t size = std::min(static_cast<std::size_t>(count->as_int()), length - pos);
+    std::shared_ptr<Value> bytes = make_string(data + pos, size);
+    pos += size;
+    release_read_pages();
+    return bytes;
+}
+
+std::shared_ptr<Value> FileValue::at_end() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::shared_ptr<Value> error = check(false)) return error;
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, pos == length);
+}
+
+std::shared_ptr<Value> FileValue::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd < 0) return file_error("File " + path + " is closed");
+    std::uint64_t bytes = writing ? written + pending.size() : length;
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, static_cast<int64_t>(bytes));
+}
+
+std::shared_ptr<Value> FileValue::write(const std::shared_ptr<Value>& text, bool line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (std::shared_ptr<Value> error = check(true)) return error;
+    pending += text->get_num();
+    if (line) pending += '\n';
+    if (pending.size() >= WRITE_BUFFER_BYTES && !flush()) {
+        return file_error("Cannot write " + path + ": " + std::strerror(errno));
+    }
+    return make_pooled<Value>();
+}
+
+std::shared_ptr<Value> FileValue::close() {
+    forget();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd < 0) return make_pooled<Value>();
+    bool flushed = !writing || flush();
+    int saved_errno = errno;
+    close_locked();
+    if (!flushed) return file_error("Cannot write " + path + ": " + std::strerror(saved_errno));
+    return make_pooled<Value>();
+}
+
+bool FileValue::flush() {
+    std::size_t done = 0;
+    while (done < pending.size()) {
+        ssize_t size = ::write(fd, pending.data() + done, pending.size() - done);
+        if (size < 0) {
+            if (errno == EINTR) continue;
+            pending.erase(0, done);
+            written += done;
+            return false;
+        }
+        done += static_cast<std::size_t>(size);
+    }
+    written += done;
+    pending.clear();
+    return true;
+}
+
+void FileValue::close_locked() {
+    if (fd < 0) return;
+    if (writing) flush();
+    if (data != nullptr) munmap(const_cast<char*>(data), length);
+    data = nullptr;
+    ::close(fd);
+    fd = -1;
+}
+
+std::shared_ptr<Value> open_file(const std::shared_ptr<Value>& path,
+                                 const std::shared_ptr<Value>& mode) {
+    if (path->get_kind() != ValueKind::String) return file_error("open expects a path that is a Str");
+    std::string how = mode->get_kind() == ValueKind::String ? mode->as_string() : "";
+    if (how != "r" && how != "w" && how != "a") {
+        return file_error("open expects a mode of \"r\", \"w\" or \"a\"");
+    }
+    std::shared_ptr<FileValue> file = make_pooled<FileValue>(path->as_string(), how != "r");
+    std::string error;
+    if (!file->open(how == "a", error)) return file_error(error);
+    return file;
+}
@@ -0,0 +1,74 @@
+/// --------------------
+/// File handles
+/// --------------------
+
+#ifndef FILES_H
+#define FILES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "value.h"
+
+// Handle returned by open(path, mode). A file opened with "r" is mapped
+// into memory and read forward from the mapping: lines and fields are cut
+// straight out of it, and pages already read are handed back to the kernel,
+// so inputs larger than memory are read with a flat footprint. A file opened
+// with "w" or "a" gathers writes in a 64 KiB buffer. Handles close when
+// closed explicitly or when the last reference goes; writes still buffered
+// at exit are written then.
+class FileValue : public Value {
+   public:
+    FileValue(std::string _path, bool _writing)
+        : Value(VALUE_FILE, ValueKind::File), path(std::move(_path)), writing(_writing) {}
+    ~FileValue();
+    std::string get_num() override { return "<File " + path + ">"; }
+    std::string repr() override { return get_num(); }
+
+    // Opens the file for the handle. Returns false with `error` set when the
+    // file cannot be opened or, for reading, mapped.
+    bool open(bool append, std::string& error);
+
+    // Methods: read_line(), read_fields(sep), read_bytes(n), at_end(),
+    // size(), write(s), write_line(s) and close(). Each returns the method's result, or an
+    // error value when it does not apply to the handle.
+    std::shared_ptr<Value> read_line();
+    std::shared_ptr<Value> read_fields(const std::shared_ptr<Value>& separator);
+    std::shared_ptr<Value> read_bytes(const std::shared_ptr<Value>& count);
+    std::shared_ptr<Value> at_end();
+    std::shared_ptr<Value> size();
+    std::shared_ptr<Value> write(const std::shared_ptr<Value>& text, bool line = false);
+    std::shared_ptr<Value> close();
+
+   private:
+    // Called with `mutex` held, apart from forget.
+    std::shared_ptr<Value> check(bool for_writing) const;
+    bool flush();
+    void release_read_pages();
+    void close_locked();
+    void forget();
+    static void flush_open_writers();
+
+    std::string path;
+    bool writing;
+    std::mutex mutex;  // tasks may share a handle
+    int fd{-1};
+    // Reading: the mapping, the next byte to read and the start of the pages
+    // still mapped in.
+    const char* data{nullptr};
+    std::size_t length{0};
+    std::size_t pos{0};
+    std::size_t kept{0};
+    // Writing: bytes handed to the file, and those still buffered.
+    std::uint64_t written{0};
+    std::string pending;
+};
+
+// Builtin: open(path, mode), with mode "r", "w" or "a".
+std::shared_ptr<Value> open_file(const std::shared_ptr<Value>& path,
+                                 const std::shared_ptr<Value>& mode);
+
+#endif
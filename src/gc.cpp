@@ -0,0 +1,146 @@
+/// --------------------
+/// Cycle collector
+/// --------------------
+
+#include "gc.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "value.h"
+
+namespace gc {
+
+namespace {
+
+bool is_container(const Value* value) {
+    if (value == nullptr) return false;
+    ValueKind kind = value->get_kind();
+    return kind == ValueKind::Array || kind == ValueKind::HashTable ||
+           kind == ValueKind::Instance;
+}
+
+}  // namespace
+
+Heap& default_heap() {
+    // Leaked on purpose: containers are untracked during static destruction.
+    static Heap* shared = new Heap;
+    return *shared;
+}
+
+Heap::~Heap() {
+    Heap& fallback = default_heap();
+    std::scoped_lock lock(mutex, fallback.mutex);
+    while (head != nullptr) {
+        ContainerValue* container = head;
+        head = container->gc_next;
+        container->gc_prev = nullptr;
+        container->gc_next = fallback.head;
+        if (fallback.head != nullptr) fallback.head->gc_prev = container;
+        fallback.head = container;
+        container->gc_heap = &fallback;
+        ++fallback.tracked;
+    }
+}
+
+void Heap::track(ContainerValue* container) {
+    std::lock_guard<std::mutex> lock(mutex);
+    container->gc_heap = this;
+    container->gc_next = head;
+    if (head != nullptr) head->gc_prev = container;
+    head = container;
+    ++tracked;
+    std::size_t remaining = allocations_until_collect.load(std::memory_order_relaxed);
+    if (remaining > 0) allocations_until_collect.store(remaining - 1, std::memory_order_relaxed);
+}
+
+void Heap::untrack(ContainerValue* container) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (container->gc_prev != nullptr) container->gc_prev->gc_next = container->gc_next;
+    if (container->gc_next != nullptr) container->gc_next->gc_prev = container->gc_prev;
+    if (head == container) head = container->gc_next;
+    --tracked;
+}
+
+std::size_t Heap::collect() {
+    std::vector<std::shared_ptr<Value>> garbage;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Trial deletion: start from each container's use count and take away
+        // the references held by other containers. A container with no
+        // shared owner at all (kept by a raw pointer) counts as a root.
+        for (ContainerValue* c = head; c != nullptr; c = c->gc_next) {
+            long owners = c->weak_from_this().use_count();
+            c->gc_refs = owners == 0 ? 1 : owners;
+            c->gc_reachable = false;
+        }
+        std::vector<Value*> children;
+        for (ContainerValue* c = head; c != nullptr; c = c->gc_next) {
+            children.clear();
+            c->list_children(children);
+            for (Value* child : children) {
+                if (!is_container(child)) continue;
+                ContainerValue* container = static_cast<ContainerValue*>(child);
+                // References into other heaps are outside owners there.
+                if (container->gc_heap == this) --container->gc_refs;
+            }
+        }
+
+        std::vector<ContainerValue*> pending;
+        for (ContainerValue* c = head; c != nullptr; c = c->gc_next) {
+            if (c->gc_refs > 0 && !c->gc_reachable) {
+                c->gc_reachable = true;
+                pending.push_back(c);
+            }
+            while (!pending.empty()) {
+                ContainerValue* reached = pending.back();
+                pending.pop_back();
+                children.clear();
+                reached->list_children(children);
+                for (Value* child : children) {
+                    if (!is_container(child)) continue;
+                    ContainerValue* container = static_cast<ContainerValue*>(child);
+                    if (container->gc_heap == this && !container->gc_reachable) {
+                        container->gc_reachable = true;
+                        pending.push_back(container);
+                    }
+                }
+            }
+        }
+
+        for (ContainerValue* c = head; c != nullptr; c = c->gc_next) {
+            if (!c->gc_reachable) garbage.push_back(c->shared_from_this());
+        }
+        ++collections;
+        freed += garbage.size();
+        allocations_until_collect.store(std::max(MIN_INTERVAL, tracked),
+                                        std::memory_order_relaxed);
+    }
+
+    // Outside the lock: freeing containers untracks them.
+    ValueList released;
+    for (const auto& value : garbage) {
+        static_cast<ContainerValue*>(value.get())->release_children(released);
+    }
+    std::size_t count = garbage.size();
+    released.clear();
+    garbage.clear();
+    return count;
+}
+
+Stats Heap::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return Stats{tracked, collections, freed};
+}
+
+void track(ContainerValue* container) { current_heap().track(container); }
+
+void untrack(ContainerValue* container) { container->gc_heap->untrack(container); }
+
+std::size_t collect() { return current_heap().collect(); }
+
+Stats stats() { return current_heap().stats(); }
+
+}  // namespace gc
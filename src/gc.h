@@ -0,0 +1,102 @@
+/// --------------------
+/// Cycle collector
+/// --------------------
+
+#ifndef GC_H
+#define GC_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include "scheduler.h"
+
+class ContainerValue;
+
+// Values are reference counted, so containers that reach themselves (a
+// doubly-linked node, an instance storing `self`, an array holding itself)
+// are never freed. Every live ContainerValue is tracked here. A trial
+// deletion pass subtracts the references that containers hold on each other
+// from their use counts. Whatever keeps a positive count is referenced from
+// outside (a scope, a local, a cache) and stays alive, along with everything
+// it reaches. The rest is cyclic garbage, and the collector breaks it by
+// dropping its references.
+//
+// Collection only runs at safe points (calls and loop iterations), where
+// every live value is owned by some shared_ptr or by a root container, and
+// never while other threads may be running pseudocode.
+// Struct destructors are not run for collected instances.
+//
+// Containers are tracked in the heap of the thread that allocates them. An
+// Engine (engine.h) installs a heap of its own, so engines running on other
+// threads never walk each other's values; scheduler tasks run in the heap of
+// the thread that queued them.
+namespace gc {
+
+struct Stats {
+    std::size_t tracked;      // live containers
+    std::size_t collections;  // passes run so far
+    std::size_t freed;        // containers freed by all passes
+};
+
+class Heap {
+   public:
+    Heap() = default;
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+    // Containers still alive move to the default heap.
+    ~Heap();
+
+    void track(ContainerValue* container);
+    void untrack(ContainerValue* container);
+    // Frees unreachable container cycles; returns the number of containers
+    // freed.
+    std::size_t collect();
+    // True once enough containers were allocated since the last collection
+    // to make a pass worth it.
+    bool due() const { return allocations_until_collect.load(std::memory_order_relaxed) == 0; }
+    Stats stats();
+
+   private:
+    // Containers allocated between passes: at least this many, and no fewer
+    // than survived the previous pass, so collection stays amortized O(1).
+    static constexpr std::size_t MIN_INTERVAL = 10000;
+
+    std::mutex mutex;
+    ContainerValue* head{nullptr};
+    std::size_t tracked{0};
+    std::size_t collections{0};
+    std::size_t freed{0};
+    std::atomic<std::size_t> allocations_until_collect{MIN_INTERVAL};
+};
+
+// The heap of threads outside any Engine.
+Heap& default_heap();
+
+inline thread_local Heap* installed_heap = nullptr;
+
+inline Heap& current_heap() { return installed_heap ? *installed_heap : default_heap(); }
+
+// Makes `heap` the calling thread's heap (nullptr restores the default) and
+// returns the previous one.
+inline Heap* use_heap(Heap* heap) {
+    std::swap(installed_heap, heap);
+    return heap;
+}
+
+void track(ContainerValue* container);
+void untrack(ContainerValue* container);
+
+// Collects the current heap; returns the number of containers freed.
+std::size_t collect();
+
+// Safe point: collects the current heap once it is due.
+inline void maybe_collect() {
+    if (current_heap().due() && !sched::concurrent()) collect();
+}
+
+Stats stats();
+
+}  // namespace gc
+
+#endif
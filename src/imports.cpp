@@ -0,0 +1,864 @@
+/// --------------------
+/// Imports
+/// --------------------
+
+#include "imports.h"
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "analysis.h"
+#include "astcache.h"
+#include "error.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "position.h"
+#include "scheduler.h"
+#include "token.h"
+
+// A file as last parsed with a ParseMemo.
+struct MemoFile {
+    struct Piece {
+        std::string text;
+        std::uint32_t offset{0};
+        std::uint32_t file_id{0};  // source_map id of the text it was lexed in
+        TokenList tokens;
+        NodeList statements;
+        std::vector<std::string> defines;
+        std::unordered_set<std::string> references;
+        bool fresh{false};  // parsed by the current parse
+    };
+    std::vector<Piece> pieces;
+    // Names defined by pieces parsed or dropped since the last successful
+    // parse.
+    std::vector<std::string> changed;
+    bool parsed{false};  // by the current parse
+};
+
+namespace {
+
+std::string trim(const std::string& str) {
+    size_t begin = 0;
+    while (begin < str.size() && std::isspace(static_cast<unsigned char>(str[begin]))) {
+        begin++;
+    }
+
+    size_t end = str.size();
+    while (end > begin && std::isspace(static_cast<unsigned char>(str[end - 1]))) {
+        end--;
+    }
+    return str.substr(begin, end - begin);
+}
+
+bool parse_import_line(const std::string& line, std::string& target) {
+    std::string trimmed = trim(line);
+    std::string keyword = "import";
+    if (trimmed.rfind(keyword, 0) != 0) {
+        return false;
+    }
+    if (trimmed.size() > keyword.size() &&
+        !std::isspace(static_cast<unsigned char>(trimmed[keyword.size()]))) {
+        return false;
+    }
+
+    target = trim(trimmed.substr(keyword.size()));
+    if (target.empty()) {
+        return false;
+    }
+
+    if (target.front() == '"' && target.back() == '"' && target.size() >= 2) {
+        target = target.substr(1, target.size() - 2);
+    }
+    return !target.empty();
+}
+
+std::vector<std::filesystem::path> candidate_import_paths(const std::string& target,
+                                                          const std::filesystem::path& base_dir) {
+    namespace fs = std::filesystem;
+    fs::path target_path(target);
+    std::vector<fs::path> candidates;
+
+    if (target_path.is_absolute()) {
+        candidates.push_back(target_path);
+    } else {
+        if (!target_path.has_extension()) {
+            candidates.push_back(fs::current_path() / "lib" / (target + ".ps"));
+        }
+        candidates.push_back(base_dir / target_path);
+        candidates.push_back(fs::current_path() / target_path);
+    }
+
+    if (!target_path.has_extension()) {
+        candidates.push_back(base_dir / (target + ".ps"));
+        candidates.push_back(fs::current_path() / (target + ".ps"));
+    }
+
+    return candidates;
+}
+
+bool read_file(const std::filesystem::path& path, std::string& text) {
+    std::ifstream input(path);
+    if (!input) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << input.rdbuf();
+    text = buffer.str();
+    if (!text.empty() && text.back() != '\n') {
+        text += '\n';
+    }
+    return true;
+}
+
+bool resolve_import(const std::string& target, const std::filesystem::path& base_dir,
+                    std::filesystem::path& resolved) {
+    namespace fs = std::filesystem;
+    for (const auto& candidate : candidate_import_paths(target, base_dir)) {
+        std::error_code ec;
+        if (fs::exists(candidate, ec) && fs::is_regular_file(candidate, ec)) {
+            resolved = fs::weakly_canonical(candidate, ec);
+            if (ec) {
+                resolved = fs::absolute(candidate, ec);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// An `import` line and the offset just past it in the stripped text.
+struct ImportLine {
+    std::string target;
+    std::uint32_t end;
+};
+
+// `text` with its `import` lines emptied, so it parses on its own and keeps
+// its line numbers.
+std::string strip_imports(const std::string& text, std::vector<ImportLine>& imports) {
+    std::string stripped;
+    stripped.reserve(text.size());
+    std::size_t begin = 0;
+    while (begin < text.size()) {
+        std::size_t end = text.find('\n', begin);
+        end = end == std::string::npos ? text.size() : end + 1;
+        std::string line = text.substr(begin, end - begin);
+        std::string target;
+        if (parse_import_line(line, target)) {
+            if (line.back() == '\n') stripped += '\n';
+            imports.push_back(ImportLine{target, static_cast<std::uint32_t>(stripped.size())});
+        } else {
+            stripped += line;
+        }
+        begin = end;
+    }
+    return stripped;
+}
+
+std::string syntax_error(const std::shared_ptr<Token>& tok, const std::string& text,
+                         bool module) {
+    Position pos = tok->get_pos();
+    std::string where = module ? ", file: " + pos.file_name() : "";
+    return "Error: " + tok->get_value() + ", line " + std::to_string(pos.line() + 1) +
+           ", column: " + std::to_string(pos.column()) + where + "\n" +
+           error_marker(text, pos, pos);
+}
+
+// Files at least this large are lexed and parsed in pieces on the
+// scheduler's threads, each piece at least PIECE_MIN_BYTES long. Lexing
+// copies the rest of its text for every token, so pieces pay off on a single
+// thread too.
+constexpr std::size_t SPLIT_MIN_BYTES = 16 * 1024;
+constexpr std::size_t PIECE_MIN_BYTES = 4 * 1024;
+
+bool starts_word(const std::string& text, std::size_t at, const std::string& word) {
+    if (text.compare(at, word.size(), word) != 0) return false;
+    std::size_t after = at + word.size();
+    return after >= text.size() ||
+           !(std::isalnum(static_cast<unsigned char>(text[after])) || text[after] == '_');
+}
+
+// Offsets where the pieces of `text` start: the first, then lines that
+// begin a top-level Algorithm or Struct at column 0, outside strings and
+// comments, at least `min_bytes` after the previous start. A definition
+// cannot continue the statement before it and the indentation of its line is
+// 0, so each piece lexes and parses on its own.
+std::vector<std::uint32_t> piece_starts(const std::string& text, std::size_t min_bytes) {
+    std::vector<std::uint32_t> starts{0};
+    bool in_string = false;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        char ch = text[i];
+        if (in_string) {
+            if (ch == '\\') {
+                ++i;
+            } else if (ch == '"') {
+                in_string = false;
+            }
+            continue;
+        }
+        if (ch == '"') {
+            in_string = true;
+        } else if (ch == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+            i = text.find('\n', i);
+            if (i == std::string::npos) break;
+            --i;
+        } else if (i > 0 && text[i - 1] == '\n' && i - starts.back() >= min_bytes &&
+                   (starts_word(text, i, "Algorithm") || starts_word(text, i, "Struct"))) {
+            starts.push_back(static_cast<std::uint32_t>(i));
+        }
+    }
+    return starts;
+}
+
+// Lexes and parses the pieces of `text` starting at `starts` concurrently,
+// joining their statements in order. Returns false when a piece has an
+// error; the caller then parses the whole text to report it as it would.
+bool parse_pieces(const std::string& file_name, const std::string& text,
+                  const std::vector<std::uint32_t>& starts, NodeList& statements) {
+    source_map::FileRef file = source_map::add(file_name, text);
+    std::uint32_t file_id = file.id();
+    std::vector<NodeList> pieces(starts.size());
+    std::vector<char> failed(starts.size(), 0);
+    sched::parallel_for(starts.size(), [&](std::size_t i) {
+        std::size_t end = i + 1 < starts.size() ? starts[i + 1] : text.size();
+        Lexer lexer(file_name, text.substr(starts[i], end - starts[i]));
+        TokenList tokens = lexer.make_tokens(file_id, starts[i]);
+        if (!tokens.empty() && tokens[0]->get_type() == TOKEN_ERROR) {
+            failed[i] = 1;
+            return;
+        }
+        if (tokens.empty()) return;
+        pieces[i] = Parser(tokens).parse();
+        for (const auto& node : pieces[i]) {
+            if (node->get_type() == NODE_ERROR) failed[i] = 1;
+        }
+    });
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end()) return false;
+    statements.clear();
+    for (auto& piece : pieces) {
+        statements.insert(statements.end(), piece.begin(), piece.end());
+    }
+    return true;
+}
+
+// Lexes and parses `text` alone, in pieces when it is large. Errors in a
+// module name its file.
+bool parse_source(const std::string& file_name, const std::string& text, bool module,
+                  NodeList& statements, std::string& error) {
+    if (text.size() >= SPLIT_MIN_BYTES) {
+        std::vector<std::uint32_t> starts = piece_starts(text, PIECE_MIN_BYTES);
+        if (starts.size() > 1 && parse_pieces(file_name, text, starts, statements)) return true;
+    }
+
+    Lexer lexer(file_name, text);
+    TokenList tokens = lexer.make_tokens();
+    statements.clear();
+    if (tokens.empty()) return true;
+    if (tokens[0]->get_type() == TOKEN_ERROR) {
+        for (auto tok : tokens) {
+            if (tok->get_type() == TOKEN_ERROR) {
+                error = syntax_error(tok, text, module);
+                return false;
+            }
+        }
+    }
+
+    Parser parser(tokens);
+    statements = parser.parse();
+
+    for (auto node : statements) {
+        if (node->get_type() == NODE_ERROR) {
+            std::shared_ptr<Token> err_tok = node->get_tok();
+            if (err_tok) {
+                error = syntax_error(err_tok, text, module);
+            } else {
+                error = "Error: " + node->get_node() + "\n";
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+// Calls `visit` on `node` and every node under it.
+void for_each_node(const std::shared_ptr<Node>& node,
+                   const std::function<void(const std::shared_ptr<Node>&)>& visit) {
+    if (node.get() == nullptr) return;
+    visit(node);
+    if (node->get_type() == NODE_IF) {
+        IfNode* if_node = static_cast<IfNode*>(node.get());
+        for_each_node(if_node->get_condition(), visit);
+        for (const auto& expr : if_node->get_expr()) for_each_node(expr, visit);
+        for (const auto& expr : if_node->get_else()) for_each_node(expr, visit);
+        return;
+    }
+    if (node->get_type() == NODE_ALGOCALL) {
+        for_each_node(static_cast<AlgorithmCallNode*>(node.get())->get_call(), visit);
+    }
+    for (const auto& child : node->get_child()) for_each_node(child, visit);
+}
+
+// What a piece defines for others to name: its Algorithms and Structs (a
+// `Struct::method` changes its Struct) and the globals it assigns.
+void describe_piece(MemoFile::Piece& piece) {
+    for (const auto& node : piece.statements) {
+        std::string type = node->get_type();
+        if (type == NODE_ALGODEF || type == NODE_STRUCTDEF || type == NODE_VARASSIGN) {
+            std::string name = node->get_name();
+            piece.defines.push_back(name.substr(0, name.find("::")));
+        }
+        collect_references(node, piece.references);
+    }
+}
+
+// Moves the tokens of a kept piece to where its text now starts in the file
+// registered as `file_id`, including those the parser made up rather than
+// lexed.
+void move_piece(MemoFile::Piece& piece, std::uint32_t offset, std::uint32_t file_id) {
+    std::int64_t delta = static_cast<std::int64_t>(offset) - piece.offset;
+    std::unordered_set<Token*> moved;
+    auto move = [&](const std::shared_ptr<Token>& tok) {
+        if (tok.get() == nullptr || !moved.insert(tok.get()).second) return;
+        Position pos = tok->get_pos();
+        tok->set_pos(Position(static_cast<std::uint32_t>(pos.offset + delta), file_id));
+    };
+    for (const auto& tok : piece.tokens) move(tok);
+    for (const auto& statement : piece.statements) {
+        for_each_node(statement, [&move](const std::shared_ptr<Node>& node) {
+            move(node->get_tok());
+            for (const auto& tok : node->get_toks()) move(tok);
+        });
+    }
+    piece.offset = offset;
+    piece.file_id = file_id;
+}
+
+// Parses `text` like parse_source, cut at every top-level definition, taking
+// the pieces whose text `memo` already holds from it and parsing the others
+// concurrently.
+bool parse_memo(const std::string& file_name, const std::string& text, bool module,
+                MemoFile& memo, NodeList& statements, std::string& error) {
+    std::vector<std::uint32_t> starts = piece_starts(text, 0);
+    std::unordered_map<std::string, std::vector<std::size_t>> old_by_text;
+    for (std::size_t i = memo.pieces.size(); i-- > 0;) {
+        old_by_text[memo.pieces[i].text].push_back(i);
+    }
+    std::vector<MemoFile::Piece> pieces(starts.size());
+    std::vector<std::size_t> old_index(starts.size(), memo.pieces.size());
+    std::vector<std::size_t> fresh;
+    for (std::size_t i = 0; i < starts.size(); ++i) {
+        std::size_t end = i + 1 < starts.size() ? starts[i + 1] : text.size();
+        pieces[i].text = text.substr(starts[i], end - starts[i]);
+        pieces[i].offset = starts[i];
+        auto found = old_by_text.find(pieces[i].text);
+        if (found != old_by_text.end() && !found->second.empty()) {
+            old_index[i] = found->second.back();
+            found->second.pop_back();
+        } else {
+            pieces[i].fresh = true;
+            fresh.push_back(i);
+        }
+    }
+
+    source_map::FileRef file = source_map::add(file_name, text);
+    std::uint32_t file_id = file.id();
+    std::vector<char> failed(fresh.size(), 0);
+    sched::parallel_for(fresh.size(), [&](std::size_t k) {
+        MemoFile::Piece& piece = pieces[fresh[k]];
+        piece.file_id = file_id;
+        piece.tokens = Lexer(file_name, piece.text).make_tokens(file_id, piece.offset);
+        if (piece.tokens.empty()) return;
+        if (piece.tokens[0]->get_type() == TOKEN_ERROR) {
+            failed[k] = 1;
+            return;
+        }
+        piece.statements = Parser(piece.tokens).parse();
+        for (const auto& node : piece.statements) {
+            if (node->get_type() == NODE_ERROR) failed[k] = 1;
+        }
+        describe_piece(piece);
+    });
+    // The memo is left as it was, so the next version is compared with the
+    // last one that parsed.
+    if (std::find(failed.begin(), failed.end(), 1) != failed.end()) {
+        return parse_source(file_name, text, module, statements, error);
+    }
+
+    std::vector<char> kept(memo.pieces.size(), 0);
+    for (std::size_t i = 0; i < pieces.size(); ++i) {
+        if (pieces[i].fresh) {
+            memo.changed.insert(memo.changed.end(), pieces[i].defines.begin(),
+                                pieces[i].defines.end());
+            continue;
+        }
+        kept[old_index[i]] = 1;
+        pieces[i] = std::move(memo.pieces[old_index[i]]);
+        if (pieces[i].offset != starts[i] || pieces[i].file_id != file_id) {
+            move_piece(pieces[i], starts[i], file_id);
+        }
+    }
+    for (std::size_t i = 0; i < memo.pieces.size(); ++i) {
+        if (kept[i]) continue;
+        memo.changed.insert(memo.changed.end(), memo.pieces[i].defines.begin(),
+                            memo.pieces[i].defines.end());
+    }
+    memo.pieces = std::move(pieces);
+    memo.parsed = true;
+
+    statements.clear();
+    for (const auto& piece : memo.pieces) {
+        statements.insert(statements.end(), piece.statements.begin(), piece.statements.end());
+    }
+    return true;
+}
+
+// Called after a parse with `memo` succeeds. Kept pieces that name something
+// that changed since the last successful parse, directly or through other
+// kept pieces, lose what the interpreter cached on their nodes. Files the
+// parse did not read are forgotten, and what they defined counts as changed.
+void settle_memo(ParseMemo& memo) {
+    std::unordered_set<std::string> changed;
+    std::vector<MemoFile::Piece*> kept;
+    memo.reparsed = memo.kept = memo.invalidated = 0;
+    for (auto it = memo.files.begin(); it != memo.files.end();) {
+        MemoFile& file = *it->second;
+        changed.insert(file.changed.begin(), file.changed.end());
+        file.changed.clear();
+        if (!file.parsed) {
+            for (const auto& piece : file.pieces) {
+                changed.insert(piece.defines.begin(), piece.defines.end());
+            }
+            it = memo.files.erase(it);
+            continue;
+        }
+        file.parsed = false;
+        for (auto& piece : file.pieces) {
+            if (piece.fresh) {
+                ++memo.reparsed;
+                piece.fresh = false;
+            } else {
+                kept.push_back(&piece);
+            }
+        }
+        ++it;
+    }
+
+    std::vector<char> stale(kept.size(), 0);
+    for (bool grew = true; grew;) {
+        grew = false;
+        for (std::size_t i = 0; i < kept.size(); ++i) {
+            if (stale[i]) continue;
+            const auto& references = kept[i]->references;
+            if (std::none_of(references.begin(), references.end(),
+                             [&changed](const std::string& name) { return changed.count(name); })) {
+                continue;
+            }
+            stale[i] = 1;
+            changed.insert(kept[i]->defines.begin(), kept[i]->defines.end());
+            grew = true;
+        }
+    }
+
+    ExecutionCaches& caches = execution_caches();
+    for (std::size_t i = 0; i < kept.size(); ++i) {
+        if (!stale[i]) {
+            ++memo.kept;
+            continue;
+        }
+        ++memo.invalidated;
+        for (const auto& statement : kept[i]->statements) {
+            for_each_node(statement, [&caches](const std::shared_ptr<Node>& node) {
+                if (JitCacheEntry* entry = caches.jit.find(*node)) *entry = JitCacheEntry{};
+                if (auto* results = caches.memoized_results.find(*node)) results->clear();
+                if (auto* compiled = caches.single_return_jit.find(*node)) compiled->reset();
+            });
+        }
+        // Restores the JIT flags of expressions that gave up compiling.
+        annotate_ast(kept[i]->statements);
+    }
+}
+
+constexpr std::uint32_t NO_OFFSET = std::numeric_limits<std::uint32_t>::max();
+
+// Offset of the first token in `node`, or NO_OFFSET when it has none.
+std::uint32_t first_offset(const std::shared_ptr<Node>& node) {
+    std::uint32_t first = NO_OFFSET;
+    if (node.get() == nullptr) return first;
+    auto visit = [&first](const std::shared_ptr<Node>& child) {
+        first = std::min(first, first_offset(child));
+    };
+    std::shared_ptr<Token> tok = node->get_tok();
+    if (tok.get() != nullptr) first = tok->get_pos().offset;
+    for (const auto& arg : node->get_toks()) first = std::min(first, arg->get_pos().offset);
+
+    std::string type = node->get_type();
+    if (type == NODE_IF) {
+        IfNode* if_node = static_cast<IfNode*>(node.get());
+        visit(if_node->get_condition());
+        for (const auto& expr : if_node->get_expr()) visit(expr);
+        for (const auto& expr : if_node->get_else()) visit(expr);
+        return first;
+    }
+    if (type == NODE_ALGOCALL) visit(static_cast<AlgorithmCallNode*>(node.get())->get_call());
+    for (const auto& child : node->get_child()) visit(child);
+    return first;
+}
+
+// Where the statements of each import go: before the first statement that
+// starts after the import line.
+std::vector<ast_cache::ModuleImport> place_imports(const NodeList& statements,
+                                                   const std::vector<ImportLine>& lines) {
+    std::vector<ast_cache::ModuleImport> imports;
+    std::size_t index = 0;
+    for (const auto& line : lines) {
+        while (index < statements.size()) {
+            std::uint32_t offset = first_offset(statements[index]);
+            if (offset != NO_OFFSET && offset >= line.end) break;
+            ++index;
+        }
+        imports.push_back(ast_cache::ModuleImport{line.target, index});
+    }
+    return imports;
+}
+
+// A module, or the program itself, with the file it was read from.
+struct LoadedModule {
+    std::string path;
+    ast_cache::Module module;
+};
+
+}  // namespace
+
+struct PreparsedModules {
+    struct Entry {
+        std::size_t text_hash;
+        std::shared_ptr<const LoadedModule> module;
+    };
+    std::unordered_map<std::string, Entry> modules;  // by resolved path
+};
+
+namespace {
+
+// A top-level statement of the linked program: the `index`th of `module`.
+struct Slot {
+    std::shared_ptr<const LoadedModule> module;
+    std::size_t index;
+
+    const ast_cache::ModuleStatement& statement() const {
+        return module->module.statements[index];
+    }
+};
+
+// `node`, a top-level statement, with what it defines and refers to. Only
+// modules' definitions are left for reachability to decide on.
+ast_cache::ModuleStatement describe(std::shared_ptr<Node> node, bool module) {
+    ast_cache::ModuleStatement statement;
+    std::string type = node->get_type();
+    if (module && (type == NODE_ALGODEF || type == NODE_STRUCTDEF) &&
+        node->get_name().find("::") == std::string::npos) {
+        statement.definition = node->get_name();
+    }
+    std::unordered_set<std::string> names;
+    collect_references(node, names);
+    statement.references.assign(names.begin(), names.end());
+    std::sort(statement.references.begin(), statement.references.end());
+    statement.node = std::move(node);
+    return statement;
+}
+
+std::shared_ptr<LoadedModule> describe_all(const std::string& path, const NodeList& statements,
+                                           const std::vector<ImportLine>& lines, bool module) {
+    auto loaded = std::make_shared<LoadedModule>();
+    loaded->path = path;
+    loaded->module.imports = place_imports(statements, lines);
+    for (const auto& node : statements) loaded->module.statements.push_back(describe(node, module));
+    return loaded;
+}
+
+// The directory imports in the file at `path` resolve from first.
+std::filesystem::path base_dir_of(const std::string& path) {
+    namespace fs = std::filesystem;
+    fs::path current_path(path);
+    return current_path.has_parent_path() ? fs::absolute(current_path).parent_path()
+                                          : fs::current_path();
+}
+
+// A module loaded ahead of linking, or the error loading it gave.
+struct Preloaded {
+    std::shared_ptr<const LoadedModule> module;
+    std::string error;
+};
+
+using PreloadedModules = std::unordered_map<std::string, Preloaded>;
+
+// The memo of the file at `path`, or nullptr when parsing without one.
+MemoFile* memo_file(ImportState& state, const std::string& path) {
+    if (state.memo == nullptr) return nullptr;
+    std::shared_ptr<MemoFile>& file = state.memo->files[path];
+    if (file.get() == nullptr) file = std::make_shared<MemoFile>();
+    return file.get();
+}
+
+// Loads the module at `path`, whose source is `text`, from `preparsed`, its
+// cache file or by parsing it, and then caches it. With `memo`, parses it
+// through the memo instead.
+Preloaded read_module(const std::string& path, const std::string& text, MemoFile* memo,
+                      const PreparsedModules* preparsed) {
+    Preloaded read;
+    if (memo == nullptr && preparsed != nullptr) {
+        auto found = preparsed->modules.find(path);
+        if (found != preparsed->modules.end() &&
+            found->second.text_hash == std::hash<std::string>()(text)) {
+            read.module = found->second.module;
+            return read;
+        }
+    }
+    auto loaded = std::make_shared<LoadedModule>();
+    if (memo == nullptr && ast_cache::load(path, text, loaded->module)) {
+        loaded->path = path;
+        read.module = std::move(loaded);
+        return read;
+    }
+    std::vector<ImportLine> lines;
+    NodeList statements;
+    std::string stripped = strip_imports(text, lines);
+    if (memo != nullptr ? !parse_memo(path, stripped, true, *memo, statements, read.error)
+                        : !parse_source(path, stripped, true, statements, read.error)) {
+        return read;
+    }
+    loaded = describe_all(path, statements, lines, true);
+    if (memo == nullptr) ast_cache::store(path, text, loaded->module);
+    read.module = std::move(loaded);
+    return read;
+}
+
+// Finds every module `program` imports, directly or through other modules,
+// that `state` has not loaded, and loads them all at once on the scheduler's
+// threads. Only reading the files and resolving their imports is sequential.
+// Linking then takes the modules in import order, reporting errors, cycles
+// and unresolved imports where the loader meets them, so the program is
+// linked the same way whatever order the modules finished in.
+PreloadedModules preload_imports(const LoadedModule& program, ImportState& state) {
+    std::vector<std::string> paths, texts;
+    PreloadedModules preloaded;
+    std::unordered_set<std::string> seen(state.loaded.begin(), state.loaded.end());
+    auto discover = [&](const std::string& target, const std::filesystem::path& base_dir) {
+        std::filesystem::path import_path;
+        if (!resolve_import(target, base_dir, import_path)) return;
+        std::string key = import_path.string();
+        if (!seen.insert(key).second) return;
+        std::string text;
+        if (!read_file(key, text)) {
+            preloaded[key].error = "Import ERROR: cannot read " + key + "\n";
+            return;
+        }
+        paths.push_back(key);
+        texts.push_back(std::move(text));
+    };
+
+    for (const auto& import : program.module.imports) discover(import.target, base_dir_of(program.path));
+    for (std::size_t next = 0; next < paths.size(); ++next) {
+        std::vector<ImportLine> lines;
+        strip_imports(texts[next], lines);
+        std::filesystem::path base_dir = base_dir_of(paths[next]);
+        for (const auto& line : lines) discover(line.target, base_dir);
+    }
+
+    std::vector<Preloaded> read(paths.size());
+    std::vector<MemoFile*> memos;
+    for (const auto& path : paths) memos.push_back(memo_file(state, path));
+    sched::parallel_for(paths.size(), [&](std::size_t i) {
+        read[i] = read_module(paths[i], texts[i], memos[i], state.preparsed);
+    });
+    for (std::size_t i = 0; i < paths.size(); ++i) preloaded[paths[i]] = std::move(read[i]);
+    return preloaded;
+}
+
+bool load_module(const std::string& path, ImportState& state, const PreloadedModules& preloaded,
+                 std::vector<Slot>& slots, std::string& error);
+
+// Appends the statements of `loaded` to `slots`, with the modules it
+// imports spliced in.
+bool link_module(const std::shared_ptr<const LoadedModule>& loaded, ImportState& state,
+                 const PreloadedModules& preloaded, std::vector<Slot>& slots,
+                 std::string& error) {
+    std::filesystem::path base_dir = base_dir_of(loaded->path);
+    const ast_cache::Module& module = loaded->module;
+    std::size_t next = 0;
+    for (const auto& import : module.imports) {
+        for (; next < import.index && next < module.statements.size(); ++next) {
+            slots.push_back(Slot{loaded, next});
+        }
+
+        std::filesystem::path import_path;
+        if (!resolve_import(import.target, base_dir, import_path)) {
+            error = "Import ERROR: cannot resolve \"" + import.target + "\" from " +
+                    base_dir.string() + "\n";
+            return false;
+        }
+
+        std::string import_key = import_path.string();
+        if (state.loaded.count(import_key)) {
+            continue;
+        }
+        if (state.loading.count(import_key)) {
+            error = "Import ERROR: circular import involving " + import_key + "\n";
+            return false;
+        }
+
+        state.loading.insert(import_key);
+        if (!load_module(import_key, state, preloaded, slots, error)) {
+            return false;
+        }
+        state.loading.erase(import_key);
+        state.loaded.insert(import_key);
+    }
+    for (; next < module.statements.size(); ++next) slots.push_back(Slot{loaded, next});
+    return true;
+}
+
+bool load_module(const std::string& path, ImportState& state, const PreloadedModules& preloaded,
+                 std::vector<Slot>& slots, std::string& error) {
+    Preloaded read;
+    auto found = preloaded.find(path);
+    if (found != preloaded.end()) {
+        read = found->second;
+    } else {
+        std::string text;
+        if (!read_file(path, text)) {
+            error = "Import ERROR: cannot read " + path + "\n";
+            return false;
+        }
+        read = read_module(path, text, memo_file(state, path), state.preparsed);
+    }
+    if (read.module.get() == nullptr) {
+        error = read.error;
+        return false;
+    }
+    return link_module(read.module, state, preloaded, slots, error);
+}
+
+std::shared_ptr<Node> read_slot(const LoadedModule& loaded, std::size_t index) {
+    const ast_cache::ModuleStatement& statement = loaded.module.statements[index];
+    if (statement.node.get() != nullptr) return statement.node;
+    return ast_cache::read_statement(*loaded.module.image, statement);
+}
+
+// Fills `statements` with the linked statements the program can reach, and
+// `deferred` with the module definitions it cannot.
+bool keep_reachable(const std::vector<Slot>& slots, NodeList& statements, std::string& error,
+                    std::vector<DeferredDefinition>* deferred) {
+    std::unordered_map<std::string, std::vector<std::size_t>> definitions;
+    std::vector<bool> kept(slots.size(), false);
+    std::vector<const std::string*> pending;
+    auto keep = [&](std::size_t i) {
+        kept[i] = true;
+        for (const auto& name : slots[i].statement().references) pending.push_back(&name);
+    };
+    for (std::size_t i = 0; i < slots.size(); ++i) {
+        const std::string& definition = slots[i].statement().definition;
+        if (definition.empty()) {
+            keep(i);
+        } else {
+            definitions[definition].push_back(i);
+        }
+    }
+    while (!pending.empty()) {
+        const std::string& name = *pending.back();
+        pending.pop_back();
+        auto found = definitions.find(name);
+        if (found == definitions.end()) continue;
+        std::vector<std::size_t> defining = std::move(found->second);
+        definitions.erase(found);
+        for (std::size_t i : defining) keep(i);
+    }
+
+    statements.clear();
+    for (std::size_t i = 0; i < slots.size(); ++i) {
+        const Slot& slot = slots[i];
+        if (kept[i]) {
+            std::shared_ptr<Node> node = read_slot(*slot.module, slot.index);
+            if (node.get() == nullptr) {
+                error = "Import ERROR: cannot read the cache of " + slot.module->path + "\n";
+                return false;
+            }
+            statements.push_back(std::move(node));
+        } else if (deferred != nullptr) {
+            std::shared_ptr<const LoadedModule> module = slot.module;
+            std::size_t index = slot.index;
+            deferred->push_back(DeferredDefinition{
+                slot.statement().definition, [module, index] { return read_slot(*module, index); }});
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+bool parse_with_imports(const std::string& file_name, const std::string& text,
+                        ImportState& state, NodeList& statements, std::string& error,
+                        std::vector<DeferredDefinition>* deferred) {
+    if (state.memo != nullptr) {
+        for (auto& [path, file] : state.memo->files) {
+            file->parsed = false;
+            for (auto& piece : file->pieces) piece.fresh = false;
+        }
+    }
+    std::vector<ImportLine> lines;
+    NodeList parsed;
+    std::string stripped = strip_imports(text, lines);
+    MemoFile* memo = memo_file(state, file_name);
+    if (memo != nullptr ? !parse_memo(file_name, stripped, false, *memo, parsed, error)
+                        : !parse_source(file_name, stripped, false, parsed, error)) {
+        return false;
+    }
+    if (lines.empty()) {
+        statements = std::move(parsed);
+    } else {
+        std::shared_ptr<const LoadedModule> program =
+            describe_all(file_name, parsed, lines, false);
+        std::vector<Slot> slots;
+        if (!link_module(program, state, preload_imports(*program, state), slots, error) ||
+            !keep_reachable(slots, statements, error, deferred)) {
+            return false;
+        }
+    }
+    if (state.memo != nullptr) settle_memo(*state.memo);
+    return true;
+}
+
+std::shared_ptr<const PreparsedModules> preparse_modules(const std::vector<std::string>& paths) {
+    std::vector<std::string> keys, texts;
+    for (const auto& path : paths) {
+        std::filesystem::path resolved;
+        std::string text;
+        if (!resolve_import(path, std::filesystem::current_path(), resolved) ||
+            !read_file(resolved, text)) {
+            continue;
+        }
+        keys.push_back(resolved.string());
+        texts.push_back(std::move(text));
+    }
+    std::vector<Preloaded> read(keys.size());
+    sched::parallel_for(keys.size(), [&](std::size_t i) {
+        read[i] = read_module(keys[i], texts[i], nullptr, nullptr);
+    });
+    auto preparsed = std::make_shared<PreparsedModules>();
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        if (read[i].module.get() == nullptr) continue;
+        preparsed->modules[keys[i]] =
+            PreparsedModules::Entry{std::hash<std::string>()(texts[i]), std::move(read[i].module)};
+    }
+    return preparsed;
+}
@@ -1,22 +1,81 @@
 /// --------------------
-/// Import expansion
+/// Imports
 /// --------------------
 
 #ifndef IMPORTS_H
 #define IMPORTS_H
 
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
+#include "node.h"
+
+struct ParseMemo;
+struct PreparsedModules;
 
 struct ImportState {
     std::set<std::string> loaded;
     std::set<std::string> loading;
+    ParseMemo* memo{nullptr};  // trees to reuse from earlier parses, if any
+    const PreparsedModules* preparsed{nullptr};  // modules parsed ahead, if any
+};
+
+// Parses the modules at `paths` concurrently on the scheduler's threads, as
+// importing them would, ahead of the programs that import them: `pseudo
+// --serve` does so before it forks a child per request (server.h). An import
+// of one of them whose file still has the same text then takes its trees as
+// they are instead of reading the module cache or parsing again, unless it
+// is parsed with a memo. The trees are not copied, so one set must not be
+// used by Engines that run at the same time. Modules that cannot be read or
+// parsed are left out.
+std::shared_ptr<const PreparsedModules> preparse_modules(const std::vector<std::string>& paths);
+
+// The program and modules as last parsed, for parsing them again after an
+// edit (`pseudo --watch`, watch.h). With a memo in ImportState, each file is
+// cut before its top-level Algorithm and Struct lines and only the pieces
+// whose text changed are lexed and parsed; the others keep their trees,
+// moved to their new place in the file, and with them the compiled code and
+// memoized results the interpreter keyed on their nodes. Pieces that name a
+// definition or global assignment that changed, directly or through other
+// pieces, keep their trees but lose those caches. Modules parsed with a memo
+// skip the module cache (astcache.h).
+struct MemoFile;
+
+struct ParseMemo {
+    std::map<std::string, std::shared_ptr<MemoFile>> files;  // by path
+    // Pieces of the last successful parse: lexed and parsed, kept with their
+    // caches, and kept with their caches cleared.
+    std::size_t reparsed{0}, kept{0}, invalidated{0};
+};
+
+// A top-level Algorithm or Struct of an imported module that nothing in the
+// program refers to. `read` builds its tree, from the module's cache file
+// when it was loaded from one.
+struct DeferredDefinition {
+    std::string name;
+    std::function<std::shared_ptr<Node>()> read;
 };
 
-// Recursively replaces `import` lines in `text` with the imported file
-// contents. Returns false and fills `error` on unresolved, unreadable, or
-// circular imports.
-bool expand_imports(const std::string& file_name, const std::string& text, ImportState& state,
-                    std::string& expanded, std::string& error);
+// Parses `text`, the source of `file_name`, into `statements`. Every
+// imported file is a module: it is parsed on its own, with positions in its
+// own file, through the cache in astcache.h, and its statements take the
+// place of the `import` line. A module is loaded once per `state`. The
+// modules are loaded concurrently on the scheduler's threads, and large
+// files are parsed in pieces split at top-level definitions; the result and
+// any error do not depend on the thread count. Returns
+// false with the message `run` prints in `error` on a syntax error or an
+// unresolved, unreadable or circular import.
+//
+// Only the definitions of modules the program can reach are kept: those
+// named by the program's own statements, by the modules' other statements,
+// or by kept definitions. The rest go to `deferred`, in import order, or
+// are dropped when it is nullptr.
+bool parse_with_imports(const std::string& file_name, const std::string& text,
+                        ImportState& state, NodeList& statements, std::string& error,
+                        std::vector<DeferredDefinition>* deferred = nullptr);
 
 #endif
@@ -0,0 +1,46 @@
+/// --------------------
+/// Intern
+/// --------------------
+
+#include "intern.h"
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+
+// Leaked on purpose: names are looked up during static destruction too.
+struct Interner {
+    std::mutex mutex;
+    std::deque<std::string> names;  // deque: growth never moves a name
+    std::unordered_map<std::string, SymbolId> ids;
+};
+
+Interner& interner() {
+    static Interner* shared = new Interner;
+    return *shared;
+}
+
+}  // namespace
+
+SymbolId intern_symbol(const std::string& name) {
+    Interner& table = interner();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    auto found = table.ids.find(name);
+    if (found != table.ids.end()) return found->second;
+    SymbolId id = static_cast<SymbolId>(table.names.size());
+    table.names.push_back(name);
+    table.ids.emplace(name, id);
+    return id;
+}
+
+const std::string& symbol_name(SymbolId id) {
+    Interner& table = interner();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    return table.names[id];
+}
+
+const SymbolId SYMBOL_SELF = intern_symbol("self");
+const SymbolId SYMBOL_CONSTRUCTOR = intern_symbol("constructor");
+const SymbolId SYMBOL_DESTRUCTOR = intern_symbol("destructor");
@@ -0,0 +1,27 @@
+/// --------------------
+/// Intern
+/// --------------------
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <cstdint>
+#include <string>
+
+// Identifiers are interned once, when the lexer (or a node built without
+// one) first sees them, into dense ids that stay valid for the whole
+// process. Scopes, member maps and JIT instructions key on the id, so a
+// lookup hashes one integer instead of the name.
+using SymbolId = std::uint32_t;
+
+// Same name, same id, from any thread.
+SymbolId intern_symbol(const std::string& name);
+// The reference stays valid for the life of the process.
+const std::string& symbol_name(SymbolId id);
+
+// Names the interpreter itself looks up.
+extern const SymbolId SYMBOL_SELF;
+extern const SymbolId SYMBOL_CONSTRUCTOR;
+extern const SymbolId SYMBOL_DESTRUCTOR;
+
+#endif
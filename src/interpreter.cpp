@@ -8,136 +8,178 @@
 #include <cstdint>
 #include <functional>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <optional>
 #include <stdexcept>
 #include <string>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "binop.h"
+#include "gc.h"
 #include "jit.h"
 #include "node.h"
+#include "parallel.h"
+#include "scheduler.h"
+#include "tasks.h"
 #include "token.h"
 #include "value.h"
 
 namespace {
 constexpr int JIT_HOT_THRESHOLD = 8;
 
-bool is_jit_root(const std::shared_ptr<Node>& node) {
-    if (!node) return false;
-    return node->get_type() == NODE_BINOP || node->get_type() == NODE_UNARYOP ||
-           node->get_type() == NODE_ALGOCALL;
+// Generic form of a node, picked once by its first visit.
+Quickened generic_form(Node& node) {
+    const std::string type = node.get_type();
+    if (type == NODE_VALUE) return Quickened::Value;
+    if (type == NODE_VARACCESS) return Quickened::VarAccess;
+    if (type == NODE_VARASSIGN) return Quickened::VarAssign;
+    if (type == NODE_BINOP) return Quickened::BinOp;
+    if (type == NODE_UNARYOP) return Quickened::UnaryOp;
+    if (type == NODE_IF) return Quickened::If;
+    if (type == NODE_FOR) return Quickened::For;
+    if (type == NODE_WHILE) return Quickened::While;
+    if (type == NODE_REPEAT) return Quickened::Repeat;
+    if (type == NODE_ALGODEF) return Quickened::AlgoDef;
+    if (type == NODE_STRUCTDEF) return Quickened::StructDef;
+    if (type == NODE_ALGOCALL) return Quickened::AlgoCall;
+    if (type == NODE_ARRAY) return Quickened::Array;
+    if (type == NODE_ARRACCESS) return Quickened::ArrayAccess;
+    if (type == NODE_ARRASSIGN) return Quickened::ArrayAssign;
+    if (type == NODE_MEMACCESS) return Quickened::MemberAccess;
+    if (type == NODE_RETURN) return Quickened::Return;
+    if (type == NODE_BREAK) return Quickened::Break;
+    if (type == NODE_CONTINUE) return Quickened::Continue;
+    if (type == NODE_PRECOMPUTED) return Quickened::Precomputed;
+    if (type == NODE_SPAWN) return Quickened::Spawn;
+    return Quickened::Unknown;
 }
+}  // namespace
 
-bool has_assignment_node(const std::shared_ptr<Node>& node) {
-    if (!node) return false;
-    std::string type = node->get_type();
-    if (type == NODE_VARASSIGN || type == NODE_ARRASSIGN) {
-        return true;
-    }
-    if (type == NODE_IF) {
-        IfNode* if_node = dynamic_cast<IfNode*>(node.get());
-        if (has_assignment_node(if_node->get_condition())) return true;
-        for (const auto& expr : if_node->get_expr()) {
-            if (has_assignment_node(expr)) return true;
+// Dispatches on the node's quickened form instead of its type string. The
+// first visit resolves the generic form and lets visit_bin_op,
+// visit_var_access and visit_array_access specialize the node for the
+// operands they see. Nodes are shared between threads, so nothing is
+// quickened while sched::concurrent().
+std::shared_ptr<Value> Interpreter::visit(std::shared_ptr<Node> node) {
+    if (node->has_flag(NODE_FLAG_JIT_ROOT)) {
+        if (std::optional<std::shared_ptr<Value>> jit_result = try_visit_jit(node)) {
+            return *jit_result;
         }
-        for (const auto& expr : if_node->get_else()) {
-            if (has_assignment_node(expr)) return true;
+    }
+
+    Quickened form = node->get_quickened();
+    bool first_visit = form == Quickened::Unvisited;
+    if (first_visit) {
+        form = generic_form(*node);
+        if (sched::concurrent()) {
+            first_visit = false;
+        } else {
+            node->quicken(form);
         }
-        return false;
     }
-    for (const auto& child : node->get_child()) {
-        if (has_assignment_node(child)) return true;
+
+    switch (form) {
+        case Quickened::Value:
+            return visit_number(node);
+        case Quickened::VarAccess:
+            return visit_var_access(node, first_visit);
+        case Quickened::VarAssign:
+            return visit_var_assign(node);
+        case Quickened::BinOp:
+            return visit_bin_op(node, first_visit);
+        case Quickened::UnaryOp:
+            return visit_unary_op(node);
+        case Quickened::If:
+            return visit_if(node);
+        case Quickened::For:
+            return visit_for(node);
+        case Quickened::While:
+            return visit_while(node);
+        case Quickened::Repeat:
+            return visit_repeat(node);
+        case Quickened::AlgoDef:
+            return visit_algo_def(node);
+        case Quickened::StructDef:
+            return visit_struct_def(node);
+        case Quickened::AlgoCall:
+            return visit_algo_call(node);
+        case Quickened::Array:
+            return visit_array(node);
+        case Quickened::ArrayAccess:
+            return visit_array_access(node, first_visit);
+        case Quickened::ArrayAssign:
+            return visit_array_assign(node);
+        case Quickened::MemberAccess:
+            return visit_member_access(node);
+        case Quickened::Return:
+            return visit_return(node);
+        case Quickened::Break:
+            return make_pooled<ControlValue>(VALUE_BREAK, ValueKind::Break);
+        case Quickened::Continue:
+            return make_pooled<ControlValue>(VALUE_CONTINUE, ValueKind::Continue);
+        case Quickened::Precomputed:
+            return static_cast<PrecomputedNode*>(node.get())->get_value();
+        case Quickened::Spawn:
+            return visit_spawn(node);
+        case Quickened::IntBinOp:
+            return visit_int_bin_op(node);
+        case Quickened::LocalLoad:
+            return visit_local_load(node);
+        case Quickened::ArrayLoad:
+            return visit_array_load(node);
+        case Quickened::Unvisited:
+        case Quickened::Unknown:
+            break;
     }
-    return false;
+    return make_pooled<ErrorValue>(VALUE_ERROR, "Fail to get result\n");
 }
+
+namespace {
+
+thread_local ExecutionCaches* lent_caches = nullptr;
+
 }  // namespace
 
-std::shared_ptr<Value> Interpreter::visit(std::shared_ptr<Node> node) {
-    if (std::optional<std::shared_ptr<Value>> jit_result = try_visit_jit(node)) {
-        return *jit_result;
-    }
+ExecutionCaches& execution_caches() {
+    if (lent_caches != nullptr) return *lent_caches;
+    thread_local ExecutionCaches own;
+    return own;
+}
 
-    if (node->get_type() == NODE_VALUE) {
-        return visit_number(node);
-    }
-    if (node->get_type() == NODE_VARACCESS) {
-        return visit_var_access(node);
-    }
-    if (node->get_type() == NODE_VARASSIGN) {
-        return visit_var_assign(node);
-    }
-    if (node->get_type() == NODE_BINOP) {
-        return visit_bin_op(node);
-    }
-    if (node->get_type() == NODE_UNARYOP) {
-        return visit_unary_op(node);
-    }
-    if (node->get_type() == NODE_IF) {
-        return visit_if(node);
-    }
-    if (node->get_type() == NODE_FOR) {
-        return visit_for(node);
-    }
-    if (node->get_type() == NODE_WHILE) {
-        return visit_while(node);
-    }
-    if (node->get_type() == NODE_REPEAT) {
-        return visit_repeat(node);
-    }
-    if (node->get_type() == NODE_ALGODEF) {
-        return visit_algo_def(node);
-    }
-    if (node->get_type() == NODE_STRUCTDEF) {
-        return visit_struct_def(node);
-    }
-    if (node->get_type() == NODE_ALGOCALL) {
-        return visit_algo_call(node);
-    }
-    if (node->get_type() == NODE_ARRAY) {
-        return visit_array(node);
-    }
-    if (node->get_type() == NODE_ARRACCESS) {
-        return visit_array_access(node);
-    }
-    if (node->get_type() == NODE_ARRASSIGN) {
-        return visit_array_assign(node);
-    }
-    if (node->get_type() == NODE_MEMACCESS) {
-        return visit_member_access(node);
-    }
-    if (node->get_type() == NODE_RETURN) {
-        return visit_return(node);
-    }
-    if (node->get_type() == NODE_BREAK) {
-        return std::make_shared<ControlValue>(VALUE_BREAK);
-    }
-    if (node->get_type() == NODE_CONTINUE) {
-        return std::make_shared<ControlValue>(VALUE_CONTINUE);
-    }
-    if (node->get_type() == NODE_PRECOMPUTED) {
-        return dynamic_cast<PrecomputedNode*>(node.get())->get_value();
-    }
-    return std::make_shared<ErrorValue>(VALUE_ERROR, "Fail to get result\n");
+ExecutionCaches* use_execution_caches(ExecutionCaches* caches) {
+    std::swap(lent_caches, caches);
+    return caches;
 }
 
 std::optional<std::shared_ptr<Value>> Interpreter::try_visit_jit(
     const std::shared_ptr<Node>& node) {
-    static std::unordered_map<std::size_t, JitCacheEntry> jit_cache;
-
-    if (!is_jit_root(node)) {
-        return std::nullopt;
-    }
-
-    JitCacheEntry& entry = jit_cache[node->get_id()];
-    if (entry.disabled) {
-        return std::nullopt;
+    JitCacheEntry& entry = execution_caches().jit[*node];
+    if (entry.program) {
+        ++entry.runs;
+        std::optional<std::shared_ptr<Value>> result = entry.program->execute(symbol_table);
+        if (!result && ++entry.bailouts >= JIT_HOT_THRESHOLD && entry.bailouts * 2 > entry.runs) {
+            // Mostly operands the program does not handle: interpreting
+            // straight away is cheaper than trying it first every time.
+            entry.program.reset();
+            disable_jit(node, entry, JitOutcome::Bails);
+        }
+        return result;
     }
+    if (entry.disabled) return std::nullopt;
 
-    if (entry.program) {
-        return entry.program->execute(symbol_table);
+    if (entry.hits == 0 && profile::active()) {
+        switch (profile::lookup(*node)) {
+            case JitOutcome::Compiled:
+                entry.hits = JIT_HOT_THRESHOLD - 1;
+                break;
+            case JitOutcome::Uncompilable:
+            case JitOutcome::Bails:
+                disable_jit(node, entry, JitOutcome::Unknown);
+                return std::nullopt;
+            default:
+                break;
+        }
     }
 
     ++entry.hits;
@@ -147,40 +189,88 @@ std::optional<std::shared_ptr<Value>> Interpreter::try_visit_jit(
 
     entry.program = ExpressionJit::compile(node);
     if (!entry.program) {
-        entry.disabled = true;
+        disable_jit(node, entry, JitOutcome::Uncompilable);
         return std::nullopt;
     }
+    if (profile::active()) profile::record(*node, JitOutcome::Compiled);
+
+    return try_visit_jit(node);
+}
 
-    return entry.program->execute(symbol_table);
+// Stops trying to compile `node`, recording why when a profile is kept.
+// Under the scheduler the node's flag stays, as other tasks may be reading it.
+void Interpreter::disable_jit(const std::shared_ptr<Node>& node, JitCacheEntry& entry,
+                              JitOutcome outcome) {
+    entry.disabled = true;
+    if (!sched::concurrent()) node->set_flag(NODE_FLAG_JIT_ROOT, false);
+    if (outcome != JitOutcome::Unknown && profile::active()) profile::record(*node, outcome);
 }
 
 std::shared_ptr<Value> Interpreter::visit_number(std::shared_ptr<Node> node) {
     if (node->get_tok()->get_type() == TOKEN_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT,
-                                                     std::stoll(node->get_tok()->get_value()));
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT,
+                                                std::stoll(node->get_tok()->get_value()));
     else if (node->get_tok()->get_type() == TOKEN_FLOAT)
-        return std::make_shared<TypedValue<double>>(VALUE_FLOAT,
-                                                    std::stod(node->get_tok()->get_value()));
+        return make_pooled<TypedValue<double>>(VALUE_FLOAT,
+                                               std::stod(node->get_tok()->get_value()));
     else if (node->get_tok()->get_type() == TOKEN_STRING)
-        return std::make_shared<TypedValue<std::string>>(VALUE_STRING,
-                                                         node->get_tok()->get_value());
+        return make_pooled<TypedValue<std::string>>(VALUE_STRING, node->get_tok()->get_value());
     else
-        return std::make_shared<ErrorValue>(VALUE_ERROR, "Not a value type\n");
+        return make_pooled<ErrorValue>(VALUE_ERROR, "Not a value type\n");
+}
+
+std::shared_ptr<Value> Interpreter::visit_var_access(std::shared_ptr<Node> node,
+                                                     bool specialize) {
+    VarAccessNode& var_node = *static_cast<VarAccessNode*>(node.get());
+    if (specialize && var_node.get_scope() == VarScope::Local) {
+        if (std::shared_ptr<Value>* slot = symbol_table.find_local_slot(var_node.get_symbol())) {
+            var_node.get_slot_cache() = LocalSlotCache{symbol_table.serial(), slot};
+            node->quicken(Quickened::LocalLoad);
+            return *slot;
+        }
+    }
+    return lookup(var_node);
 }
 
-std::shared_ptr<Value> Interpreter::visit_var_access(std::shared_ptr<Node> node) {
-    std::string var_name = node->get_name();
-    return symbol_table.get(var_name);
+// Reads the slot the name had in this scope the last time around. A scope
+// without the name locally sends the node back to a full lookup for good.
+std::shared_ptr<Value> Interpreter::visit_local_load(const std::shared_ptr<Node>& node) {
+    VarAccessNode& var_node = *static_cast<VarAccessNode*>(node.get());
+    LocalSlotCache& cache = var_node.get_slot_cache();
+    if (cache.table_serial == symbol_table.serial()) return *cache.slot;
+    if (sched::concurrent()) return lookup(var_node);
+    if (std::shared_ptr<Value>* slot = symbol_table.find_local_slot(var_node.get_symbol())) {
+        cache = LocalSlotCache{symbol_table.serial(), slot};
+        return *slot;
+    }
+    node->quicken(Quickened::VarAccess);
+    return lookup(var_node);
+}
+
+// Builtin names cannot be rebound, so they skip the scope chain. Names the
+// resolver found unbound in their Algorithm go straight to the global table
+// when Algorithms are lexically scoped.
+std::shared_ptr<Value> Interpreter::lookup(VarAccessNode& node) {
+    SymbolId var_symbol = node.get_symbol();
+    if (node.get_scope() == VarScope::Builtin) {
+        if (std::shared_ptr<Value> builtin = builtin_algo(var_symbol)) return builtin;
+    } else if (node.get_scope() == VarScope::Global && symbol_table.uses_lexical_scoping()) {
+        return symbol_table.get_global()->get(var_symbol);
+    }
+    return symbol_table.get(var_symbol);
 }
 
 std::shared_ptr<Value> Interpreter::visit_var_assign(std::shared_ptr<Node> node) {
     NodeList child = node->get_child();
-    std::string var_name = node->get_name();
+    SymbolId var_symbol = node->get_symbol();
     if (child[0]->get_type() == NODE_BINOP && child[0]->get_tok()->get_type() == TOKEN_ADD) {
         NodeList add_child = child[0]->get_child();
-        if (add_child[0]->get_type() == NODE_VARACCESS && add_child[0]->get_name() == var_name) {
-            std::shared_ptr<Value> current = symbol_table.get(var_name);
-            if (current->get_type() == VALUE_STRING && current.use_count() <= 2) {
+        if (add_child[0]->get_type() == NODE_VARACCESS &&
+            add_child[0]->get_symbol() == var_symbol) {
+            std::shared_ptr<Value> current = symbol_table.get(var_symbol);
+            // Another thread may be reading a string bound in an outer scope.
+            if (current->get_type() == VALUE_STRING && current.use_count() <= 2 &&
+                (!sched::concurrent() || symbol_table.contains_local(var_symbol))) {
                 std::shared_ptr<Value> suffix = visit(add_child[1]);
                 if (suffix->get_type() == VALUE_ERROR) {
                     return suffix;
@@ -194,30 +284,59 @@ std::shared_ptr<Value> Interpreter::visit_var_assign(std::shared_ptr<Node> node)
     }
     std::shared_ptr<Value> value = visit(child[0]);
     if (value->get_type() == VALUE_ERROR) return value;
-    symbol_table.set(var_name, value);
-    return symbol_table.get(var_name);
+    symbol_table.set(var_symbol, value);
+    return symbol_table.get(var_symbol);
 }
 
-std::shared_ptr<Value> Interpreter::visit_bin_op(std::shared_ptr<Node> node) {
-    NodeList child = node->get_child();
+std::shared_ptr<Value> Interpreter::visit_bin_op(std::shared_ptr<Node> node, bool specialize) {
+    BinOpNode* bin_op_node = static_cast<BinOpNode*>(node.get());
+    BinaryOp op = bin_op_node->get_op();
     std::shared_ptr<Value> a, b;
-    a = visit(child[0]);
-    if (a->get_type() == VALUE_ERROR) return a;
-    if (node->get_tok()->get_type() == TOKEN_KEYWORD && node->get_tok()->get_value() == "and") {
-        if (a->as_int() == 0) return std::make_shared<TypedValue<int64_t>>(VALUE_INT, 0);
-        b = visit(child[1]);
-        if (b->get_type() == VALUE_ERROR) return b;
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, b->as_int() != 0);
+    a = visit(bin_op_node->get_left());
+    if (a->get_kind() == ValueKind::Error) return a;
+    if (op == BINARY_AND) {
+        if (a->as_int() == 0) return make_pooled<TypedValue<int64_t>>(VALUE_INT, 0);
+        b = visit(bin_op_node->get_right());
+        if (b->get_kind() == ValueKind::Error) return b;
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, b->as_int() != 0);
+    }
+    if (op == BINARY_OR) {
+        if (a->as_int() != 0) return make_pooled<TypedValue<int64_t>>(VALUE_INT, 1);
+        b = visit(bin_op_node->get_right());
+        if (b->get_kind() == ValueKind::Error) return b;
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, b->as_int() != 0);
+    }
+    b = visit(bin_op_node->get_right());
+    if (b->get_kind() == ValueKind::Error) return b;
+    if (op == BINARY_COUNT) return make_pooled<ErrorValue>(VALUE_ERROR, "Not a binary op\n");
+    if (specialize && a->get_kind() == ValueKind::Int && b->get_kind() == ValueKind::Int) {
+        node->quicken(Quickened::IntBinOp);
     }
-    if (node->get_tok()->get_type() == TOKEN_KEYWORD && node->get_tok()->get_value() == "or") {
-        if (a->as_int() != 0) return std::make_shared<TypedValue<int64_t>>(VALUE_INT, 1);
-        b = visit(child[1]);
-        if (b->get_type() == VALUE_ERROR) return b;
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, b->as_int() != 0);
+    return apply_binary(op, a, b);
+}
+
+// Arithmetic or comparison on operands that have been Int so far. `and` and
+// `or` short-circuit and never get here.
+std::shared_ptr<Value> Interpreter::visit_int_bin_op(const std::shared_ptr<Node>& node) {
+    BinOpNode* bin_op_node = static_cast<BinOpNode*>(node.get());
+    BinaryOp op = bin_op_node->get_op();
+    std::shared_ptr<Value> a = visit(bin_op_node->get_left());
+    if (a->get_kind() == ValueKind::Error) return a;
+    std::shared_ptr<Value> b = visit(bin_op_node->get_right());
+    if (b->get_kind() == ValueKind::Error) return b;
+    if (a->get_kind() != ValueKind::Int || b->get_kind() != ValueKind::Int) {
+        if (!sched::concurrent()) node->quicken(Quickened::BinOp);
+        return apply_binary(op, a, b);
     }
-    b = visit(child[1]);
-    if (b->get_type() == VALUE_ERROR) return b;
-    return bin_op(a, b, node->get_tok());
+    Number out;
+    if (numeric_kernel(op, false, false)(
+            Number::from_int(static_cast<const TypedValue<int64_t>&>(*a).raw()),
+            Number::from_int(static_cast<const TypedValue<int64_t>&>(*b).raw()),
+            out) != NumericStatus::Ok) {
+        // Division by zero and 0 ^ 0 build their errors in the general operators.
+        return apply_binary(op, a, b);
+    }
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, out.int_value);
 }
 
 std::shared_ptr<Value> Interpreter::visit_unary_op(std::shared_ptr<Node> node) {
@@ -233,20 +352,44 @@ std::shared_ptr<Value> Interpreter::visit_array(std::shared_ptr<Node> node) {
     for (int i{0}; i < child.size(); ++i) {
         array_value.push_back(visit(child[i]));
     }
-    return std::make_shared<ArrayValue>(array_value);
+    return make_pooled<ArrayValue>(array_value);
 }
 
-std::shared_ptr<Value>& Interpreter::visit_array_access(std::shared_ptr<Node> node) {
-    NodeList child{node->get_child()};
-    std::shared_ptr<Value> arr{visit(child[0])}, index{visit(child[1])};
+std::shared_ptr<Value>& Interpreter::visit_array_access(std::shared_ptr<Node> node,
+                                                        bool specialize) {
+    ArrayAccessNode* access_node = static_cast<ArrayAccessNode*>(node.get());
+    std::shared_ptr<Value> arr{visit(access_node->get_array())};
+    std::shared_ptr<Value> index{visit(access_node->get_index())};
+    if (specialize && arr->get_kind() == ValueKind::Array && index->get_kind() == ValueKind::Int) {
+        node->quicken(Quickened::ArrayLoad);
+    }
+    return element_of(arr, index);
+}
+
+// Indexing an Array with an Int, as seen on the node's first visit.
+std::shared_ptr<Value> Interpreter::visit_array_load(const std::shared_ptr<Node>& node) {
+    ArrayAccessNode* access_node = static_cast<ArrayAccessNode*>(node.get());
+    std::shared_ptr<Value> arr{visit(access_node->get_array())};
+    std::shared_ptr<Value> index{visit(access_node->get_index())};
+    if (arr->get_kind() != ValueKind::Array || index->get_kind() != ValueKind::Int) {
+        if (!sched::concurrent()) node->quicken(Quickened::ArrayAccess);
+        return element_of(arr, index);
+    }
+    algo_call_temp = arr;
+    return static_cast<ArrayValue&>(*arr)[static_cast<int>(
+        static_cast<const TypedValue<int64_t>&>(*index).raw())];
+}
+
+std::shared_ptr<Value>& Interpreter::element_of(const std::shared_ptr<Value>& arr,
+                                                const std::shared_ptr<Value>& index) {
     if (arr->get_type() == VALUE_STRING) {
         std::string str = arr->as_string();
         int p = index->as_int();
         if (1 <= p && p <= static_cast<int>(str.size())) {
             error =
-                std::make_shared<TypedValue<std::string>>(VALUE_STRING, std::string(1, str[p - 1]));
+                make_pooled<TypedValue<std::string>>(VALUE_STRING, std::string(1, str[p - 1]));
         } else {
-            error = std::make_shared<ErrorValue>(
+            error = make_pooled<ErrorValue>(
                 VALUE_ERROR, "Index out of range, size: " + std::to_string(str.size()) +
                                  ", position: " + std::to_string(p));
         }
@@ -258,7 +401,7 @@ std::shared_ptr<Value>& Interpreter::visit_array_access(std::shared_ptr<Node> no
         return error;
     }
     if (arr->get_type() != VALUE_ARRAY) {
-        error = std::make_shared<ErrorValue>(
+        error = make_pooled<ErrorValue>(
             VALUE_ERROR, "Access can only apply on array, find " + arr->get_type() + "\n");
         return error;
     }
@@ -279,20 +422,30 @@ std::shared_ptr<Value> Interpreter::visit_array_assign(std::shared_ptr<Node> nod
         std::shared_ptr<Value> obj = visit(obj_node);
         if (obj->get_type() == VALUE_INSTANCE) {
             InstanceValue* inst = dynamic_cast<InstanceValue*>(obj.get());
+            if (std::shared_ptr<Value> error = inst->check_change()) return error;
             std::shared_ptr<Value> val = visit(child[1]);
             if (val->get_type() == VALUE_ERROR) return val;
-            inst->set_member(member_node->get_name(), val);
+            inst->set_member(member_node->get_symbol(), val);
             return val;
         } else {
-            return std::make_shared<ErrorValue>(
+            return make_pooled<ErrorValue>(
                 VALUE_ERROR, "Assignment to member only supported for Struct Instances\n");
         }
     } else if (child[0]->get_type() != NODE_ARRACCESS) {
-        return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                            "Access can only apply on array or object member\n");
+        return make_pooled<ErrorValue>(VALUE_ERROR,
+                                       "Access can only apply on array or object member\n");
     }
     NodeList access_child{child[0]->get_child()};
     std::shared_ptr<Value> obj{visit(access_child[0])};
+    if (obj->get_kind() == ValueKind::Array) {
+        if (std::shared_ptr<Value> error = static_cast<ArrayValue*>(obj.get())->check_store()) {
+            return error;
+        }
+    } else if (obj->get_kind() == ValueKind::HashTable) {
+        if (std::shared_ptr<Value> error = static_cast<HashTableValue*>(obj.get())->check_change()) {
+            return error;
+        }
+    }
     if (obj->get_type() == VALUE_HASH_TABLE) {
         std::shared_ptr<Value> key{visit(access_child[1])};
         if (key->get_type() == VALUE_ERROR) return key;
@@ -305,21 +458,22 @@ std::shared_ptr<Value> Interpreter::visit_array_assign(std::shared_ptr<Node> nod
 }
 
 std::shared_ptr<Value> Interpreter::visit_member_access(std::shared_ptr<Node> node) {
-    NodeList child{node->get_child()};
-    std::shared_ptr<Value> obj{visit(child[0])};
-    std::shared_ptr<Node>& member{child[1]};
+    MemberAccessNode* member_node = static_cast<MemberAccessNode*>(node.get());
+    return member_of(visit(member_node->get_obj()), *member_node);
+}
 
+std::shared_ptr<Value> Interpreter::member_of(const std::shared_ptr<Value>& obj,
+                                              const MemberAccessNode& node) {
+    const std::string& member_name = node.get_member_name();
     if (obj->get_type() == VALUE_ARRAY || obj->get_type() == VALUE_STRING ||
         obj->get_type() == VALUE_HASH_TABLE) {
-        std::string member_name = member->get_name();
-        return std::make_shared<BoundMethodValue>(obj, member_name);
+        return make_pooled<BoundMethodValue>(obj, node.get_member_symbol());
     } else if (obj->get_type() == VALUE_INSTANCE) {
-        std::string member_name = member->get_name();
         InstanceValue* inst = dynamic_cast<InstanceValue*>(obj.get());
-        return inst->get_member(member_name, obj);
+        return inst->get_member(node.get_member_symbol(), obj);
     }
-    error = std::make_shared<ErrorValue>(
-        VALUE_ERROR, obj->get_num() + " has no member " + member->get_name() + "\n");
+    error = make_pooled<ErrorValue>(VALUE_ERROR,
+                                    obj->get_num() + " has no member " + member_name + "\n");
     return error;
 }
 
@@ -348,11 +502,14 @@ std::shared_ptr<Value> Interpreter::visit_if(std::shared_ptr<Node> node) {
         }
         return ret;
     }
-    return std::make_shared<TypedValue<int64_t>>(VALUE_INT, 0);
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, 0);
 }
 
 std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
+    if (static_cast<ForNode*>(node.get())->is_parallel()) return visit_parallel_for(node);
     NodeList child = node->get_child();
+    SymbolId loop_symbol = child[0]->get_symbol();
+    bool collect = collect_loop_results && node->has_flag(NODE_FLAG_RESULT_USED);
     std::shared_ptr<Value> i = visit(child[0]);
     if (i->get_type() == VALUE_ERROR) return i;
     std::shared_ptr<Value> step;
@@ -360,7 +517,7 @@ std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
         step = visit(child[2]);
         if (step->get_type() == VALUE_ERROR) return step;
     } else {
-        step = std::make_shared<TypedValue<int64_t>>(VALUE_INT, 1);
+        step = make_pooled<TypedValue<int64_t>>(VALUE_INT, 1);
     }
     std::shared_ptr<Value> end_value = visit(child[1]);
     if (end_value->get_type() == VALUE_ERROR) return end_value;
@@ -378,29 +535,31 @@ std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
             return i->as_int() >= end->as_int();
         };
     } else {
-        return std::make_shared<ErrorValue>(VALUE_ERROR, "Infinite for loop\n");
+        return make_pooled<ErrorValue>(VALUE_ERROR, "Infinite for loop\n");
     }
 
-    std::string fast_assign_name;
+    SymbolId fast_assign_symbol{};
     std::optional<JitProgram> fast_assign_program;
-    std::string fast_array_name;
     std::optional<JitProgram> fast_array_index_program;
     std::optional<JitProgram> fast_array_value_program;
     ArrayValue* fast_array = nullptr;
-    std::string fast_call_assign_name;
-    std::vector<std::string> fast_call_arg_names;
+    SymbolId fast_call_assign_symbol{};
+    std::vector<SymbolId> fast_call_arg_symbols;
     std::vector<JitProgram> fast_call_arg_programs;
     std::optional<JitProgram> fast_call_body_program;
-    if (!collect_loop_results && child.size() == 4) {
+    if (!collect && child.size() == 4) {
         if (child[3]->get_type() == NODE_VARASSIGN) {
             NodeList assign_child = child[3]->get_child();
-            fast_assign_name = child[3]->get_name();
+            fast_assign_symbol = child[3]->get_symbol();
             fast_assign_program = ExpressionJit::compile(assign_child[0]);
-            if (!fast_assign_program && assign_child[0]->get_type() == NODE_ALGOCALL) {
+            // The inlined call evaluates the callee's return expression in
+            // this scope, which is only its dynamic scope.
+            if (!fast_assign_program && assign_child[0]->get_type() == NODE_ALGOCALL &&
+                !symbol_table.uses_lexical_scoping()) {
                 AlgorithmCallNode* call_node =
                     dynamic_cast<AlgorithmCallNode*>(assign_child[0].get());
                 if (call_node->get_call()->get_type() == NODE_VARACCESS) {
-                    std::shared_ptr<Value> callee = symbol_table.get(call_node->get_name());
+                    std::shared_ptr<Value> callee = symbol_table.get(call_node->get_symbol());
                     AlgoValue* algo = dynamic_cast<AlgoValue*>(callee.get());
                     if (algo) {
                         AlgorithmDefNode* algo_node =
@@ -422,8 +581,8 @@ std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
                                     fast_call_arg_programs.push_back(std::move(*arg_program));
                                 }
                                 if (args_compiled) {
-                                    fast_call_assign_name = child[3]->get_name();
-                                    fast_call_arg_names = algo->get_arg_names();
+                                    fast_call_assign_symbol = child[3]->get_symbol();
+                                    fast_call_arg_symbols = algo->get_arg_symbols();
                                 } else {
                                     fast_call_body_program.reset();
                                     fast_call_arg_programs.clear();
@@ -438,9 +597,10 @@ std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
             if (assign_child[0]->get_type() == NODE_ARRACCESS) {
                 NodeList access_child = assign_child[0]->get_child();
                 if (access_child[0]->get_type() == NODE_VARACCESS) {
-                    std::shared_ptr<Value> array = symbol_table.get(access_child[0]->get_name());
-                    if (array->get_type() == VALUE_ARRAY) {
-                        fast_array_name = access_child[0]->get_name();
+                    std::shared_ptr<Value> array = symbol_table.get(access_child[0]->get_symbol());
+                    // A frozen array takes the checked path, which reports it.
+                    if (array->get_type() == VALUE_ARRAY &&
+                        static_cast<ArrayValue*>(array.get())->check_store().get() == nullptr) {
                         fast_array = dynamic_cast<ArrayValue*>(array.get());
                         fast_array_index_program = ExpressionJit::compile(access_child[1]);
                         fast_array_value_program = ExpressionJit::compile(assign_child[1]);
@@ -464,7 +624,7 @@ std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
             } else {
                 if ((*val)->get_type() == VALUE_ERROR || (*val)->get_type() == VALUE_RETURN)
                     return *val;
-                symbol_table.set(fast_assign_name, *val);
+                symbol_table.set(fast_assign_symbol, *val);
             }
         } else if (fast_call_body_program) {
             ValueList saved_values;
@@ -478,10 +638,10 @@ std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
                     failed = true;
                     break;
                 }
-                const std::string& arg_name = fast_call_arg_names[arg_index];
-                had_saved_values.push_back(symbol_table.contains_local(arg_name));
-                saved_values.push_back(symbol_table.get_local(arg_name));
-                symbol_table.set(arg_name, *arg);
+                SymbolId arg_symbol = fast_call_arg_symbols[arg_index];
+                had_saved_values.push_back(symbol_table.contains_local(arg_symbol));
+                saved_values.push_back(symbol_table.get_local(arg_symbol));
+                symbol_table.set(arg_symbol, *arg);
             }
 
             if (!failed) {
@@ -497,16 +657,16 @@ std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
                 } else if ((*val)->get_type() == VALUE_CONTINUE) {
                     goto next_for_iteration;
                 } else {
-                    symbol_table.set(fast_call_assign_name, *val);
+                    symbol_table.set(fast_call_assign_symbol, *val);
                 }
             }
 
             for (int arg_index = static_cast<int>(had_saved_values.size()) - 1; arg_index >= 0;
                  --arg_index) {
                 if (had_saved_values[arg_index]) {
-                    symbol_table.set(fast_call_arg_names[arg_index], saved_values[arg_index]);
+                    symbol_table.set(fast_call_arg_symbols[arg_index], saved_values[arg_index]);
                 } else {
-                    symbol_table.erase(fast_call_arg_names[arg_index]);
+                    symbol_table.erase(fast_call_arg_symbols[arg_index]);
                 }
             }
 
@@ -543,7 +703,7 @@ std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
             if (val->get_type() == VALUE_ERROR || val->get_type() == VALUE_RETURN) return val;
             if (val->get_type() == VALUE_BREAK) goto end_for_loop;
             if (val->get_type() == VALUE_CONTINUE) goto next_for_iteration;
-            if (collect_loop_results) {
+            if (collect) {
                 ret.push_back(val);
             }
         } else {
@@ -555,28 +715,82 @@ std::shared_ptr<Value> Interpreter::visit_for(std::shared_ptr<Node> node) {
             }
         }
     next_for_iteration:
-        symbol_table.set(child[0]->get_name(), i + step);
-        i = symbol_table.get(child[0]->get_name());
+        gc::maybe_collect();
+        symbol_table.set(loop_symbol, apply_binary(BINARY_ADD, i, step));
+        i = symbol_table.get(loop_symbol);
     }
 end_for_loop:
-    if (!collect_loop_results) {
-        static std::shared_ptr<Value> none = std::make_shared<Value>();
+    if (!collect) {
+        static std::shared_ptr<Value> none = make_pooled<Value>();
         return none;
     }
-    if (child.size() != 4) ret.push_back(std::make_shared<Value>());
-    return std::make_shared<ArrayValue>(ret);
+    if (child.size() != 4) ret.push_back(make_pooled<Value>());
+    return make_pooled<ArrayValue>(ret);
+}
+
+// Evaluates the bounds like visit_for, then hands the iterations to
+// run_parallel_loop, each one visited by an Interpreter over its chunk's scope.
+std::shared_ptr<Value> Interpreter::visit_parallel_for(const std::shared_ptr<Node>& node) {
+    ForNode* for_node = static_cast<ForNode*>(node.get());
+    NodeList child = node->get_child();
+    SymbolId loop_symbol = child[0]->get_symbol();
+    std::shared_ptr<Value> start = visit(child[0]);
+    if (start->get_kind() == ValueKind::Error) return start;
+    std::shared_ptr<Value> step = make_pooled<TypedValue<int64_t>>(VALUE_INT, 1);
+    if (child[2] != nullptr) {
+        step = visit(child[2]);
+        if (step->get_kind() == ValueKind::Error) return step;
+    }
+    std::shared_ptr<Value> end_value = visit(child[1]);
+    if (end_value->get_kind() == ValueKind::Error) return end_value;
+    if (start->get_kind() != ValueKind::Int || step->get_kind() != ValueKind::Int ||
+        end_value->get_kind() != ValueKind::Int) {
+        return make_pooled<ErrorValue>(VALUE_ERROR,
+                                       "Parallel for loop bounds and step must be Int\n");
+    }
+    int64_t first = start->as_int(), last = end_value->as_int(), stride = step->as_int();
+    if (stride == 0) return make_pooled<ErrorValue>(VALUE_ERROR, "Infinite for loop\n");
+    int64_t count = parallel_trip_count(first, last, stride);
+
+    const NodeList& body = for_node->get_body();
+    SharedWrites writes = find_shared_writes(body, child[0]->get_name());
+    if (std::shared_ptr<Value> error = check_shared_writes(writes, symbol_table)) return error;
+    std::vector<LoopReduction> reductions;
+    for (const LoopReduction& reduction : find_loop_reductions(body)) {
+        if (reduction.symbol != loop_symbol) reductions.push_back(reduction);
+    }
+    bool collect = collect_loop_results && node->has_flag(NODE_FLAG_RESULT_USED);
+    std::shared_ptr<Value> ret = run_parallel_loop(
+        symbol_table, loop_symbol, first, stride, count, reductions, collect && body.size() == 1,
+        [&body, this](SymbolTable& scope) {
+            Interpreter worker(scope, collect_loop_results);
+            std::shared_ptr<Value> value = make_pooled<Value>();
+            for (const auto& statement : body) {
+                value = worker.visit(statement);
+                ValueKind kind = value->get_kind();
+                if (kind == ValueKind::Error || kind == ValueKind::Return ||
+                    kind == ValueKind::Break || kind == ValueKind::Continue) {
+                    break;
+                }
+            }
+            return value;
+        });
+    if (ret->get_kind() == ValueKind::Error || !collect || body.size() == 1) return ret;
+    return make_pooled<ArrayValue>(ValueList{make_pooled<Value>()});
 }
 
 std::shared_ptr<Value> Interpreter::visit_while(std::shared_ptr<Node> node) {
     NodeList child = node->get_child();
+    bool collect = collect_loop_results && node->has_flag(NODE_FLAG_RESULT_USED);
     ValueList ret;
     while (visit(child[0])->as_int() == 1) {
+        gc::maybe_collect();
         if (child.size() == 2) {
             std::shared_ptr<Value> val = visit(child[1]);
             if (val->get_type() == VALUE_ERROR || val->get_type() == VALUE_RETURN) return val;
             if (val->get_type() == VALUE_BREAK) break;
             if (val->get_type() == VALUE_CONTINUE) continue;
-            if (collect_loop_results) {
+            if (collect) {
                 ret.push_back(val);
             }
         } else {
@@ -598,23 +812,25 @@ std::shared_ptr<Value> Interpreter::visit_while(std::shared_ptr<Node> node) {
             if (should_continue) continue;
         }
     }
-    if (!collect_loop_results) {
-        static std::shared_ptr<Value> none = std::make_shared<Value>();
+    if (!collect) {
+        static std::shared_ptr<Value> none = make_pooled<Value>();
         return none;
     }
-    return std::make_shared<ArrayValue>(ret);
+    return make_pooled<ArrayValue>(ret);
 }
 
 std::shared_ptr<Value> Interpreter::visit_repeat(std::shared_ptr<Node> node) {
     NodeList child = node->get_child();
+    bool collect = collect_loop_results && node->has_flag(NODE_FLAG_RESULT_USED);
     ValueList ret;
     do {
+        gc::maybe_collect();
         if (child.size() == 2) {
             std::shared_ptr<Value> val = visit(child[1]);
             if (val->get_type() == VALUE_ERROR || val->get_type() == VALUE_RETURN) return val;
             if (val->get_type() == VALUE_BREAK) break;
             if (val->get_type() == VALUE_CONTINUE) continue;
-            if (collect_loop_results) {
+            if (collect) {
                 ret.push_back(val);
             }
         } else {
@@ -636,16 +852,20 @@ std::shared_ptr<Value> Interpreter::visit_repeat(std::shared_ptr<Node> node) {
             if (should_continue) continue;
         }
     } while (visit(child[0])->as_int() == 0);
-    if (!collect_loop_results) {
-        static std::shared_ptr<Value> none = std::make_shared<Value>();
+    if (!collect) {
+        static std::shared_ptr<Value> none = make_pooled<Value>();
         return none;
     }
-    return std::make_shared<ArrayValue>(ret);
+    return make_pooled<ArrayValue>(ret);
 }
 
 std::shared_ptr<Value> Interpreter::visit_algo_def(std::shared_ptr<Node> node) {
     std::string algo_name = node->get_name();
-    std::shared_ptr<Value> value = std::make_shared<AlgoValue>(algo_name, node);
+    std::shared_ptr<AlgoValue> algo = make_pooled<AlgoValue>(algo_name, node);
+    if (symbol_table.uses_lexical_scoping() && symbol_table.get_parent() == nullptr) {
+        algo->set_lexical_parent(&symbol_table);
+    }
+    std::shared_ptr<Value> value = algo;
 
     size_t pos = algo_name.find("::");
     if (pos != std::string::npos) {
@@ -660,198 +880,100 @@ std::shared_ptr<Value> Interpreter::visit_algo_def(std::shared_ptr<Node> node) {
             // But actually, the AlgoValue holds the AST node.
             // The AST node has the full name.
             // It should be fine.
-            s->methods[method_name] = value;
+            s->methods[intern_symbol(method_name)] = value;
         }
     }
 
-    symbol_table.set(algo_name, value);
-    return symbol_table.get(algo_name);
+    symbol_table.set(node->get_symbol(), value);
+    return value;
 }
 
 std::shared_ptr<Value> Interpreter::visit_algo_call(std::shared_ptr<Node> node) {
-    if (std::optional<std::shared_ptr<Value>> array_result = try_visit_array_method_call(node)) {
-        return *array_result;
+    AlgorithmCallNode* algo_call_node = static_cast<AlgorithmCallNode*>(node.get());
+    const std::shared_ptr<Node>& algo_node = algo_call_node->get_call();
+    if (algo_node->get_type() == NODE_MEMACCESS) {
+        return visit_method_call(*algo_call_node);
     }
 
-    AlgorithmCallNode* algo_call_node = dynamic_cast<AlgorithmCallNode*>(node.get());
-    std::shared_ptr<Node> algo_node = algo_call_node->get_call();
     std::shared_ptr<Value> algo;
     if (algo_node->get_type() == NODE_VARACCESS)
-        algo = symbol_table.get(algo_call_node->get_name());
+        algo = lookup(*static_cast<VarAccessNode*>(algo_node.get()));
     else
         algo = visit(algo_node);
     return algo->execute(algo_call_node->get_args(), &symbol_table);
 }
 
-std::optional<std::shared_ptr<Value>> Interpreter::try_visit_array_method_call(
-    const std::shared_ptr<Node>& node) {
-    AlgorithmCallNode* algo_call_node = dynamic_cast<AlgorithmCallNode*>(node.get());
-    if (!algo_call_node) {
-        return std::nullopt;
-    }
-
-    std::shared_ptr<Node> call_node = algo_call_node->get_call();
-    if (call_node->get_type() != NODE_MEMACCESS) {
-        return std::nullopt;
-    }
-
-    NodeList member_child = call_node->get_child();
-    std::string method_name = member_child[1]->get_name();
-    bool supported_method =
-        method_name == "push" || method_name == "push_back" || method_name == "pop" ||
-        method_name == "pop_back" || method_name == "resize" || method_name == "size" ||
-        method_name == "back" || method_name == "insert" || method_name == "remove";
-    if (!supported_method || member_child[0]->get_type() != NODE_VARACCESS) {
-        return std::nullopt;
-    }
-
-    std::shared_ptr<Value> obj = symbol_table.get(member_child[0]->get_name());
-    if (obj->get_type() != VALUE_ARRAY) {
-        return std::nullopt;
-    }
-    ArrayValue* arr_obj = dynamic_cast<ArrayValue*>(obj.get());
-    const NodeList& args = algo_call_node->get_args();
-
-    auto visit_arg = [this](const std::shared_ptr<Node>& arg) -> std::shared_ptr<Value> {
-        if (!has_assignment_node(arg)) {
-            return visit(arg);
-        }
-        SymbolTable arg_scope(&symbol_table);
-        Interpreter arg_interpreter(arg_scope, collect_loop_results);
-        return arg_interpreter.visit(arg);
-    };
-
-    if (method_name == "push" || method_name == "push_back") {
-        if (args.size() != 1) {
-            return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                "Expect one argument for " + method_name + "\n");
-        }
-        std::shared_ptr<Value> arg = visit_arg(args[0]);
-        if (arg->get_type() == VALUE_ERROR) {
-            return arg;
-        }
-        arr_obj->push_back(arg);
-        return arr_obj->back();
-    }
-
-    if (method_name == "pop" || method_name == "pop_back") {
-        if (!args.empty()) {
-            return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                "Expect zero argument for " + method_name + "\n");
-        }
-        if (arr_obj->empty()) {
-            std::cout << "Cannot " << method_name << " from an empty array\n";
-            return std::make_shared<Value>();
-        }
-        return arr_obj->pop_back();
-    }
-
-    if (method_name == "resize") {
-        if (args.size() != 1) {
-            return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect one argument for resize\n");
-        }
-        std::shared_ptr<Value> new_size_val = visit_arg(args[0]);
-        if (new_size_val->get_type() == VALUE_ERROR) {
-            return new_size_val;
-        }
-        if (new_size_val->get_type() != VALUE_INT) {
-            std::cout << "Argument for resize must be an integer\n";
-            return std::make_shared<Value>();
-        }
-        long long new_size;
-        try {
-            new_size = new_size_val->as_int();
-        } catch (const std::out_of_range&) {
-            std::cout << "Resize argument out of range\n";
-            return std::make_shared<Value>();
-        }
-        if (new_size < 0) {
-            std::cout << "Resize argument cannot be negative\n";
-            return std::make_shared<Value>();
-        }
-        arr_obj->resize(static_cast<int>(new_size));
-        return obj;
-    }
+std::shared_ptr<Value> Interpreter::visit_method_call(AlgorithmCallNode& call_node) {
+    MemberAccessNode* member_node = static_cast<MemberAccessNode*>(call_node.get_call().get());
+    std::shared_ptr<Value> obj = visit(member_node->get_obj());
+    const std::string& method_name = member_node->get_member_name();
+    SymbolId method_symbol = member_node->get_member_symbol();
+    const NodeList& args = call_node.get_args();
 
-    if (method_name == "insert") {
-        if (args.size() != 2) {
-            return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect two arguments for insert\n");
-        }
-        std::shared_ptr<Value> index = visit_arg(args[0]);
-        if (index->get_type() == VALUE_ERROR) {
-            return index;
-        }
-        std::shared_ptr<Value> value = visit_arg(args[1]);
-        if (value->get_type() == VALUE_ERROR) {
-            return value;
-        }
-        return arr_obj->insert(index->as_int(), value);
+    // Builtin container methods run straight from the method table, keyed on
+    // the receiver kind this call site saw last.
+    MethodInlineCache& cache = call_node.get_method_cache();
+    std::uint8_t kind = static_cast<std::uint8_t>(obj->get_kind());
+    const BuiltinMethod* method = cache.method;
+    if (cache.receiver_kind != kind) {
+        method = find_builtin_method(obj->get_kind(), member_node->get_method_id());
+        if (!sched::concurrent()) cache = MethodInlineCache{kind, method};
     }
-
-    if (method_name == "remove") {
-        if (args.size() != 1) {
-            return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect one argument for remove\n");
+    if (method) {
+        if (args.size() != method->arity) {
+            return make_pooled<ErrorValue>(VALUE_ERROR, method->arity_error + method_name + "\n");
         }
-        std::shared_ptr<Value> index = visit_arg(args[0]);
-        if (index->get_type() == VALUE_ERROR) {
-            return index;
+        std::shared_ptr<Value> evaluated[MAX_METHOD_ARITY];
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            evaluated[i] = visit_method_arg(args[i]);
+            if (evaluated[i]->get_type() == VALUE_ERROR) return evaluated[i];
         }
-        return arr_obj->remove(index->as_int());
+        return method->call(obj, method_name, evaluated);
     }
 
-    if (method_name == "size") {
-        if (!args.empty()) {
-            return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect zero argument for size\n");
+    if (obj->get_kind() == ValueKind::Instance) {
+        InstanceValue* inst = static_cast<InstanceValue*>(obj.get());
+        if (!inst->members.count(method_symbol)) {
+            std::shared_ptr<Value> ret =
+                inst->call_method(method_symbol, obj, args, &symbol_table);
+            if (ret) return ret;
         }
-        return arr_obj->size();
     }
+    return member_of(obj, *member_node)->execute(args, &symbol_table);
+}
 
-    if (method_name == "back") {
-        if (!args.empty()) {
-            return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect zero arguments for back\n");
-        }
-        if (arr_obj->empty()) {
-            return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                "Cannot call back on an empty array\n");
-        }
-        return arr_obj->back();
+// The callee and arguments are evaluated here; the call itself runs as a
+// task in a scope of its own (see start_task).
+std::shared_ptr<Value> Interpreter::visit_spawn(std::shared_ptr<Node> node) {
+    AlgorithmCallNode* call_node =
+        static_cast<AlgorithmCallNode*>(static_cast<SpawnNode*>(node.get())->get_call().get());
+    std::shared_ptr<Value> algo = visit(call_node->get_call());
+    if (algo->get_kind() == ValueKind::Error) return algo;
+    ValueList values;
+    for (const auto& arg : call_node->get_args()) {
+        std::shared_ptr<Value> value = visit_method_arg(arg);
+        if (value->get_kind() == ValueKind::Error) return value;
+        values.push_back(value);
     }
-
-    return std::nullopt;
+    std::shared_ptr<TaskStart> start =
+        std::make_shared<TaskStart>(start_task(symbol_table, algo, std::move(values)));
+    NodeList args;
+    for (const auto& value : start->args) args.push_back(make_pooled<PrecomputedNode>(value));
+    return spawn_task([start, args] {
+        TaskGlobals globals(*start);
+        return start->callee->execute(args, start->scope.get());
+    });
 }
 
-std::shared_ptr<Value> Interpreter::bin_op(std::shared_ptr<Value> a, std::shared_ptr<Value> b,
-                                           std::shared_ptr<Token> op) {
-    if (op->get_type() == TOKEN_ADD)
-        return a + b;
-    else if (op->get_type() == TOKEN_SUB)
-        return a - b;
-    else if (op->get_type() == TOKEN_MUL)
-        return a * b;
-    else if (op->get_type() == TOKEN_DIV)
-        return a / b;
-    else if (op->get_type() == TOKEN_MOD)
-        return a % b;
-    else if (op->get_type() == TOKEN_POW)
-        return pow(a, b);  // NOLINT(misc-include-cleaner): value.h overload
-    else if (op->get_type() == TOKEN_EQUAL)
-        return a == b;
-    else if (op->get_type() == TOKEN_NEQ)
-        return a != b;
-    else if (op->get_type() == TOKEN_LESS)
-        return a < b;
-    else if (op->get_type() == TOKEN_GREATER)
-        return a > b;
-    else if (op->get_type() == TOKEN_LEQ)
-        return a <= b;
-    else if (op->get_type() == TOKEN_GEQ)
-        return a >= b;
-    else if (op->get_type() == TOKEN_KEYWORD && op->get_value() == "and")
-        return a && b;
-    else if (op->get_type() == TOKEN_KEYWORD && op->get_value() == "or")
-        return a || b;
-
-    return std::make_shared<ErrorValue>(VALUE_ERROR, "Not a binary op\n");
+// Arguments that assign run in a child scope so the assignment does not leak
+// into the caller, matching how algorithm arguments are evaluated.
+std::shared_ptr<Value> Interpreter::visit_method_arg(const std::shared_ptr<Node>& arg) {
+    if (!arg->has_flag(NODE_FLAG_HAS_ASSIGNMENT)) {
+        return visit(arg);
+    }
+    SymbolTable arg_scope(&symbol_table);
+    Interpreter arg_interpreter(arg_scope, collect_loop_results);
+    return arg_interpreter.visit(arg);
 }
 
 std::shared_ptr<Value> Interpreter::unary_op(std::shared_ptr<Value> a, std::shared_ptr<Token> op) {
@@ -861,17 +983,17 @@ std::shared_ptr<Value> Interpreter::unary_op(std::shared_ptr<Value> a, std::shar
         return -a;
     else if (op->get_type() == TOKEN_KEYWORD && op->get_value() == "not")
         return !a;
-    return std::make_shared<ErrorValue>(VALUE_ERROR, "Not an unary op\n");
+    return make_pooled<ErrorValue>(VALUE_ERROR, "Not an unary op\n");
 }
 std::shared_ptr<Value> Interpreter::visit_struct_def(std::shared_ptr<Node> node) {
     auto struct_node = dynamic_cast<StructDefNode*>(node.get());
     std::string name = struct_node->get_name();
-    std::vector<std::string> members;
+    std::vector<SymbolId> members;
     for (const auto& tok : struct_node->get_toks()) {
-        members.push_back(tok->get_value());
+        members.push_back(tok->get_symbol());
     }
 
-    std::map<std::string, std::shared_ptr<Value>> methods;
+    StructValue::MethodMap methods;
     for (const auto& method_node : struct_node->get_child()) {
         std::string method_name =
             method_node->get_name();  // This is the simple name "constructor", "add", etc.
@@ -882,8 +1004,11 @@ std::shared_ptr<Value> Interpreter::visit_struct_def(std::shared_ptr<Node> node)
         // But it also sets it in symbol_table.
         // We can temporarily use a dummy symbol table or just remove it after.
         // Or better, manually create AlgoValue.
-        std::shared_ptr<Value> method_val = std::make_shared<AlgoValue>(method_name, method_node);
-        methods[method_name] = method_val;
+        std::shared_ptr<AlgoValue> method_val = make_pooled<AlgoValue>(method_name, method_node);
+        if (symbol_table.uses_lexical_scoping() && symbol_table.get_parent() == nullptr) {
+            method_val->set_lexical_parent(&symbol_table);
+        }
+        methods[method_node->get_symbol()] = method_val;
     }
 
     // Now we also need to handle "Algorithm Struct::Method".
@@ -893,8 +1018,8 @@ std::shared_ptr<Value> Interpreter::visit_struct_def(std::shared_ptr<Node> node)
     // But StructValue is in symbol table.
     // So visit_algo_def needs to check if name contains "::".
 
-    std::shared_ptr<Value> struct_val = std::make_shared<StructValue>(name, members, methods);
-    symbol_table.set(name, struct_val);
+    std::shared_ptr<Value> struct_val = make_pooled<StructValue>(name, members, methods);
+    symbol_table.set(struct_node->get_symbol(), struct_val);
 
     // Also create a constructor wrapper in global scope if "constructor" exists?
     // The user usage: `Algorithm List constructor(_head, _tail)` inside struct.
@@ -910,5 +1035,5 @@ std::shared_ptr<Value> Interpreter::visit_return(std::shared_ptr<Node> node) {
     ReturnNode* ret_node = dynamic_cast<ReturnNode*>(node.get());
     std::shared_ptr<Value> val = visit(ret_node->get_child()[0]);
     if (val->get_type() == VALUE_ERROR) return val;
-    return std::make_shared<ReturnValue>(val);
+    return make_pooled<ReturnValue>(val);
 }
@@ -10,8 +10,34 @@
 #include "node.h"
 #include "token.h"
 #include "jit.h"
+#include "profile.h"
 #include <memory>
 #include <optional>
+#include <string>
+#include <unordered_map>
+
+struct JitCacheEntry {
+    int hits{0};
+    std::optional<JitProgram> program;
+    int runs{0}, bailouts{0};  // of `program`
+    bool disabled{false};      // not compilable, or bails out too often
+};
+
+// Side tables filled while running: compiled hot expressions and memoized
+// Algorithm results. They are not synchronized, so every thread has its own,
+// and an Engine (engine.h) lends its own to the thread running it.
+struct ExecutionCaches {
+    NodeTable<JitCacheEntry> jit;
+    NodeTable<std::unordered_map<std::string, std::shared_ptr<Value>>> memoized_results;
+    NodeTable<std::optional<JitProgram>> single_return_jit;
+};
+
+// The calling thread's caches.
+ExecutionCaches& execution_caches();
+
+// Makes `caches` the calling thread's caches (nullptr restores its own) and
+// returns the previous ones.
+ExecutionCaches* use_execution_caches(ExecutionCaches* caches);
 
 class Interpreter {
 public:
@@ -19,34 +45,40 @@ public:
         : symbol_table(symbols), collect_loop_results(_collect_loop_results) {}
     std::shared_ptr<Value> visit(std::shared_ptr<Node>);
     std::shared_ptr<Value> visit_number(std::shared_ptr<Node>);
-    std::shared_ptr<Value> visit_var_access(std::shared_ptr<Node>);
+    std::shared_ptr<Value> visit_var_access(std::shared_ptr<Node>, bool specialize = false);
     std::shared_ptr<Value> visit_var_assign(std::shared_ptr<Node>);
-    std::shared_ptr<Value> visit_bin_op(std::shared_ptr<Node>);
+    std::shared_ptr<Value> visit_bin_op(std::shared_ptr<Node>, bool specialize = false);
     std::shared_ptr<Value> visit_unary_op(std::shared_ptr<Node>);
     std::shared_ptr<Value> visit_array(std::shared_ptr<Node>);
     std::shared_ptr<Value> visit_if(std::shared_ptr<Node>);
     std::shared_ptr<Value> visit_for(std::shared_ptr<Node>);
+    std::shared_ptr<Value> visit_parallel_for(const std::shared_ptr<Node>&);
     std::shared_ptr<Value> visit_while(std::shared_ptr<Node>);
     std::shared_ptr<Value> visit_repeat(std::shared_ptr<Node>);
     std::shared_ptr<Value> visit_algo_def(std::shared_ptr<Node>);
     std::shared_ptr<Value> visit_struct_def(std::shared_ptr<Node>);
     std::shared_ptr<Value> visit_algo_call(std::shared_ptr<Node>);
-    std::shared_ptr<Value>& visit_array_access(std::shared_ptr<Node>);
+    std::shared_ptr<Value>& visit_array_access(std::shared_ptr<Node>, bool specialize = false);
     std::shared_ptr<Value> visit_array_assign(std::shared_ptr<Node>);
     std::shared_ptr<Value> visit_member_access(std::shared_ptr<Node>);
+    std::shared_ptr<Value> visit_method_call(AlgorithmCallNode&);
     std::shared_ptr<Value> visit_return(std::shared_ptr<Node>);
+    std::shared_ptr<Value> visit_spawn(std::shared_ptr<Node>);
 
-    std::shared_ptr<Value> bin_op(std::shared_ptr<Value>, std::shared_ptr<Value>, std::shared_ptr<Token>);
     std::shared_ptr<Value> unary_op(std::shared_ptr<Value>, std::shared_ptr<Token>);
 protected:
-    struct JitCacheEntry {
-        int hits{0};
-        bool disabled{false};
-        std::optional<JitProgram> program;
-    };
-
     std::optional<std::shared_ptr<Value>> try_visit_jit(const std::shared_ptr<Node>& node);
-    std::optional<std::shared_ptr<Value>> try_visit_array_method_call(const std::shared_ptr<Node>& node);
+    void disable_jit(const std::shared_ptr<Node>& node, JitCacheEntry& entry, JitOutcome outcome);
+    std::shared_ptr<Value> visit_method_arg(const std::shared_ptr<Node>& arg);
+    std::shared_ptr<Value> lookup(VarAccessNode& node);
+    // Specialized forms of quickened nodes (see Quickened in node.h).
+    std::shared_ptr<Value> visit_int_bin_op(const std::shared_ptr<Node>& node);
+    std::shared_ptr<Value> visit_local_load(const std::shared_ptr<Node>& node);
+    std::shared_ptr<Value> visit_array_load(const std::shared_ptr<Node>& node);
+    std::shared_ptr<Value>& element_of(const std::shared_ptr<Value>& arr,
+                                       const std::shared_ptr<Value>& index);
+    std::shared_ptr<Value> member_of(const std::shared_ptr<Value>& obj,
+                                     const MemberAccessNode& node);
 
     SymbolTable &symbol_table;
     std::shared_ptr<Value> error, algo_call_temp;
@@ -0,0 +1,235 @@
+/// --------------------
+/// Program I/O
+/// --------------------
+
+#include "io.h"
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace io {
+
+namespace {
+
+constexpr std::size_t BUFFER_BYTES = 64 * 1024;
+
+thread_local Streams* installed = nullptr;
+
+// Called with the output locked.
+void flush_output(Streams& streams) {
+    if (streams.pending.empty()) return;
+    streams.out->write(streams.pending.data(), static_cast<std::streamsize>(streams.pending.size()));
+    streams.pending.clear();
+    if (streams.write_through) streams.out->flush();
+}
+
+void flush_standard();
+
+Streams& standard() {
+    // Leaked on purpose: programs may print during static destruction.
+    static Streams* shared = [] {
+        Streams* streams = new Streams(std::cin, std::cout);
+        streams->raw = true;
+        streams->write_through = isatty(STDOUT_FILENO);
+        streams->pending.reserve(BUFFER_BYTES);
+        std::atexit(flush_standard);
+        return streams;
+    }();
+    return *shared;
+}
+
+void flush_standard() {
+    Streams& streams = standard();
+    std::lock_guard<std::mutex> lock(streams.out_mutex);
+    flush_output(streams);
+    streams.out->flush();
+}
+
+// Writes `text`, then `end` if given. Called with the output locked.
+void put(Streams& streams, const std::string& text, char end) {
+    if (!streams.raw) {
+        *streams.out << text;
+        if (end != '\0') *streams.out << end;
+        return;
+    }
+    streams.pending += text;
+    if (end != '\0') streams.pending += end;
+    if (streams.write_through || streams.pending.size() >= BUFFER_BYTES) flush_output(streams);
+}
+
+// Refills the input buffer of the standard streams, after handing over
+// pending output, which may be the prompt for what is read. Called with the
+// input locked.
+bool fill(Streams& streams) {
+    if (streams.input_done) return false;
+    {
+        std::lock_guard<std::mutex> lock(streams.out_mutex);
+        flush_output(streams);
+        streams.out->flush();
+    }
+    streams.input.resize(BUFFER_BYTES);
+    ssize_t size;
+    do {
+        size = ::read(STDIN_FILENO, &streams.input[0], BUFFER_BYTES);
+    } while (size < 0 && errno == EINTR);
+    streams.input.resize(size > 0 ? static_cast<std::size_t>(size) : 0);
+    streams.input_pos = 0;
+    streams.input_done = size <= 0;
+    return size > 0;
+}
+
+// The next character of the input, or EOF. Called with the input locked.
+int peek(Streams& streams) {
+    if (!streams.raw) return streams.in->peek();
+    if (streams.input_pos == streams.input.size() && !fill(streams)) return EOF;
+    return static_cast<unsigned char>(streams.input[streams.input_pos]);
+}
+
+void skip(Streams& streams) {
+    if (!streams.raw) {
+        streams.in->get();
+    } else if (streams.input_pos < streams.input.size()) {
+        ++streams.input_pos;
+    }
+}
+
+// Reads the next whitespace-separated word into `word` and consumes the
+// character after it, like `>>` followed by ignore(). Called with the input
+// locked.
+void next_word(Streams& streams, std::string& word) {
+    word.clear();
+    int ch;
+    while ((ch = peek(streams)) != EOF && std::isspace(ch)) skip(streams);
+    while ((ch = peek(streams)) != EOF && !std::isspace(ch)) {
+        word += static_cast<char>(ch);
+        skip(streams);
+    }
+    if (ch != EOF) skip(streams);
+}
+
+bool parse_int(const std::string& word, std::int64_t& value) {
+    bool negative = !word.empty() && word[0] == '-';
+    std::size_t i = !word.empty() && (word[0] == '-' || word[0] == '+') ? 1 : 0;
+    if (i == word.size()) return false;
+    const std::uint64_t limit =
+        static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()) + (negative ? 1 : 0);
+    std::uint64_t magnitude = 0;
+    for (; i < word.size(); ++i) {
+        if (word[i] < '0' || word[i] > '9') return false;
+        std::uint64_t digit = static_cast<std::uint64_t>(word[i] - '0');
+        if (magnitude > (limit - digit) / 10) return false;
+        magnitude = magnitude * 10 + digit;
+    }
+    value = negative ? static_cast<std::int64_t>(0 - magnitude) : static_cast<std::int64_t>(magnitude);
+    return true;
+}
+
+}  // namespace
+
+Streams& current() {
+    if (installed != nullptr) return *installed;
+    return standard();
+}
+
+Streams* use_streams(Streams* streams) {
+    std::swap(installed, streams);
+    return streams;
+}
+
+void flush() {
+    Streams& streams = current();
+    std::lock_guard<std::mutex> lock(streams.out_mutex);
+    flush_output(streams);
+}
+
+void write(const std::string& text) {
+    Streams& streams = current();
+    std::lock_guard<std::mutex> lock(streams.out_mutex);
+    put(streams, text, '\0');
+}
+
+void write_line(const std::string& text) {
+    Streams& streams = current();
+    std::lock_guard<std::mutex> lock(streams.out_mutex);
+    put(streams, text, '\n');
+}
+
+std::string read_word() {
+    Streams& streams = current();
+    std::lock_guard<std::mutex> lock(streams.in_mutex);
+    std::string word;
+    next_word(streams, word);
+    return word;
+}
+
+std::string read_line() {
+    Streams& streams = current();
+    std::lock_guard<std::mutex> lock(streams.in_mutex);
+    std::string line;
+    if (!streams.raw) {
+        std::getline(*streams.in, line);
+        return line;
+    }
+    while (peek(streams) != EOF) {
+        std::size_t begin = streams.input_pos;
+        std::size_t end = streams.input.find('\n', begin);
+        if (end != std::string::npos) {
+            line.append(streams.input, begin, end - begin);
+            streams.input_pos = end + 1;
+            break;
+        }
+        line.append(streams.input, begin, std::string::npos);
+        streams.input_pos = streams.input.size();
+    }
+    return line;
+}
+
+bool read_ints(std::size_t count, std::vector<std::int64_t>& values, std::string& bad) {
+    Streams& streams = current();
+    std::lock_guard<std::mutex> lock(streams.in_mutex);
+    values.reserve(values.size() + count);
+    std::string word;
+    for (std::size_t i = 0; i < count; ++i) {
+        next_word(streams, word);
+        std::int64_t value = 0;
+        if (!parse_int(word, value)) {
+            bad = word;
+            return false;
+        }
+        values.push_back(value);
+    }
+    return true;
+}
+
+std::vector<std::string> read_all_lines() {
+    Streams& streams = current();
+    std::lock_guard<std::mutex> lock(streams.in_mutex);
+    std::vector<std::string> lines;
+    std::string rest;
+    if (!streams.raw) {
+        std::string line;
+        while (std::getline(*streams.in, line)) lines.push_back(std::move(line));
+        return lines;
+    }
+    while (peek(streams) != EOF) {
+        rest.append(streams.input, streams.input_pos, std::string::npos);
+        streams.input_pos = streams.input.size();
+    }
+    std::size_t begin = 0;
+    while (begin < rest.size()) {
+        std::size_t end = rest.find('\n', begin);
+        if (end == std::string::npos) end = rest.size();
+        lines.emplace_back(rest, begin, end - begin);
+        begin = end + 1;
+    }
+    return lines;
+}
+
+}  // namespace io
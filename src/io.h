@@ -0,0 +1,81 @@
+/// --------------------
+/// Program I/O
+/// --------------------
+
+#ifndef IO_H
+#define IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Where a program's print writes and its read and read_line read. Threads
+// outside an Engine use standard input and output. An Engine can redirect
+// its own (Engine::redirect), and scheduler tasks inherit the streams of the
+// thread that queued them.
+//
+// Standard input and output skip iostreams. Output is gathered in a 64 KiB
+// buffer handed to std::cout when it fills, before input is read, on flush
+// and at exit; a terminal gets each write at once. Input is read into a
+// buffer of the same size with read(2), so nothing else may read std::cin.
+namespace io {
+
+struct Streams {
+    Streams(std::istream& _in, std::ostream& _out) : in(&_in), out(&_out) {}
+
+    std::istream* in;
+    std::ostream* out;
+    // Serialize the program's threads on each stream.
+    std::mutex in_mutex;
+    std::mutex out_mutex;
+
+    // Set for the standard streams only (see above).
+    bool raw{false};
+    bool write_through{false};  // output is a terminal
+    std::string pending;        // output not yet handed to `out`
+    std::string input;          // read from standard input, from `input_pos` on unconsumed
+    std::size_t input_pos{0};
+    bool input_done{false};
+};
+
+// The calling thread's streams.
+Streams& current();
+
+// Makes `streams` the calling thread's streams (nullptr restores std::cin
+// and std::cout) and returns the previous ones.
+Streams* use_streams(Streams* streams);
+
+// Hands output gathered for the current streams to their ostream. Code
+// writing std::cout itself calls this first, so that it comes after what the
+// program printed.
+void flush();
+
+// Writes `text` to the current output.
+void write(const std::string& text);
+
+// Writes `text` and a newline to the current output.
+void write_line(const std::string& text);
+
+// The next whitespace-separated word of the current input, consuming the
+// character after it.
+std::string read_word();
+
+// The rest of the current input line, without its newline.
+std::string read_line();
+
+// Appends up to `count` integers of the current input to `values`, each
+// read as read_word reads a word. Returns false when the input ends first or
+// a word is not a decimal integer in 64 bits; `bad` then holds that word, or
+// is empty at the end of the input.
+bool read_ints(std::size_t count, std::vector<std::int64_t>& values, std::string& bad);
+
+// The rest of the current input, as lines without their newlines.
+std::vector<std::string> read_all_lines();
+
+}  // namespace io
+
+#endif
@@ -44,7 +44,7 @@ struct JitInstruction {
     JitOp op;
     int64_t int_value{0};
     double float_value{0.0};
-    std::string name;
+    SymbolId symbol{0};
 };
 
 class JitProgram {
@@ -4,6 +4,7 @@
 
 #include "lexer.h"
 #include "color.h"
+#include "pool.h"
 #include <regex>
 #include <string>
 #include <vector>
@@ -14,85 +15,92 @@ struct TokenRegex {
     std::string type;
 };
 
-const std::regex NUMBER_RE(R"(^\d+(?:\.\d*)?)");
-const std::regex IDENTIFIER_RE(R"(^[A-Za-z_][A-Za-z0-9_]*)");
-const std::regex STRING_RE(R"(^"(?:\\.|[^"\\])*")");
-const std::regex WHITESPACE_RE(R"(^[ \t]+)");
-const std::regex NEWLINE_INDENT_RE(R"(^\n *)");
-const std::regex COMMENT_RE(R"(^//[^\n]*)");
-
-const std::vector<TokenRegex> TOKEN_REGEXES{
-    {std::regex(R"(^::)"), TOKEN_SCOPE_RES},
-    {std::regex(R"(^<-)"), TOKEN_ASSIGN},
-    {std::regex(R"(^<=)"), TOKEN_LEQ},
-    {std::regex(R"(^>=)"), TOKEN_GEQ},
-    {std::regex(R"(^!=)"), TOKEN_NEQ},
-    {std::regex(R"(^\+)"), TOKEN_ADD},
-    {std::regex(R"(^-)"), TOKEN_SUB},
-    {std::regex(R"(^\*)"), TOKEN_MUL},
-    {std::regex(R"(^/)"), TOKEN_DIV},
-    {std::regex(R"(^%)"), TOKEN_MOD},
-    {std::regex(R"(^\^)"), TOKEN_POW},
-    {std::regex(R"(^\()"), TOKEN_LEFT_PAREN},
-    {std::regex(R"(^\))"), TOKEN_RIGHT_PAREN},
-    {std::regex(R"(^=)"), TOKEN_EQUAL},
-    {std::regex(R"(^,)"), TOKEN_COMMA},
-    {std::regex(R"(^:)"), TOKEN_COLON},
-    {std::regex(R"(^\{)"), TOKEN_LEFT_BRACE},
-    {std::regex(R"(^\})"), TOKEN_RIGHT_BRACE},
-    {std::regex(R"(^\[)"), TOKEN_LEFT_SQUARE},
-    {std::regex(R"(^\])"), TOKEN_RIGHT_SQUARE},
-    {std::regex(R"(^;)"), TOKEN_SEMICOLON},
-    {std::regex(R"(^\.)"), TOKEN_DOT},
-    {std::regex(R"(^<)"), TOKEN_LESS},
-    {std::regex(R"(^>)"), TOKEN_GREATER},
+// Compiled on first use rather than at startup, so runs that never lex
+// (such as `pseudo --client`) do not pay for them.
+struct LexerPatterns {
+    std::regex number{R"(^\d+(?:\.\d*)?)"};
+    std::regex identifier{R"(^[A-Za-z_][A-Za-z0-9_]*)"};
+    std::regex string{R"(^"(?:\\.|[^"\\])*")"};
+    std::regex whitespace{R"(^[ \t]+)"};
+    std::regex newline_indent{R"(^\n *)"};
+    std::regex comment{R"(^//[^\n]*)"};
+    std::vector<TokenRegex> operators{
+        {std::regex(R"(^::)"), TOKEN_SCOPE_RES},
+        {std::regex(R"(^<-)"), TOKEN_ASSIGN},
+        {std::regex(R"(^<=)"), TOKEN_LEQ},
+        {std::regex(R"(^>=)"), TOKEN_GEQ},
+        {std::regex(R"(^!=)"), TOKEN_NEQ},
+        {std::regex(R"(^\+)"), TOKEN_ADD},
+        {std::regex(R"(^-)"), TOKEN_SUB},
+        {std::regex(R"(^\*)"), TOKEN_MUL},
+        {std::regex(R"(^/)"), TOKEN_DIV},
+        {std::regex(R"(^%)"), TOKEN_MOD},
+        {std::regex(R"(^\^)"), TOKEN_POW},
+        {std::regex(R"(^\()"), TOKEN_LEFT_PAREN},
+        {std::regex(R"(^\))"), TOKEN_RIGHT_PAREN},
+        {std::regex(R"(^=)"), TOKEN_EQUAL},
+        {std::regex(R"(^,)"), TOKEN_COMMA},
+        {std::regex(R"(^:)"), TOKEN_COLON},
+        {std::regex(R"(^\{)"), TOKEN_LEFT_BRACE},
+        {std::regex(R"(^\})"), TOKEN_RIGHT_BRACE},
+        {std::regex(R"(^\[)"), TOKEN_LEFT_SQUARE},
+        {std::regex(R"(^\])"), TOKEN_RIGHT_SQUARE},
+        {std::regex(R"(^;)"), TOKEN_SEMICOLON},
+        {std::regex(R"(^\.)"), TOKEN_DOT},
+        {std::regex(R"(^<)"), TOKEN_LESS},
+        {std::regex(R"(^>)"), TOKEN_GREATER},
+    };
 };
 
+const LexerPatterns& patterns() {
+    static const LexerPatterns shared;
+    return shared;
+}
+
 bool regex_prefix(const std::string& input, const std::regex& regex, std::smatch& match) {
     return std::regex_search(input, match, regex, std::regex_constants::match_continuous);
 }
 }
 
 void Lexer::advance() {
-    pos.advance(current_char);
-    if(pos.index >= text.size()) {
-        current_char = NONE;
-        return;
-    }
-    current_char = text[pos.index];
+    pos.advance();
+    current_char = pos.offset - base >= text.size() ? NONE : text[pos.offset - base];
 }
 
 void Lexer::advance_by(const std::string& lexeme) {
-    for(char ch : lexeme) {
-        current_char = ch;
-        pos.advance(current_char);
-    }
-    current_char = pos.index >= text.size() ? NONE : text[pos.index];
+    pos.offset += static_cast<std::uint32_t>(lexeme.size());
+    current_char = pos.offset - base >= text.size() ? NONE : text[pos.offset - base];
 }
 
 std::shared_ptr<Token> Lexer::make_error(const Position& start_pos, const std::string& message) {
-    return std::make_shared<ErrorToken>(TOKEN_ERROR, start_pos, message);
+    return make_pooled<ErrorToken>(TOKEN_ERROR, start_pos, message);
 }
 
 TokenList Lexer::make_tokens() {
+    source_map::FileRef file = source_map::add(file_name, text);
+    return make_tokens(file.id(), 0);
+}
+
+TokenList Lexer::make_tokens(std::uint32_t file_id, std::uint32_t _base) {
     TokenList tokens;
-    pos = Position(-1, 0, -1, file_name);
-    current_char = NONE;
-    advance();
+    const LexerPatterns& re = patterns();
+    base = _base;
+    pos = Position(base, file_id);
+    current_char = text.empty() ? NONE : text[0];
 
     while(current_char != NONE) {
-        const std::string rest = text.substr(pos.index);
+        const std::string rest = text.substr(pos.offset - base);
         Position start_pos = pos;
         std::smatch match;
 
-        if(regex_prefix(rest, COMMENT_RE, match)) {
+        if(regex_prefix(rest, re.comment, match)) {
             advance_by(match.str());
             continue;
         }
 
-        if(regex_prefix(rest, NEWLINE_INDENT_RE, match)) {
+        if(regex_prefix(rest, re.newline_indent, match)) {
             const std::string lexeme = match.str();
-            tokens.push_back(std::make_shared<Token>(TOKEN_NEWLINE, start_pos));
+            tokens.push_back(make_pooled<Token>(TOKEN_NEWLINE, start_pos));
 
             const int space_num = static_cast<int>(lexeme.size()) - 1;
             const std::string line_rest = rest.substr(lexeme.size());
@@ -109,18 +117,18 @@ TokenList Lexer::make_tokens() {
                 return tokens;
             }
             for(int i{0}; i < (space_num / TAB_SIZE); ++i) {
-                tokens.push_back(std::make_shared<Token>(TOKEN_TAB, start_pos));
+                tokens.push_back(make_pooled<Token>(TOKEN_TAB, start_pos));
             }
             continue;
         }
 
-        if(regex_prefix(rest, WHITESPACE_RE, match)) {
+        if(regex_prefix(rest, re.whitespace, match)) {
             advance_by(match.str());
             continue;
         }
 
         if(current_char == '\"') {
-            if(!regex_prefix(rest, STRING_RE, match)) {
+            if(!regex_prefix(rest, re.string, match)) {
                 tokens.clear();
                 tokens.push_back(make_error(start_pos, "Expected \'\"\'"));
                 return tokens;
@@ -136,22 +144,22 @@ TokenList Lexer::make_tokens() {
             continue;
         }
 
-        if(regex_prefix(rest, NUMBER_RE, match)) {
+        if(regex_prefix(rest, re.number, match)) {
             tokens.push_back(make_number(match.str(), start_pos));
             advance_by(match.str());
             continue;
         }
 
-        if(regex_prefix(rest, IDENTIFIER_RE, match)) {
+        if(regex_prefix(rest, re.identifier, match)) {
             tokens.push_back(make_identifier(match.str(), start_pos));
             advance_by(match.str());
             continue;
         }
 
         bool matched_operator = false;
-        for(const auto& token_regex : TOKEN_REGEXES) {
+        for(const auto& token_regex : re.operators) {
             if(regex_prefix(rest, token_regex.pattern, match)) {
-                tokens.push_back(std::make_shared<Token>(token_regex.type, start_pos));
+                tokens.push_back(make_pooled<Token>(token_regex.type, start_pos));
                 advance_by(match.str());
                 matched_operator = true;
                 break;
@@ -171,8 +179,8 @@ TokenList Lexer::make_tokens() {
 
 std::shared_ptr<Token> Lexer::make_number(const std::string& number_str, const Position& start_pos) {
     if(number_str.find('.') == std::string::npos) 
-        return std::make_shared<TypedToken<int64_t>>(TOKEN_INT, start_pos, std::stoll(number_str));
-    return std::make_shared<TypedToken<double>>(TOKEN_FLOAT, start_pos, std::stod(number_str));
+        return make_pooled<TypedToken<int64_t>>(TOKEN_INT, start_pos, std::stoll(number_str));
+    return make_pooled<TypedToken<double>>(TOKEN_FLOAT, start_pos, std::stod(number_str));
 }
 
 std::shared_ptr<Token> Lexer::make_identifier(const std::string& id_str, const Position& start_pos) {
@@ -185,7 +193,9 @@ std::shared_ptr<Token> Lexer::make_identifier(const std::string& id_str, const P
         type = TOKEN_BUILTIN_ALGO;
     else 
         type = TOKEN_IDENTIFIER;
-    return std::make_shared<TypedToken<std::string>>(type, start_pos, id_str);
+    std::shared_ptr<Token> token = make_pooled<TypedToken<std::string>>(type, start_pos, id_str);
+    token->set_symbol(intern_symbol(id_str));
+    return token;
 }
 
 std::shared_ptr<Token> Lexer::make_string(const std::string& string_lexeme, const Position& start_pos) {
@@ -205,5 +215,5 @@ std::shared_ptr<Token> Lexer::make_string(const std::string& string_lexeme, cons
             return make_error(start_pos, "Unknown char after \'\\\'");
         ret += ESCAPE_CHAR.at(escaped);
     }
-    return std::make_shared<TypedToken<std::string>>(TOKEN_STRING, start_pos, ret);
+    return make_pooled<TypedToken<std::string>>(TOKEN_STRING, start_pos, ret);
 }
@@ -6,6 +6,7 @@
 #define LEXER_H
 
 #include <map>
+#include <cstdint>
 #include <set>
 #include <string>
 #include "token.h"
@@ -27,11 +28,11 @@ const std::map<char, std::string> TO_TOKEN_TYPE {
 
 const std::set<std::string> KEYWORDS{
     "and", "or", "not",
-    "for", "to", "step", "while", "do",
+    "for", "parallel", "to", "step", "while", "do",
     "repeat", "until",
     "if", "then", "else", 
     "Algorithm", "continue", "break",
-    "Struct", "self", "operator", "return"
+    "Struct", "self", "operator", "return", "spawn"
 };
 
 const std::map<std::string, int64_t> BUILTIN_CONST{
@@ -40,6 +41,7 @@ const std::map<std::string, int64_t> BUILTIN_CONST{
 
 const std::set<std::string> BUILTIN_ALGO{
     "print", "read", "read_line",
+    "read_int", "read_ints", "read_all_lines",
     "open", "clear", "quit",
     "int", "float", "string"
 };
@@ -54,10 +56,14 @@ const std::map<char, char> ESCAPE_CHAR {
 class Lexer {
 public:
     Lexer(const std::string& _file_name, const std::string& _text)
-        : file_name(_file_name), text(_text)
-        , pos(-1, 0, -1, _file_name), current_char(NONE) {}
+        : file_name(_file_name), text(_text), current_char(NONE) {}
     void advance();
+    // Registers the text with source_map and lexes all of it.
     TokenList make_tokens();
+    // Lexes the text as the part starting at offset `base` of a file already
+    // registered as `file_id`, with positions in that file. The part must
+    // start a line.
+    TokenList make_tokens(std::uint32_t file_id, std::uint32_t base);
     std::shared_ptr<Token> make_number(const std::string& number_str, const Position& start_pos);
     std::shared_ptr<Token> make_identifier(const std::string& id_str, const Position& start_pos);
     std::shared_ptr<Token> make_string(const std::string& string_lexeme, const Position& start_pos);
@@ -67,6 +73,7 @@ protected:
     std::string file_name, text;
     Position pos;
     char current_char;
+    std::uint32_t base{0};  // file offset of text[0]
 };
 
 #endif
@@ -254,15 +254,18 @@ std::vector<std::string> split_lines(const std::string& text) {
     return lines;
 }
 
-int line_length(const std::vector<std::string>& lines, int line) {
-    if (line < 0 || line >= static_cast<int>(lines.size())) return 0;
-    return static_cast<int>(lines[line].size());
+int line_length(const SourceFile& file, int line) {
+    if (line < 0 || line >= static_cast<int>(file.line_starts.size())) return 0;
+    std::uint32_t end = line + 1 < static_cast<int>(file.line_starts.size()) ? file.line_starts[line + 1] - 1
+                                                                             : file.length;
+    return static_cast<int>(end - file.line_starts[line]);
 }
 
-std::string diagnostic_json(const std::string& message, const Position& pos, const std::vector<std::string>& lines) {
-    int line = std::max(0, pos.line);
-    int character = std::max(0, pos.column);
-    int end_character = std::min(std::max(character + 1, 1), std::max(line_length(lines, line), character + 1));
+std::string diagnostic_json(const std::string& message, const Position& pos) {
+    int line = std::max(0, pos.line());
+    int character = std::max(0, pos.column());
+    int end_character = std::min(std::max(character + 1, 1),
+                                 std::max(line_length(source_map::get(pos.file_id), line), character + 1));
     return "{\"range\":{\"start\":{\"line\":" + std::to_string(line) +
            ",\"character\":" + std::to_string(character) + "},\"end\":{\"line\":" +
            std::to_string(line) + ",\"character\":" + std::to_string(end_character) +
@@ -299,7 +302,6 @@ std::string strip_line_comments(const std::string& text) {
 }
 
 std::string diagnostics_for(const std::string& uri, const std::string& text) {
-    std::vector<std::string> lines = split_lines(text);
     std::vector<std::string> diagnostics;
     std::string parse_text = strip_line_comments(text);
 
@@ -307,7 +309,7 @@ std::string diagnostics_for(const std::string& uri, const std::string& text) {
     TokenList tokens = lexer.make_tokens();
     for (const auto& token : tokens) {
         if (token->get_type() == TOKEN_ERROR) {
-            diagnostics.push_back(diagnostic_json(token->get_value(), token->get_pos(), lines));
+            diagnostics.push_back(diagnostic_json(token->get_value(), token->get_pos()));
         }
     }
 
@@ -318,10 +320,10 @@ std::string diagnostics_for(const std::string& uri, const std::string& text) {
             if (node->get_type() != NODE_ERROR) continue;
             std::shared_ptr<Token> token = node->get_tok();
             if (token) {
-                diagnostics.push_back(diagnostic_json(token->get_value(), token->get_pos(), lines));
+                diagnostics.push_back(diagnostic_json(token->get_value(), token->get_pos()));
             } else {
-                Position pos(0, 0, 0, uri);
-                diagnostics.push_back(diagnostic_json(node->get_node(), pos, lines));
+                Position pos(0, tokens.front()->get_pos().file_id);
+                diagnostics.push_back(diagnostic_json(node->get_node(), pos));
             }
             break;
         }
@@ -350,11 +352,14 @@ std::string completion_items() {
         {"if", 14, "Conditional block", "if ${1:condition} then\n    ${0}"},
         {"else", 14, "Else branch", "else\n    ${0}"},
         {"for", 14, "For loop", "for ${1:i} <- ${2:1} to ${3:10} do\n    ${0}"},
+        {"parallel", 14, "Parallel for loop",
+         "parallel for ${1:i} <- ${2:1} to ${3:10} do\n    ${0}"},
         {"while", 14, "While loop", "while ${1:condition} do\n    ${0}"},
         {"repeat", 14, "Repeat loop", "repeat\n    ${1}\nuntil ${0:condition}"},
         {"return", 14, "Return from algorithm", "return ${0:value}"},
         {"break", 14, "Exit the nearest loop", "break"},
         {"continue", 14, "Skip to the next loop iteration", "continue"},
+        {"spawn", 14, "Start a call as a task", "spawn ${1:algorithm}(${0})"},
         {"true", 12, "Builtin constant", "true"},
         {"false", 12, "Builtin constant", "false"},
         {"none", 12, "Builtin constant", "none"},
@@ -362,11 +367,24 @@ std::string completion_items() {
         {"print()", 3, "Builtin function", "print(${0:value})"},
         {"read", 3, "Builtin function", "read()"},
         {"read_line", 3, "Builtin function", "read_line()"},
+        {"read_int", 3, "Builtin function", "read_int()"},
+        {"read_ints", 3, "Builtin function", "read_ints(${0:n})"},
+        {"read_all_lines", 3, "Builtin function", "read_all_lines()"},
+        {"open", 3, "Builtin function", "open(${1:path}, ${0:mode})"},
         {"clear", 3, "Builtin function", "clear()"},
         {"quit", 3, "Builtin function", "quit()"},
         {"int", 3, "Type conversion", "int(${0:value})"},
         {"float", 3, "Type conversion", "float(${0:value})"},
         {"string", 3, "Type conversion", "string(${0:value})"},
+        {"await", 3, "Wait for a task", "await(${0:task})"},
+        {"join", 3, "Wait for a task", "join(${0:task})"},
+        {"channel", 3, "Bounded channel constructor", "channel(${0:capacity})"},
+        {"send", 3, "Send to a channel", "send(${1:ch}, ${0:value})"},
+        {"receive", 3, "Receive from a channel", "receive(${0:ch})"},
+        {"map", 3, "Apply to each element", "map(${1:arr}, ${0:f})"},
+        {"filter", 3, "Keep matching elements", "filter(${1:arr}, ${0:pred})"},
+        {"reduce", 3, "Fold an array", "reduce(${1:arr}, ${2:f}, ${0:init})"},
+        {"for_each", 3, "Call for each element", "for_each(${1:arr}, ${0:f})"},
         {"import", 14, "Import a pseudocode library", "import ${0:dsa}"},
         {"import dsa", 9, "Import the DSA standard library", "import dsa"},
         {"LinkedList", 7, "Linked list constructor", "LinkedList()"},
@@ -452,11 +470,26 @@ std::optional<std::string> hover_for(const std::string& word) {
         {"Struct", "Defines a struct with members and methods."},
         {"if", "Starts a conditional expression. Use `then` before the body."},
         {"for", "Iterates from a start value to an end value: `for i <- 1 to 10 do`."},
+        {"parallel", "Runs a for loop's iterations across threads: `parallel for i <- 1 to n do`."},
+        {"spawn", "Starts an algorithm call as a task and returns its handle: `t <- spawn f(x)`."},
+        {"await", "Waits for a spawned task and returns its result. `join` is the same."},
+        {"join", "Waits for a spawned task and returns its result. `await` is the same."},
+        {"channel", "Creates a channel holding at most `capacity` values."},
+        {"send", "Adds a value to a channel, waiting while the channel is full."},
+        {"receive", "Takes the oldest value from a channel, waiting while it is empty."},
+        {"map", "Returns a new array of `f(x)` for each element `x` of `arr`."},
+        {"filter", "Returns a new array of the elements `x` of `arr` for which `pred(x)` is 1."},
+        {"reduce", "Folds `arr` from the left: `f(f(init, x1), x2)` and so on."},
+        {"for_each", "Calls `f(x)` for each element `x` of `arr`."},
         {"while", "Runs a block while the condition is true."},
         {"repeat", "Runs a block until the trailing condition becomes true."},
         {"print", "Builtin function that writes values to stdout."},
         {"read", "Builtin function that reads one whitespace-separated token."},
         {"read_line", "Builtin function that reads a full input line."},
+        {"read_int", "Builtin function that reads one whitespace-separated integer."},
+        {"read_ints", "Builtin function that reads `n` integers into an array."},
+        {"read_all_lines", "Builtin function that reads the rest of the input as an array of lines."},
+        {"open", "Opens a file with mode \"r\", \"w\" or \"a\" and returns its handle. Methods: `read_line`, `read_fields`, `read_bytes`, `at_end`, `size`, `write`, `write_line`, `close`."},
         {"int", "Converts a value to an integer."},
         {"float", "Converts a value to a float."},
         {"string", "Converts a value to a string."},
@@ -6,6 +6,7 @@
 #include <string>
 #include <iostream>
 #include <sstream>
+#include <unordered_map>
 
 std::string ValueNode::get_node() {
     return tok->get_tok();
@@ -84,7 +85,7 @@ std::string IfNode::get_node() {
 
 std::string ForNode::get_node() {
     std::stringstream ss;
-    ss << "(FOR " << var_assign->get_node() << " TO " << end_value->get_node();
+    ss << (parallel ? "(PARALLEL FOR " : "(FOR ") << var_assign->get_node() << " TO " << end_value->get_node();
     if(step_value != nullptr)
         ss << " STEP " << step_value->get_node();
     ss << " DO ";
@@ -185,6 +186,38 @@ std::string ArrayAssignNode::get_node() {
     return ret;
 }
 
+MethodId method_id_from_name(const std::string& name) {
+    static const std::unordered_map<std::string, MethodId> ids{
+        {"push", METHOD_PUSH},         {"push_back", METHOD_PUSH}, {"pop", METHOD_POP},
+        {"pop_back", METHOD_POP},      {"resize", METHOD_RESIZE},  {"insert", METHOD_INSERT},
+        {"remove", METHOD_REMOVE},     {"size", METHOD_SIZE},      {"back", METHOD_BACK},
+        {"set", METHOD_SET},           {"get", METHOD_GET},        {"contains", METHOD_CONTAINS},
+        {"is_empty", METHOD_IS_EMPTY}, {"keys", METHOD_KEYS},      {"values", METHOD_VALUES},
+        {"clear", METHOD_CLEAR},       {"read_line", METHOD_READ_LINE},
+        {"read_fields", METHOD_READ_FIELDS}, {"read_bytes", METHOD_READ_BYTES},
+        {"at_end", METHOD_AT_END},     {"write", METHOD_WRITE},    {"write_line", METHOD_WRITE_LINE},
+        {"close", METHOD_CLOSE}};
+    auto found = ids.find(name);
+    return found == ids.end() ? METHOD_NONE : found->second;
+}
+
+BinaryOp binary_op_from_token(Token& tok) {
+    static const std::unordered_map<std::string, BinaryOp> ops{
+        {TOKEN_ADD, BINARY_ADD},     {TOKEN_SUB, BINARY_SUB},
+        {TOKEN_MUL, BINARY_MUL},     {TOKEN_DIV, BINARY_DIV},
+        {TOKEN_MOD, BINARY_MOD},     {TOKEN_POW, BINARY_POW},
+        {TOKEN_EQUAL, BINARY_EQUAL}, {TOKEN_NEQ, BINARY_NOT_EQUAL},
+        {TOKEN_LESS, BINARY_LESS},   {TOKEN_GREATER, BINARY_GREATER},
+        {TOKEN_LEQ, BINARY_LESS_EQUAL}, {TOKEN_GEQ, BINARY_GREATER_EQUAL}};
+    if (tok.get_type() == TOKEN_KEYWORD) {
+        if (tok.get_value() == "and") return BINARY_AND;
+        if (tok.get_value() == "or") return BINARY_OR;
+        return BINARY_COUNT;
+    }
+    auto found = ops.find(tok.get_type());
+    return found == ops.end() ? BINARY_COUNT : found->second;
+}
+
 std::string MemberAccessNode::get_node() {
     std::stringstream ss;
     ss << obj->get_node() << "." << member->get_node();
@@ -5,11 +5,13 @@
 #ifndef NODE_H
 #define NODE_H
 
-#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "token.h"
@@ -35,11 +37,59 @@ const std::string NODE_RETURN("RETURN");
 const std::string NODE_BREAK("BREAK");
 const std::string NODE_CONTINUE("CONTINUE");
 const std::string NODE_PRECOMPUTED("PRECOMPUTED");
+const std::string NODE_SPAWN("SPAWN");
 const std::string TAB{"    "};
 
+// Facts computed once per node by annotate_ast (analysis.h) right after parsing.
+enum NodeFlag : std::uint32_t {
+    NODE_FLAG_RESULT_USED = 1u << 0,     // value is observed by the enclosing code
+    NODE_FLAG_HAS_ASSIGNMENT = 1u << 1,  // subtree contains a variable or array store
+    NODE_FLAG_PURE = 1u << 2,            // no effects outside the evaluating scope
+    NODE_FLAG_CONSTANT = 1u << 3,        // literal arithmetic only
+    NODE_FLAG_JIT_ROOT = 1u << 4,        // candidate root for ExpressionJit
+    NODE_FLAG_SELF_RECURSIVE = 1u << 5,  // Algorithm body calls itself
+    NODE_FLAG_MEMOIZABLE = 1u << 6,      // see is_memoizable_numeric_algo
+    NODE_FLAG_SINGLE_RETURN = 1u << 7,   // Algorithm body is one numeric return
+    NODE_FLAG_ASSOCIATIVE = 1u << 8,     // see is_associative_combiner
+};
+
+// How Interpreter::visit runs a node. Nodes start Unvisited; the first visit
+// picks the generic form and, when the operands allow it, a specialized one
+// instead. A specialized node checks its assumption on every visit and falls
+// back to its generic form for good once the assumption fails.
+enum class Quickened : std::uint8_t {
+    Unvisited,
+    Unknown,
+    Value,
+    VarAccess,
+    VarAssign,
+    BinOp,
+    UnaryOp,
+    If,
+    For,
+    While,
+    Repeat,
+    AlgoDef,
+    StructDef,
+    AlgoCall,
+    Array,
+    ArrayAccess,
+    ArrayAssign,
+    MemberAccess,
+    Return,
+    Break,
+    Continue,
+    Precomputed,
+    Spawn,
+    // Specialized forms
+    IntBinOp,   // BinOp whose operands have been Int
+    LocalLoad,  // VarAccess bound in the scope it runs in
+    ArrayLoad,  // ArrayAccess of an Array at an Int index
+};
+
 class Node {
    public:
-    Node() : node_id(next_node_id.fetch_add(1, std::memory_order_relaxed)) {}
+    Node() = default;
     virtual std::string get_node() = 0;
     virtual ~Node() {}
     virtual std::vector<std::shared_ptr<Node>> get_child() {
@@ -49,15 +99,142 @@ class Node {
     virtual std::shared_ptr<Token> get_tok() { return nullptr; }
     virtual TokenList get_toks() { return TokenList(0); }
     virtual std::string get_name() { return ""; }
-    std::size_t get_id() const { return node_id; }
+    // get_name() interned; nodes that carry a name resolve it when built.
+    virtual SymbolId get_symbol() { return intern_symbol(get_name()); }
+    // Where the node is in the trees annotate_ast numbered (NodeTable): the
+    // tree, from 1, and the node's ordinal in it. Tree 0 until numbered.
+    std::uint32_t get_tree() const { return tree; }
+    std::uint32_t get_ordinal() const { return ordinal; }
+    void number(std::uint32_t _tree, std::uint32_t _ordinal) {
+        tree = _tree;
+        ordinal = _ordinal;
+    }
+    bool has_flag(NodeFlag flag) const { return (flags & flag) != 0; }
+    void set_flag(NodeFlag flag, bool value) {
+        flags = value ? (flags | flag) : (flags & ~static_cast<std::uint32_t>(flag));
+    }
+    Quickened get_quickened() const { return quickened; }
+    void quicken(Quickened form) { quickened = form; }
 
    private:
-    inline static std::atomic_size_t next_node_id{1};
-    std::size_t node_id;
+    std::uint32_t tree{0};
+    std::uint32_t ordinal{0};
+    std::uint32_t flags{NODE_FLAG_RESULT_USED};
+    Quickened quickened{Quickened::Unvisited};
 };
 
 using NodeList = std::vector<std::shared_ptr<Node>>;
 
+// Builtin container and file methods (`arr.push(x)`, `table.get(k)`, ...), resolved from
+// the member name once when the member access node is built.
+enum MethodId : std::uint8_t {
+    METHOD_NONE,
+    METHOD_PUSH,
+    METHOD_POP,
+    METHOD_RESIZE,
+    METHOD_INSERT,
+    METHOD_REMOVE,
+    METHOD_SIZE,
+    METHOD_BACK,
+    METHOD_SET,
+    METHOD_GET,
+    METHOD_CONTAINS,
+    METHOD_IS_EMPTY,
+    METHOD_KEYS,
+    METHOD_VALUES,
+    METHOD_CLEAR,
+    METHOD_READ_LINE,
+    METHOD_READ_FIELDS,
+    METHOD_READ_BYTES,
+    METHOD_AT_END,
+    METHOD_WRITE,
+    METHOD_WRITE_LINE,
+    METHOD_CLOSE,
+    METHOD_COUNT
+};
+
+MethodId method_id_from_name(const std::string& name);
+
+// Binary operators, resolved from the operator token once when the node is
+// built. Indexes the kernel tables in binop.h.
+enum BinaryOp : std::uint8_t {
+    BINARY_ADD,
+    BINARY_SUB,
+    BINARY_MUL,
+    BINARY_DIV,
+    BINARY_MOD,
+    BINARY_POW,
+    BINARY_EQUAL,
+    BINARY_NOT_EQUAL,
+    BINARY_LESS,
+    BINARY_GREATER,
+    BINARY_LESS_EQUAL,
+    BINARY_GREATER_EQUAL,
+    BINARY_AND,
+    BINARY_OR,
+    BINARY_COUNT  // not a binary operator
+};
+
+BinaryOp binary_op_from_token(Token& tok);
+
+struct BuiltinMethod;
+class Value;
+
+// Call-site inline cache: the receiver kind last seen by a method call and the
+// builtin method it resolved to.
+struct MethodInlineCache {
+    std::uint8_t receiver_kind{0xFF};
+    const BuiltinMethod* method{nullptr};
+};
+
+// Slot cache of a LocalLoad node: where the name lives in the scope with
+// SymbolTable::serial() `table_serial`.
+struct LocalSlotCache {
+    std::uint64_t table_serial{0};
+    std::shared_ptr<Value>* slot{nullptr};
+};
+
+// Side table of node entries: one dense run per numbered tree (Node::get_tree),
+// indexed by the node's ordinal, so a table spans the trees it serves
+// and not every node the process has parsed. A node annotate_ast has not
+// numbered gets a fresh entry each time. Growing it keeps references to
+// existing entries valid, so callers may hold an entry across re-entrant
+// visits.
+template <typename T>
+class NodeTable {
+   public:
+    NodeTable() = default;
+    NodeTable(const NodeTable&) = delete;
+    NodeTable& operator=(const NodeTable&) = delete;
+
+    T& operator[](const Node& node) {
+        if (node.get_tree() == 0) return unnumbered.emplace_back();
+        std::deque<T>& entries = run(node.get_tree());
+        if (node.get_ordinal() >= entries.size()) entries.resize(node.get_ordinal() + 1);
+        return entries[node.get_ordinal()];
+    }
+    // The entry for `node`, or nullptr when it has none, without growing.
+    T* find(const Node& node) {
+        auto found = runs.find(node.get_tree());
+        if (found == runs.end() || node.get_ordinal() >= found->second.size()) return nullptr;
+        return &found->second[node.get_ordinal()];
+    }
+
+   private:
+    std::deque<T>& run(std::uint32_t tree) {
+        if (tree != last_tree) {
+            last = &runs[tree];
+            last_tree = tree;
+        }
+        return *last;
+    }
+
+    std::unordered_map<std::uint32_t, std::deque<T>> runs;
+    std::uint32_t last_tree{0};
+    std::deque<T>* last{nullptr};
+    std::deque<T> unnumbered;
+};
+
 class ErrorNode : public Node {
    public:
     ErrorNode(std::shared_ptr<Token> _tok) : tok(_tok) {}
@@ -83,15 +260,19 @@ class ValueNode : public Node {
 class BinOpNode : public Node {
    public:
     BinOpNode(std::shared_ptr<Node> left, std::shared_ptr<Node> right, std::shared_ptr<Token> tok)
-        : left_node(left), right_node(right), op_tok(tok) {}
+        : left_node(left), right_node(right), op_tok(tok), op(binary_op_from_token(*tok)) {}
     std::string get_node() override;
     NodeList get_child() override;
     std::string get_type() override { return NODE_BINOP; }
     std::shared_ptr<Token> get_tok() override { return op_tok; }
+    const std::shared_ptr<Node>& get_left() const { return left_node; }
+    const std::shared_ptr<Node>& get_right() const { return right_node; }
+    BinaryOp get_op() const { return op; }
 
    protected:
     std::shared_ptr<Node> left_node, right_node;
     std::shared_ptr<Token> op_tok;
+    BinaryOp op;
 };
 
 class UnaryOpNode : public Node {
@@ -110,29 +291,43 @@ class UnaryOpNode : public Node {
 
 class VarAssignNode : public Node {
    public:
-    VarAssignNode(std::string _name, std::shared_ptr<Node> _node) : name(_name), node(_node) {}
+    VarAssignNode(std::string _name, std::shared_ptr<Node> _node)
+        : name(_name), symbol(intern_symbol(name)), node(_node) {}
     std::string get_node() override;
     NodeList get_child() override { return NodeList{node}; }
     std::string get_type() override { return NODE_VARASSIGN; }
     std::shared_ptr<Token> get_tok() override { return nullptr; }
     std::string get_name() override { return name; }
+    SymbolId get_symbol() override { return symbol; }
 
    protected:
     std::string name;
+    SymbolId symbol;
     std::shared_ptr<Node> node;
 };
 
+// Where a variable read resolves, as decided by the scope resolver in
+// analysis.cpp. Global is only taken as a shortcut under lexical scoping.
+enum class VarScope : std::uint8_t { Local, Global, Builtin };
+
 class VarAccessNode : public Node {
    public:
-    VarAccessNode(std::shared_ptr<Token> _tok) : tok(_tok) {}
+    VarAccessNode(std::shared_ptr<Token> _tok) : tok(_tok), symbol(tok->get_symbol()) {}
     std::string get_node() override;
     NodeList get_child() override { return NodeList(0); }
     std::string get_type() override { return NODE_VARACCESS; }
     std::shared_ptr<Token> get_tok() override { return tok; }
     std::string get_name() override { return tok->get_value(); }
+    SymbolId get_symbol() override { return symbol; }
+    VarScope get_scope() const { return scope; }
+    void set_scope(VarScope _scope) { scope = _scope; }
+    LocalSlotCache& get_slot_cache() { return slot_cache; }
 
    protected:
     std::shared_ptr<Token> tok;
+    SymbolId symbol;
+    VarScope scope{VarScope::Local};
+    LocalSlotCache slot_cache;
 };
 
 class IfNode : public Node {
@@ -158,11 +353,12 @@ class IfNode : public Node {
 class ForNode : public Node {
    public:
     ForNode(std::shared_ptr<Node> _var_assign, std::shared_ptr<Node> _end_value,
-            std::shared_ptr<Node> _step_value, NodeList _body_node)
+            std::shared_ptr<Node> _step_value, NodeList _body_node, bool _parallel = false)
         : var_assign(_var_assign),
           end_value(_end_value),
           step_value(_step_value),
-          body_node(_body_node) {}
+          body_node(_body_node),
+          parallel(_parallel) {}
     std::string get_node() override;
     NodeList get_child() override {
         NodeList child{var_assign, end_value, step_value};
@@ -172,10 +368,14 @@ class ForNode : public Node {
     std::string get_type() override { return NODE_FOR; }
     std::shared_ptr<Token> get_tok() override { return nullptr; }
     std::string get_name() override { return ""; }
+    // `parallel for`: iterations may run concurrently (see run_parallel_loop).
+    bool is_parallel() const { return parallel; }
+    const NodeList& get_body() const { return body_node; }
 
    protected:
     std::shared_ptr<Node> var_assign, end_value, step_value;
     NodeList body_node;
+    bool parallel;
 };
 
 class WhileNode : public Node {
@@ -220,7 +420,10 @@ class AlgorithmDefNode : public Node {
    public:
     AlgorithmDefNode(std::shared_ptr<Token> _algo_name, const TokenList& _args_name,
                      NodeList _body_node = {})
-        : algo_name(_algo_name), args_name(_args_name), body_node(_body_node) {}
+        : algo_name(_algo_name),
+          args_name(_args_name),
+          body_node(_body_node),
+          symbol(algo_name->get_symbol()) {}
     std::string get_node() override;
     NodeList get_child() override { return body_node; }
     const NodeList& get_body() const { return body_node; }
@@ -228,11 +431,13 @@ class AlgorithmDefNode : public Node {
     std::shared_ptr<Token> get_tok() override { return algo_name; }
     TokenList get_toks() override { return args_name; }
     std::string get_name() override { return algo_name->get_value(); }
+    SymbolId get_symbol() override { return symbol; }
 
    protected:
     std::shared_ptr<Token> algo_name;
     TokenList args_name;
     NodeList body_node;
+    SymbolId symbol;
 };
 
 class AlgorithmCallNode : public Node {
@@ -245,11 +450,14 @@ class AlgorithmCallNode : public Node {
     std::string get_type() override { return NODE_ALGOCALL; }
     std::shared_ptr<Token> get_tok() override { return nullptr; }
     std::string get_name() override { return call_node->get_name(); }
-    std::shared_ptr<Node> get_call() { return call_node; }
+    SymbolId get_symbol() override { return call_node->get_symbol(); }
+    const std::shared_ptr<Node>& get_call() const { return call_node; }
+    MethodInlineCache& get_method_cache() { return method_cache; }
 
    protected:
     std::shared_ptr<Node> call_node;
     NodeList args;
+    MethodInlineCache method_cache;
 };
 
 class ArrayNode : public Node {
@@ -273,6 +481,8 @@ class ArrayAccessNode : public Node {
     NodeList get_child() override { return NodeList{arr, index}; }
     std::string get_type() override { return NODE_ARRACCESS; }
     std::shared_ptr<Token> get_tok() override { return nullptr; }
+    const std::shared_ptr<Node>& get_array() const { return arr; }
+    const std::shared_ptr<Node>& get_index() const { return index; }
 
    protected:
     std::shared_ptr<Node> arr, index;
@@ -294,32 +504,48 @@ class ArrayAssignNode : public Node {
 class MemberAccessNode : public Node {
    public:
     MemberAccessNode(std::shared_ptr<Node> _obj, std::shared_ptr<Node> _member)
-        : obj(_obj), member(_member) {}
+        : obj(_obj),
+          member(_member),
+          member_name(_member->get_name()),
+          member_symbol(_member->get_symbol()),
+          method_id(method_id_from_name(member_name)) {}
     std::string get_node() override;
     NodeList get_child() override { return NodeList{obj, member}; }
     std::string get_type() override { return NODE_MEMACCESS; }
     std::shared_ptr<Token> get_tok() override { return nullptr; }
+    const std::shared_ptr<Node>& get_obj() const { return obj; }
+    const std::string& get_member_name() const { return member_name; }
+    SymbolId get_member_symbol() const { return member_symbol; }
+    MethodId get_method_id() const { return method_id; }
 
    protected:
     std::shared_ptr<Node> obj, member;
+    std::string member_name;
+    SymbolId member_symbol;
+    MethodId method_id;
 };
 
 class StructDefNode : public Node {
    public:
     StructDefNode(std::shared_ptr<Token> _struct_name, const TokenList& _members,
                   const NodeList& _methods)
-        : struct_name(_struct_name), members(_members), methods(_methods) {}
+        : struct_name(_struct_name),
+          members(_members),
+          methods(_methods),
+          symbol(struct_name->get_symbol()) {}
     std::string get_node() override;
     NodeList get_child() override { return methods; }
     std::string get_type() override { return NODE_STRUCTDEF; }
     std::shared_ptr<Token> get_tok() override { return struct_name; }
     TokenList get_toks() override { return members; }
     std::string get_name() override { return struct_name->get_value(); }
+    SymbolId get_symbol() override { return symbol; }
 
    protected:
     std::shared_ptr<Token> struct_name;
     TokenList members;
     NodeList methods;
+    SymbolId symbol;
 };
 
 class ReturnNode : public Node {
@@ -335,6 +561,21 @@ class ReturnNode : public Node {
     std::shared_ptr<Node> node;
 };
 
+// `spawn f(args)`: starts the call as a task.
+class SpawnNode : public Node {
+   public:
+    SpawnNode(std::shared_ptr<Node> _call) : call(_call) {}
+    std::string get_node() override { return "(SPAWN " + call->get_node() + ")"; }
+    NodeList get_child() override { return NodeList{call}; }
+    std::string get_type() override { return NODE_SPAWN; }
+    std::shared_ptr<Token> get_tok() override { return nullptr; }
+    std::string get_name() override { return ""; }
+    const std::shared_ptr<Node>& get_call() const { return call; }
+
+   protected:
+    std::shared_ptr<Node> call;
+};
+
 class ControlNode : public Node {
    public:
     ControlNode(const std::string& _type) : control_type(_type) {}
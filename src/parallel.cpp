@@ -0,0 +1,314 @@
+/// --------------------
+/// Parallel loops
+/// --------------------
+
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "binop.h"
+#include "scheduler.h"
+
+namespace {
+
+// Chunks per loop: enough to balance uneven iterations across the pool.
+constexpr std::int64_t PARALLEL_CHUNKS = 256;
+
+struct ChunkResult {
+    ValueList values;
+    ValueList partials;  // one per reduction; nullptr when it is not reduced
+    std::shared_ptr<Value> error;
+};
+
+// Starting value of a reduction over `current`, or nullptr when the kind
+// of `current` cannot be reduced with `op`.
+std::shared_ptr<Value> reduction_identity(BinaryOp op, const std::shared_ptr<Value>& current) {
+    int64_t unit = op == BINARY_MUL ? 1 : 0;
+    switch (current->get_kind()) {
+        case ValueKind::Int:
+            return make_pooled<TypedValue<int64_t>>(VALUE_INT, unit);
+        case ValueKind::Float:
+            return make_pooled<TypedValue<double>>(VALUE_FLOAT, static_cast<double>(unit));
+        case ValueKind::String:
+            if (op == BINARY_ADD) return make_pooled<TypedValue<std::string>>(VALUE_STRING, "");
+            return nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+// Gives the calling thread a chunk id of its own (ContainerValue::running_chunk)
+// while it runs one chunk of iterations.
+class ChunkOwner {
+   public:
+    ChunkOwner() : saved(ContainerValue::running_chunk) {
+        static std::atomic<std::uint32_t> last{0};
+        std::uint32_t id = ++last;
+        if (id == 0) id = ++last;
+        ContainerValue::running_chunk = id;
+    }
+    ~ChunkOwner() { ContainerValue::running_chunk = saved; }
+    ChunkOwner(const ChunkOwner&) = delete;
+    ChunkOwner& operator=(const ChunkOwner&) = delete;
+
+   private:
+    std::uint32_t saved;
+};
+
+void lower_to(std::atomic<std::size_t>& target, std::size_t value) {
+    std::size_t current = target.load();
+    while (value < current && !target.compare_exchange_weak(current, value)) {
+    }
+}
+
+// Arrays shorter than this are handled on the calling thread: their calls
+// would not pay for the chunks.
+constexpr std::size_t PARALLEL_MIN_ELEMENTS = 1024;
+
+bool is_error(const std::shared_ptr<Value>& value) { return value->get_kind() == ValueKind::Error; }
+
+std::shared_ptr<Value> call_with(const std::shared_ptr<Value>& f, const ValueList& args,
+                                 SymbolTable* parent) {
+    NodeList arg_nodes;
+    arg_nodes.reserve(args.size());
+    for (const auto& arg : args) arg_nodes.push_back(make_pooled<PrecomputedNode>(arg));
+    return f->execute(arg_nodes, parent);
+}
+
+bool runs_chunked(const std::shared_ptr<Value>& f, std::size_t size) {
+    return size >= PARALLEL_MIN_ELEMENTS && sched::thread_count() > 1 && f->is_pure();
+}
+
+// Splits `size` elements into chunks and runs body(chunk, first, last) for
+// each on the scheduler. A body returning an error stops the chunks after
+// it; the error of the earliest failing chunk is returned, else nullptr.
+std::shared_ptr<Value> run_chunks(
+    std::size_t size,
+    const std::function<std::shared_ptr<Value>(std::size_t, std::size_t, std::size_t)>& body) {
+    std::size_t chunks = std::min(size, static_cast<std::size_t>(PARALLEL_CHUNKS));
+    ValueList errors(chunks);
+    std::atomic<std::size_t> first_failed{std::numeric_limits<std::size_t>::max()};
+    sched::parallel_for(chunks, [&](std::size_t chunk) {
+        if (chunk > first_failed.load()) return;
+        std::shared_ptr<Value> error =
+            body(chunk, size * chunk / chunks, size * (chunk + 1) / chunks);
+        if (error) {
+            errors[chunk] = error;
+            lower_to(first_failed, chunk);
+        }
+    });
+    for (const auto& error : errors) {
+        if (error) return error;
+    }
+    return nullptr;
+}
+
+// Sets results[k] to f(elements[k]) for every element. Returns the error of
+// the earliest failing call, or nullptr.
+std::shared_ptr<Value> call_each(const std::shared_ptr<Value>& f, const ValueList& elements,
+                                 SymbolTable* parent, ValueList& results) {
+    results.assign(elements.size(), nullptr);
+    if (!runs_chunked(f, elements.size())) {
+        for (std::size_t k = 0; k < elements.size(); ++k) {
+            results[k] = call_with(f, {elements[k]}, parent);
+            if (is_error(results[k])) return results[k];
+        }
+        return nullptr;
+    }
+    return run_chunks(elements.size(), [&](std::size_t, std::size_t first, std::size_t last) {
+        for (std::size_t k = first; k < last; ++k) {
+            results[k] = call_with(f, {elements[k]}, parent);
+            if (is_error(results[k])) return results[k];
+        }
+        return std::shared_ptr<Value>();
+    });
+}
+
+// The error for a call with the wrong kinds of arguments, or nullptr.
+std::shared_ptr<Value> check_array_call(const std::string& name, const std::shared_ptr<Value>& arr,
+                                        const std::shared_ptr<Value>& f) {
+    if (arr->get_kind() != ValueKind::Array) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, name + " expects an Array\n");
+    }
+    if (f->get_type() != VALUE_ALGO) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, name + " expects an Algorithm\n");
+    }
+    return nullptr;
+}
+
+// A copy, so calls that modify `arr` do not change what is iterated.
+ValueList elements_of(const std::shared_ptr<Value>& arr) {
+    return static_cast<ArrayValue*>(arr.get())->elements();
+}
+
+}  // namespace
+
+std::int64_t parallel_trip_count(std::int64_t start, std::int64_t end, std::int64_t step) {
+    if (step > 0 && end >= start) return (end - start) / step + 1;
+    if (step < 0 && end <= start) return (start - end) / -step + 1;
+    return 0;
+}
+
+std::shared_ptr<Value> check_shared_writes(const SharedWrites& writes, SymbolTable& scope) {
+    if (!writes.error.empty()) return make_pooled<ErrorValue>(VALUE_ERROR, writes.error + "\n");
+    for (SymbolId symbol : writes.element_writes) {
+        std::shared_ptr<Value> target = scope.get(symbol);
+        if (target.get() != nullptr && target->get_kind() == ValueKind::HashTable) {
+            return make_pooled<ErrorValue>(
+                VALUE_ERROR, "Storing into HashTable \"" + symbol_name(symbol) +
+                                 "\" changes a table shared by the iterations of a parallel for "
+                                 "loop\n");
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<Value> run_parallel_loop(SymbolTable& scope, SymbolId loop_symbol,
+                                         std::int64_t start, std::int64_t step,
+                                         std::int64_t count,
+                                         const std::vector<LoopReduction>& reductions,
+                                         bool collect, const IterationBody& body) {
+    ValueList identities;
+    for (const LoopReduction& reduction : reductions) {
+        std::shared_ptr<Value> current = scope.get(reduction.symbol);
+        identities.push_back(reduction_identity(reduction.op, current));
+    }
+
+    std::int64_t chunks = std::min(count, PARALLEL_CHUNKS);
+    std::vector<ChunkResult> results(static_cast<std::size_t>(std::max<std::int64_t>(chunks, 0)));
+    // Chunks after the earliest failed one have nothing to report.
+    std::atomic<std::size_t> first_failed{std::numeric_limits<std::size_t>::max()};
+
+    sched::parallel_for(results.size(), [&](std::size_t chunk) {
+        std::int64_t first = count * static_cast<std::int64_t>(chunk) / chunks;
+        std::int64_t last = count * static_cast<std::int64_t>(chunk + 1) / chunks;
+        ChunkResult& result = results[chunk];
+        ChunkOwner owner;
+        SymbolTable chunk_scope(&scope);
+        for (std::size_t r = 0; r < reductions.size(); ++r) {
+            if (identities[r]) chunk_scope.set(reductions[r].symbol, identities[r]);
+        }
+        for (std::int64_t k = first; k < last && chunk < first_failed.load(); ++k) {
+            chunk_scope.set(loop_symbol, make_pooled<TypedValue<int64_t>>(VALUE_INT, start + k * step));
+            std::shared_ptr<Value> value = body(chunk_scope);
+            ValueKind kind = value->get_kind();
+            if (kind == ValueKind::Break || kind == ValueKind::Return) {
+                value = make_pooled<ErrorValue>(
+                    VALUE_ERROR, std::string(kind == ValueKind::Break ? "break" : "return") +
+                                     " is not allowed in a parallel for loop\n");
+                kind = ValueKind::Error;
+            }
+            if (kind == ValueKind::Error) {
+                result.error = value;
+                lower_to(first_failed, chunk);
+                return;
+            }
+            if (collect && kind != ValueKind::Continue) result.values.push_back(value);
+        }
+        for (std::size_t r = 0; r < reductions.size(); ++r) {
+            result.partials.push_back(identities[r] ? chunk_scope.get_local(reductions[r].symbol)
+                                                    : nullptr);
+        }
+    });
+
+    for (const ChunkResult& result : results) {
+        if (result.error) return result.error;
+    }
+    for (std::size_t r = 0; r < reductions.size(); ++r) {
+        if (identities[r].get() == nullptr) continue;
+        std::shared_ptr<Value> total = scope.get(reductions[r].symbol);
+        for (const ChunkResult& result : results) {
+            total = apply_binary(reductions[r].op, total, result.partials[r]);
+            if (total->get_kind() == ValueKind::Error) return total;
+        }
+        scope.set(reductions[r].symbol, total);
+    }
+    scope.set(loop_symbol, make_pooled<TypedValue<int64_t>>(VALUE_INT, start + count * step));
+
+    if (!collect) return make_pooled<Value>();
+    ValueList values;
+    for (const ChunkResult& result : results) {
+        values.insert(values.end(), result.values.begin(), result.values.end());
+    }
+    return make_pooled<ArrayValue>(values);
+}
+
+std::shared_ptr<Value> map_array(const std::shared_ptr<Value>& arr, const std::shared_ptr<Value>& f,
+                                 SymbolTable* parent) {
+    if (std::shared_ptr<Value> error = check_array_call("map", arr, f)) return error;
+    ValueList results;
+    if (std::shared_ptr<Value> error = call_each(f, elements_of(arr), parent, results)) {
+        return error;
+    }
+    return make_pooled<ArrayValue>(results);
+}
+
+std::shared_ptr<Value> filter_array(const std::shared_ptr<Value>& arr,
+                                    const std::shared_ptr<Value>& pred, SymbolTable* parent) {
+    if (std::shared_ptr<Value> error = check_array_call("filter", arr, pred)) return error;
+    ValueList elements = elements_of(arr);
+    ValueList results;
+    if (std::shared_ptr<Value> error = call_each(pred, elements, parent, results)) return error;
+    ValueList kept;
+    for (std::size_t k = 0; k < elements.size(); ++k) {
+        if (results[k]->get_kind() == ValueKind::Int && results[k]->as_int() == 1) {
+            kept.push_back(elements[k]);
+        }
+    }
+    return make_pooled<ArrayValue>(kept);
+}
+
+std::shared_ptr<Value> reduce_array(const std::shared_ptr<Value>& arr,
+                                    const std::shared_ptr<Value>& f,
+                                    const std::shared_ptr<Value>& init, SymbolTable* parent) {
+    if (std::shared_ptr<Value> error = check_array_call("reduce", arr, f)) return error;
+    ValueList elements = elements_of(arr);
+    auto is_int = [](const std::shared_ptr<Value>& value) {
+        return value->get_kind() == ValueKind::Int;
+    };
+    bool chunked = runs_chunked(f, elements.size()) && f->is_associative() && is_int(init) &&
+                   std::all_of(elements.begin(), elements.end(), is_int);
+    if (!chunked) {
+        std::shared_ptr<Value> total = init;
+        for (const auto& element : elements) {
+            total = call_with(f, {total, element}, parent);
+            if (is_error(total)) return total;
+        }
+        return total;
+    }
+
+    ValueList partials(std::min(elements.size(), static_cast<std::size_t>(PARALLEL_CHUNKS)));
+    std::shared_ptr<Value> error =
+        run_chunks(elements.size(), [&](std::size_t chunk, std::size_t first, std::size_t last) {
+            std::shared_ptr<Value> partial = elements[first];
+            for (std::size_t k = first + 1; k < last; ++k) {
+                partial = call_with(f, {partial, elements[k]}, parent);
+                if (is_error(partial)) return partial;
+            }
+            partials[chunk] = partial;
+            return std::shared_ptr<Value>();
+        });
+    if (error) return error;
+    std::shared_ptr<Value> total = init;
+    for (const auto& partial : partials) {
+        total = call_with(f, {total, partial}, parent);
+        if (is_error(total)) return total;
+    }
+    return total;
+}
+
+std::shared_ptr<Value> for_each_array(const std::shared_ptr<Value>& arr,
+                                      const std::shared_ptr<Value>& f, SymbolTable* parent) {
+    if (std::shared_ptr<Value> error = check_array_call("for_each", arr, f)) return error;
+    ValueList results;
+    if (std::shared_ptr<Value> error = call_each(f, elements_of(arr), parent, results)) {
+        return error;
+    }
+    return make_pooled<Value>();
+}
@@ -0,0 +1,75 @@
+/// --------------------
+/// Parallel loops
+/// --------------------
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "analysis.h"
+#include "symboltable.h"
+#include "value.h"
+
+// One iteration of a parallel loop body, run with the loop variable bound in
+// `scope`. Returns the iteration's value.
+using IterationBody = std::function<std::shared_ptr<Value>(SymbolTable& scope)>;
+
+// Iterations of `for i <- start to end step step`, or 0 when there are none.
+// `step` must not be 0.
+std::int64_t parallel_trip_count(std::int64_t start, std::int64_t end, std::int64_t step);
+
+// The error for a loop body whose changes to `scope`'s containers
+// (find_shared_writes) would race between iterations, or nullptr.
+std::shared_ptr<Value> check_shared_writes(const SharedWrites& writes, SymbolTable& scope);
+
+// Runs `count` iterations of `parallel for` with `loop_symbol` bound to
+// start, start + step, ... on the scheduler. The iterations are split into a
+// fixed number of chunks, so results do not depend on the thread count. Each
+// chunk runs in its own child scope of `scope`. Names the body assigns stay
+// private to their chunk, except for `reductions`. While a chunk runs, it may
+// only change containers it made itself, apart from storing elements of
+// other arrays (ContainerValue::check_change). Each chunk accumulates a
+// reduction from its operator's identity, and the partial results are folded
+// into `scope` in iteration order. Like a sequential loop, `loop_symbol` ends
+// up one step past the last iteration.
+//
+// Returns the error of the earliest failing iteration. Otherwise returns the
+// per-iteration values in order when `collect` is set, or None.
+std::shared_ptr<Value> run_parallel_loop(SymbolTable& scope, SymbolId loop_symbol,
+                                         std::int64_t start, std::int64_t step,
+                                         std::int64_t count,
+                                         const std::vector<LoopReduction>& reductions,
+                                         bool collect, const IterationBody& body);
+
+// Higher-order array builtins. Each works on the elements `arr` has when the
+// call starts and calls `f` with `parent` as the caller's scope. When `f` is
+// pure and the array is large, the calls run in chunks on the scheduler;
+// otherwise they run one at a time in order. Either way the result is the
+// sequential one, and a failing call reports the error of the earliest
+// failing element.
+
+// map(arr, f): a new array of f(x) for each element x.
+std::shared_ptr<Value> map_array(const std::shared_ptr<Value>& arr, const std::shared_ptr<Value>& f,
+                                 SymbolTable* parent);
+
+// filter(arr, pred): a new array of the elements x for which pred(x) is 1.
+std::shared_ptr<Value> filter_array(const std::shared_ptr<Value>& arr,
+                                    const std::shared_ptr<Value>& pred, SymbolTable* parent);
+
+// reduce(arr, f, init): f(...f(f(init, x1), x2)..., xn). Only chunked when
+// `f` is also associative and `init` and every element are Ints; each chunk
+// then folds from its first element and the partials fold onto `init` in
+// order.
+std::shared_ptr<Value> reduce_array(const std::shared_ptr<Value>& arr,
+                                    const std::shared_ptr<Value>& f,
+                                    const std::shared_ptr<Value>& init, SymbolTable* parent);
+
+// for_each(arr, f): calls f(x) for each element x and returns None.
+std::shared_ptr<Value> for_each_array(const std::shared_ptr<Value>& arr,
+                                      const std::shared_ptr<Value>& f, SymbolTable* parent);
+
+#endif
@@ -3,9 +3,11 @@
 /// --------------------
 
 #include "parser.h"
+#include "analysis.h"
 #include "color.h"
 #include "lexer.h"
 #include "node.h"
+#include "pool.h"
 #include "token.h"
 #include <iostream>
 #include <memory>
@@ -22,7 +24,7 @@ const Grammar CFG{
     {GrammarProduction::Factor, "factor -> (+ | -) factor | power"},
     {GrammarProduction::Power, "power -> call (^ factor)*"},
     {GrammarProduction::Call, "call -> atom (member-access | call-args | index | assignment)*"},
-    {GrammarProduction::Atom, "atom -> literal | identifier | group | array | if | for | while | repeat | algorithm | struct | return | break | continue"},
+    {GrammarProduction::Atom, "atom -> literal | identifier | group | array | if | for | while | repeat | algorithm | struct | return | break | continue | spawn call"},
     {GrammarProduction::ArrayExpr, "array -> { (expr (, expr)*)? }"},
     {GrammarProduction::IfExpr, "if -> if expr then block (else (if | block))?"},
     {GrammarProduction::ForExpr, "for -> for identifier <- expr to expr (step expr)? do block"},
@@ -50,8 +52,8 @@ bool Parser::match_keyword(const std::string& keyword) const {
 }
 
 std::shared_ptr<Node> Parser::parse_error(const std::string& message) {
-    std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), message);
-    return std::make_shared<ErrorNode>(error_token);
+    std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), message);
+    return make_pooled<ErrorNode>(error_token);
 }
 
 std::shared_ptr<Token> Parser::advance() {
@@ -59,7 +61,7 @@ std::shared_ptr<Token> Parser::advance() {
     if(tok_index >= 0 && tok_index < tokens.size())
         current_tok = tokens[tok_index];
     else
-        current_tok = std::make_shared<Token>();
+        current_tok = make_pooled<Token>();
     return current_tok;
 }
 
@@ -68,27 +70,27 @@ std::shared_ptr<Token> Parser::back() {
     if(tok_index >= 0 && tok_index < tokens.size())
         current_tok = tokens[tok_index];
     else
-        current_tok = std::make_shared<Token>();
+        current_tok = make_pooled<Token>();
     return current_tok;
 }
 
 std::shared_ptr<Node> Parser::atom(int tab_expect) {
-    // atom -> literal | identifier | group | array | if | for | while | repeat | algorithm | struct | return
+    // atom -> literal | identifier | group | array | if | for | while | repeat | algorithm | struct | return | spawn call
     std::shared_ptr<Token> tok = current_tok;
     std::string error_msg{"Not an atom, found \""};
     if(tok->isnumber()) {
         advance();
-        return std::make_shared<ValueNode>(tok);
+        return make_pooled<ValueNode>(tok);
     } else if(tok->get_type() == TOKEN_STRING) {
         advance();
-        return std::make_shared<ValueNode>(tok);
+        return make_pooled<ValueNode>(tok);
     } else if(tok->get_type() == TOKEN_BUILTIN_CONST) {
         advance();
-        std::shared_ptr<Token> ret{std::make_shared<TypedToken<int64_t>>(TOKEN_INT, tok->get_pos(), BUILTIN_CONST.at(tok->get_value()))};
-        return std::make_shared<ValueNode>(ret);
+        std::shared_ptr<Token> ret{make_pooled<TypedToken<int64_t>>(TOKEN_INT, tok->get_pos(), BUILTIN_CONST.at(tok->get_value()))};
+        return make_pooled<ValueNode>(ret);
     }  else if(tok->get_type() == TOKEN_BUILTIN_ALGO) {
         advance();
-        return std::make_shared<VarAccessNode>(tok);
+        return make_pooled<VarAccessNode>(tok);
     } else if(tok->get_type() == TOKEN_LEFT_PAREN) {
         advance();
         std::shared_ptr<Node> e{expr(tab_expect)};
@@ -97,26 +99,35 @@ std::shared_ptr<Node> Parser::atom(int tab_expect) {
             return e;
         }
         error_msg += "Expected \')\'";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     } else if(tok->get_type() == TOKEN_IDENTIFIER) {
         advance();
         if(current_tok->get_type() == TOKEN_ASSIGN) {
             advance();
             std::shared_ptr<Node> ret = expr(tab_expect);
             if(ret->get_type() == NODE_ERROR) return ret;
-            return std::make_shared<VarAssignNode>(tok->get_value(), ret);
+            return make_pooled<VarAssignNode>(tok->get_value(), ret);
         }
-        return std::make_shared<VarAccessNode>(tok);
+        return make_pooled<VarAccessNode>(tok);
     } else if(match_keyword("self")) {
         advance();
-        return std::make_shared<VarAccessNode>(tok);
+        return make_pooled<VarAccessNode>(tok);
     } else if(match_keyword("if")) {
         advance();
         return if_expr(tab_expect);
     } else if(match_keyword("for")) {
         advance();
         return for_expr(tab_expect);
+    } else if(match_keyword("parallel")) {
+        advance();
+        if(!match_keyword("for")) {
+            std::string error_msg = "Expected \"for\"";
+            std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+            return make_pooled<ErrorNode>(error_token);
+        }
+        advance();
+        return for_expr(tab_expect, true);
     } else if(match_keyword("while")) {
         advance();
         return while_expr(tab_expect);
@@ -138,22 +149,32 @@ std::shared_ptr<Node> Parser::atom(int tab_expect) {
     } else if(match_keyword("return")) {
         advance();
         if (current_tok->get_type() == TOKEN_NEWLINE || current_tok->get_type() == TOKEN_SEMICOLON) {
-             return std::make_shared<ReturnNode>(std::make_shared<ValueNode>(std::make_shared<Token>(TOKEN_BUILTIN_CONST, tok->get_pos()))); // Return NONE
+             return make_pooled<ReturnNode>(make_pooled<ValueNode>(make_pooled<Token>(TOKEN_BUILTIN_CONST, tok->get_pos()))); // Return NONE
         }
         std::shared_ptr<Node> ret_val = expr(tab_expect);
         if(ret_val->get_type() == NODE_ERROR) return ret_val;
-        return std::make_shared<ReturnNode>(ret_val);
+        return make_pooled<ReturnNode>(ret_val);
+    } else if(match_keyword("spawn")) {
+        advance();
+        std::shared_ptr<Node> spawned = call(tab_expect);
+        if(spawned->get_type() == NODE_ERROR) return spawned;
+        if(spawned->get_type() != NODE_ALGOCALL) {
+            std::string error_msg = "Expected an Algorithm call after \"spawn\"";
+            std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, tok->get_pos(), error_msg);
+            return make_pooled<ErrorNode>(error_token);
+        }
+        return make_pooled<SpawnNode>(spawned);
     } else if(match_keyword("break")) {
         advance();
-        return std::make_shared<ControlNode>(NODE_BREAK);
+        return make_pooled<ControlNode>(NODE_BREAK);
     } else if(match_keyword("continue")) {
         advance();
-        return std::make_shared<ControlNode>(NODE_CONTINUE);
+        return make_pooled<ControlNode>(NODE_CONTINUE);
     }
 
     error_msg += "\"";
-    std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-    return std::make_shared<ErrorNode>(error_token);
+    std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+    return make_pooled<ErrorNode>(error_token);
 }
 
 std::shared_ptr<Node> Parser::factor(int tab_expect) {
@@ -161,7 +182,7 @@ std::shared_ptr<Node> Parser::factor(int tab_expect) {
     std::shared_ptr<Token> tok = current_tok;
     if(tok->get_type() == TOKEN_ADD || tok->get_type() == TOKEN_SUB) {
         advance();
-        return std::make_shared<UnaryOpNode>(factor(tab_expect), tok);
+        return make_pooled<UnaryOpNode>(factor(tab_expect), tok);
     }
     return pow(tab_expect);
 }
@@ -191,7 +212,7 @@ std::shared_ptr<Node> Parser::comp_expr(int tab_expect) {
         advance();
         std::shared_ptr<Node> ret = comp_expr(tab_expect);
         if(ret->get_type() == NODE_ERROR) return ret;
-        return std::make_shared<UnaryOpNode>(ret, tok);
+        return make_pooled<UnaryOpNode>(ret, tok);
     }
     return bin_op(
         tab_expect,
@@ -214,7 +235,7 @@ std::shared_ptr<Node> Parser::array_expr(int tab_expect, const std::string& clos
     NodeList ret;
     if(current_tok->get_type() == closing_token) {
         advance();
-        return std::make_shared<ArrayNode>(ret);
+        return make_pooled<ArrayNode>(ret);
     }
     ret.push_back(expr(tab_expect));
     if(ret.back()->get_type() == NODE_ERROR) return ret.back();
@@ -226,11 +247,11 @@ std::shared_ptr<Node> Parser::array_expr(int tab_expect, const std::string& clos
     if(current_tok->get_type() != closing_token) {
         std::string expected = closing_token == TOKEN_RIGHT_SQUARE ? "]" : "}";
         std::string error_msg = "Expected a \"" + expected + "\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
-    return std::make_shared<ArrayNode>(ret);
+    return make_pooled<ArrayNode>(ret);
 }
 
 std::shared_ptr<Node> Parser::if_expr(int tab_expect) {
@@ -239,8 +260,8 @@ std::shared_ptr<Node> Parser::if_expr(int tab_expect) {
     if(condition->get_type() == NODE_ERROR) return condition;
     if(!match_keyword("then")) {
         std::string error_msg = "Expected \"then\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     NodeList exp;
@@ -282,32 +303,32 @@ std::shared_ptr<Node> Parser::if_expr(int tab_expect) {
             back();
         }
     }
-    return std::make_shared<IfNode>(condition, exp, els);
+    return make_pooled<IfNode>(condition, exp, els);
 }
 
-std::shared_ptr<Node> Parser::for_expr(int tab_expect) {
-    // for -> for identifier <- expr to expr (step expr)? do block
+std::shared_ptr<Node> Parser::for_expr(int tab_expect, bool parallel) {
+    // for -> (parallel)? for identifier <- expr to expr (step expr)? do block
     std::shared_ptr<Token> var_name = current_tok;
     if(current_tok->get_type() != TOKEN_IDENTIFIER) {
         std::string error_msg = "Expected \"an identifier\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     if(current_tok->get_type() != TOKEN_ASSIGN) {
         std::string error_msg = "Expected \"<-\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     std::shared_ptr<Node> start_value = expr(tab_expect);
     if(start_value->get_type() == NODE_ERROR) return start_value;
-    std::shared_ptr<Node> var_assign = std::make_shared<VarAssignNode>(var_name->get_value(), start_value);
+    std::shared_ptr<Node> var_assign = make_pooled<VarAssignNode>(var_name->get_value(), start_value);
     
     if(!match_keyword("to")) {
         std::string error_msg = "Expected \"to\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     std::shared_ptr<Node> end_value = expr(tab_expect);
@@ -321,14 +342,16 @@ std::shared_ptr<Node> Parser::for_expr(int tab_expect) {
     }
     if(!match_keyword("do")) {
         std::string error_msg = "Expected \"do\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     NodeList body_node = statement(tab_expect + 1);
     for(auto node : body_node)
         if(node->get_type() == NODE_ERROR) return node;
-    return std::make_shared<ForNode>(var_assign, end_value, step_value, body_node);
+    std::shared_ptr<Node> loop = make_pooled<ForNode>(var_assign, end_value, step_value, body_node, parallel);
+    if(parallel) parallel_loops.emplace_back(loop.get(), var_name);
+    return loop;
 }
 
 std::shared_ptr<Node> Parser::while_expr(int tab_expect) {
@@ -337,14 +360,14 @@ std::shared_ptr<Node> Parser::while_expr(int tab_expect) {
     if(condition->get_type() == NODE_ERROR) return condition;
     if(!match_keyword("do")) {
         std::string error_msg = "Expected \"do\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     NodeList body_node = statement(tab_expect + 1);
     for(auto node : body_node)
         if(node->get_type() == NODE_ERROR) return node;
-    return std::make_shared<WhileNode>(condition, body_node);
+    return make_pooled<WhileNode>(condition, body_node);
 }
 
 std::shared_ptr<Node> Parser::repeat_expr(int tab_expect) {
@@ -354,13 +377,13 @@ std::shared_ptr<Node> Parser::repeat_expr(int tab_expect) {
         if(node->get_type() == NODE_ERROR) return node;
     if(!match_keyword("until")) {
         std::string error_msg = "Expected \"until\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     std::shared_ptr<Node> condition = expr(tab_expect);
     if(condition->get_type() == NODE_ERROR) return condition;
-    return std::make_shared<RepeatNode>(body_node, condition);
+    return make_pooled<RepeatNode>(body_node, condition);
 }
 
 std::shared_ptr<Node> Parser::algo_def(int tab_expect) {
@@ -373,8 +396,8 @@ std::shared_ptr<Node> Parser::algo_def(int tab_expect) {
              advance();
              if (current_tok->get_type() != TOKEN_IDENTIFIER && current_tok->get_type() != TOKEN_KEYWORD) {
                   std::string error_msg = "Expected method name after ::";
-                  std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-                  return std::make_shared<ErrorNode>(error_token);
+                  std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+                  return make_pooled<ErrorNode>(error_token);
              }
              // For now, construct a name like "StructName::MethodName" to handle it easily in symbol table?
              // Or better, handle it in interpreter.
@@ -384,7 +407,7 @@ std::shared_ptr<Node> Parser::algo_def(int tab_expect) {
              // We can create a new Token with the mangled name, or update AlgorithmDefNode.
              // Let's just create a new Token with name "Struct::Method".
              std::string full_name = struct_name->get_value() + "::" + current_tok->get_value();
-             algo_name = std::make_shared<TypedToken<std::string>>(TOKEN_IDENTIFIER, struct_name->get_pos(), full_name);
+             algo_name = make_pooled<TypedToken<std::string>>(TOKEN_IDENTIFIER, struct_name->get_pos(), full_name);
              advance();
         } else if (current_tok->get_type() == TOKEN_IDENTIFIER) {
              // Handle "Algorithm List constructor" where List is struct name and constructor is method name
@@ -428,8 +451,8 @@ std::shared_ptr<Node> Parser::algo_def(int tab_expect) {
              advance();
         } else if (current_tok->get_type() != TOKEN_LEFT_PAREN) {
             std::string error_msg = "Expected a \"(\"";
-            std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-            return std::make_shared<ErrorNode>(error_token);
+            std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+            return make_pooled<ErrorNode>(error_token);
         }
     } else if (match_keyword("operator")) {
         // Operator overloading
@@ -450,15 +473,15 @@ std::shared_ptr<Node> Parser::algo_def(int tab_expect) {
         // Check what `add` is tokenized as.
         // "add" is not in KEYWORDS, BUILTIN_ALGO, BUILTIN_CONST. So it is IDENTIFIER.
         op_name = "operator " + current_tok->get_value();
-        algo_name = std::make_shared<TypedToken<std::string>>(TOKEN_IDENTIFIER, current_tok->get_pos(), op_name);
+        algo_name = make_pooled<TypedToken<std::string>>(TOKEN_IDENTIFIER, current_tok->get_pos(), op_name);
         advance();
 
     } else if(current_tok->get_type() != TOKEN_LEFT_PAREN) {
-        algo_name = std::make_shared<TypedToken<std::string>>(TOKEN_IDENTIFIER, current_tok->get_pos(), "Anonymous");
+        algo_name = make_pooled<TypedToken<std::string>>(TOKEN_IDENTIFIER, current_tok->get_pos(), "Anonymous");
     } else {
         std::string error_msg = "Expected an \"identifier\" or \"(\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     TokenList args_name;
@@ -469,8 +492,8 @@ std::shared_ptr<Node> Parser::algo_def(int tab_expect) {
             advance();
             if(current_tok->get_type() != TOKEN_IDENTIFIER) {
                 std::string error_msg = "Expected an \"identifier\" or a \"(\"";
-                std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-                return std::make_shared<ErrorNode>(error_token);
+                std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+                return make_pooled<ErrorNode>(error_token);
             }
             args_name.push_back(current_tok);
             advance();
@@ -479,20 +502,20 @@ std::shared_ptr<Node> Parser::algo_def(int tab_expect) {
 
     if(current_tok->get_type() != TOKEN_RIGHT_PAREN) {
         std::string error_msg = "Expected a \")\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     if(current_tok->get_type() != TOKEN_COLON) {
         std::string error_msg = "Expected a \":\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
     NodeList body_node = statement(tab_expect + 1);
     for(auto node : body_node)
         if(node->get_type() == NODE_ERROR) return node;
-    return std::make_shared<AlgorithmDefNode>(algo_name, args_name, body_node);
+    return make_pooled<AlgorithmDefNode>(algo_name, args_name, body_node);
 }
 
 std::shared_ptr<Node> Parser::pow(int tab_expect) {
@@ -513,12 +536,12 @@ std::shared_ptr<Node> Parser::call(int tab_expect) {
             if(current_tok->get_type() != TOKEN_IDENTIFIER &&
                current_tok->get_type() != TOKEN_BUILTIN_ALGO) {
                  std::string error_msg = "Expected an identifier after \".\"";
-                 std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-                 return std::make_shared<ErrorNode>(error_token);
+                 std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+                 return make_pooled<ErrorNode>(error_token);
             }
-            std::shared_ptr<Node> member = std::make_shared<VarAccessNode>(current_tok);
+            std::shared_ptr<Node> member = make_pooled<VarAccessNode>(current_tok);
             advance();
-            at = std::make_shared<MemberAccessNode>(at, member);
+            at = make_pooled<MemberAccessNode>(at, member);
             continue;
         }
 
@@ -535,12 +558,12 @@ std::shared_ptr<Node> Parser::call(int tab_expect) {
                 }
                 if(current_tok->get_type() != TOKEN_RIGHT_PAREN) {
                     std::string error_msg = "Expected a \")\"";
-                    std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-                    return std::make_shared<ErrorNode>(error_token);
+                    std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+                    return make_pooled<ErrorNode>(error_token);
                 }
             }
             advance();
-            at = std::make_shared<AlgorithmCallNode>(at, args);
+            at = make_pooled<AlgorithmCallNode>(at, args);
             continue;
         }
 
@@ -550,11 +573,11 @@ std::shared_ptr<Node> Parser::call(int tab_expect) {
             if(index->get_type() == NODE_ERROR) return index;
             if(current_tok->get_type() != TOKEN_RIGHT_SQUARE) {
                 std::string error_msg = "Expected a \"]\"";
-                std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-                return std::make_shared<ErrorNode>(error_token);
+                std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+                return make_pooled<ErrorNode>(error_token);
             }
             advance();
-            at = std::make_shared<ArrayAccessNode>(at, index);
+            at = make_pooled<ArrayAccessNode>(at, index);
             continue;
         }
 
@@ -562,7 +585,7 @@ std::shared_ptr<Node> Parser::call(int tab_expect) {
             advance();
             std::shared_ptr<Node> val = expr(tab_expect);
             if(val->get_type() == NODE_ERROR) return val;
-            return std::make_shared<ArrayAssignNode>(at, val);
+            return make_pooled<ArrayAssignNode>(at, val);
         }
 
         break;
@@ -588,7 +611,7 @@ std::shared_ptr<Node> Parser::bin_op(
         std::shared_ptr<Node> right = rfunc(tab_expect);
         if(right->get_type() == NODE_ERROR) 
             return right;
-        left = std::make_shared<BinOpNode>(left, right, op_tok);
+        left = make_pooled<BinOpNode>(left, right, op_tok);
     }
     return left;
 }
@@ -636,9 +659,9 @@ NodeList Parser::statement(int tab_expect) {
                 return ret;
             } else if (tab_count > tab_expect) {
                  std::string error_msg = "Expected " + std::to_string(tab_expect) + " tabs";
-                 std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, tok->get_pos(), error_msg);
+                 std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, tok->get_pos(), error_msg);
                  ret.clear();
-                 ret.push_back(std::make_shared<ErrorNode>(error_token));
+                 ret.push_back(make_pooled<ErrorNode>(error_token));
                  return ret;
             }
             // Exact indentation matches tab_expect
@@ -669,6 +692,21 @@ NodeList Parser::statement(int tab_expect) {
 
 NodeList Parser::parse() {
     NodeList ret = statement(0);
+    for(const auto& node : ret)
+        if(node->get_type() == NODE_ERROR) return ret;
+    // The first loop parsed that loses an assignment is reported.
+    std::vector<LostAssignment> lost = find_lost_assignments(ret);
+    for(const auto& [loop, tok] : parallel_loops) {
+        for(const auto& assignment : lost) {
+            if(assignment.loop != loop) continue;
+            std::string error_msg = "Assigning \"" + assignment.name + "\" in a parallel for loop does not change it outside the loop: only \"" +
+                                    assignment.name + " <- " + assignment.name + " + e\" and \"" + assignment.name + " <- " +
+                                    assignment.name + " * e\" updates do";
+            std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, tok->get_pos(), error_msg);
+            return NodeList{make_pooled<ErrorNode>(error_token)};
+        }
+    }
+    annotate_ast(ret);
     return ret;
 }
 
@@ -677,15 +715,15 @@ std::shared_ptr<Node> Parser::struct_def(int tab_expect) {
     std::shared_ptr<Token> struct_name = current_tok;
     if (current_tok->get_type() != TOKEN_IDENTIFIER) {
         std::string error_msg = "Expected an identifier";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
 
     if (current_tok->get_type() != TOKEN_COLON) {
         std::string error_msg = "Expected a \":\"";
-        std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-        return std::make_shared<ErrorNode>(error_token);
+        std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+        return make_pooled<ErrorNode>(error_token);
     }
     advance();
 
@@ -709,13 +747,13 @@ std::shared_ptr<Node> Parser::struct_def(int tab_expect) {
         if (tab_count < tab_expect + 1) {
              // Indentation finished, end of struct definition
              while(current_tok != tok_newline) back(); // Go back to newline
-             return std::make_shared<StructDefNode>(struct_name, members, methods);
+             return make_pooled<StructDefNode>(struct_name, members, methods);
         }
 
         if (tab_count > tab_expect + 1) {
              std::string error_msg = "Expected " + std::to_string(tab_expect + 1) + " tabs";
-             std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-             return std::make_shared<ErrorNode>(error_token);
+             std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+             return make_pooled<ErrorNode>(error_token);
         }
 
         // Inside struct block
@@ -737,10 +775,10 @@ std::shared_ptr<Node> Parser::struct_def(int tab_expect) {
              // If it's something else, might be error.
              if (current_tok->get_type() != TOKEN_NEWLINE && current_tok->get_type() != TOKEN_NONE) {
                  std::string error_msg = "Expected identifier or Algorithm inside struct";
-                 std::shared_ptr<Token> error_token = std::make_shared<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
-                 return std::make_shared<ErrorNode>(error_token);
+                 std::shared_ptr<Token> error_token = make_pooled<ErrorToken>(TOKEN_ERROR, current_tok->get_pos(), error_msg);
+                 return make_pooled<ErrorNode>(error_token);
              }
         }
     }
-    return std::make_shared<StructDefNode>(struct_name, members, methods);
+    return make_pooled<StructDefNode>(struct_name, members, methods);
 }
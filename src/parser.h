@@ -9,6 +9,8 @@
 #include <memory>
 #include <functional>
 #include <map>
+#include <utility>
+#include <vector>
 #include "node.h"
 #include "token.h"
 
@@ -46,7 +48,7 @@ public:
     std::shared_ptr<Node> comp_expr(int tab_expect);
     std::shared_ptr<Node> array_expr(int tab_expect, const std::string& closing_token = TOKEN_RIGHT_BRACE);
     std::shared_ptr<Node> if_expr(int tab_expect);
-    std::shared_ptr<Node> for_expr(int tab_expect);
+    std::shared_ptr<Node> for_expr(int tab_expect, bool parallel = false);
     std::shared_ptr<Node> while_expr(int tab_expect);
     std::shared_ptr<Node> repeat_expr(int tab_expect);
     std::shared_ptr<Node> pow(int tab_expect);
@@ -70,6 +72,8 @@ protected:
     TokenList tokens;
     std::shared_ptr<Token> current_tok;
     int64_t tok_index;
+    // Parallel loops parsed so far, with their loop variable's token.
+    std::vector<std::pair<Node*, std::shared_ptr<Token>>> parallel_loops;
 };
 
 #endif
@@ -0,0 +1,269 @@
+/// --------------------
+/// Pool
+/// --------------------
+
+#include "pool.h"
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace pool {
+namespace {
+
+constexpr std::size_t SLAB_BYTES = 64 * 1024;
+// Blocks are threaded onto a free list a page at a time, so a slab's pages
+// are only touched once the thread needs them. Short runs thereby avoid
+// faulting in memory they never use.
+constexpr std::size_t CARVE_BYTES = 4 * 1024;
+// Free blocks move between a thread and the depot in batches of this many
+// bytes. A thread keeps at most two batches of each class, so blocks it
+// frees for other threads flow back to them through the depot.
+constexpr std::size_t BATCH_BYTES = 16 * 1024;
+
+struct FreeBlock {
+    FreeBlock* next;
+    FreeBlock* next_batch;  // in the depot, on a batch's first block
+};
+
+std::size_t batch_blocks(std::size_t cls) {
+    return std::max(BATCH_BYTES / ((cls + 1) * GRANULE), std::size_t{1});
+}
+
+struct Counters {
+    // Net allocations; a thread's count goes negative when it frees blocks
+    // that another thread allocated.
+    std::ptrdiff_t live[CLASS_COUNT]{};
+    std::size_t high_water[CLASS_COUNT]{};
+    std::size_t slabs[CLASS_COUNT]{};
+    // Net bytes over all classes and their peak since reset_thread_peak().
+    std::ptrdiff_t bytes{0};
+    std::ptrdiff_t peak_bytes{0};
+
+    void on_allocate(std::size_t cls) {
+        if (++live[cls] > static_cast<std::ptrdiff_t>(high_water[cls])) {
+            high_water[cls] = live[cls];
+        }
+        bytes += static_cast<std::ptrdiff_t>((cls + 1) * GRANULE);
+        peak_bytes = std::max(peak_bytes, bytes);
+    }
+
+    void on_deallocate(std::size_t cls) {
+        --live[cls];
+        bytes -= static_cast<std::ptrdiff_t>((cls + 1) * GRANULE);
+    }
+};
+
+struct ThreadCache {
+    FreeBlock* free[CLASS_COUNT]{};
+    std::size_t free_count[CLASS_COUNT]{};
+    // The part of each class's newest slab not yet carved into blocks.
+    char* uncarved[CLASS_COUNT]{};
+    char* slab_end[CLASS_COUNT]{};
+    Counters counters;
+};
+
+// Batches of free blocks that threads spilled or left behind on exit,
+// counters of exited threads, and the registry of live caches. Leaked on
+// purpose: threads may exit during static destruction.
+struct Depot {
+    std::mutex mutex;
+    FreeBlock* batches[CLASS_COUNT]{};
+    Counters counters;
+    std::vector<ThreadCache*> threads;
+};
+
+Depot& depot() {
+    static Depot* shared = new Depot;
+    return *shared;
+}
+
+std::size_t class_of(std::size_t size) { return (size - 1) / GRANULE; }
+
+// Threads the whole blocks of class `cls` in [begin, end) into a list.
+FreeBlock* carve(std::size_t cls, char* begin, char* end) {
+    std::size_t block_size = (cls + 1) * GRANULE;
+    FreeBlock* blocks = nullptr;
+    for (std::size_t offset = (end - begin) / block_size * block_size; offset > 0;) {
+        offset -= block_size;
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(begin + offset);
+        block->next = blocks;
+        blocks = block;
+    }
+    return blocks;
+}
+
+void push_batch(FreeBlock*& batches, FreeBlock* batch) {
+    batch->next_batch = batches;
+    batches = batch;
+}
+
+FreeBlock* pop_batch(FreeBlock*& batches) {
+    FreeBlock* batch = batches;
+    if (batch != nullptr) batches = batch->next_batch;
+    return batch;
+}
+
+// Hands the first `count` blocks of the thread's `cls` list to the depot.
+void spill(ThreadCache& local, std::size_t cls, std::size_t count) {
+    FreeBlock* batch = local.free[cls];
+    FreeBlock* last = batch;
+    for (std::size_t i = 1; i < count; ++i) last = last->next;
+    local.free[cls] = last->next;
+    local.free_count[cls] -= count;
+    last->next = nullptr;
+    Depot& shared = depot();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    push_batch(shared.batches[cls], batch);
+}
+
+FreeBlock* carve_slab(std::size_t cls, Counters& counters) {
+    char* slab = static_cast<char*>(::operator new(SLAB_BYTES));
+    ++counters.slabs[cls];
+    return carve(cls, slab, slab + SLAB_BYTES);
+}
+
+// Sets the thread's empty `cls` list to a batch from the depot, or else to
+// freshly carved blocks.
+void refill(ThreadCache& local, std::size_t cls) {
+    Depot& shared = depot();
+    FreeBlock* batch;
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        batch = pop_batch(shared.batches[cls]);
+    }
+    if (batch != nullptr) {
+        std::size_t count = 0;
+        for (FreeBlock* block = batch; block != nullptr; block = block->next) ++count;
+        local.free[cls] = batch;
+        local.free_count[cls] = count;
+        return;
+    }
+    std::size_t block_size = (cls + 1) * GRANULE;
+    if (static_cast<std::size_t>(local.slab_end[cls] - local.uncarved[cls]) < block_size) {
+        local.uncarved[cls] = static_cast<char*>(::operator new(SLAB_BYTES));
+        local.slab_end[cls] = local.uncarved[cls] + SLAB_BYTES;
+        ++local.counters.slabs[cls];
+    }
+    // At least one block, even when blocks are larger than a page.
+    std::size_t bytes = std::max(CARVE_BYTES / block_size, std::size_t{1}) * block_size;
+    char* begin = local.uncarved[cls];
+    char* end = std::min(begin + bytes, local.slab_end[cls]);
+    local.uncarved[cls] = end;
+    local.free[cls] = carve(cls, begin, end);
+    local.free_count[cls] = static_cast<std::size_t>(end - begin) / block_size;
+}
+
+thread_local ThreadCache* cache = nullptr;
+// Set once the thread's cache has been handed back; later frees during
+// thread exit go straight to the depot.
+thread_local bool cache_retired = false;
+
+struct CacheRetirer {
+    ~CacheRetirer() {
+        Depot& shared = depot();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        for (std::size_t cls = 0; cls < CLASS_COUNT; ++cls) {
+            if (cache->free[cls] != nullptr) push_batch(shared.batches[cls], cache->free[cls]);
+            shared.counters.live[cls] += cache->counters.live[cls];
+            shared.counters.high_water[cls] =
+                std::max(shared.counters.high_water[cls], cache->counters.high_water[cls]);
+            shared.counters.slabs[cls] += cache->counters.slabs[cls];
+        }
+        shared.threads.erase(std::find(shared.threads.begin(), shared.threads.end(), cache));
+        delete cache;
+        cache = nullptr;
+        cache_retired = true;
+    }
+};
+
+ThreadCache* attach_thread() {
+    if (cache_retired) return nullptr;
+    thread_local CacheRetirer retirer;
+    (void)retirer;
+    cache = new ThreadCache;
+    std::lock_guard<std::mutex> lock(depot().mutex);
+    depot().threads.push_back(cache);
+    return cache;
+}
+
+}  // namespace
+
+void* allocate(std::size_t size) {
+    std::size_t cls = class_of(size);
+    ThreadCache* local = cache != nullptr ? cache : attach_thread();
+    if (local == nullptr) {
+        Depot& shared = depot();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        FreeBlock* block = pop_batch(shared.batches[cls]);
+        if (block == nullptr) block = carve_slab(cls, shared.counters);
+        if (block->next != nullptr) push_batch(shared.batches[cls], block->next);
+        shared.counters.on_allocate(cls);
+        return block;
+    }
+    if (local->free[cls] == nullptr) refill(*local, cls);
+    FreeBlock* block = local->free[cls];
+    local->free[cls] = block->next;
+    --local->free_count[cls];
+    local->counters.on_allocate(cls);
+    return block;
+}
+
+void deallocate(void* block, std::size_t size) noexcept {
+    std::size_t cls = class_of(size);
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    if (cache == nullptr) {
+        Depot& shared = depot();
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        FreeBlock* batch = shared.batches[cls];
+        if (batch != nullptr) {
+            freed->next = batch->next;
+            batch->next = freed;
+        } else {
+            freed->next = nullptr;
+            push_batch(shared.batches[cls], freed);
+        }
+        shared.counters.on_deallocate(cls);
+        return;
+    }
+    freed->next = cache->free[cls];
+    cache->free[cls] = freed;
+    cache->counters.on_deallocate(cls);
+    std::size_t batch = batch_blocks(cls);
+    if (++cache->free_count[cls] > 2 * batch) spill(*cache, cls, batch);
+}
+
+ThreadBytes thread_bytes() {
+    ThreadCache* local = cache != nullptr ? cache : attach_thread();
+    if (local == nullptr) return ThreadBytes{0, 0};
+    return ThreadBytes{local->counters.bytes, local->counters.peak_bytes};
+}
+
+void reset_thread_peak() {
+    ThreadCache* local = cache != nullptr ? cache : attach_thread();
+    if (local != nullptr) local->counters.peak_bytes = local->counters.bytes;
+}
+
+std::vector<ClassStats> stats() {
+    Depot& shared = depot();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    std::vector<ClassStats> ret;
+    for (std::size_t cls = 0; cls < CLASS_COUNT; ++cls) {
+        std::ptrdiff_t live = shared.counters.live[cls];
+        std::size_t thread_peak = shared.counters.high_water[cls];
+        std::size_t slabs = shared.counters.slabs[cls];
+        for (const ThreadCache* thread : shared.threads) {
+            live += thread->counters.live[cls];
+            thread_peak = std::max(thread_peak, thread->counters.high_water[cls]);
+            slabs += thread->counters.slabs[cls];
+        }
+        if (slabs == 0) continue;
+        ret.push_back(ClassStats{(cls + 1) * GRANULE,
+                                 static_cast<std::size_t>(std::max<std::ptrdiff_t>(live, 0)),
+                                 thread_peak, slabs});
+    }
+    return ret;
+}
+
+}  // namespace pool
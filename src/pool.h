@@ -0,0 +1,95 @@
+/// --------------------
+/// Pool
+/// --------------------
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Size-class allocator for the interpreter's small objects: values, tokens
+// and AST nodes, each with its shared_ptr control block. Blocks are carved
+// from slabs and recycled through per-thread free lists. Slabs are never
+// returned to the system. A thread's lists are capped per class: blocks
+// beyond the cap, and all of them when the thread exits, go in batches to a
+// shared depot that other threads refill from.
+namespace pool {
+
+constexpr std::size_t GRANULE = 16;
+constexpr std::size_t CLASS_COUNT = 16;
+constexpr std::size_t MAX_BLOCK = GRANULE * CLASS_COUNT;
+
+void* allocate(std::size_t size);
+void deallocate(void* block, std::size_t size) noexcept;
+
+struct ClassStats {
+    std::size_t block_size;
+    std::size_t live;        // blocks handed out and not yet freed
+    // The most blocks one thread had live at once. Blocks live on several
+    // threads together can exceed it: there is no shared count to take a
+    // global peak from, as that would put an atomic on every allocation.
+    std::size_t thread_peak;
+    std::size_t slabs;       // slabs carved for this class
+};
+
+// Bytes of blocks the calling thread allocated net of the ones it freed
+// (negative when it freed other threads' blocks), and the peak of that since
+// the last reset_thread_peak().
+struct ThreadBytes {
+    std::ptrdiff_t live;
+    std::ptrdiff_t peak;
+};
+
+ThreadBytes thread_bytes();
+void reset_thread_peak();
+
+// Size classes that have seen at least one allocation. Counters of other
+// threads are read without synchronization, so call this while they idle.
+std::vector<ClassStats> stats();
+
+}  // namespace pool
+
+template <typename T>
+class PoolAllocator {
+   public:
+    using value_type = T;
+
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if (!fits(n)) return static_cast<T*>(::operator new(n * sizeof(T)));
+        return static_cast<T*>(pool::allocate(n * sizeof(T)));
+    }
+    void deallocate(T* block, std::size_t n) noexcept {
+        if (!fits(n)) return ::operator delete(block);
+        pool::deallocate(block, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U>&) const noexcept {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const PoolAllocator<U>&) const noexcept {
+        return false;
+    }
+
+   private:
+    static bool fits(std::size_t n) {
+        return alignof(T) <= pool::GRANULE && n <= pool::MAX_BLOCK / sizeof(T);
+    }
+};
+
+// make_shared through the pool: object and control block share one block.
+template <typename T, typename... Args>
+std::shared_ptr<T> make_pooled(Args&&... args) {
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+#endif
@@ -3,17 +3,141 @@
 /// --------------------
 
 #include "position.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
-void Position::advance(char current_char) {
-    index++;
-    column++;
-    if(current_char == '\n') {
-        line++;
-        column = 0;
+namespace source_map {
+namespace {
+
+struct Entry {
+    SourceFile file{"", 0, {0}};
+    std::atomic<std::uint32_t> refs{0};
+    bool live{false};
+};
+
+// Entries sit in blocks that are never moved or freed, so retain(), release()
+// and get() find them without taking the lock; add() and freeing an entry
+// take it.
+constexpr std::uint32_t BLOCK_BITS = 10;
+constexpr std::uint32_t BLOCK_SIZE = 1u << BLOCK_BITS;
+constexpr std::uint32_t MAX_BLOCKS = 1u << 12;
+
+struct Registry {
+    std::mutex mutex;
+    std::atomic<Entry*> blocks[MAX_BLOCKS]{};
+    std::atomic<std::uint32_t> size{1};  // ids handed out so far; 0 is the anonymous file
+    std::vector<std::uint32_t> free_ids;
+    std::unordered_map<std::string, std::uint32_t> ids;  // last registered, by name
+
+    Registry() {
+        blocks[0].store(new Entry[BLOCK_SIZE]);
+        blocks[0].load()[0].live = true;
+    }
+    Entry& entry(std::uint32_t file_id) {
+        Entry* block = blocks[file_id >> BLOCK_BITS].load(std::memory_order_acquire);
+        return block[file_id & (BLOCK_SIZE - 1)];
+    }
+};
+
+Registry& registry() {
+    static Registry* shared = new Registry;
+    return *shared;
+}
+
+// Takes the lock. Hands out a free id, or a new one; 0 once every block is
+// in use.
+std::uint32_t new_id(Registry& shared) {
+    if (!shared.free_ids.empty()) {
+        std::uint32_t id = shared.free_ids.back();
+        shared.free_ids.pop_back();
+        return id;
+    }
+    std::uint32_t id = shared.size.load(std::memory_order_relaxed);
+    std::uint32_t block = id >> BLOCK_BITS;
+    if (block >= MAX_BLOCKS) return 0;
+    if (shared.blocks[block].load(std::memory_order_relaxed) == nullptr) {
+        shared.blocks[block].store(new Entry[BLOCK_SIZE], std::memory_order_release);
+    }
+    shared.size.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+}  // namespace
+
+FileRef add(const std::string& name, const std::string& text) {
+    SourceFile file{name, static_cast<std::uint32_t>(text.size()), {0}};
+    for(std::uint32_t i = 0; i < file.length; ++i) {
+        if(text[i] == '\n') file.line_starts.push_back(i + 1);
     }
+    file.text_hash = std::hash<std::string>()(text) | 1;  // never 0, which means unknown
+    return add(std::move(file));
+}
+
+FileRef add(SourceFile file) {
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    auto found = shared.ids.find(file.name);
+    if(found != shared.ids.end()) {
+        const SourceFile& last = shared.entry(found->second).file;
+        if(file.text_hash != 0 && last.text_hash == file.text_hash && last.length == file.length) {
+            return FileRef(found->second);
+        }
+    }
+    std::uint32_t id = new_id(shared);
+    if(id == 0) return FileRef();
+    Entry& entry = shared.entry(id);
+    shared.ids[file.name] = id;
+    entry.file = std::move(file);
+    entry.live = true;
+    return FileRef(id);
+}
+
+const SourceFile& get(std::uint32_t file_id) {
+    Registry& shared = registry();
+    if(file_id >= shared.size.load(std::memory_order_acquire)) file_id = 0;
+    return shared.entry(file_id).file;
+}
+
+void retain(std::uint32_t file_id) {
+    if(file_id == 0) return;
+    registry().entry(file_id).refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void release(std::uint32_t file_id) {
+    if(file_id == 0) return;
+    Registry& shared = registry();
+    Entry& entry = shared.entry(file_id);
+    if(entry.refs.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    // add() may have handed the file out again, or another release may have
+    // freed it, before the lock is taken.
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if(!entry.live || entry.refs.load(std::memory_order_acquire) != 0) return;
+    auto found = shared.ids.find(entry.file.name);
+    if(found != shared.ids.end() && found->second == file_id) shared.ids.erase(found);
+    entry.file = SourceFile{"", 0, {0}};
+    entry.live = false;
+    shared.free_ids.push_back(file_id);
+}
+
+}  // namespace source_map
+
+int Position::line() const {
+    const std::vector<std::uint32_t>& starts = source_map::get(file_id).line_starts;
+    return static_cast<int>(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin()) - 1;
+}
+
+int Position::column() const {
+    return static_cast<int>(offset - source_map::get(file_id).line_starts[line()]);
+}
+
+const std::string& Position::file_name() const {
+    return source_map::get(file_id).name;
 }
 
 std::string Position::get_pos() {
@@ -25,6 +149,6 @@ std::string Position::get_pos() {
 }
 
 std::ostream& operator<<(std::ostream &out, Position &pos) {
-    out << "File: " << pos.file_name << ", Line: " << pos.line << ", Column: " << pos.column;
+    out << "File: " << pos.file_name() << ", Line: " << pos.line() << ", Column: " << pos.column();
     return out;
-}
\ No newline at end of file
+}
@@ -5,16 +5,82 @@
 #ifndef POSITION_H
 #define POSITION_H
 
+#include <cstdint>
+#include <iosfwd>
 #include <string>
+#include <vector>
 
+// Line-start table of a lexed source text, shared by every position in it.
+struct SourceFile {
+    std::string name;
+    std::uint32_t length;
+    std::vector<std::uint32_t> line_starts;  // byte offset of each line
+    std::uint64_t text_hash{0};              // of the text, or 0 when not known
+};
+
+namespace source_map {
+
+// Keeps a file registered while held. A file stays in the registry while a
+// FileRef or a Position refers to it; after that its entry is freed and its
+// id may be handed to another file.
+class FileRef;
+
+// Records the line starts of `text` under `name` and returns a reference to
+// the file. Entries are not changed while referenced, so references from
+// get() stay valid and positions keep describing the text they were lexed
+// from: a name registered again with other text gets a new id, while the
+// same text under the same name gets its id back as long as the file is
+// still registered. File id 0 is an anonymous empty file, always registered.
+FileRef add(const std::string& name, const std::string& text);
+// Registers `file` as recorded elsewhere, such as in a snapshot (snapshot.h),
+// under its name, like the other add.
+FileRef add(SourceFile file);
+const SourceFile& get(std::uint32_t file_id);
+// Counts a reference to a registered file, or drops one.
+void retain(std::uint32_t file_id);
+void release(std::uint32_t file_id);
+
+class FileRef {
+public:
+    FileRef() = default;
+    explicit FileRef(std::uint32_t _file_id) : file_id(_file_id) { retain(file_id); }
+    FileRef(const FileRef& other) : FileRef(other.file_id) {}
+    FileRef& operator=(const FileRef& other) {
+        retain(other.file_id);
+        release(file_id);
+        file_id = other.file_id;
+        return *this;
+    }
+    ~FileRef() { release(file_id); }
+    std::uint32_t id() const { return file_id; }
+private:
+    std::uint32_t file_id{0};
+};
+
+}  // namespace source_map
+
+// Byte offset into an interned source file; line and column are computed
+// from the file's line-start table on demand. A position keeps its file
+// registered.
 struct Position {
-    int index, line, column;
-    std::string file_name;
-    Position(int idx = 0, int ln = 0, int col = 0, const std::string& _file_name = "")
-        : index(idx), line(ln), column(col), file_name(_file_name) {}
-    void advance(char);
+    std::uint32_t offset, file_id;
+    Position(std::uint32_t _offset = 0, std::uint32_t _file_id = 0)
+        : offset(_offset), file_id(_file_id) { source_map::retain(file_id); }
+    Position(const Position& other) : Position(other.offset, other.file_id) {}
+    Position& operator=(const Position& other) {
+        source_map::retain(other.file_id);
+        source_map::release(file_id);
+        offset = other.offset;
+        file_id = other.file_id;
+        return *this;
+    }
+    ~Position() { source_map::release(file_id); }
+    void advance() { ++offset; }
+    int line() const;
+    int column() const;
+    const std::string& file_name() const;
     std::string get_pos();
     friend std::ostream& operator<<(std::ostream &out, Position &pos);
 };
 
-#endif
\ No newline at end of file
+#endif
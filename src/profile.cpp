@@ -0,0 +1,191 @@
+/// --------------------
+/// JIT profiles
+/// --------------------
+
+#include "profile.h"
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include "position.h"
+#include "token.h"
+
+namespace profile {
+namespace {
+
+const char* const HEADER = "pseudo-profile 1";
+
+struct FileProfile {
+    std::uint64_t text_hash{0};
+    std::map<std::uint32_t, JitOutcome> sites;  // by offset
+};
+
+struct State {
+    std::mutex mutex;
+    std::string path;
+    std::map<std::string, FileProfile> files;  // by name
+};
+
+std::atomic<bool> recording{false};
+
+State& state() {
+    static State* shared = new State;
+    return *shared;
+}
+
+const char* outcome_name(JitOutcome outcome) {
+    switch (outcome) {
+        case JitOutcome::Compiled:
+            return "compiled";
+        case JitOutcome::Uncompilable:
+            return "uncompilable";
+        case JitOutcome::Bails:
+            return "bails";
+        default:
+            return nullptr;
+    }
+}
+
+JitOutcome outcome_of(const std::string& name) {
+    for (JitOutcome outcome :
+         {JitOutcome::Compiled, JitOutcome::Uncompilable, JitOutcome::Bails}) {
+        if (name == outcome_name(outcome)) return outcome;
+    }
+    return JitOutcome::Unknown;
+}
+
+// The profile of the file `node` is in, started afresh for its current text
+// when `create` is set. The file is looked up by name, as a name lexed again
+// with other text gets a new file id. Called with the state locked.
+FileProfile* file_of(State& shared, const Node& node, bool create) {
+    std::shared_ptr<Token> tok = const_cast<Node&>(node).get_tok();
+    if (tok.get() == nullptr) return nullptr;
+    const SourceFile& source = source_map::get(tok->get_pos().file_id);
+    if (source.text_hash == 0) return nullptr;
+    auto known = shared.files.find(source.name);
+    if (known != shared.files.end() && known->second.text_hash == source.text_hash) {
+        return &known->second;
+    }
+    if (!create) return nullptr;
+    FileProfile& file = shared.files[source.name];
+    file = FileProfile{source.text_hash, {}};
+    return &file;
+}
+
+std::uint32_t offset_of(const Node& node) {
+    return const_cast<Node&>(node).get_tok()->get_pos().offset;
+}
+
+}  // namespace
+
+bool open(const std::string& dir, const std::string& program, std::string& error) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        error = "Profile ERROR: cannot create " + dir;
+        return false;
+    }
+    std::string key = fs::absolute(program, ec).lexically_normal().string();
+    std::ostringstream name;
+    name << fs::path(program).filename().string() << "-" << std::hex << std::setw(16)
+         << std::setfill('0') << std::hash<std::string>()(key) << ".profile";
+
+    State& shared = state();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.path = (fs::path(dir) / name.str()).string();
+    shared.files.clear();
+
+    std::ifstream input(shared.path);
+    std::string line;
+    if (input && std::getline(input, line)) {
+        if (line != HEADER) {
+            error = "Profile ERROR: " + shared.path + " is not a profile";
+            return false;
+        }
+        FileProfile* file = nullptr;
+        while (std::getline(input, line)) {
+            std::istringstream fields(line);
+            if (line.rfind("file ", 0) == 0) {
+                std::string word, file_name;
+                std::uint64_t text_hash = 0;
+                fields >> word >> text_hash;
+                std::getline(fields >> std::ws, file_name);
+                file = &shared.files[file_name];
+                file->text_hash = text_hash;
+                continue;
+            }
+            std::uint32_t offset = 0;
+            std::string outcome;
+            if (file != nullptr && fields >> offset >> outcome) {
+                JitOutcome parsed = outcome_of(outcome);
+                if (parsed != JitOutcome::Unknown) file->sites[offset] = parsed;
+            }
+        }
+    }
+    recording = true;
+    return true;
+}
+
+bool active() { return recording.load(std::memory_order_relaxed); }
+
+JitOutcome lookup(const Node& node) {
+    State& shared = state();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    FileProfile* file = file_of(shared, node, false);
+    if (file == nullptr) return JitOutcome::Unknown;
+    auto found = file->sites.find(offset_of(node));
+    return found == file->sites.end() ? JitOutcome::Unknown : found->second;
+}
+
+void record(const Node& node, JitOutcome outcome) {
+    State& shared = state();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    if (FileProfile* file = file_of(shared, node, true)) file->sites[offset_of(node)] = outcome;
+}
+
+bool save(std::string& error) {
+    namespace fs = std::filesystem;
+    recording = false;
+    State& shared = state();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    std::ostringstream output;
+    output << HEADER << "\n";
+    for (const auto& [name, file] : shared.files) {
+        if (file.sites.empty()) continue;
+        output << "file " << file.text_hash << " " << name << "\n";
+        for (const auto& [offset, outcome] : file.sites) {
+            output << offset << " " << outcome_name(outcome) << "\n";
+        }
+    }
+
+    // Written aside and renamed into place, as runs of the same program may
+    // save at once.
+    std::string temporary = shared.path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream file(temporary);
+        if (!(file << output.str())) {
+            error = "Profile ERROR: cannot write " + shared.path;
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temporary, shared.path, ec);
+    if (ec) {
+        fs::remove(temporary, ec);
+        error = "Profile ERROR: cannot write " + shared.path;
+        return false;
+    }
+    return true;
+}
+
+}  // namespace profile
@@ -0,0 +1,47 @@
+/// --------------------
+/// JIT profiles
+/// --------------------
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <string>
+#include "node.h"
+
+// What running an expression the JIT may compile (NODE_FLAG_JIT_ROOT)
+// showed: it became hot and compiled, it cannot be compiled, or its
+// compiled program kept bailing out to the interpreter on operands it does
+// not handle.
+enum class JitOutcome : std::uint8_t { Unknown, Compiled, Uncompilable, Bails };
+
+// `pseudo --profile-cache <dir> program.ps` keeps the outcomes of a
+// program's JIT roots across runs, so the next run compiles known-hot
+// expressions on their first visit and never tries the others. Sites are
+// keyed by source file and offset; a file whose text changed starts over.
+//
+// The profile is a text file per program in the directory: a header line,
+// then for each source file a `file <text hash> <name>` line followed by
+// `<offset> compiled|uncompilable|bails` lines.
+namespace profile {
+
+// Reads the profile of `program` from `dir`, if there is one, and starts
+// recording outcomes. Returns false with `error` set when `dir` cannot be
+// created or its profile is not one.
+bool open(const std::string& dir, const std::string& program, std::string& error);
+
+// True between open and save. Recording costs nothing otherwise.
+bool active();
+
+// The outcome recorded for the JIT root `node`, from this run or an earlier one.
+JitOutcome lookup(const Node& node);
+
+void record(const Node& node, JitOutcome outcome);
+
+// Writes the profile back, with this run's outcomes replacing older ones,
+// and stops recording.
+bool save(std::string& error);
+
+}  // namespace profile
+
+#endif
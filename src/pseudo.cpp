@@ -1,5 +1,6 @@
 #include "pseudo.h"
 
+#include <array>
 #include <cctype>
 #include <cmath>
 #include <cstddef>
@@ -23,13 +24,20 @@
 
 #include "analysis.h"
 #include "color.h"
+#include "engine.h"
 #include "error.h"
+#include "files.h"
+#include "gc.h"
 #include "imports.h"
 #include "interpreter.h"
+#include "io.h"
 #include "jit.h"
 #include "lexer.h"
 #include "node.h"
+#include "parallel.h"
 #include "parser.h"
+#include "scheduler.h"
+#include "tasks.h"
 #include "token.h"
 #include "value.h"
 
@@ -126,6 +134,15 @@ std::string TypedValue<T>::repr() {
     return ret;
 }
 
+void ArrayValue::list_children(std::vector<Value*>& out) {
+    for (const auto& element : value) out.push_back(element.get());
+}
+
+void ArrayValue::release_children(ValueList& released) {
+    for (auto& element : value) released.push_back(std::move(element));
+    value.clear();
+}
+
 std::string ArrayValue::get_num() {
     std::stringstream ss;
     ss << "{";
@@ -143,7 +160,7 @@ void ArrayValue::push_back(std::shared_ptr<Value> new_value) { value.push_back(n
 
 std::shared_ptr<Value> ArrayValue::insert(int p, std::shared_ptr<Value> new_value) {
     if (p < 1 || p > static_cast<int>(value.size()) + 1) {
-        return std::make_shared<ErrorValue>(
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, "Index out of range, size: " + std::to_string(value.size()) +
                              ", position: " + std::to_string(p));
     }
@@ -153,7 +170,7 @@ std::shared_ptr<Value> ArrayValue::insert(int p, std::shared_ptr<Value> new_valu
 
 std::shared_ptr<Value> ArrayValue::remove(int p) {
     if (p < 1 || p > static_cast<int>(value.size())) {
-        return std::make_shared<ErrorValue>(
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, "Index out of range, size: " + std::to_string(value.size()) +
                              ", position: " + std::to_string(p));
     }
@@ -163,7 +180,7 @@ std::shared_ptr<Value> ArrayValue::remove(int p) {
 }
 
 std::shared_ptr<Value> ArrayValue::pop_back() {
-    if (value.empty()) return std::make_shared<ErrorValue>(VALUE_ERROR, "Pop an empty array");
+    if (value.empty()) return make_pooled<ErrorValue>(VALUE_ERROR, "Pop an empty array");
     std::shared_ptr<Value> ret = value.back();
     value.pop_back();
     return ret;
@@ -171,12 +188,26 @@ std::shared_ptr<Value> ArrayValue::pop_back() {
 
 std::shared_ptr<Value>& ArrayValue::operator[](int p) {
     if (1 <= p && p <= value.size()) return value[p - 1];
-    error = std::make_shared<ErrorValue>(
+    static thread_local std::shared_ptr<Value> error;
+    error = make_pooled<ErrorValue>(
         VALUE_ERROR, "Index out of range, size: " + std::to_string(value.size()) +
                          ", position: " + std::to_string(p));
     return error;
 }
 
+thread_local std::uint32_t ContainerValue::running_chunk = 0;
+
+std::shared_ptr<Value> ContainerValue::frozen_error() {
+    return make_pooled<ErrorValue>(
+        VALUE_ERROR, "Cannot change this " + type + ": values passed between tasks are read-only\n");
+}
+
+std::shared_ptr<Value> ContainerValue::shared_error() {
+    return make_pooled<ErrorValue>(
+        VALUE_ERROR, "Cannot change this " + type +
+                         ": the iterations of a parallel for loop share it\n");
+}
+
 std::string HashTableValue::key_id(std::shared_ptr<Value> key) const {
     if (key->get_type() == VALUE_ARRAY || key->get_type() == VALUE_INSTANCE ||
         key->get_type() == VALUE_STRUCT || key->get_type() == VALUE_HASH_TABLE ||
@@ -187,6 +218,22 @@ std::string HashTableValue::key_id(std::shared_ptr<Value> key) const {
     return key->get_type() + ":" + key->repr();
 }
 
+void HashTableValue::list_children(std::vector<Value*>& out) {
+    for (const Entry& entry : entries) {
+        out.push_back(entry.key.get());
+        out.push_back(entry.value.get());
+    }
+}
+
+void HashTableValue::release_children(ValueList& released) {
+    for (Entry& entry : entries) {
+        released.push_back(std::move(entry.key));
+        released.push_back(std::move(entry.value));
+    }
+    entries.clear();
+    index.clear();
+}
+
 std::string HashTableValue::get_num() {
     std::stringstream ss;
     ss << "{";
@@ -203,7 +250,7 @@ std::string HashTableValue::get_num() {
 std::shared_ptr<Value> HashTableValue::get(std::shared_ptr<Value> key) {
     auto found = index.find(key_id(key));
     if (found == index.end()) {
-        return std::make_shared<Value>();
+        return make_pooled<Value>();
     }
     return entries[found->second].value;
 }
@@ -225,7 +272,7 @@ std::shared_ptr<Value> HashTableValue::remove(std::shared_ptr<Value> key) {
     std::string id = key_id(key);
     auto found = index.find(id);
     if (found == index.end()) {
-        return std::make_shared<Value>();
+        return make_pooled<Value>();
     }
 
     size_t removed = found->second;
@@ -244,7 +291,7 @@ bool HashTableValue::contains(std::shared_ptr<Value> key) const {
 }
 
 std::shared_ptr<Value> HashTableValue::size() const {
-    return std::make_shared<TypedValue<int64_t>>(VALUE_INT, entries.size());
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, entries.size());
 }
 
 std::shared_ptr<Value> HashTableValue::keys() const {
@@ -253,7 +300,7 @@ std::shared_ptr<Value> HashTableValue::keys() const {
     for (const Entry& entry : entries) {
         keys.push_back(entry.key);
     }
-    return std::make_shared<ArrayValue>(keys);
+    return make_pooled<ArrayValue>(keys);
 }
 
 std::shared_ptr<Value> HashTableValue::values() const {
@@ -262,7 +309,7 @@ std::shared_ptr<Value> HashTableValue::values() const {
     for (const Entry& entry : entries) {
         values.push_back(entry.value);
     }
-    return std::make_shared<ArrayValue>(values);
+    return make_pooled<ArrayValue>(values);
 }
 
 void HashTableValue::clear() {
@@ -273,19 +320,19 @@ void HashTableValue::clear() {
 std::shared_ptr<Value> BaseAlgoValue::set_args(const NodeList& args, SymbolTable& sym,
                                                Interpreter& interpreter) {
     if (args.size() < arg_names.size()) {
-        return std::make_shared<ErrorValue>(
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Too few arguments" RESET);
     } else if (args.size() > arg_names.size()) {
-        return std::make_shared<ErrorValue>(
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Too many arguments" RESET);
     }
 
     for (int i = 0; i < args.size(); ++i) {
         std::shared_ptr<Value> v = interpreter.visit(args[i]);
         if (v->get_type() == VALUE_ERROR) return v;
-        sym.set(arg_names[i], v);
+        sym.set(arg_symbols[i], v);
     }
-    static std::shared_ptr<Value> none = std::make_shared<Value>();
+    static std::shared_ptr<Value> none = make_pooled<Value>();
     return none;
 }
 
@@ -301,7 +348,7 @@ class ScopeCleaner {
                 if (val.use_count() == 1) {
                     InstanceValue* inst = dynamic_cast<InstanceValue*>(val.get());
                     std::shared_ptr<Value> self_ptr = val;
-                    std::shared_ptr<Value> dtor = inst->get_member("destructor", self_ptr);
+                    std::shared_ptr<Value> dtor = inst->get_member(SYMBOL_DESTRUCTOR, self_ptr);
                     if (dtor->get_type() == VALUE_ALGO) {
                         dtor->execute({}, sym.get_parent());
                     }
@@ -314,127 +361,27 @@ class ScopeCleaner {
     SymbolTable& sym;
 };
 
-namespace {
-
-bool is_pure_numeric_node(const std::shared_ptr<Node>& node, const std::string& algo_name,
-                          const std::unordered_set<std::string>& arg_names) {
-    if (!node) return false;
-
-    std::string type = node->get_type();
-    if (type == NODE_VALUE) {
-        std::string token_type = node->get_tok()->get_type();
-        return token_type == TOKEN_INT || token_type == TOKEN_FLOAT;
-    }
-    if (type == NODE_VARACCESS) {
-        return arg_names.count(node->get_name()) != 0;
-    }
-    if (type == NODE_BINOP) {
-        NodeList child = node->get_child();
-        return child.size() == 2 && is_pure_numeric_node(child[0], algo_name, arg_names) &&
-               is_pure_numeric_node(child[1], algo_name, arg_names);
-    }
-    if (type == NODE_UNARYOP) {
-        NodeList child = node->get_child();
-        return child.size() == 1 && is_pure_numeric_node(child[0], algo_name, arg_names);
-    }
-    if (type == NODE_RETURN) {
-        NodeList child = node->get_child();
-        return child.size() == 1 && is_pure_numeric_node(child[0], algo_name, arg_names);
-    }
-    if (type == NODE_IF) {
-        IfNode* if_node = dynamic_cast<IfNode*>(node.get());
-        if (!is_pure_numeric_node(if_node->get_condition(), algo_name, arg_names)) return false;
-        for (const auto& expr : if_node->get_expr()) {
-            if (!is_pure_numeric_node(expr, algo_name, arg_names)) return false;
-        }
-        for (const auto& expr : if_node->get_else()) {
-            if (!is_pure_numeric_node(expr, algo_name, arg_names)) return false;
-        }
-        return true;
-    }
-    if (type == NODE_ALGOCALL) {
-        AlgorithmCallNode* call_node = dynamic_cast<AlgorithmCallNode*>(node.get());
-        if (call_node->get_call()->get_type() != NODE_VARACCESS ||
-            call_node->get_name() != algo_name) {
-            return false;
-        }
-        for (const auto& arg : call_node->get_args()) {
-            if (!is_pure_numeric_node(arg, algo_name, arg_names)) return false;
-        }
-        return true;
-    }
-
-    return false;
-}
-
-bool has_self_call(const std::shared_ptr<Node>& node, const std::string& algo_name) {
-    if (!node) return false;
-
-    if (node->get_type() == NODE_ALGOCALL) {
-        AlgorithmCallNode* call_node = dynamic_cast<AlgorithmCallNode*>(node.get());
-        if (call_node->get_call()->get_type() == NODE_VARACCESS &&
-            call_node->get_name() == algo_name) {
-            return true;
-        }
-        for (const auto& arg : call_node->get_args()) {
-            if (has_self_call(arg, algo_name)) return true;
-        }
-        return false;
-    }
-
-    if (node->get_type() == NODE_IF) {
-        IfNode* if_node = dynamic_cast<IfNode*>(node.get());
-        if (has_self_call(if_node->get_condition(), algo_name)) return true;
-        for (const auto& expr : if_node->get_expr()) {
-            if (has_self_call(expr, algo_name)) return true;
-        }
-        for (const auto& expr : if_node->get_else()) {
-            if (has_self_call(expr, algo_name)) return true;
+// Under lexical scoping a call frame's parent is the defining scope, yet the
+// arguments must still be evaluated against the caller's scope.
+class CallerArgs {
+   public:
+    CallerArgs(SymbolTable* caller, SymbolTable* lexical_parent, Interpreter& frame)
+        : frame(frame) {
+        if (lexical_parent) {
+            caller_scope.emplace(caller);
+            caller_interpreter.emplace(*caller_scope);
         }
-        return false;
-    }
-
-    for (const auto& child : node->get_child()) {
-        if (has_self_call(child, algo_name)) return true;
     }
-    return false;
-}
-
-}  // namespace
+    Interpreter& interpreter() { return caller_interpreter ? *caller_interpreter : frame; }
 
-bool is_memoizable_numeric_algo(const std::shared_ptr<Node>& node, const std::string& algo_name,
-                                const std::vector<std::string>& args) {
-    AlgorithmDefNode* algo_node = dynamic_cast<AlgorithmDefNode*>(node.get());
-    if (!algo_node || args.empty()) return false;
-
-    bool recursive = false;
-    std::unordered_set<std::string> arg_set(args.begin(), args.end());
-    for (const auto& expr : algo_node->get_body()) {
-        if (!is_pure_numeric_node(expr, algo_name, arg_set)) return false;
-        recursive = recursive || has_self_call(expr, algo_name);
-    }
-    return recursive;
-}
+   private:
+    Interpreter& frame;
+    std::optional<SymbolTable> caller_scope;
+    std::optional<Interpreter> caller_interpreter;
+};
 
 namespace {
 
-std::shared_ptr<Node> single_return_numeric_expr(const std::shared_ptr<Node>& node,
-                                                 const std::string& algo_name,
-                                                 const std::vector<std::string>& args) {
-    AlgorithmDefNode* algo_node = dynamic_cast<AlgorithmDefNode*>(node.get());
-    if (!algo_node || algo_node->get_body().size() != 1) return nullptr;
-
-    std::shared_ptr<Node> ret = algo_node->get_body()[0];
-    if (ret->get_type() != NODE_RETURN || has_self_call(ret, algo_name)) return nullptr;
-
-    NodeList child = ret->get_child();
-    if (child.size() != 1) return nullptr;
-
-    std::unordered_set<std::string> arg_set(args.begin(), args.end());
-    if (!is_pure_numeric_node(child[0], algo_name, arg_set)) return nullptr;
-    return child[0];
-}
-
 std::string numeric_cache_key(const ValueList& values) {
     std::string key;
     for (const auto& value : values) {
@@ -450,56 +397,46 @@ std::string numeric_cache_key(const ValueList& values) {
 }  // namespace
 
 std::shared_ptr<Value> AlgoValue::execute(const NodeList& args, SymbolTable* parent) {
-    static std::unordered_map<std::size_t, bool> memoizable_by_node;
-    static std::unordered_map<std::size_t, std::unordered_map<std::string, std::shared_ptr<Value>>>
-        memoized_results;
-    static std::unordered_map<std::size_t, JitProgram> single_return_jit;
-    static std::unordered_set<std::size_t> single_return_jit_disabled;
+    ExecutionCaches& caches = execution_caches();
 
-    SymbolTable sym(parent);
+    gc::maybe_collect();
+    SymbolTable sym(lexical_parent ? lexical_scope(lexical_parent) : parent);
     ScopeCleaner cleaner(sym);
     Interpreter interpreter(sym);
-    std::size_t node_id = value->get_id();
-    auto memoizable_found = memoizable_by_node.find(node_id);
-    if (memoizable_found == memoizable_by_node.end()) {
-        memoizable_found =
-            memoizable_by_node
-                .emplace(node_id, is_memoizable_numeric_algo(value, algo_name, arg_names))
-                .first;
-    }
+    CallerArgs caller_args(parent, lexical_parent, interpreter);
 
-    if (memoizable_found->second) {
+    if (value->has_flag(NODE_FLAG_MEMOIZABLE)) {
         if (args.size() < arg_names.size()) {
-            return std::make_shared<ErrorValue>(
+            return make_pooled<ErrorValue>(
                 VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Too few arguments" RESET);
         } else if (args.size() > arg_names.size()) {
-            return std::make_shared<ErrorValue>(
+            return make_pooled<ErrorValue>(
                 VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Too many arguments" RESET);
         }
 
         ValueList evaluated_args;
         evaluated_args.reserve(args.size());
         for (int i = 0; i < args.size(); ++i) {
-            std::shared_ptr<Value> arg = interpreter.visit(args[i]);
+            std::shared_ptr<Value> arg = caller_args.interpreter().visit(args[i]);
             if (arg->get_type() == VALUE_ERROR) return arg;
             evaluated_args.push_back(arg);
         }
 
         std::string cache_key = numeric_cache_key(evaluated_args);
         if (!cache_key.empty()) {
-            auto& cache = memoized_results[node_id];
+            auto& cache = caches.memoized_results[*value];
             auto cached = cache.find(cache_key);
             if (cached != cache.end()) {
                 return cached->second;
             }
 
             for (int i = 0; i < evaluated_args.size(); ++i) {
-                sym.set(arg_names[i], evaluated_args[i]);
+                sym.set(arg_symbols[i], evaluated_args[i]);
             }
 
             AlgorithmDefNode* algo_node = dynamic_cast<AlgorithmDefNode*>(value.get());
             const NodeList& algo_body = algo_node->get_body();
-            std::shared_ptr<Value> ret = std::make_shared<Value>();
+            std::shared_ptr<Value> ret = make_pooled<Value>();
             for (int i = 0; i < algo_body.size(); ++i) {
                 ret = interpreter.visit(algo_body[i]);
                 if (ret->get_type() == VALUE_RETURN) {
@@ -517,27 +454,18 @@ std::shared_ptr<Value> AlgoValue::execute(const NodeList& args, SymbolTable* par
         }
     }
 
-    std::shared_ptr<Value> ret{set_args(args, sym, interpreter)};
+    std::shared_ptr<Value> ret{set_args(args, sym, caller_args.interpreter())};
     if (ret->get_type() == VALUE_ERROR) return ret;
 
-    if (!single_return_jit_disabled.count(node_id)) {
-        auto compiled = single_return_jit.find(node_id);
-        if (compiled == single_return_jit.end()) {
-            std::shared_ptr<Node> return_expr =
-                single_return_numeric_expr(value, algo_name, arg_names);
-            if (return_expr) {
-                std::optional<JitProgram> program = ExpressionJit::compile(return_expr);
-                if (program) {
-                    compiled = single_return_jit.emplace(node_id, std::move(*program)).first;
-                } else {
-                    single_return_jit_disabled.insert(node_id);
-                }
-            } else {
-                single_return_jit_disabled.insert(node_id);
-            }
+    if (value->has_flag(NODE_FLAG_SINGLE_RETURN)) {
+        std::optional<JitProgram>& compiled = caches.single_return_jit[*value];
+        if (!compiled) {
+            compiled =
+                ExpressionJit::compile(single_return_numeric_expr(value, algo_name, arg_names));
+            if (!compiled && !sched::concurrent()) value->set_flag(NODE_FLAG_SINGLE_RETURN, false);
         }
-        if (compiled != single_return_jit.end()) {
-            std::optional<std::shared_ptr<Value>> jit_result = compiled->second.execute(sym);
+        if (compiled) {
+            std::optional<std::shared_ptr<Value>> jit_result = compiled->execute(sym);
             if (jit_result) {
                 return *jit_result;
             }
@@ -552,6 +480,9 @@ std::shared_ptr<Value> AlgoValue::execute(const NodeList& args, SymbolTable* par
         if (ret->get_type() == VALUE_RETURN) {
             return dynamic_cast<ReturnValue*>(ret.get())->get_value();
         }
+        if (ret->get_type() == VALUE_ERROR) {
+            return ret;
+        }
     }
     return ret;
 }
@@ -577,502 +508,700 @@ std::shared_ptr<Value> BuiltinAlgoValue::execute(const NodeList& args, SymbolTab
         return execute_read();
     } else if (algo_name == "read_line") {
         return execute_read_line();
+    } else if (algo_name == "read_int") {
+        return execute_read_ints(nullptr);
+    } else if (algo_name == "read_ints") {
+        return execute_read_ints(sym.get(arg_symbols[0]));
+    } else if (algo_name == "read_all_lines") {
+        return execute_read_all_lines();
     } else if (algo_name == "open") {
-        return std::make_shared<ErrorValue>(VALUE_ERROR, "Not found!");
+        return open_file(sym.get(arg_symbols[0]), sym.get(arg_symbols[1]));
     } else if (algo_name == "clear") {
         return execute_clear();
     } else if (algo_name == "quit") {
+        if (running_in_engine()) throw EngineQuit{};
         exit(0);
     } else if (algo_name == "int") {
-        return execute_int(sym.get(arg_names[0])->get_num());
+        return execute_int(sym.get(arg_symbols[0])->get_num());
     } else if (algo_name == "float") {
-        return execute_float(sym.get(arg_names[0])->get_num());
+        return execute_float(sym.get(arg_symbols[0])->get_num());
     } else if (algo_name == "string") {
-        return execute_string(sym.get(arg_names[0])->get_num());
+        return execute_string(sym.get(arg_symbols[0])->get_num());
     } else if (algo_name == "HashTable") {
-        return std::make_shared<HashTableValue>();
+        return make_pooled<HashTableValue>();
+    } else if (algo_name == "channel") {
+        return make_channel(sym.get(arg_symbols[0]));
+    } else if (algo_name == "send") {
+        return channel_send(sym.get(arg_symbols[0]), sym.get(arg_symbols[1]));
+    } else if (algo_name == "receive") {
+        return channel_receive(sym.get(arg_symbols[0]));
+    } else if (algo_name == "await" || algo_name == "join") {
+        return await_task(sym.get(arg_symbols[0]));
+    } else if (algo_name == "map") {
+        return map_array(sym.get(arg_symbols[0]), sym.get(arg_symbols[1]), parent);
+    } else if (algo_name == "filter") {
+        return filter_array(sym.get(arg_symbols[0]), sym.get(arg_symbols[1]), parent);
+    } else if (algo_name == "reduce") {
+        return reduce_array(sym.get(arg_symbols[0]), sym.get(arg_symbols[1]),
+                            sym.get(arg_symbols[2]), parent);
+    } else if (algo_name == "for_each") {
+        return for_each_array(sym.get(arg_symbols[0]), sym.get(arg_symbols[1]), parent);
     }
     return ret;
 }
 
-std::shared_ptr<Value> BoundMethodValue::execute(const NodeList& args, SymbolTable* parent) {
-    if (obj->get_type() == VALUE_ARRAY) {
-        ArrayValue* arr_obj = dynamic_cast<ArrayValue*>(obj.get());
-        SymbolTable sym(parent);
-        Interpreter interpreter(sym);
+bool BuiltinAlgoValue::is_pure() {
+    return algo_name == "int" || algo_name == "float" || algo_name == "string";
+}
 
-        if (method_name == "push" || method_name == "push_back") {
-            if (args.size() != 1) {
-                return std::make_shared<ErrorValue>(
-                    VALUE_ERROR, "Expect one argument for " + method_name + "\n");
-            }
-            std::shared_ptr<Value> arg = interpreter.visit(args[0]);
-            if (arg->get_type() == VALUE_ERROR) return arg;
-            arr_obj->push_back(arg);
-            return arr_obj->back();
-        } else if (method_name == "pop" || method_name == "pop_back") {
-            if (!args.empty()) {
-                return std::make_shared<ErrorValue>(
-                    VALUE_ERROR, "Expect zero argument for " + method_name + "\n");
-            }
-            if (arr_obj->size()->get_num() == "0") {
-                std::cout << "Cannot " << method_name << " from an empty array\n";
-                return std::make_shared<Value>();
-            }
-            return arr_obj->pop_back();
-        } else if (method_name == "resize") {
-            if (args.size() != 1) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Expect one argument for resize\n");
-            }
-            std::shared_ptr<Value> new_size_val = interpreter.visit(args[0]);
-            if (new_size_val->get_type() == VALUE_ERROR) return new_size_val;
-            if (new_size_val->get_type() != VALUE_INT) {
-                std::cout << "Argument for resize must be an integer\n";
-                return std::make_shared<Value>();
-            }
-            long long new_size;
-            try {
-                new_size = new_size_val->as_int();
-            } catch (const std::out_of_range& oor) {
-                std::cout << "Resize argument out of range\n";
-                return std::make_shared<Value>();
-            }
-            if (new_size < 0) {
-                std::cout << "Resize argument cannot be negative\n";
-                return std::make_shared<Value>();
-            }
-            arr_obj->resize(static_cast<int>(new_size));
-            return obj;
-        } else if (method_name == "insert") {
-            if (args.size() != 2) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Expect two arguments for insert\n");
-            }
-            std::shared_ptr<Value> index = interpreter.visit(args[0]);
-            if (index->get_type() == VALUE_ERROR) return index;
-            std::shared_ptr<Value> value = interpreter.visit(args[1]);
-            if (value->get_type() == VALUE_ERROR) return value;
-            return arr_obj->insert(index->as_int(), value);
-        } else if (method_name == "remove") {
-            if (args.size() != 1) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Expect one argument for remove\n");
-            }
-            std::shared_ptr<Value> index = interpreter.visit(args[0]);
-            if (index->get_type() == VALUE_ERROR) return index;
-            return arr_obj->remove(index->as_int());
-        } else if (method_name == "size") {
-            if (!args.empty()) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect zero argument for size\n");
-            }
-            return arr_obj->size();
-        } else if (method_name == "back") {
-            if (!args.empty()) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Expect zero arguments for back\n");
-            }
-            if (arr_obj->size()->get_num() == "0") {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Cannot call back on an empty array\n");
-            }
-            return arr_obj->back();
-        }
-    } else if (obj->get_type() == VALUE_STRING) {
-        if (method_name == "size") {
-            if (!args.empty()) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect zero argument for size\n");
-            }
-            return std::make_shared<TypedValue<int64_t>>(
-                VALUE_INT, static_cast<int64_t>(obj->as_string().size()));
-        }
-    } else if (obj->get_type() == VALUE_HASH_TABLE) {
-        HashTableValue* table_obj = dynamic_cast<HashTableValue*>(obj.get());
-        SymbolTable sym(parent);
-        Interpreter interpreter(sym);
+namespace {
 
-        if (method_name == "set") {
-            if (args.size() != 2) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect two arguments for set\n");
-            }
-            std::shared_ptr<Value> key = interpreter.visit(args[0]);
-            if (key->get_type() == VALUE_ERROR) return key;
-            std::shared_ptr<Value> value = interpreter.visit(args[1]);
-            if (value->get_type() == VALUE_ERROR) return value;
-            return table_obj->set(key, value);
-        } else if (method_name == "get") {
-            if (args.size() != 1) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect one argument for get\n");
-            }
-            std::shared_ptr<Value> key = interpreter.visit(args[0]);
-            if (key->get_type() == VALUE_ERROR) return key;
-            return table_obj->get(key);
-        } else if (method_name == "contains") {
-            if (args.size() != 1) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Expect one argument for contains\n");
-            }
-            std::shared_ptr<Value> key = interpreter.visit(args[0]);
-            if (key->get_type() == VALUE_ERROR) return key;
-            return std::make_shared<TypedValue<int64_t>>(VALUE_INT, table_obj->contains(key));
-        } else if (method_name == "remove") {
-            if (args.size() != 1) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Expect one argument for remove\n");
-            }
-            std::shared_ptr<Value> key = interpreter.visit(args[0]);
-            if (key->get_type() == VALUE_ERROR) return key;
-            return table_obj->remove(key);
-        } else if (method_name == "size") {
-            if (!args.empty()) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect zero argument for size\n");
-            }
-            return table_obj->size();
-        } else if (method_name == "is_empty") {
-            if (!args.empty()) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Expect zero argument for is_empty\n");
-            }
-            return std::make_shared<TypedValue<int64_t>>(VALUE_INT,
-                                                         table_obj->size()->as_int() == 0);
-        } else if (method_name == "keys") {
-            if (!args.empty()) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR, "Expect zero argument for keys\n");
-            }
-            return table_obj->keys();
-        } else if (method_name == "values") {
-            if (!args.empty()) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Expect zero argument for values\n");
-            }
-            return table_obj->values();
-        } else if (method_name == "clear") {
-            if (!args.empty()) {
-                return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                    "Expect zero argument for clear\n");
-            }
-            table_obj->clear();
-            return obj;
-        }
-    } else if (obj->get_type() == VALUE_INSTANCE) {
-        InstanceValue* inst_obj = dynamic_cast<InstanceValue*>(obj.get());
-        // Find method
-        if (inst_obj->struct_def->methods.count(method_name)) {
-            std::shared_ptr<Value> method = inst_obj->struct_def->methods[method_name];
-            AlgoValue* algo_val = dynamic_cast<AlgoValue*>(method.get());
-            if (!algo_val) {
-                if (method->get_type() != VALUE_ALGO) {
-                    return std::make_shared<ErrorValue>(VALUE_ERROR, "Method is not an algorithm");
-                }
-                // Compiled struct methods use their own execute path, with
-                // `self` provided by this parent binding scope.
-                SymbolTable sym(parent);
-                sym.set("self", obj);
-                return method->execute(args, &sym);
-            }
+std::shared_ptr<Value> array_push(const std::shared_ptr<Value>& obj, const std::string&,
+                                  const std::shared_ptr<Value>* args) {
+    ArrayValue* arr_obj = static_cast<ArrayValue*>(obj.get());
+    if (std::shared_ptr<Value> error = arr_obj->check_change()) return error;
+    arr_obj->push_back(args[0]);
+    return arr_obj->back();
+}
 
-            SymbolTable sym(parent);
-            ScopeCleaner cleaner(sym);
-            Interpreter interpreter(sym);
+std::shared_ptr<Value> array_pop(const std::shared_ptr<Value>& obj, const std::string& name,
+                                 const std::shared_ptr<Value>*) {
+    ArrayValue* arr_obj = static_cast<ArrayValue*>(obj.get());
+    if (std::shared_ptr<Value> error = arr_obj->check_change()) return error;
+    if (arr_obj->empty()) {
+        io::write("Cannot " + name + " from an empty array\n");
+        return make_pooled<Value>();
+    }
+    return arr_obj->pop_back();
+}
 
-            // Set self
-            sym.set("self", obj);
+std::shared_ptr<Value> array_resize(const std::shared_ptr<Value>& obj, const std::string&,
+                                    const std::shared_ptr<Value>* args) {
+    ArrayValue* arr_obj = static_cast<ArrayValue*>(obj.get());
+    if (std::shared_ptr<Value> error = arr_obj->check_change()) return error;
+    const std::shared_ptr<Value>& new_size_val = args[0];
+    if (new_size_val->get_kind() != ValueKind::Int) {
+        io::write("Argument for resize must be an integer\n");
+        return make_pooled<Value>();
+    }
+    long long new_size;
+    try {
+        new_size = new_size_val->as_int();
+    } catch (const std::out_of_range&) {
+        io::write("Resize argument out of range\n");
+        return make_pooled<Value>();
+    }
+    if (new_size < 0) {
+        io::write("Resize argument cannot be negative\n");
+        return make_pooled<Value>();
+    }
+    arr_obj->resize(static_cast<int>(new_size));
+    return obj;
+}
 
-            std::shared_ptr<Value> ret{algo_val->set_args(args, sym, interpreter)};
-            if (ret->get_type() == VALUE_ERROR) return ret;
+std::shared_ptr<Value> array_insert(const std::shared_ptr<Value>& obj, const std::string&,
+                                    const std::shared_ptr<Value>* args) {
+    ArrayValue* arr_obj = static_cast<ArrayValue*>(obj.get());
+    if (std::shared_ptr<Value> error = arr_obj->check_change()) return error;
+    return arr_obj->insert(args[0]->as_int(), args[1]);
+}
 
-            // Execute body
-            AlgorithmDefNode* algo_node =
-                dynamic_cast<AlgorithmDefNode*>(algo_val->get_node_ptr().get());
-            const NodeList& algo_body = algo_node->get_body();
+std::shared_ptr<Value> array_remove(const std::shared_ptr<Value>& obj, const std::string&,
+                                    const std::shared_ptr<Value>* args) {
+    ArrayValue* arr_obj = static_cast<ArrayValue*>(obj.get());
+    if (std::shared_ptr<Value> error = arr_obj->check_change()) return error;
+    return arr_obj->remove(args[0]->as_int());
+}
 
-            std::shared_ptr<Value> res = ret;
-            for (int i = 0; i < algo_body.size(); ++i) {
-                res = interpreter.visit(algo_body[i]);
-                if (res->get_type() == VALUE_ERROR) return res;
-                if (res->get_type() == VALUE_RETURN)
-                    return dynamic_cast<ReturnValue*>(res.get())->get_value();
-            }
-            return res;
+std::shared_ptr<Value> array_size(const std::shared_ptr<Value>& obj, const std::string&,
+                                  const std::shared_ptr<Value>*) {
+    return static_cast<ArrayValue*>(obj.get())->size();
+}
+
+std::shared_ptr<Value> array_back(const std::shared_ptr<Value>& obj, const std::string&,
+                                  const std::shared_ptr<Value>*) {
+    ArrayValue* arr_obj = static_cast<ArrayValue*>(obj.get());
+    if (arr_obj->empty()) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, "Cannot call back on an empty array\n");
+    }
+    return arr_obj->back();
+}
+
+std::shared_ptr<Value> string_size(const std::shared_ptr<Value>& obj, const std::string&,
+                                   const std::shared_ptr<Value>*) {
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT,
+                                            static_cast<int64_t>(obj->as_string().size()));
+}
+
+HashTableValue* as_table(const std::shared_ptr<Value>& obj) {
+    return static_cast<HashTableValue*>(obj.get());
+}
+
+std::shared_ptr<Value> table_set(const std::shared_ptr<Value>& obj, const std::string&,
+                                 const std::shared_ptr<Value>* args) {
+    if (std::shared_ptr<Value> error = as_table(obj)->check_change()) return error;
+    return as_table(obj)->set(args[0], args[1]);
+}
+
+std::shared_ptr<Value> table_get(const std::shared_ptr<Value>& obj, const std::string&,
+                                 const std::shared_ptr<Value>* args) {
+    return as_table(obj)->get(args[0]);
+}
+
+std::shared_ptr<Value> table_contains(const std::shared_ptr<Value>& obj, const std::string&,
+                                      const std::shared_ptr<Value>* args) {
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, as_table(obj)->contains(args[0]));
+}
+
+std::shared_ptr<Value> table_remove(const std::shared_ptr<Value>& obj, const std::string&,
+                                    const std::shared_ptr<Value>* args) {
+    if (std::shared_ptr<Value> error = as_table(obj)->check_change()) return error;
+    return as_table(obj)->remove(args[0]);
+}
+
+std::shared_ptr<Value> table_size(const std::shared_ptr<Value>& obj, const std::string&,
+                                  const std::shared_ptr<Value>*) {
+    return as_table(obj)->size();
+}
+
+std::shared_ptr<Value> table_is_empty(const std::shared_ptr<Value>& obj, const std::string&,
+                                      const std::shared_ptr<Value>*) {
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, as_table(obj)->size()->as_int() == 0);
+}
+
+std::shared_ptr<Value> table_keys(const std::shared_ptr<Value>& obj, const std::string&,
+                                  const std::shared_ptr<Value>*) {
+    return as_table(obj)->keys();
+}
+
+std::shared_ptr<Value> table_values(const std::shared_ptr<Value>& obj, const std::string&,
+                                    const std::shared_ptr<Value>*) {
+    return as_table(obj)->values();
+}
+
+std::shared_ptr<Value> table_clear(const std::shared_ptr<Value>& obj, const std::string&,
+                                   const std::shared_ptr<Value>*) {
+    if (std::shared_ptr<Value> error = as_table(obj)->check_change()) return error;
+    as_table(obj)->clear();
+    return obj;
+}
+
+FileValue* as_file(const std::shared_ptr<Value>& obj) {
+    return static_cast<FileValue*>(obj.get());
+}
+
+std::shared_ptr<Value> file_read_line(const std::shared_ptr<Value>& obj, const std::string&,
+                                      const std::shared_ptr<Value>*) {
+    return as_file(obj)->read_line();
+}
+
+std::shared_ptr<Value> file_read_fields(const std::shared_ptr<Value>& obj, const std::string&,
+                                        const std::shared_ptr<Value>* args) {
+    return as_file(obj)->read_fields(args[0]);
+}
+
+std::shared_ptr<Value> file_read_bytes(const std::shared_ptr<Value>& obj, const std::string&,
+                                       const std::shared_ptr<Value>* args) {
+    return as_file(obj)->read_bytes(args[0]);
+}
+
+std::shared_ptr<Value> file_at_end(const std::shared_ptr<Value>& obj, const std::string&,
+                                   const std::shared_ptr<Value>*) {
+    return as_file(obj)->at_end();
+}
+
+std::shared_ptr<Value> file_size(const std::shared_ptr<Value>& obj, const std::string&,
+                                 const std::shared_ptr<Value>*) {
+    return as_file(obj)->size();
+}
+
+std::shared_ptr<Value> file_write(const std::shared_ptr<Value>& obj, const std::string&,
+                                  const std::shared_ptr<Value>* args) {
+    return as_file(obj)->write(args[0]);
+}
+
+std::shared_ptr<Value> file_write_line(const std::shared_ptr<Value>& obj, const std::string&,
+                                       const std::shared_ptr<Value>* args) {
+    return as_file(obj)->write(args[0], true);
+}
+
+std::shared_ptr<Value> file_close(const std::shared_ptr<Value>& obj, const std::string&,
+                                  const std::shared_ptr<Value>*) {
+    return as_file(obj)->close();
+}
+
+constexpr const char* EXPECT_ZERO = "Expect zero argument for ";
+constexpr const char* EXPECT_ONE = "Expect one argument for ";
+constexpr const char* EXPECT_TWO = "Expect two arguments for ";
+
+// A method table entry taking `Arity` arguments. Callers evaluate them into
+// an array of MAX_METHOD_ARITY.
+template <std::size_t Arity>
+constexpr BuiltinMethod builtin_method(const char* arity_error,
+                                       decltype(BuiltinMethod::call) call) {
+    static_assert(Arity <= MAX_METHOD_ARITY, "the arguments would not fit; raise MAX_METHOD_ARITY");
+    return BuiltinMethod{Arity, arity_error, call};
+}
+
+using MethodTable = std::array<const BuiltinMethod*, METHOD_COUNT>;
+
+const MethodTable& array_methods() {
+    static const BuiltinMethod push = builtin_method<1>(EXPECT_ONE, array_push);
+    static const BuiltinMethod pop = builtin_method<0>(EXPECT_ZERO, array_pop);
+    static const BuiltinMethod resize = builtin_method<1>(EXPECT_ONE, array_resize);
+    static const BuiltinMethod insert = builtin_method<2>(EXPECT_TWO, array_insert);
+    static const BuiltinMethod remove = builtin_method<1>(EXPECT_ONE, array_remove);
+    static const BuiltinMethod size = builtin_method<0>(EXPECT_ZERO, array_size);
+    static const BuiltinMethod back = builtin_method<0>("Expect zero arguments for ", array_back);
+    static const MethodTable table = [] {
+        MethodTable t{};
+        t[METHOD_PUSH] = &push;
+        t[METHOD_POP] = &pop;
+        t[METHOD_RESIZE] = &resize;
+        t[METHOD_INSERT] = &insert;
+        t[METHOD_REMOVE] = &remove;
+        t[METHOD_SIZE] = &size;
+        t[METHOD_BACK] = &back;
+        return t;
+    }();
+    return table;
+}
+
+const MethodTable& string_methods() {
+    static const BuiltinMethod size = builtin_method<0>(EXPECT_ZERO, string_size);
+    static const MethodTable table = [] {
+        MethodTable t{};
+        t[METHOD_SIZE] = &size;
+        return t;
+    }();
+    return table;
+}
+
+const MethodTable& table_methods() {
+    static const BuiltinMethod set = builtin_method<2>(EXPECT_TWO, table_set);
+    static const BuiltinMethod get = builtin_method<1>(EXPECT_ONE, table_get);
+    static const BuiltinMethod contains = builtin_method<1>(EXPECT_ONE, table_contains);
+    static const BuiltinMethod remove = builtin_method<1>(EXPECT_ONE, table_remove);
+    static const BuiltinMethod size = builtin_method<0>(EXPECT_ZERO, table_size);
+    static const BuiltinMethod is_empty = builtin_method<0>(EXPECT_ZERO, table_is_empty);
+    static const BuiltinMethod keys = builtin_method<0>(EXPECT_ZERO, table_keys);
+    static const BuiltinMethod values = builtin_method<0>(EXPECT_ZERO, table_values);
+    static const BuiltinMethod clear = builtin_method<0>(EXPECT_ZERO, table_clear);
+    static const MethodTable table = [] {
+        MethodTable t{};
+        t[METHOD_SET] = &set;
+        t[METHOD_GET] = &get;
+        t[METHOD_CONTAINS] = &contains;
+        t[METHOD_REMOVE] = &remove;
+        t[METHOD_SIZE] = &size;
+        t[METHOD_IS_EMPTY] = &is_empty;
+        t[METHOD_KEYS] = &keys;
+        t[METHOD_VALUES] = &values;
+        t[METHOD_CLEAR] = &clear;
+        return t;
+    }();
+    return table;
+}
+
+const MethodTable& file_methods() {
+    static const BuiltinMethod read_line = builtin_method<0>(EXPECT_ZERO, file_read_line);
+    static const BuiltinMethod read_fields = builtin_method<1>(EXPECT_ONE, file_read_fields);
+    static const BuiltinMethod read_bytes = builtin_method<1>(EXPECT_ONE, file_read_bytes);
+    static const BuiltinMethod at_end = builtin_method<0>(EXPECT_ZERO, file_at_end);
+    static const BuiltinMethod size = builtin_method<0>(EXPECT_ZERO, file_size);
+    static const BuiltinMethod write = builtin_method<1>(EXPECT_ONE, file_write);
+    static const BuiltinMethod write_line = builtin_method<1>(EXPECT_ONE, file_write_line);
+    static const BuiltinMethod close = builtin_method<0>(EXPECT_ZERO, file_close);
+    static const MethodTable table = [] {
+        MethodTable t{};
+        t[METHOD_READ_LINE] = &read_line;
+        t[METHOD_READ_FIELDS] = &read_fields;
+        t[METHOD_READ_BYTES] = &read_bytes;
+        t[METHOD_AT_END] = &at_end;
+        t[METHOD_SIZE] = &size;
+        t[METHOD_WRITE] = &write;
+        t[METHOD_WRITE_LINE] = &write_line;
+        t[METHOD_CLOSE] = &close;
+        return t;
+    }();
+    return table;
+}
+
+}  // namespace
+
+const BuiltinMethod* find_builtin_method(ValueKind kind, MethodId id) {
+    switch (kind) {
+        case ValueKind::Array:
+            return array_methods()[id];
+        case ValueKind::String:
+            return string_methods()[id];
+        case ValueKind::HashTable:
+            return table_methods()[id];
+        case ValueKind::File:
+            return file_methods()[id];
+        default:
+            return nullptr;
+    }
+}
+
+std::shared_ptr<Value> BoundMethodValue::execute(const NodeList& args, SymbolTable* parent) {
+    if (const BuiltinMethod* method = find_builtin_method(obj->get_kind(), method_id)) {
+        if (args.size() != method->arity) {
+            return make_pooled<ErrorValue>(VALUE_ERROR, method->arity_error + method_name + "\n");
+        }
+        SymbolTable sym(parent);
+        Interpreter interpreter(sym);
+        std::shared_ptr<Value> evaluated[MAX_METHOD_ARITY];
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            evaluated[i] = interpreter.visit(args[i]);
+            if (evaluated[i]->get_type() == VALUE_ERROR) return evaluated[i];
+        }
+        return method->call(obj, method_name, evaluated);
+    }
+    if (obj->get_kind() == ValueKind::Instance) {
+        InstanceValue* inst_obj = static_cast<InstanceValue*>(obj.get());
+        if (std::shared_ptr<Value> ret = inst_obj->call_method(method_symbol, obj, args, parent)) {
+            return ret;
         }
     }
-    return std::make_shared<ErrorValue>(
+    return make_pooled<ErrorValue>(
         VALUE_ERROR, "Unknown member or invalid object for " + method_name + "\n");
 }
 
 std::shared_ptr<Value> BuiltinAlgoValue::execute_print(const std::string& str) {
-    std::cout << str << "\n";
-    return std::make_shared<Value>();
+    io::write_line(str);
+    return make_pooled<Value>();
 }
 
 std::shared_ptr<Value> BuiltinAlgoValue::execute_read() {
-    std::string ret;
-    std::cin >> ret;
-    std::cin.ignore();
-    return std::make_shared<TypedValue<std::string>>(VALUE_STRING, ret);
+    return make_pooled<TypedValue<std::string>>(VALUE_STRING, io::read_word());
 }
 
 std::shared_ptr<Value> BuiltinAlgoValue::execute_read_line() {
-    std::string ret;
-    std::getline(std::cin, ret);
-    return std::make_shared<TypedValue<std::string>>(VALUE_STRING, ret);
+    return make_pooled<TypedValue<std::string>>(VALUE_STRING, io::read_line());
+}
+
+std::shared_ptr<Value> BuiltinAlgoValue::execute_read_ints(const std::shared_ptr<Value>& count) {
+    if (count.get() != nullptr && (count->get_kind() != ValueKind::Int || count->as_int() < 0)) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, "read_ints expects a count that is a non-negative Int\n");
+    }
+    std::size_t wanted = count.get() == nullptr ? 1 : static_cast<std::size_t>(count->as_int());
+    std::vector<std::int64_t> numbers;
+    std::string bad;
+    if (!io::read_ints(wanted, numbers, bad)) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, bad.empty() ? "No int left to read"
+                                                   : "Cannot convert \"" + bad + "\" to an int");
+    }
+    if (count.get() == nullptr) return make_pooled<TypedValue<int64_t>>(VALUE_INT, numbers[0]);
+    ValueList elements;
+    elements.reserve(numbers.size());
+    for (std::int64_t number : numbers) {
+        elements.push_back(make_pooled<TypedValue<int64_t>>(VALUE_INT, number));
+    }
+    return make_pooled<ArrayValue>(std::move(elements));
+}
+
+std::shared_ptr<Value> BuiltinAlgoValue::execute_read_all_lines() {
+    ValueList elements;
+    for (std::string& line : io::read_all_lines()) {
+        elements.push_back(make_pooled<TypedValue<std::string>>(VALUE_STRING, std::move(line)));
+    }
+    return make_pooled<ArrayValue>(std::move(elements));
 }
 
 std::shared_ptr<Value> BuiltinAlgoValue::execute_clear() {
     std::system("clear");
-    return std::make_shared<Value>();
+    return make_pooled<Value>();
 }
 
 std::shared_ptr<Value> BuiltinAlgoValue::execute_int(const std::string& str) {
     if (str[0] != '-' && !std::isdigit(str[0])) {
-        return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                            "Cannot convert \"" + str + "\" to an int");
+        return make_pooled<ErrorValue>(VALUE_ERROR, "Cannot convert \"" + str + "\" to an int");
     }
     for (int i{1}; i < str.size(); ++i)
         if (!std::isdigit(str[0]))
-            return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                "Cannot convert \"" + str + "\" to an int");
-    return std::make_shared<TypedValue<int64_t>>(VALUE_INT, std::stoll(str));
+            return make_pooled<ErrorValue>(VALUE_ERROR, "Cannot convert \"" + str + "\" to an int");
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, std::stoll(str));
 }
 
 std::shared_ptr<Value> BuiltinAlgoValue::execute_float(const std::string& str) {
     int point{0};
     if (str[0] != '-' && !std::isdigit(str[0])) {
-        return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                            "Cannot convert \"" + str + "\" to an int");
+        return make_pooled<ErrorValue>(VALUE_ERROR, "Cannot convert \"" + str + "\" to an int");
     }
     for (int i{1}; i < str.size(); ++i) {
         if (!std::isdigit(str[0]) && (str[0] != '.' || point == 1)) {
-            return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                                "Cannot convert \"" + str + "\" to an int");
+            return make_pooled<ErrorValue>(VALUE_ERROR, "Cannot convert \"" + str + "\" to an int");
         }
         if (str[0] == '.') point++;
     }
-    return std::make_shared<TypedValue<double>>(VALUE_FLOAT, std::stod(str));
+    return make_pooled<TypedValue<double>>(VALUE_FLOAT, std::stod(str));
 }
 
 std::shared_ptr<Value> BuiltinAlgoValue::execute_string(const std::string& str) {
-    return std::make_shared<TypedValue<std::string>>(VALUE_STRING, str);
+    return make_pooled<TypedValue<std::string>>(VALUE_STRING, str);
 }
 
-std::shared_ptr<Value> operator+(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator+(const std::shared_ptr<Value>& a, const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<double>>(VALUE_FLOAT, a->as_double() + b->as_double());
+        return make_pooled<TypedValue<double>>(VALUE_FLOAT, a->as_double() + b->as_double());
     else if (a->get_type() == VALUE_INT && b->get_type() == VALUE_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() + b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() + b->as_int());
     else if (a->get_type() == VALUE_STRING && b->get_type() == VALUE_STRING)
-        return std::make_shared<TypedValue<std::string>>(VALUE_STRING,
-                                                         a->as_string() + b->as_string());
+        return make_pooled<TypedValue<std::string>>(VALUE_STRING, a->as_string() + b->as_string());
     else
-        return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                            Color(0xFF, 0x39, 0x6E).get() +
-                                                "Runtime ERROR: ADD operation can only apply on "
-                                                "number or two string\n" RESET);
+        return make_pooled<ErrorValue>(VALUE_ERROR,
+                                       Color(0xFF, 0x39, 0x6E).get() +
+                                           "Runtime ERROR: ADD operation can only apply on "
+                                           "number or two string\n" RESET);
 }
 
-std::shared_ptr<Value> operator-(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator-(const std::shared_ptr<Value>& a, const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<double>>(VALUE_FLOAT, a->as_double() - b->as_double());
+        return make_pooled<TypedValue<double>>(VALUE_FLOAT, a->as_double() - b->as_double());
     else if (a->get_type() == VALUE_INT && b->get_type() == VALUE_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() - b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() - b->as_int());
     else
-        return std::make_shared<ErrorValue>(
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() +
                              "Runtime ERROR: SUB operation can only apply on number\n" RESET);
 }
 
-std::shared_ptr<Value> operator*(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator*(const std::shared_ptr<Value>& a, const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<double>>(VALUE_FLOAT, a->as_double() * b->as_double());
+        return make_pooled<TypedValue<double>>(VALUE_FLOAT, a->as_double() * b->as_double());
     else if (a->get_type() == VALUE_INT && b->get_type() == VALUE_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() * b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() * b->as_int());
     else if (a->get_type() == VALUE_STRING && b->get_type() == VALUE_INT) {
         std::string ret, str_a{a->as_string()};
         int64_t times{b->as_int()};
         for (int i{0}; i < times; ++i) ret += str_a;
-        return std::make_shared<TypedValue<std::string>>(VALUE_STRING, ret);
+        return make_pooled<TypedValue<std::string>>(VALUE_STRING, ret);
     } else
-        return std::make_shared<ErrorValue>(VALUE_ERROR,
-                                            Color(0xFF, 0x39, 0x6E).get() +
-                                                "Runtime ERROR: MUL operation can only apply on "
-                                                "number or string and int\n" RESET);
+        return make_pooled<ErrorValue>(VALUE_ERROR,
+                                       Color(0xFF, 0x39, 0x6E).get() +
+                                           "Runtime ERROR: MUL operation can only apply on "
+                                           "number or string and int\n" RESET);
 }
 
-std::shared_ptr<Value> operator/(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator/(const std::shared_ptr<Value>& a, const std::shared_ptr<Value>& b) {
     if (b->as_double() == 0.0)
-        return std::make_shared<ErrorValue>(
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Runtime ERROR: DIV by 0\n" RESET);
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<double>>(VALUE_FLOAT, a->as_double() / b->as_double());
+        return make_pooled<TypedValue<double>>(VALUE_FLOAT, a->as_double() / b->as_double());
     else if (a->get_type() == VALUE_INT && b->get_type() == VALUE_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() / b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() / b->as_int());
     else
-        return std::make_shared<ErrorValue>(
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() +
                              "Runtime ERROR: DIV operation can only apply on number\n" RESET);
 }
 
-std::shared_ptr<Value> operator%(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator%(const std::shared_ptr<Value>& a, const std::shared_ptr<Value>& b) {
     if (a->get_type() != VALUE_INT || b->get_type() != VALUE_INT)
-        return std::make_shared<ErrorValue>(
+        return make_pooled<ErrorValue>(
             VALUE_ERROR,
             Color(0xFF, 0x39, 0x6E).get() + "Cannot apply \"%\" operation on float\n" RESET);
-    return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() % b->as_int());
+    return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() % b->as_int());
 }
 
-std::shared_ptr<Value> operator==(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator==(const std::shared_ptr<Value>& a,
+                                  const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_INSTANCE || b->get_type() == VALUE_INSTANCE ||
         a->get_type() == VALUE_ARRAY || b->get_type() == VALUE_ARRAY ||
         a->get_type() == VALUE_HASH_TABLE || b->get_type() == VALUE_HASH_TABLE ||
         a->get_type() == VALUE_STRUCT || b->get_type() == VALUE_STRUCT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a.get() == b.get());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a.get() == b.get());
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_double() == b->as_double());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_double() == b->as_double());
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_string() == b->as_string());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_string() == b->as_string());
 }
 
-std::shared_ptr<Value> operator!=(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator!=(const std::shared_ptr<Value>& a,
+                                  const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_INSTANCE || b->get_type() == VALUE_INSTANCE ||
         a->get_type() == VALUE_ARRAY || b->get_type() == VALUE_ARRAY ||
         a->get_type() == VALUE_HASH_TABLE || b->get_type() == VALUE_HASH_TABLE ||
         a->get_type() == VALUE_STRUCT || b->get_type() == VALUE_STRUCT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a.get() != b.get());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a.get() != b.get());
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_double() != b->as_double());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_double() != b->as_double());
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_string() != b->as_string());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_string() != b->as_string());
 }
 
-std::shared_ptr<Value> operator<(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator<(const std::shared_ptr<Value>& a, const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_double() < b->as_double());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_double() < b->as_double());
     else if (a->get_type() == VALUE_INT && b->get_type() == VALUE_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() < b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() < b->as_int());
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_string() < b->as_string());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_string() < b->as_string());
 }
 
-std::shared_ptr<Value> operator>(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator>(const std::shared_ptr<Value>& a, const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_double() > b->as_double());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_double() > b->as_double());
     else if (a->get_type() == VALUE_INT && b->get_type() == VALUE_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() > b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() > b->as_int());
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_string() > b->as_string());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_string() > b->as_string());
 }
 
-std::shared_ptr<Value> operator<=(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator<=(const std::shared_ptr<Value>& a,
+                                  const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_double() <= b->as_double());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_double() <= b->as_double());
     else if (a->get_type() == VALUE_INT && b->get_type() == VALUE_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() <= b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() <= b->as_int());
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_string() <= b->as_string());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_string() <= b->as_string());
 }
 
-std::shared_ptr<Value> operator>=(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator>=(const std::shared_ptr<Value>& a,
+                                  const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_double() >= b->as_double());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_double() >= b->as_double());
     else if (a->get_type() == VALUE_INT && b->get_type() == VALUE_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() >= b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() >= b->as_int());
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_string() >= b->as_string());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_string() >= b->as_string());
 }
 
-std::shared_ptr<Value> operator&&(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator&&(const std::shared_ptr<Value>& a,
+                                  const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT,
-                                                     a->as_double() != 0 && b->as_double() != 0);
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT,
+                                                a->as_double() != 0 && b->as_double() != 0);
     else if (a->get_type() == VALUE_INT && b->get_type() == VALUE_INT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT,
-                                                     a->as_int() != 0 && b->as_int() != 0);
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() != 0 && b->as_int() != 0);
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() && b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() && b->as_int());
 }
 
-std::shared_ptr<Value> operator||(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> operator||(const std::shared_ptr<Value>& a,
+                                  const std::shared_ptr<Value>& b) {
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT,
-                                                     a->as_double() != 0 || b->as_double() != 0);
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT,
+                                                a->as_double() != 0 || b->as_double() != 0);
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() || b->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() || b->as_int());
 }
 
-std::shared_ptr<Value> operator-(std::shared_ptr<Value> a) {
+std::shared_ptr<Value> operator-(const std::shared_ptr<Value>& a) {
     if (a->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<double>>(VALUE_FLOAT, 0 - a->as_double());
+        return make_pooled<TypedValue<double>>(VALUE_FLOAT, 0 - a->as_double());
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, 0 - a->as_int());
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, 0 - a->as_int());
 }
 
-std::shared_ptr<Value> operator!(std::shared_ptr<Value> a) {
+std::shared_ptr<Value> operator!(const std::shared_ptr<Value>& a) {
     if (a->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<double>>(VALUE_FLOAT, a->as_double() == 0);
+        return make_pooled<TypedValue<double>>(VALUE_FLOAT, a->as_double() == 0);
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, a->as_int() == 0);
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, a->as_int() == 0);
 }
 
-std::shared_ptr<Value> pow(std::shared_ptr<Value> a, std::shared_ptr<Value> b) {
+std::shared_ptr<Value> pow(const std::shared_ptr<Value>& a, const std::shared_ptr<Value>& b) {
     if (a->as_double() == 0.0 && b->as_double() == 0.0)
-        return std::make_shared<ErrorValue>(
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Runtime ERROR: 0 to the 0\n" RESET);
     if (a->get_type() == VALUE_FLOAT || b->get_type() == VALUE_FLOAT)
-        return std::make_shared<TypedValue<double>>(VALUE_FLOAT,
-                                                    std::pow(a->as_double(), b->as_double()));
+        return make_pooled<TypedValue<double>>(VALUE_FLOAT,
+                                               std::pow(a->as_double(), b->as_double()));
     else
-        return std::make_shared<TypedValue<int64_t>>(VALUE_INT, std::pow(a->as_int(), b->as_int()));
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, std::pow(a->as_int(), b->as_int()));
 }
 
-std::shared_ptr<Value> InstanceValue::get_member(const std::string& name,
-                                                 std::shared_ptr<Value> self) {
-    if (members.count(name)) {
-        return members[name];
+std::shared_ptr<Value> InstanceValue::get_member(SymbolId id, std::shared_ptr<Value> self) {
+    auto member = members.find(id);
+    if (member != members.end()) {
+        return member->second;
     }
     // Check for methods in struct definition
-    if (struct_def->methods.count(name)) {
+    if (struct_def->methods.count(id)) {
         if (self.get() == nullptr) {
             // Fallback if self not provided, but this shouldn't happen for method calls
             // Create a copy? Or error?
             // For now, create a copy as before, but warn?
-            return std::make_shared<BoundMethodValue>(std::make_shared<InstanceValue>(*this), name);
+            return make_pooled<BoundMethodValue>(make_pooled<InstanceValue>(*this), id);
         }
-        return std::make_shared<BoundMethodValue>(self, name);
+        return make_pooled<BoundMethodValue>(self, id);
     }
-    return std::make_shared<ErrorValue>(VALUE_ERROR, "Member not found: " + name);
+    return make_pooled<ErrorValue>(VALUE_ERROR, "Member not found: " + symbol_name(id));
 }
 
-void InstanceValue::set_member(const std::string& name, std::shared_ptr<Value> val) {
-    // If it's declared in struct def members, we can set it.
-    bool found = false;
-    for (const auto& mem : struct_def->members) {
-        if (mem == name) {
-            found = true;
-            break;
+std::shared_ptr<Value> InstanceValue::call_method(SymbolId id, std::shared_ptr<Value> self,
+                                                  const NodeList& args, SymbolTable* parent) {
+    auto found = struct_def->methods.find(id);
+    if (found == struct_def->methods.end()) return nullptr;
+
+    std::shared_ptr<Value> method = found->second;
+    AlgoValue* algo_val = dynamic_cast<AlgoValue*>(method.get());
+    if (!algo_val) {
+        if (method->get_type() != VALUE_ALGO) {
+            return make_pooled<ErrorValue>(VALUE_ERROR, "Method is not an algorithm");
         }
+        // Compiled struct methods use their own execute path, with
+        // `self` provided by this parent binding scope.
+        SymbolTable sym(parent);
+        sym.set(SYMBOL_SELF, self);
+        return method->execute(args, &sym);
     }
-    if (found) {
-        members[name] = val;
-    } else {
-        members[name] = val;  // Just set it for now.
+
+    SymbolTable* lexical_parent = algo_val->get_lexical_parent();
+    SymbolTable sym(lexical_parent ? lexical_scope(lexical_parent) : parent);
+    ScopeCleaner cleaner(sym);
+    Interpreter interpreter(sym);
+    CallerArgs caller_args(parent, lexical_parent, interpreter);
+
+    // Set self
+    sym.set(SYMBOL_SELF, self);
+
+    std::shared_ptr<Value> ret{algo_val->set_args(args, sym, caller_args.interpreter())};
+    if (ret->get_type() == VALUE_ERROR) return ret;
+
+    // Execute body
+    AlgorithmDefNode* algo_node = dynamic_cast<AlgorithmDefNode*>(algo_val->get_node_ptr().get());
+    const NodeList& algo_body = algo_node->get_body();
+
+    std::shared_ptr<Value> res = ret;
+    for (int i = 0; i < algo_body.size(); ++i) {
+        res = interpreter.visit(algo_body[i]);
+        if (res->get_type() == VALUE_ERROR) return res;
+        if (res->get_type() == VALUE_RETURN)
+            return dynamic_cast<ReturnValue*>(res.get())->get_value();
     }
+    return res;
 }
+
+void InstanceValue::list_children(std::vector<Value*>& out) {
+    for (const auto& [name, member] : members) out.push_back(member.get());
+}
+
+void InstanceValue::release_children(ValueList& released) {
+    for (auto& [name, member] : members) released.push_back(std::move(member));
+    members.clear();
+}
+
 std::shared_ptr<Value> StructValue::execute(const NodeList& args, SymbolTable* parent) {
     // Constructor call
     std::shared_ptr<InstanceValue> instance =
-        std::make_shared<InstanceValue>(std::make_shared<StructValue>(*this));
+        make_pooled<InstanceValue>(make_pooled<StructValue>(*this));
 
     // Initialize members to NONE
     for (const auto& member : members) {
-        instance->set_member(member, std::make_shared<Value>(VALUE_NONE));
+        instance->set_member(member, make_pooled<Value>());
     }
 
     // Call constructor if exists
-    if (methods.count("constructor")) {
-        std::shared_ptr<Value> ctor = methods["constructor"];
+    if (methods.count(SYMBOL_CONSTRUCTOR)) {
+        std::shared_ptr<Value> ctor = methods[SYMBOL_CONSTRUCTOR];
         // We need to bind the constructor to the instance
         std::shared_ptr<BoundMethodValue> bound_ctor =
-            std::make_shared<BoundMethodValue>(instance, "constructor");
+            make_pooled<BoundMethodValue>(instance, SYMBOL_CONSTRUCTOR);
         // But BoundMethodValue execute logic for custom objects is not implemented
         // in pseudo.cpp yet (only ArrayValue). We need to implement it. Actually,
         // let's reuse AlgoValue::execute but inject 'self'.
@@ -1098,9 +1227,9 @@ std::shared_ptr<Value> StructValue::execute(const NodeList& args, SymbolTable* p
 
     // For now, let's rely on BoundMethodValue which we will implement/update in
     // pseudo.cpp.
-    if (methods.count("constructor")) {
+    if (methods.count(SYMBOL_CONSTRUCTOR)) {
         std::shared_ptr<BoundMethodValue> bound_ctor =
-            std::make_shared<BoundMethodValue>(instance, "constructor");
+            make_pooled<BoundMethodValue>(instance, SYMBOL_CONSTRUCTOR);
         std::shared_ptr<Value> ret = bound_ctor->execute(args, parent);
         if (ret->get_type() == VALUE_ERROR) return ret;
     }
@@ -1112,196 +1241,46 @@ std::shared_ptr<Value> StructValue::execute(const NodeList& args, SymbolTable* p
 /// Run
 /// --------------------
 
-namespace {
-
-std::string trim(const std::string& str) {
-    size_t begin = 0;
-    while (begin < str.size() && std::isspace(static_cast<unsigned char>(str[begin]))) {
-        begin++;
-    }
-
-    size_t end = str.size();
-    while (end > begin && std::isspace(static_cast<unsigned char>(str[end - 1]))) {
-        end--;
-    }
-    return str.substr(begin, end - begin);
-}
-
-bool parse_import_line(const std::string& line, std::string& target) {
-    std::string trimmed = trim(line);
-    std::string keyword = "import";
-    if (trimmed.rfind(keyword, 0) != 0) {
-        return false;
-    }
-    if (trimmed.size() > keyword.size() &&
-        !std::isspace(static_cast<unsigned char>(trimmed[keyword.size()]))) {
-        return false;
-    }
-
-    target = trim(trimmed.substr(keyword.size()));
-    if (target.empty()) {
-        return false;
-    }
-
-    if (target.front() == '"' && target.back() == '"' && target.size() >= 2) {
-        target = target.substr(1, target.size() - 2);
-    }
-    return !target.empty();
-}
-
-std::vector<std::filesystem::path> candidate_import_paths(const std::string& target,
-                                                          const std::filesystem::path& base_dir) {
-    namespace fs = std::filesystem;
-    fs::path target_path(target);
-    std::vector<fs::path> candidates;
-
-    if (target_path.is_absolute()) {
-        candidates.push_back(target_path);
-    } else {
-        if (!target_path.has_extension()) {
-            candidates.push_back(fs::current_path() / "lib" / (target + ".ps"));
-        }
-        candidates.push_back(base_dir / target_path);
-        candidates.push_back(fs::current_path() / target_path);
-    }
-
-    if (!target_path.has_extension()) {
-        candidates.push_back(base_dir / (target + ".ps"));
-        candidates.push_back(fs::current_path() / (target + ".ps"));
-    }
-
-    return candidates;
-}
-
-bool read_file(const std::filesystem::path& path, std::string& text) {
-    std::ifstream input(path);
-    if (!input) {
-        return false;
-    }
-    std::stringstream buffer;
-    buffer << input.rdbuf();
-    text = buffer.str();
-    if (!text.empty() && text.back() != '\n') {
-        text += '\n';
-    }
-    return true;
-}
-
-bool resolve_import(const std::string& target, const std::filesystem::path& base_dir,
-                    std::filesystem::path& resolved) {
-    namespace fs = std::filesystem;
-    for (const auto& candidate : candidate_import_paths(target, base_dir)) {
-        std::error_code ec;
-        if (fs::exists(candidate, ec) && fs::is_regular_file(candidate, ec)) {
-            resolved = fs::weakly_canonical(candidate, ec);
-            if (ec) {
-                resolved = fs::absolute(candidate, ec);
-            }
-            return true;
-        }
-    }
-    return false;
+bool parse_program(const std::string& file_name, const std::string& text, NodeList& ast,
+                   std::string& error) {
+    ImportState import_state;
+    return parse_with_imports(file_name, text, import_state, ast, error);
 }
 
-}  // namespace
-
-bool expand_imports(const std::string& file_name, const std::string& text, ImportState& state,
-                    std::string& expanded, std::string& error) {
-    namespace fs = std::filesystem;
-    fs::path current_path(file_name);
-    fs::path base_dir = current_path.has_parent_path() ? fs::absolute(current_path).parent_path()
-                                                       : fs::current_path();
-
-    std::stringstream input(text);
-    std::string line;
-    while (std::getline(input, line)) {
-        std::string target;
-        if (!parse_import_line(line, target)) {
-            expanded += line + "\n";
-            continue;
-        }
-
-        fs::path import_path;
-        if (!resolve_import(target, base_dir, import_path)) {
-            error = "Import ERROR: cannot resolve \"" + target + "\" from " + base_dir.string();
-            return false;
-        }
-
-        std::string import_key = import_path.string();
-        if (state.loaded.count(import_key)) {
-            continue;
-        }
-        if (state.loading.count(import_key)) {
-            error = "Import ERROR: circular import involving " + import_key;
-            return false;
-        }
-
-        std::string import_text;
-        if (!read_file(import_path, import_text)) {
-            error = "Import ERROR: cannot read " + import_key;
-            return false;
-        }
-
-        state.loading.insert(import_key);
-        std::string import_expanded;
-        if (!expand_imports(import_key, import_text, state, import_expanded, error)) {
-            return false;
-        }
-        state.loading.erase(import_key);
-        state.loaded.insert(import_key);
-        expanded += import_expanded;
-        expanded += "\n";
+bool parse_program(const std::string& file_name, const std::string& text,
+                   SymbolTable& global_table, NodeList& ast, std::string& error,
+                   ParseMemo* memo, const PreparsedModules* preparsed) {
+    ImportState import_state;
+    import_state.memo = memo;
+    import_state.preparsed = preparsed;
+    std::vector<DeferredDefinition> deferred;
+    if (!parse_with_imports(file_name, text, import_state, ast, error, &deferred)) return false;
+    if (global_table.has_deferred()) {
+        std::unordered_set<std::string> references;
+        for (const auto& node : ast) collect_references(node, references);
+        for (const auto& name : references) global_table.define_deferred(intern_symbol(name));
+    }
+    for (auto& definition : deferred) {
+        global_table.defer(intern_symbol(definition.name), std::move(definition.read));
     }
     return true;
 }
 
-std::string run(std::string file_name, std::string text, SymbolTable& global_symbol_table) {
-    ImportState import_state;
-    std::string expanded_text;
-    std::string import_error;
-    if (!expand_imports(file_name, text, import_state, expanded_text, import_error)) {
-        std::cout << import_error << "\n";
+std::string run(std::string file_name, std::string text, SymbolTable& global_symbol_table,
+                ParseMemo* memo) {
+    NodeList ast;
+    std::string error;
+    if (!parse_program(file_name, text, global_symbol_table, ast, error, memo)) {
+        io::write(error);
         return "ABORT";
     }
+    if (ast.empty()) return "";
 
-    Lexer lexer(file_name, expanded_text);
-    TokenList tokens = lexer.make_tokens();
-    if (tokens.empty()) return "";
-    if (tokens[0]->get_type() == TOKEN_ERROR) {
-        // std::cout << "Tokens: " << tokens << "\n";
-        // Detailed Lexer Error?
-        // Lexer returns TOKEN_ERROR in list.
-        // But lexer usually returns a list with one error token if it fails?
-        // Or a list where some tokens are errors.
-        // Check lexer.cpp.
-        // Lexer::make_tokens() returns a list. If error, it pushes ErrorToken.
-        // Let's iterate and find errors.
-        for (auto tok : tokens) {
-            if (tok->get_type() == TOKEN_ERROR) {
-                std::cout << "Error: " << tok->get_value() << ", line " << tok->get_pos().line + 1
-                          << ", column: " << tok->get_pos().column << "\n";
-                std::cout << error_marker(expanded_text, tok->get_pos(), tok->get_pos());
-                return "ABORT";
-            }
-        }
-    }
-
-    Parser parser(tokens);
-    NodeList ast = parser.parse();
-
-    for (auto node : ast) {
-        if (node->get_type() == NODE_ERROR) {
-            // std::cout << "Nodes: " << node->get_node() << "\n";
-            std::shared_ptr<Token> err_tok = node->get_tok();
-            if (err_tok) {
-                std::cout << "Error: " << err_tok->get_value() << ", line "
-                          << err_tok->get_pos().line + 1
-                          << ", column: " << err_tok->get_pos().column << "\n";
-                std::cout << error_marker(expanded_text, err_tok->get_pos(), err_tok->get_pos());
-            } else {
-                std::cout << "Error: " << node->get_node() << "\n";
-            }
-            return "ABORT";
+    if (global_symbol_table.uses_lexical_scoping()) {
+        // Diagnostics, kept out of the program's output.
+        io::flush();
+        for (const std::string& warning : check_lexical_scoping(ast)) {
+            std::cerr << "Warning: " << warning << "\n";
         }
     }
 
@@ -1310,7 +1289,7 @@ std::string run(std::string file_name, std::string text, SymbolTable& global_sym
     for (auto node : ast) {
         ret->push_back(interpreter.visit(node));
         if (ret->back()->get_type() == VALUE_ERROR) {
-            std::cout << ret->back()->get_num() << "\n";
+            io::write_line(ret->back()->get_num());
             return "ABORT";
         }
     }
@@ -1320,7 +1299,7 @@ std::string run(std::string file_name, std::string text, SymbolTable& global_sym
     }
 
     if (file_name == "stdin" && ret->operator[](0)->get_type() != VALUE_NONE) {
-        std::cout << ret->get_num() << "\n";
+        io::write_line(ret->get_num());
     }
     return "";
 }
@@ -20,6 +20,23 @@
 /// Run
 /// --------------------
 
-std::string run(std::string, std::string, SymbolTable&);
+// Expands the imports of `text` and parses it into `ast`. On an import or
+// syntax error, returns false with the message `run` prints in `error`.
+bool parse_program(const std::string& file_name, const std::string& text, NodeList& ast,
+                   std::string& error);
+
+struct ParseMemo;
+struct PreparsedModules;
+
+// Like parse_program, for running in `global_table`: imported definitions
+// the program does not refer to are deferred on the table, and deferred
+// definitions from earlier runs that it refers to are defined now. With
+// `memo`, trees of unchanged definitions are reused, and with `preparsed`,
+// the trees of modules parsed ahead (imports.h).
+bool parse_program(const std::string& file_name, const std::string& text,
+                   SymbolTable& global_table, NodeList& ast, std::string& error,
+                   ParseMemo* memo = nullptr, const PreparsedModules* preparsed = nullptr);
+
+std::string run(std::string, std::string, SymbolTable&, ParseMemo* memo = nullptr);
 
 #endif
\ No newline at end of file
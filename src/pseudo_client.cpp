@@ -0,0 +1,26 @@
+/// --------------------
+/// pseudo-client driver
+/// --------------------
+///
+/// Runs a program on a `pseudo --serve` server without loading the
+/// interpreter:
+///   pseudo-client <socket> <file.ps>
+
+#include <iostream>
+#include <string>
+
+#include "server.h"
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "usage: pseudo-client <socket> <file.ps>\n";
+        return 2;
+    }
+    std::string error;
+    int status = run_client(argv[1], argv[2], 0, 1, 2, error);
+    if (status < 0) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    return status;
+}
@@ -33,11 +33,8 @@
 #include <vector>
 
 #include "compiler.h"
-#include "error.h"
 #include "imports.h"
-#include "lexer.h"
 #include "node.h"
-#include "parser.h"
 #include "token.h"
 
 namespace {
@@ -133,41 +130,15 @@ int main(int argc, char** argv) {
         code += line + "\n";
     }
 
+    // Imported definitions the program never names are left out.
     ImportState import_state;
-    std::string expanded_text, import_error;
-    if (!expand_imports(input_path, code, import_state, expanded_text, import_error)) {
-        std::cout << import_error << "\n";
+    NodeList ast;
+    std::string parse_error;
+    if (!parse_with_imports(input_path, code, import_state, ast, parse_error)) {
+        std::cout << parse_error;
         return 1;
     }
 
-    Lexer lexer(input_path, expanded_text);
-    TokenList tokens = lexer.make_tokens();
-    for (const auto& tok : tokens) {
-        if (tok->get_type() == TOKEN_ERROR) {
-            std::cout << "Error: " << tok->get_value() << ", line " << tok->get_pos().line + 1
-                      << ", column: " << tok->get_pos().column << "\n";
-            std::cout << error_marker(expanded_text, tok->get_pos(), tok->get_pos());
-            return 1;
-        }
-    }
-
-    Parser parser(tokens);
-    NodeList ast = parser.parse();
-    for (const auto& node : ast) {
-        if (node->get_type() == NODE_ERROR) {
-            std::shared_ptr<Token> err_tok = node->get_tok();
-            if (err_tok) {
-                std::cout << "Error: " << err_tok->get_value() << ", line "
-                          << err_tok->get_pos().line + 1
-                          << ", column: " << err_tok->get_pos().column << "\n";
-                std::cout << error_marker(expanded_text, err_tok->get_pos(), err_tok->get_pos());
-            } else {
-                std::cout << "Error: " << node->get_node() << "\n";
-            }
-            return 1;
-        }
-    }
-
     llvm::LLVMContext context;
     llvm::Module module(input_path, context);
     std::vector<std::string> compile_errors;
@@ -251,7 +222,7 @@ int main(int argc, char** argv) {
         linker = env;
     }
     std::string command = linker + " " + shell_quote(object_path.string()) + " " +
-                          shell_quote(runtime_lib) + " -o " + shell_quote(output_path);
+                          shell_quote(runtime_lib) + " -pthread -o " + shell_quote(output_path);
     int status = std::system(command.c_str());
     fs::remove(object_path);
     if (status != 0) {
@@ -7,31 +7,50 @@
 #include <cstdint>
 #include <cstdlib>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "binop.h"
 #include "color.h"
+#include "gc.h"
 #include "interpreter.h"
+#include "io.h"
 #include "node.h"
+#include "parallel.h"
+#include "scheduler.h"
+#include "tasks.h"
 #include "symboltable.h"
 #include "value.h"
+#include "valueref.h"
 
 namespace {
 
 // Arena frames keep every runtime-created value alive until its frame is
-// released; survivors are owned by symbol tables and containers.
-std::vector<std::vector<std::shared_ptr<Value>>> frames;
-// Scope stack: scopes.back() is the current symbol table; entry 0 holds the
-// globals. Parents follow the caller chain, like the interpreter.
-std::vector<std::unique_ptr<SymbolTable>> scopes;
-std::vector<std::unordered_map<int64_t, int64_t>> i64_memo_tables;
+// released; survivors are owned by symbol tables and containers. Entries are
+// ValueRef pins, so re-referencing a tracked value costs no atomics on the
+// main thread; other threads' frames hold shared_ptrs (ValueRef).
+// Each thread running compiled code has its own frames and scope stack.
+thread_local std::vector<std::vector<ValueRef>> frames;
+// Scope stack: scopes.back() is the current symbol table. On the main thread
+// entry 0 holds the globals; on a parallel loop worker it is the scope of the
+// running chunk. Parents follow the caller chain, like the interpreter.
+thread_local std::vector<SymbolTable*> scopes;
+std::unique_ptr<SymbolTable> globals;
+thread_local std::vector<std::unordered_map<int64_t, int64_t>> i64_memo_tables;
 
 [[noreturn]] void rt_fail(const std::shared_ptr<Value>& err) {
+    // After what the program printed, which io may still be holding.
+    io::flush();
     std::cout << err->get_num() << "\n";
+    if (sched::concurrent()) {
+        // Other threads may still be running compiled code; skip the static
+        // destructors they depend on.
+        std::cout.flush();
+        std::_Exit(1);
+    }
     exit(1);
 }
 
@@ -39,34 +58,60 @@ Value* track(std::shared_ptr<Value> value) {
     if (value->get_type() == VALUE_ERROR) {
         rt_fail(value);
     }
+    frames.back().emplace_back(std::move(value));
+    return frames.back().back().get();
+}
+
+ValueRef ref(Value* v) { return ValueRef(v); }
+
+// Re-tracks an already pinned value in the current frame.
+Value* track(const ValueRef& value) {
     frames.back().push_back(value);
     return value.get();
 }
 
-std::shared_ptr<Value> ref(Value* v) { return v->shared_from_this(); }
-
 SymbolTable& current_scope() { return *scopes.back(); }
 
+// Scheduler threads start without frames of their own.
+void ensure_base_frame() {
+    if (frames.empty()) frames.emplace_back();
+}
+
+// Names arrive as the compiled program's string constants, which live for the
+// whole run, so each address is interned once.
+SymbolId symbol_of(const char* name) {
+    thread_local std::unordered_map<const char*, SymbolId> symbols;
+    auto found = symbols.find(name);
+    if (found != symbols.end()) return found->second;
+    SymbolId id = intern_symbol(name);
+    symbols.emplace(name, id);
+    return id;
+}
+
 class CompiledAlgoValue : public Value {
    public:
     CompiledAlgoValue(const std::string& _algo_name, Value* (*_fn)(),
-                      std::vector<std::string> _arg_names, bool _memoizable)
-        : Value(VALUE_ALGO),
+                      std::vector<SymbolId> _arg_symbols, int64_t _flags)
+        : Value(VALUE_ALGO, ValueKind::Algo),
           fn(_fn),
           algo_name(_algo_name),
-          arg_names(std::move(_arg_names)),
-          memoizable(_memoizable) {}
+          arg_symbols(std::move(_arg_symbols)),
+          memoizable((_flags & RT_ALGO_MEMOIZABLE) != 0),
+          flags(_flags) {}
 
     std::string get_num() override { return algo_name; }
     std::string repr() override { return algo_name; }
+    bool is_pure() override { return (flags & RT_ALGO_PURE) != 0; }
+    bool is_associative() override { return (flags & RT_ALGO_ASSOCIATIVE) != 0; }
 
     std::shared_ptr<Value> execute(const NodeList& args = {},
                                    SymbolTable* parent = nullptr) override;
 
     Value* (*fn)();
     std::string algo_name;
-    std::vector<std::string> arg_names;
+    std::vector<SymbolId> arg_symbols;
     bool memoizable;
+    int64_t flags;
     std::unordered_map<std::string, std::shared_ptr<Value>> memo;
 };
 
@@ -86,13 +131,13 @@ std::string numeric_args_key(const ValueList& values) {
 
 std::shared_ptr<Value> make_compiled_algo(const char* name, Value* (*fn)(),
                                           const char* const* arg_names, int64_t nargs,
-                                          int64_t memoizable) {
-    std::vector<std::string> names;
-    names.reserve(nargs);
+                                          int64_t flags) {
+    std::vector<SymbolId> symbols;
+    symbols.reserve(nargs);
     for (int64_t i = 0; i < nargs; ++i) {
-        names.emplace_back(arg_names[i]);
+        symbols.push_back(symbol_of(arg_names[i]));
     }
-    return std::make_shared<CompiledAlgoValue>(name, fn, std::move(names), memoizable != 0);
+    return make_pooled<CompiledAlgoValue>(name, fn, std::move(symbols), flags);
 }
 
 void run_scope_destructors(SymbolTable& scope) {
@@ -106,7 +151,7 @@ void run_scope_destructors(SymbolTable& scope) {
         }
         InstanceValue* inst = dynamic_cast<InstanceValue*>(val.get());
         std::shared_ptr<Value> self_ptr = val;
-        std::shared_ptr<Value> dtor = inst->get_member("destructor", self_ptr);
+        std::shared_ptr<Value> dtor = inst->get_member(SYMBOL_DESTRUCTOR, self_ptr);
         if (dtor->get_type() == VALUE_ALGO) {
             std::shared_ptr<Value> ret = dtor->execute({}, scope.get_parent());
             if (ret->get_type() == VALUE_ERROR) {
@@ -118,17 +163,18 @@ void run_scope_destructors(SymbolTable& scope) {
 
 std::shared_ptr<Value> call_compiled(CompiledAlgoValue* algo, const ValueList& args,
                                      SymbolTable* parent = nullptr) {
-    if (args.size() < algo->arg_names.size()) {
-        return std::make_shared<ErrorValue>(
+    if (args.size() < algo->arg_symbols.size()) {
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Too few arguments" RESET);
     }
-    if (args.size() > algo->arg_names.size()) {
-        return std::make_shared<ErrorValue>(
+    if (args.size() > algo->arg_symbols.size()) {
+        return make_pooled<ErrorValue>(
             VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Too many arguments" RESET);
     }
 
+    // The memo table is shared, so iterations of a parallel loop skip it.
     std::string memo_key;
-    if (algo->memoizable) {
+    if (algo->memoizable && !sched::concurrent()) {
         memo_key = numeric_args_key(args);
         if (!memo_key.empty()) {
             auto cached = algo->memo.find(memo_key);
@@ -140,19 +186,35 @@ std::shared_ptr<Value> call_compiled(CompiledAlgoValue* algo, const ValueList& a
 
     int64_t mark = rt_frame_mark();
     rt_frame_push();
-    scopes.push_back(std::make_unique<SymbolTable>(parent != nullptr ? parent : &current_scope()));
+    SymbolTable scope(parent != nullptr ? parent : &current_scope());
     for (size_t i = 0; i < args.size(); ++i) {
-        scopes.back()->set(algo->arg_names[i], args[i]);
+        scope.set(algo->arg_symbols[i], args[i]);
     }
+    scopes.push_back(&scope);
     Value* result = algo->fn();
-    std::shared_ptr<Value> kept = ref(result);
+    ValueRef kept = ref(result);
     rt_frame_release(mark);
-    run_scope_destructors(*scopes.back());
+    run_scope_destructors(scope);
     scopes.pop_back();
     if (!memo_key.empty() && (kept->get_type() == VALUE_INT || kept->get_type() == VALUE_FLOAT)) {
-        algo->memo[memo_key] = kept;
+        algo->memo[memo_key] = kept.shared();
+    }
+    return kept.shared();
+}
+
+std::shared_ptr<Value> call_value(Value* callee, const ValueList& args) {
+    if (auto* compiled = dynamic_cast<CompiledAlgoValue*>(callee)) {
+        return call_compiled(compiled, args);
+    }
+
+    // Builtins, bound methods, and other interpreter-executed callees: hand
+    // over the already-evaluated arguments as precomputed AST nodes.
+    NodeList arg_nodes;
+    arg_nodes.reserve(args.size());
+    for (const auto& arg : args) {
+        arg_nodes.push_back(make_pooled<PrecomputedNode>(arg));
     }
-    return kept;
+    return callee->execute(arg_nodes, &current_scope());
 }
 
 std::shared_ptr<Value> CompiledAlgoValue::execute(const NodeList& args, SymbolTable* parent) {
@@ -175,30 +237,36 @@ std::shared_ptr<Value> CompiledAlgoValue::execute(const NodeList& args, SymbolTa
 extern "C" {
 
 void rt_init() {
+    ValueRef::pin_on_this_thread();
     frames.emplace_back();
-    scopes.push_back(std::make_unique<SymbolTable>());
+    globals = std::make_unique<SymbolTable>();
+    scopes.push_back(globals.get());
 }
 
-Value* rt_make_int(int64_t v) { return track(std::make_shared<TypedValue<int64_t>>(VALUE_INT, v)); }
+Value* rt_make_int(int64_t v) { return track(make_pooled<TypedValue<int64_t>>(VALUE_INT, v)); }
 
 Value* rt_make_float(double v) {
-    return track(std::make_shared<TypedValue<double>>(VALUE_FLOAT, v));
+    return track(make_pooled<TypedValue<double>>(VALUE_FLOAT, v));
 }
 
 Value* rt_make_string(const char* s) {
-    return track(std::make_shared<TypedValue<std::string>>(VALUE_STRING, std::string(s)));
+    return track(make_pooled<TypedValue<std::string>>(VALUE_STRING, std::string(s)));
 }
 
-Value* rt_make_none() { return track(std::make_shared<Value>()); }
+Value* rt_make_none() { return track(make_pooled<Value>()); }
 
-Value* rt_array_new() { return track(std::make_shared<ArrayValue>(ValueList(0))); }
+Value* rt_array_new() { return track(make_pooled<ArrayValue>(ValueList(0))); }
 
-void rt_array_push(Value* arr, Value* v) { dynamic_cast<ArrayValue*>(arr)->push_back(ref(v)); }
+void rt_array_push(Value* arr, Value* v) {
+    ArrayValue* array = dynamic_cast<ArrayValue*>(arr);
+    if (std::shared_ptr<Value> error = array->check_change()) rt_fail(error);
+    array->push_back(ref(v).shared());
+}
 
 Value* rt_array_get_i64(Value* arr, int64_t index) {
     ArrayValue* array = dynamic_cast<ArrayValue*>(arr);
     if (array == nullptr) {
-        rt_fail(std::make_shared<ErrorValue>(VALUE_ERROR, "Indexing a non-array value"));
+        rt_fail(make_pooled<ErrorValue>(VALUE_ERROR, "Indexing a non-array value"));
     }
     return track(array->operator[](static_cast<int>(index)));
 }
@@ -206,9 +274,10 @@ Value* rt_array_get_i64(Value* arr, int64_t index) {
 Value* rt_array_set_i64(Value* arr, int64_t index, int64_t value) {
     ArrayValue* array = dynamic_cast<ArrayValue*>(arr);
     if (array == nullptr) {
-        rt_fail(std::make_shared<ErrorValue>(VALUE_ERROR, "Indexing a non-array value"));
+        rt_fail(make_pooled<ErrorValue>(VALUE_ERROR, "Indexing a non-array value"));
     }
-    std::shared_ptr<Value> boxed = std::make_shared<TypedValue<int64_t>>(VALUE_INT, value);
+    if (std::shared_ptr<Value> error = array->check_store()) rt_fail(error);
+    std::shared_ptr<Value> boxed = make_pooled<TypedValue<int64_t>>(VALUE_INT, value);
     array->operator[](static_cast<int>(index)) = boxed;
     if (boxed->get_type() == VALUE_ERROR) {
         rt_fail(boxed);
@@ -219,9 +288,10 @@ Value* rt_array_set_i64(Value* arr, int64_t index, int64_t value) {
 Value* rt_array_push_i64(Value* arr, int64_t value) {
     ArrayValue* array = dynamic_cast<ArrayValue*>(arr);
     if (array == nullptr) {
-        rt_fail(std::make_shared<ErrorValue>(VALUE_ERROR, "Calling push on a non-array value"));
+        rt_fail(make_pooled<ErrorValue>(VALUE_ERROR, "Calling push on a non-array value"));
     }
-    std::shared_ptr<Value> boxed = std::make_shared<TypedValue<int64_t>>(VALUE_INT, value);
+    if (std::shared_ptr<Value> error = array->check_change()) rt_fail(error);
+    std::shared_ptr<Value> boxed = make_pooled<TypedValue<int64_t>>(VALUE_INT, value);
     array->push_back(boxed);
     return track(boxed);
 }
@@ -229,8 +299,9 @@ Value* rt_array_push_i64(Value* arr, int64_t value) {
 int64_t rt_array_pop_i64(Value* arr) {
     ArrayValue* array = dynamic_cast<ArrayValue*>(arr);
     if (array == nullptr) {
-        rt_fail(std::make_shared<ErrorValue>(VALUE_ERROR, "Calling pop on a non-array value"));
+        rt_fail(make_pooled<ErrorValue>(VALUE_ERROR, "Calling pop on a non-array value"));
     }
+    if (std::shared_ptr<Value> error = array->check_change()) rt_fail(error);
     std::shared_ptr<Value> value = array->pop_back();
     if (value->get_type() == VALUE_ERROR) {
         rt_fail(value);
@@ -266,47 +337,29 @@ void rt_i64_memo_store(int64_t memo_id, int64_t arg, int64_t value) {
     i64_memo_tables[index][arg] = value;
 }
 
-Value* rt_get_var(const char* name) { return track(current_scope().get(name)); }
+Value* rt_get_var(const char* name) { return track(current_scope().get(symbol_of(name))); }
 
 Value* rt_set_var(const char* name, Value* v) {
-    current_scope().set(name, ref(v));
-    return track(current_scope().get(name));
+    SymbolId id = symbol_of(name);
+    current_scope().set(id, ref(v).shared());
+    return track(current_scope().get(id));
 }
 
+// RT_OP_ADD through RT_OP_GEQ share BinaryOp's numbering.
+static_assert(static_cast<int>(RT_OP_ADD) == static_cast<int>(BINARY_ADD) &&
+              static_cast<int>(RT_OP_GEQ) == static_cast<int>(BINARY_GREATER_EQUAL));
+
 Value* rt_bin_op(int64_t op, Value* a, Value* b) {
-    std::shared_ptr<Value> lhs = ref(a), rhs = ref(b);
-    switch (op) {
-        case RT_OP_ADD:
-            return track(lhs + rhs);
-        case RT_OP_SUB:
-            return track(lhs - rhs);
-        case RT_OP_MUL:
-            return track(lhs * rhs);
-        case RT_OP_DIV:
-            return track(lhs / rhs);
-        case RT_OP_MOD:
-            return track(lhs % rhs);
-        case RT_OP_POW:
-            return track(pow(lhs, rhs));  // NOLINT(misc-include-cleaner): value.h overload
-        case RT_OP_EQUAL:
-            return track(lhs == rhs);
-        case RT_OP_NEQ:
-            return track(lhs != rhs);
-        case RT_OP_LESS:
-            return track(lhs < rhs);
-        case RT_OP_GREATER:
-            return track(lhs > rhs);
-        case RT_OP_LEQ:
-            return track(lhs <= rhs);
-        case RT_OP_GEQ:
-            return track(lhs >= rhs);
-        default:
-            rt_fail(std::make_shared<ErrorValue>(VALUE_ERROR, "Not a binary op\n"));
+    if (op < RT_OP_ADD || op > RT_OP_GEQ) {
+        rt_fail(make_pooled<ErrorValue>(VALUE_ERROR, "Not a binary op\n"));
     }
+    ValueRef lhs = ref(a), rhs = ref(b);
+    return track(apply_binary(static_cast<BinaryOp>(op), lhs.shared(), rhs.shared()));
 }
 
 Value* rt_unary_op(int64_t op, Value* a) {
-    std::shared_ptr<Value> operand = ref(a);
+    ValueRef operand_ref = ref(a);
+    const std::shared_ptr<Value>& operand = operand_ref.shared();
     switch (op) {
         case RT_OP_UPLUS:
             return track(operand);
@@ -315,7 +368,7 @@ Value* rt_unary_op(int64_t op, Value* a) {
         case RT_OP_UNOT:
             return track(!operand);
         default:
-            rt_fail(std::make_shared<ErrorValue>(VALUE_ERROR, "Not an unary op\n"));
+            rt_fail(make_pooled<ErrorValue>(VALUE_ERROR, "Not an unary op\n"));
     }
 }
 
@@ -338,105 +391,118 @@ int64_t rt_for_cond(Value* i, Value* end, Value* step) {
 
 void rt_for_step_check(Value* step) {
     if (step->as_double() == 0) {
-        rt_fail(std::make_shared<ErrorValue>(VALUE_ERROR, "Infinite for loop\n"));
+        rt_fail(make_pooled<ErrorValue>(VALUE_ERROR, "Infinite for loop\n"));
     }
 }
 
 Value* rt_index(Value* obj, Value* idx) {
-    std::shared_ptr<Value> container = ref(obj), index = ref(idx);
+    ValueRef container = ref(obj), index = ref(idx);
     if (container->get_type() == VALUE_STRING) {
         std::string str = container->as_string();
         int p = index->as_int();
         if (1 <= p && p <= static_cast<int>(str.size())) {
-            return track(std::make_shared<TypedValue<std::string>>(VALUE_STRING,
-                                                                   std::string(1, str[p - 1])));
+            return track(make_pooled<TypedValue<std::string>>(VALUE_STRING,
+                                                              std::string(1, str[p - 1])));
         }
-        return track(std::make_shared<ErrorValue>(
+        return track(make_pooled<ErrorValue>(
             VALUE_ERROR, "Index out of range, size: " + std::to_string(str.size()) +
                              ", position: " + std::to_string(p)));
     }
     if (container->get_type() == VALUE_HASH_TABLE) {
-        return track(dynamic_cast<HashTableValue*>(container.get())->get(index));
+        return track(dynamic_cast<HashTableValue*>(container.get())->get(index.shared()));
     }
     if (container->get_type() != VALUE_ARRAY) {
-        return track(std::make_shared<ErrorValue>(
+        return track(make_pooled<ErrorValue>(
             VALUE_ERROR, "Access can only apply on array, find " + container->get_type() + "\n"));
     }
     return track(dynamic_cast<ArrayValue*>(container.get())->operator[](index->as_int()));
 }
 
 Value* rt_index_assign(Value* obj, Value* idx, Value* v) {
-    std::shared_ptr<Value> container = ref(obj), index = ref(idx), value = ref(v);
+    ValueRef container = ref(obj), index = ref(idx), value = ref(v);
+    if (container->get_kind() == ValueKind::Array) {
+        ContainerValue* array = static_cast<ContainerValue*>(container.get());
+        if (std::shared_ptr<Value> error = array->check_store()) return track(error);
+    } else if (container->get_kind() == ValueKind::HashTable) {
+        ContainerValue* table = static_cast<ContainerValue*>(container.get());
+        if (std::shared_ptr<Value> error = table->check_change()) return track(error);
+    }
     if (container->get_type() == VALUE_HASH_TABLE) {
-        return track(dynamic_cast<HashTableValue*>(container.get())->set(index, value));
+        return track(
+            dynamic_cast<HashTableValue*>(container.get())->set(index.shared(), value.shared()));
     }
     if (container->get_type() != VALUE_ARRAY) {
-        return track(std::make_shared<ErrorValue>(
+        return track(make_pooled<ErrorValue>(
             VALUE_ERROR, "Access can only apply on array or object member\n"));
     }
     // Matches visit_array_assign: an out-of-range index assigns into the
     // array's error slot and is effectively ignored.
-    dynamic_cast<ArrayValue*>(container.get())->operator[](index->as_int()) = value;
+    dynamic_cast<ArrayValue*>(container.get())->operator[](index->as_int()) = value.shared();
     return track(value);
 }
 
 Value* rt_member_access(Value* obj, const char* name) {
-    std::shared_ptr<Value> object = ref(obj);
+    ValueRef object_ref = ref(obj);
+    const std::shared_ptr<Value>& object = object_ref.shared();
     if (object->get_type() == VALUE_ARRAY || object->get_type() == VALUE_STRING ||
         object->get_type() == VALUE_HASH_TABLE) {
-        return track(std::make_shared<BoundMethodValue>(object, name));
+        return track(make_pooled<BoundMethodValue>(object, symbol_of(name)));
     }
     if (object->get_type() == VALUE_INSTANCE) {
-        return track(dynamic_cast<InstanceValue*>(object.get())->get_member(name, object));
+        return track(
+            dynamic_cast<InstanceValue*>(object.get())->get_member(symbol_of(name), object));
     }
-    return track(std::make_shared<ErrorValue>(
+    return track(make_pooled<ErrorValue>(
         VALUE_ERROR, object->get_num() + " has no member " + std::string(name) + "\n"));
 }
 
 Value* rt_member_assign(Value* obj, const char* name, Value* v) {
-    std::shared_ptr<Value> object = ref(obj), value = ref(v);
+    ValueRef object = ref(obj), value = ref(v);
     if (object->get_type() == VALUE_INSTANCE) {
-        dynamic_cast<InstanceValue*>(object.get())->set_member(name, value);
+        InstanceValue* instance = dynamic_cast<InstanceValue*>(object.get());
+        if (std::shared_ptr<Value> error = instance->check_change()) return track(error);
+        instance->set_member(symbol_of(name), value.shared());
         return track(value);
     }
-    return track(std::make_shared<ErrorValue>(
+    return track(make_pooled<ErrorValue>(
         VALUE_ERROR, "Assignment to member only supported for Struct Instances\n"));
 }
 
 Value* rt_make_algo(const char* name, Value* (*fn)(), const char* const* arg_names, int64_t nargs,
-                    int64_t memoizable) {
-    return track(make_compiled_algo(name, fn, arg_names, nargs, memoizable));
+                    int64_t flags) {
+    return track(make_compiled_algo(name, fn, arg_names, nargs, flags));
 }
 
 Value* rt_define_algo(const char* name, Value* (*fn)(), const char* const* arg_names, int64_t nargs,
-                      int64_t memoizable) {
-    std::shared_ptr<Value> algo = make_compiled_algo(name, fn, arg_names, nargs, memoizable);
-    current_scope().set(name, algo);
+                      int64_t flags) {
+    std::shared_ptr<Value> algo = make_compiled_algo(name, fn, arg_names, nargs, flags);
+    current_scope().set(symbol_of(name), algo);
     return track(algo);
 }
 
 Value* rt_define_struct(const char* name, const char* const* member_names, int64_t nmembers,
                         const char* const* method_names, Value** methods, int64_t nmethods) {
-    std::vector<std::string> members;
+    std::vector<SymbolId> members;
     members.reserve(nmembers);
     for (int64_t i = 0; i < nmembers; ++i) {
-        members.emplace_back(member_names[i]);
+        members.push_back(symbol_of(member_names[i]));
     }
 
-    std::map<std::string, std::shared_ptr<Value>> method_map;
+    StructValue::MethodMap method_map;
     for (int64_t i = 0; i < nmethods; ++i) {
-        method_map[method_names[i]] = ref(methods[i]);
+        method_map[symbol_of(method_names[i])] = ref(methods[i]).shared();
     }
 
-    std::shared_ptr<Value> struct_value = std::make_shared<StructValue>(name, members, method_map);
-    current_scope().set(name, struct_value);
+    std::shared_ptr<Value> struct_value = make_pooled<StructValue>(name, members, method_map);
+    current_scope().set(symbol_of(name), struct_value);
     return track(struct_value);
 }
 
 Value* rt_struct_add_method(const char* struct_name, const char* method_name, Value* method) {
-    std::shared_ptr<Value> struct_value = current_scope().get(struct_name);
+    std::shared_ptr<Value> struct_value = current_scope().get(symbol_of(struct_name));
     if (struct_value->get_type() == VALUE_STRUCT) {
-        dynamic_cast<StructValue*>(struct_value.get())->methods[method_name] = ref(method);
+        dynamic_cast<StructValue*>(struct_value.get())->methods[symbol_of(method_name)] =
+            ref(method).shared();
     }
     return track(ref(method));
 }
@@ -445,21 +511,68 @@ Value* rt_call(Value* callee, Value** argv, int64_t argc) {
     ValueList args;
     args.reserve(argc);
     for (int64_t i = 0; i < argc; ++i) {
-        args.push_back(ref(argv[i]));
-    }
-
-    if (auto* compiled = dynamic_cast<CompiledAlgoValue*>(callee)) {
-        return track(call_compiled(compiled, args));
+        args.push_back(ref(argv[i]).shared());
     }
+    return track(call_value(callee, args));
+}
 
-    // Builtins, bound methods, and other interpreter-executed callees: hand
-    // over the already-evaluated arguments as precomputed AST nodes.
-    NodeList arg_nodes;
-    arg_nodes.reserve(argc);
-    for (const auto& arg : args) {
-        arg_nodes.push_back(std::make_shared<PrecomputedNode>(arg));
-    }
-    return track(callee->execute(arg_nodes, &current_scope()));
+Value* rt_spawn(Value* callee, Value** argv, int64_t argc) {
+    ValueList args;
+    args.reserve(argc);
+    for (int64_t i = 0; i < argc; ++i) {
+        args.push_back(ref(argv[i]).shared());
+    }
+    std::shared_ptr<TaskStart> start = std::make_shared<TaskStart>(
+        start_task(current_scope(), ref(callee).shared(), std::move(args)));
+    return track(spawn_task([start] {
+        ensure_base_frame();
+        int64_t mark = rt_frame_mark();
+        rt_frame_push();
+        scopes.push_back(start->scope.get());
+        std::shared_ptr<Value> result = call_value(start->callee.get(), start->args);
+        rt_frame_release(mark);
+        scopes.pop_back();
+        return result;
+    }));
+}
+
+void rt_wait_tasks() { sched::wait_for_tasks(); }
+
+Value* rt_parallel_for(Value* start, Value* end, Value* step, const char* var_name,
+                       Value* (*body)(), const char* const* reduction_names,
+                       const int64_t* reduction_ops, int64_t nreductions,
+                       const char* const* element_names, int64_t nelements) {
+    ValueRef first = ref(start), last = ref(end), stride = ref(step);
+    if (first->get_kind() != ValueKind::Int || last->get_kind() != ValueKind::Int ||
+        stride->get_kind() != ValueKind::Int) {
+        rt_fail(make_pooled<ErrorValue>(VALUE_ERROR,
+                                        "Parallel for loop bounds and step must be Int\n"));
+    }
+    rt_for_step_check(step);
+    SharedWrites writes;
+    for (int64_t i = 0; i < nelements; ++i) {
+        writes.element_writes.push_back(symbol_of(element_names[i]));
+    }
+    if (std::shared_ptr<Value> error = check_shared_writes(writes, current_scope())) rt_fail(error);
+    std::vector<LoopReduction> reductions;
+    for (int64_t i = 0; i < nreductions; ++i) {
+        reductions.push_back(
+            {symbol_of(reduction_names[i]), static_cast<BinaryOp>(reduction_ops[i])});
+    }
+    int64_t count = parallel_trip_count(first->as_int(), last->as_int(), stride->as_int());
+    std::shared_ptr<Value> result = run_parallel_loop(
+        current_scope(), symbol_of(var_name), first->as_int(), stride->as_int(), count, reductions,
+        false, [body](SymbolTable& scope) {
+                ensure_base_frame();
+            int64_t mark = rt_frame_mark();
+            rt_frame_push();
+            scopes.push_back(&scope);
+            ValueRef kept = ref(body());
+            rt_frame_release(mark);
+            scopes.pop_back();
+            return kept.shared();
+        });
+    return track(result);
 }
 
 int64_t rt_frame_mark() { return static_cast<int64_t>(frames.size()); }
@@ -470,12 +583,13 @@ void rt_frame_release(int64_t mark) {
     while (static_cast<int64_t>(frames.size()) > mark) {
         frames.pop_back();
     }
+    gc::maybe_collect();
 }
 
 void rt_loop_keep(int64_t frame_index, Value* v) {
-    std::shared_ptr<Value> kept = ref(v);
+    ValueRef kept = ref(v);
     frames[frame_index].clear();
-    frames[frame_index].push_back(kept);
+    frames[frame_index].push_back(std::move(kept));
 }
 
 }  // extern "C"
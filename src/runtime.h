@@ -40,6 +40,14 @@ enum RtUnaryOpCode : int64_t {
     RT_OP_UNOT,
 };
 
+// Facts about a compiled algorithm, combined into the `flags` of
+// rt_make_algo. They mirror the AST's NodeFlag facts.
+enum RtAlgoFlag : int64_t {
+    RT_ALGO_MEMOIZABLE = 1,   // by-argument result caching
+    RT_ALGO_PURE = 2,         // calls may run concurrently
+    RT_ALGO_ASSOCIATIVE = 4,  // reduce may fold chunks separately
+};
+
 extern "C" {
 
 void rt_init();
@@ -79,16 +87,30 @@ Value* rt_index_assign(Value* obj, Value* idx, Value* v);
 Value* rt_member_access(Value* obj, const char* name);
 Value* rt_member_assign(Value* obj, const char* name, Value* v);
 
-// `memoizable` enables the same by-argument result caching the interpreter
-// applies to recursive pure-numeric algorithms.
+// RT_ALGO_MEMOIZABLE in `flags` enables the same by-argument result caching
+// the interpreter applies to recursive pure-numeric algorithms.
 Value* rt_make_algo(const char* name, Value* (*fn)(), const char* const* arg_names, int64_t nargs,
-                    int64_t memoizable);
+                    int64_t flags);
 Value* rt_define_algo(const char* name, Value* (*fn)(), const char* const* arg_names, int64_t nargs,
-                      int64_t memoizable);
+                      int64_t flags);
 Value* rt_define_struct(const char* name, const char* const* member_names, int64_t nmembers,
                         const char* const* method_names, Value** methods, int64_t nmethods);
 Value* rt_struct_add_method(const char* struct_name, const char* method_name, Value* method);
 Value* rt_call(Value* callee, Value** argv, int64_t argc);
+// `spawn callee(argv...)`: runs the call as a task and returns its handle.
+Value* rt_spawn(Value* callee, Value** argv, int64_t argc);
+// Returns once every spawned task has finished; called before main returns.
+void rt_wait_tasks();
+
+// `parallel for`: runs body() once per iteration on the scheduler, each time
+// in a fresh chunk scope with `var_name` bound. The named reductions use the
+// RtBinOpCode in `reduction_ops` and are combined like run_parallel_loop.
+// `element_names` are the outer names the body stores elements of
+// (SharedWrites::element_writes), checked before the loop starts.
+Value* rt_parallel_for(Value* start, Value* end, Value* step, const char* var_name,
+                       Value* (*body)(), const char* const* reduction_names,
+                       const int64_t* reduction_ops, int64_t nreductions,
+                       const char* const* element_names, int64_t nelements);
 
 int64_t rt_frame_mark();
 void rt_frame_push();
@@ -0,0 +1,306 @@
+/// --------------------
+/// Scheduler
+/// --------------------
+
+#include "scheduler.h"
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "gc.h"
+#include "io.h"
+
+namespace sched {
+
+namespace {
+
+using Task = std::function<void()>;
+
+struct TaskQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+};
+
+// Most threads the pool starts, counting the ones that replace blocked
+// workers.
+constexpr std::size_t MAX_WORKERS = 256;
+
+// Leaked on purpose: workers are detached and outlive static destruction.
+class Pool {
+   public:
+    // Queues for every possible worker exist from the start, so thieves
+    // never see the vector change.
+    explicit Pool(std::size_t workers) : queues(MAX_WORKERS + 1) {
+        for (auto& queue : queues) queue = std::make_unique<TaskQueue>();
+        for (std::size_t i = 0; i < workers; ++i) add_worker();
+    }
+
+    void push(Task task) {
+        TaskQueue& queue = *queues[self];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        queued.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        wake.notify_one();
+    }
+
+    // Runs one queued task: the newest of this thread's own, else the oldest
+    // of another queue's. Returns false when every queue is empty.
+    bool run_one() {
+        Task task;
+        if (!pop_back(*queues[self], task)) {
+            std::size_t count = workers.load() + 1;
+            std::size_t start = self + 1;
+            bool stolen = false;
+            for (std::size_t i = 0; i < count && !stolen; ++i) {
+                std::size_t victim = (start + i) % count;
+                if (victim != self) stolen = pop_front(*queues[victim], task);
+            }
+            if (!stolen) return false;
+        }
+        queued.fetch_sub(1);
+        task();
+        return true;
+    }
+
+    bool has_tasks() const { return queued.load() > 0; }
+
+    void ensure_progress() {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        if (queued.load() > 0 && idle == 0 && workers.load() < MAX_WORKERS) add_worker();
+    }
+
+   private:
+    static bool pop_back(TaskQueue& queue, Task& task) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return true;
+    }
+
+    static bool pop_front(TaskQueue& queue, Task& task) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) return false;
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return true;
+    }
+
+    void add_worker() {
+        std::size_t index = workers.fetch_add(1) + 1;
+        std::thread([this, index] { work(index); }).detach();
+    }
+
+    void work(std::size_t index) {
+        self = index;
+        while (true) {
+            if (run_one()) continue;
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            ++idle;
+            wake.wait(lock, [this] { return queued.load() > 0; });
+            --idle;
+        }
+    }
+
+    // Queue 0 is the injector shared by non-worker threads.
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::atomic<std::size_t> workers{0};
+    std::atomic<std::size_t> queued{0};
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    std::size_t idle{0};  // guarded by sleep_mutex
+    static thread_local std::size_t self;
+};
+
+thread_local std::size_t Pool::self = 0;
+
+// Started on first use, and again after a fork (after_fork).
+std::atomic<Pool*> shared_pool{nullptr};
+std::mutex pool_mutex;
+
+Pool& pool() {
+    Pool* current = shared_pool.load(std::memory_order_acquire);
+    if (current != nullptr) return *current;
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    current = shared_pool.load(std::memory_order_relaxed);
+    if (current == nullptr) {
+        current = new Pool(thread_count() - 1);
+        shared_pool.store(current, std::memory_order_release);
+    }
+    return *current;
+}
+
+thread_local TaskGroup* installed_group = nullptr;
+
+TaskGroup& default_group() {
+    static TaskGroup* shared = new TaskGroup;
+    return *shared;
+}
+
+TaskGroup& current_group() {
+    return installed_group ? *installed_group : default_group();
+}
+
+std::int64_t thread_cpu_ns() {
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<std::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+thread_local std::int64_t task_cpu = 0;  // thread_task_cpu_ns()
+
+// Wraps `task` to run in the calling thread's task group, heap and streams,
+// and to charge its CPU time to the group.
+Task in_context(Task task) {
+    TaskGroup* group = installed_group;
+    gc::Heap* heap = &gc::current_heap();
+    io::Streams* streams = &io::current();
+    return [task = std::move(task), group, heap, streams] {
+        TaskGroup* previous_group = use_task_group(group);
+        gc::Heap* previous_heap = gc::use_heap(heap);
+        io::Streams* previous_streams = io::use_streams(streams);
+        std::int64_t outer_tasks = task_cpu;
+        std::int64_t start = thread_cpu_ns();
+        task();
+        std::int64_t spent = thread_cpu_ns() - start;
+        // Tasks this one ran while it waited charged their own groups.
+        current_group().task_cpu_ns.fetch_add(spent - (task_cpu - outer_tasks));
+        task_cpu = outer_tasks + spent;
+        io::use_streams(previous_streams);
+        gc::use_heap(previous_heap);
+        use_task_group(previous_group);
+    };
+}
+
+// One parallel_for call: counts its unfinished tasks and keeps the first
+// exception.
+struct Batch {
+    std::atomic<std::size_t> remaining;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+};
+
+}  // namespace
+
+std::size_t thread_count() {
+    static const std::size_t count = [] {
+        if (const char* env = std::getenv("PSEUDO_THREADS")) {
+            try {
+                long requested = std::stol(env);
+                if (requested > 0) return static_cast<std::size_t>(requested);
+            } catch (const std::exception&) {
+            }
+        }
+        return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }();
+    return count;
+}
+
+bool concurrent() {
+    const TaskGroup& group = current_group();
+    return group.active_regions.load(std::memory_order_relaxed) > 0 ||
+           group.live.load(std::memory_order_relaxed) > 0;
+}
+
+void parallel_for(std::size_t count, const std::function<void(std::size_t)>& body) {
+    if (count == 0) return;
+    if (count == 1 || thread_count() == 1) {
+        for (std::size_t i = 0; i < count; ++i) body(i);
+        return;
+    }
+
+    Pool& workers = pool();
+    TaskGroup& group = current_group();
+    Batch batch;
+    batch.remaining.store(count);
+    group.active_regions.fetch_add(1);
+    for (std::size_t i = 0; i < count; ++i) {
+        workers.push(in_context([&batch, &body, i] {
+            try {
+                body(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(batch.mutex);
+                if (!batch.error) batch.error = std::current_exception();
+            }
+            if (batch.remaining.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(batch.mutex);
+                batch.done.notify_all();
+            }
+        }));
+    }
+
+    // Help until the batch is done. Tasks pushed by other threads do not wake
+    // this thread, so the wait rechecks the queues now and then.
+    while (batch.remaining.load() > 0) {
+        if (workers.run_one()) continue;
+        std::unique_lock<std::mutex> lock(batch.mutex);
+        batch.done.wait_for(lock, std::chrono::milliseconds(1), [&batch, &workers] {
+            return batch.remaining.load() == 0 || workers.has_tasks();
+        });
+    }
+    group.active_regions.fetch_sub(1);
+
+    std::lock_guard<std::mutex> lock(batch.mutex);
+    if (batch.error) std::rethrow_exception(batch.error);
+}
+
+void spawn(std::function<void()> task) {
+    TaskGroup& group = current_group();
+    group.live.fetch_add(1);
+    // Counted finished only once in_context has charged its CPU time.
+    pool().push([task = in_context(std::move(task)), &group] {
+        task();
+        group.live.fetch_sub(1);
+    });
+}
+
+bool run_queued() { return pool().run_one(); }
+
+void ensure_progress() { pool().ensure_progress(); }
+
+TaskGroup* installed_task_group() { return installed_group; }
+
+std::int64_t thread_task_cpu_ns() { return task_cpu; }
+
+TaskGroup* use_task_group(TaskGroup* group) {
+    std::swap(installed_group, group);
+    return group;
+}
+
+void after_fork() {
+    // The old pool is left as it is: its workers are gone, and a lock one of
+    // them held stays held in this process.
+    shared_pool.store(nullptr);
+    default_group().live.store(0);
+    default_group().active_regions.store(0);
+    installed_group = nullptr;
+}
+
+void wait_for_tasks() {
+    TaskGroup& group = current_group();
+    while (group.live.load() > 0) {
+        if (run_queued()) continue;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+}  // namespace sched
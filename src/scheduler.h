@@ -0,0 +1,88 @@
+/// --------------------
+/// Scheduler
+/// --------------------
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Work-stealing thread pool shared by every parallel construct. Each worker
+// owns a deque: it pushes and pops its own tasks at the back and steals from
+// the front of the others' deques when it runs dry. Threads that are not
+// workers push to a shared injector deque. A thread waiting for tasks runs
+// queued ones meanwhile, so parallel constructs can nest without deadlock.
+// A thread about to block on something another task provides calls
+// ensure_progress(), which starts another worker when queued tasks would
+// otherwise have no thread to run on.
+//
+// While pseudocode of the calling thread's task group may be running on more
+// than one thread, concurrent() returns true. The interpreter then treats the
+// group's AST nodes and their caches as read-only, and the cycle collector
+// does not run. Other groups (other Engines) do not affect it.
+namespace sched {
+
+// Threads that run tasks, including the caller of parallel_for. Set by
+// PSEUDO_THREADS, defaulting to the hardware concurrency.
+std::size_t thread_count();
+
+bool concurrent();
+
+// Runs body(0) ... body(count - 1) across the pool and returns once all of
+// them have finished. Runs them in order on the calling thread when there is
+// a single thread or a single index. The first exception a task throws is
+// rethrown here.
+void parallel_for(std::size_t count, const std::function<void(std::size_t)>& body);
+
+// Spawned tasks are counted in the group of the thread that spawned them.
+// Threads outside an Engine (engine.h) share a default group. Every task
+// runs in the group, cycle-collector heap and program streams of the thread
+// that queued it, and the CPU time a thread spends running a task is charged
+// to that group, less the time it spent meanwhile in tasks it ran while
+// waiting.
+struct TaskGroup {
+    std::atomic<std::size_t> live{0};          // spawned tasks not yet finished
+    std::atomic<int> active_regions{0};        // parallel_for calls running
+    std::atomic<std::int64_t> task_cpu_ns{0};  // CPU time charged for its tasks
+};
+
+// CPU time the calling thread has spent running tasks of any group.
+std::int64_t thread_task_cpu_ns();
+
+// The group installed on the calling thread, or nullptr for the default.
+TaskGroup* installed_task_group();
+
+// Makes `group` the calling thread's group (nullptr restores the default)
+// and returns the previous one.
+TaskGroup* use_task_group(TaskGroup* group);
+
+// Queues `task` without waiting for it. concurrent() stays true in the group
+// until it has finished.
+void spawn(std::function<void()> task);
+
+// Runs one queued task on the calling thread. Returns false when there was
+// none.
+bool run_queued();
+
+// Called before blocking until another task acts. Starts a worker when tasks
+// are queued and no worker is idle.
+void ensure_progress();
+
+// Returns once every task spawned in the calling thread's group has
+// finished, running queued ones meanwhile.
+void wait_for_tasks();
+
+// Called in the child of a fork() that does not exec. The child has only
+// the forking thread, but inherits the pool's queues and its counts of
+// workers and idle workers, so blocked tasks would wait for threads that do
+// not exist. Drops the pool and the task counts; the next parallel construct
+// starts a pool of its own. Call it before the child runs pseudocode, with
+// no parallel construct running in the forking thread.
+void after_fork();
+
+}  // namespace sched
+
+#endif
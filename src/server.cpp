@@ -0,0 +1,130 @@
+/// --------------------
+/// Fork server
+/// --------------------
+
+#include "server.h"
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "engine.h"
+#include "imports.h"
+#include "io.h"
+#include "pseudo.h"
+#include "scheduler.h"
+
+namespace {
+
+// The socket the server removes when it is stopped. A plain array, so the
+// signal handler can use it.
+char bound_path[sizeof(sockaddr_un::sun_path)];
+
+void remove_socket(int) {
+    unlink(bound_path);
+    _exit(0);
+}
+
+// Parses the standard library as modules, which every child's imports of
+// it then use, and so the lexer, parser, symbol interner and allocator pools
+// are warm in every child.
+std::shared_ptr<const PreparsedModules> warm_up() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    std::vector<std::string> paths;
+    for (const auto& entry : fs::directory_iterator(fs::current_path() / "lib", ec)) {
+        if (entry.path().extension() == ".ps") paths.push_back(entry.path().string());
+    }
+    return preparse_modules(paths);
+}
+
+// Runs a request in a forked child, like `pseudo` would run the program in
+// the client's working directory, and reports the exit status on `conn`.
+[[noreturn]] void run_request(int conn, const std::string& payload, const int fds[3],
+                              bool lexical, std::shared_ptr<const PreparsedModules> modules) {
+    sched::after_fork();
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    for (int i = 0; i < 3; ++i) {
+        if (fds[i] == i) continue;
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+
+    std::size_t split = payload.find('\0');
+    std::string cwd = payload.substr(0, split);
+    std::string file_name = split == std::string::npos ? "" : payload.substr(split + 1);
+    if (!file_name.empty() && file_name.back() == '\0') file_name.pop_back();
+    char status = 0;
+    if (chdir(cwd.c_str()) != 0) {
+        std::cerr << "Cannot enter " << cwd << "\n";
+        status = 1;
+    } else {
+        std::ifstream input(file_name);
+        std::string code, line;
+        while (std::getline(input, line)) code += line + "\n";
+        Engine engine(lexical);
+        engine.use_modules(std::move(modules));
+        std::shared_ptr<Value> result = engine.load(code, file_name);
+        if (result->get_kind() == ValueKind::Error) io::write_line(result->get_num());
+    }
+    io::flush();
+    std::cout.flush();
+    std::cerr.flush();
+    wire::write_all(conn, &status, 1);
+    _exit(status);
+}
+
+}  // namespace
+
+bool serve(const std::string& socket_path, bool lexical, std::string& error) {
+    sockaddr_un address;
+    if (!wire::socket_address(socket_path, address, error)) return false;
+    struct stat existing;
+    if (lstat(socket_path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+        unlink(socket_path.c_str());
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 ||
+        bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        error = "Cannot listen on " + socket_path + ": " + std::strerror(errno);
+        if (listener >= 0) close(listener);
+        return false;
+    }
+    std::memcpy(bound_path, address.sun_path, sizeof(bound_path));
+    signal(SIGINT, remove_socket);
+    signal(SIGTERM, remove_socket);
+    signal(SIGCHLD, SIG_IGN);  // children are reaped automatically
+
+    std::shared_ptr<const PreparsedModules> modules = warm_up();
+    io::flush();
+    std::cout.flush();
+    while (true) {
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            error = std::string("Cannot accept requests: ") + std::strerror(errno);
+            close(listener);
+            return false;
+        }
+        std::string payload;
+        int fds[3];
+        if (wire::receive_request(conn, payload, fds)) {
+            if (fork() == 0) {
+                close(listener);
+                run_request(conn, payload, fds, lexical, modules);
+            }
+            for (int i = 0; i < 3; ++i) close(fds[i]);
+        }
+        close(conn);
+    }
+}
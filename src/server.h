@@ -0,0 +1,57 @@
+/// --------------------
+/// Fork server
+/// --------------------
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <sys/un.h>
+#include <cstddef>
+#include <string>
+
+// `pseudo --serve` keeps a warm interpreter process listening on a Unix
+// socket, and `pseudo --client` asks it to run a program. For each request
+// the server forks a child, which shares the server's warmed-up memory copy
+// on write and runs the program in an Engine with the client's standard
+// input, output and error. The client waits for the run to end, so it
+// behaves like `pseudo program.ps` without paying for the interpreter's
+// startup.
+//
+// Before accepting requests the server parses every `.ps` file in the
+// `lib` directory of its working directory as a module, on the scheduler's
+// pool (scheduler.h). A child's imports of those files use the server's
+// trees, shared copy on write, unless the file has changed since
+// (preparse_modules in imports.h). Children start a pool of their own
+// rather than use the server's, whose threads they do not inherit.
+
+// Serves requests on `socket_path` until SIGINT or SIGTERM, which remove
+// the socket and end the process. A stale socket at `socket_path` is
+// replaced. Returns false with `error` set when the socket cannot be set up.
+bool serve(const std::string& socket_path, bool lexical, std::string& error);
+
+// Runs `file_name`, resolved against the calling process's working
+// directory, on the server at `socket_path` with `in`, `out` and `err` as
+// its standard streams. Returns the run's exit status once it has ended,
+// or -1 with `error` set when the server cannot be reached or the run was
+// cut short.
+int run_client(const std::string& socket_path, const std::string& file_name, int in, int out,
+               int err, std::string& error);
+
+// The protocol between the two sides. Defined in client.cpp, which does
+// not depend on the interpreter, so `pseudo-client` stays small.
+namespace wire {
+
+// A request is the length of its payload, sent with the client's three
+// standard streams attached, then the payload: the client's working
+// directory and the program path, each ended by '\0'. The reply is one
+// byte, the run's exit status.
+bool send_request(int conn, const std::string& payload, const int fds[3]);
+bool receive_request(int conn, std::string& payload, int fds[3]);
+
+bool socket_address(const std::string& path, sockaddr_un& address, std::string& error);
+bool write_all(int fd, const char* data, std::size_t size);
+bool read_all(int fd, char* data, std::size_t size);
+
+}  // namespace wire
+
+#endif
@@ -1,40 +1,167 @@
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <iomanip>
 #include "pseudo.h"
+#include "batch.h"
+#include "server.h"
+#include "snapshot.h"
+#include "profile.h"
+#include "watch.h"
 #include "color.h"
+#include "gc.h"
+#include "io.h"
+#include "pool.h"
+#include "scheduler.h"
 
 using time_point = std::chrono::steady_clock::time_point;
 
-void run_shell(std::string file_name) {
+void print_pool_stats() {
+    std::cerr << "Pool block   live  thread-peak   slabs\n";
+    for(const pool::ClassStats& cls : pool::stats()) {
+        std::cerr << std::setw(10) << cls.block_size << std::setw(7) << cls.live
+                  << std::setw(13) << cls.thread_peak << std::setw(8) << cls.slabs << "\n";
+    }
+    gc::Stats cycles = gc::stats();
+    std::cerr << "Cycle collector: " << cycles.collections << " passes, " << cycles.freed
+              << " containers freed, " << cycles.tracked << " tracked\n";
+}
+
+void run_shell(std::string file_name, bool lexical) {
     SymbolTable global_symbol_table;
+    global_symbol_table.set_lexical_scoping(lexical);
     while(true) {
         std::cout << Color(0x34, 0xD3, 0xDE) << "Pseudo >> " RESET;
-        std::string input;
-        std::getline(std::cin, input);
+        // Through io, which buffers standard input for the program's reads.
+        std::string input = io::read_line();
         time_point start{std::chrono::steady_clock::now()};
-        std::cout << run(file_name, input, global_symbol_table) << "\n";
+        std::string result = run(file_name, input, global_symbol_table);
+        io::flush();
+        std::cout << result << "\n";
         time_point end{std::chrono::steady_clock::now()};
         int64_t time_cost{std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()};
         std::cout << "Execution time: " << time_cost << " ms\n";
     }
 }
 
-void run_code(std::string file_name, char *args[]) {
+// Runs `file_name` in globals restored from `from_snapshot`, if given, and
+// saves the globals it leaves to `to_snapshot`, if given (snapshot.h).
+int run_code(std::string file_name, bool lexical, const std::string& from_snapshot,
+             const std::string& to_snapshot) {
     std::ifstream input(file_name);
     std::string code, line;
     while(std::getline(input, line)) {
         code += line + "\n";
     }
     SymbolTable global_symbol_table;
-    run(file_name, code, global_symbol_table);
+    global_symbol_table.set_lexical_scoping(lexical);
+    std::string error;
+    if(!from_snapshot.empty() && !snapshot::load(from_snapshot, global_symbol_table, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    std::string result = run(file_name, code, global_symbol_table);
+    // The program ends once the tasks it spawned have finished.
+    sched::wait_for_tasks();
+    if(!to_snapshot.empty()) {
+        if(result == "ABORT") {
+            std::cerr << "Snapshot ERROR: " << file_name << " failed, so no snapshot was written\n";
+            return 1;
+        }
+        if(!snapshot::save(to_snapshot, global_symbol_table, error)) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    }
+    return 0;
 }
 
 int main(int argc, char *args[]) {
-    if(argc == 1) {
-        run_shell("stdin");
+    // --lexical: top-level Algorithms read free names from the global scope
+    // instead of their caller's frame.
+    bool lexical{false};
+    bool pool_stats{false};
+    std::string file_name;
+    // --batch <manifest>: run the programs the manifest lists (batch.h) and
+    // write a summary to <manifest>.summary or --summary <path>.
+    std::string manifest, summary;
+    // --serve <socket>: keep a warm server for --client <socket> (server.h).
+    std::string serve_socket, client_socket;
+    // --snapshot <out>: save the globals the program leaves (snapshot.h).
+    // --from-snapshot <snap>: run the program in globals restored from one.
+    std::string to_snapshot, from_snapshot;
+    // --profile-cache <dir>: keep what the JIT learned about the program in
+    // <dir> and start from it next time (profile.h).
+    std::string profile_dir;
+    // --watch: run the program again whenever it or its imports change
+    // (watch.h).
+    bool watch_mode{false};
+    for(int i{1}; i < argc; ++i) {
+        std::string arg{args[i]};
+        if(arg == "--lexical") {
+            lexical = true;
+        } else if(arg == "--pool-stats") {
+            pool_stats = true;
+        } else if(arg == "--batch" && i + 1 < argc) {
+            manifest = args[++i];
+        } else if(arg == "--summary" && i + 1 < argc) {
+            summary = args[++i];
+        } else if(arg == "--serve" && i + 1 < argc) {
+            serve_socket = args[++i];
+        } else if(arg == "--client" && i + 1 < argc) {
+            client_socket = args[++i];
+        } else if(arg == "--snapshot" && i + 1 < argc) {
+            to_snapshot = args[++i];
+        } else if(arg == "--from-snapshot" && i + 1 < argc) {
+            from_snapshot = args[++i];
+        } else if(arg == "--watch") {
+            watch_mode = true;
+        } else if(arg == "--profile-cache" && i + 1 < argc) {
+            profile_dir = args[++i];
+        } else if(file_name.empty()) {
+            file_name = arg;
+        }
+    }
+    if(!serve_socket.empty()) {
+        std::string error;
+        serve(serve_socket, lexical, error);
+        std::cerr << error << "\n";
+        return 1;
+    }
+    if(!client_socket.empty()) {
+        std::string error;
+        int status = run_client(client_socket, file_name, 0, 1, 2, error);
+        if(status < 0) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        return status;
+    }
+    int status{0};
+    if(!manifest.empty()) {
+        std::string error;
+        if(!run_batch(manifest, summary.empty() ? manifest + ".summary" : summary, lexical, error)) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+    } else if(file_name.empty()) {
+        run_shell("stdin", lexical);
+    } else if(watch_mode) {
+        status = watch(file_name, lexical);
     } else {
-        run_code(args[1], args + 1);
+        std::string error;
+        if(!profile_dir.empty() && !profile::open(profile_dir, file_name, error)) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        status = run_code(file_name, lexical, from_snapshot, to_snapshot);
+        if(profile::active() && !profile::save(error)) {
+            std::cerr << error << "\n";
+            status = 1;
+        }
     }
-    return 0;
+    if(pool_stats) {
+        print_pool_stats();
+    }
+    return status;
 }
\ No newline at end of file
@@ -0,0 +1,644 @@
+/// --------------------
+/// Snapshots
+/// --------------------
+
+#include "snapshot.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "astcache.h"
+#include "interpreter.h"
+#include "position.h"
+#include "value.h"
+
+namespace snapshot {
+namespace {
+
+constexpr std::uint32_t VERSION = 1;
+constexpr char MAGIC[4] = {'P', 'S', 'N', 'P'};
+
+// A snapshot is this header followed by its sections, in order: the source
+// files the trees come from (name, length and line starts), the trees (a
+// file index, then the encoded tree's length and bytes), the values (one
+// record each, referring to other values by index), the globals (name and
+// value index), the deferred definitions (name and tree index) and the
+// memoized results (a tree index, then each argument key and value index).
+// Every section starts with its count; numbers are LEB128 varints.
+struct Header {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t tree_fingerprint;
+};
+
+enum Kind : std::uint8_t {
+    KIND_NONE,
+    KIND_INT,       // zigzag encoded
+    KIND_FLOAT,     // its 8 bytes
+    KIND_STRING,    // length and bytes
+    KIND_ARRAY,     // count, then the elements
+    KIND_HASH_TABLE,  // count, then each key and value
+    KIND_ALGO,      // tree, name, and whether it runs in the global scope
+    KIND_BUILTIN,   // name
+    KIND_STRUCT,    // name, member names, then each method's name and value
+    KIND_INSTANCE,  // Struct, then each member's name and value
+};
+
+class Encoder {
+   public:
+    std::string bytes;
+
+    void byte(std::uint8_t value) { bytes += static_cast<char>(value); }
+
+    void varint(std::uint64_t value) {
+        while (value >= 0x80) {
+            byte(static_cast<std::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        byte(static_cast<std::uint8_t>(value));
+    }
+
+    void integer(std::int64_t value) {
+        varint((static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+    }
+
+    void real(double value) { bytes.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+    void string(const std::string& str) {
+        varint(str.size());
+        bytes += str;
+    }
+};
+
+// Thrown by Decoder on a truncated or malformed snapshot.
+struct Corrupt {};
+
+class Decoder {
+   public:
+    Decoder(const char* _data, const char* _end) : data(_data), end(_end) {}
+
+    const char* position() const { return data; }
+
+    const char* take(std::size_t size) {
+        if (static_cast<std::size_t>(end - data) < size) throw Corrupt{};
+        const char* at = data;
+        data += size;
+        return at;
+    }
+
+    std::uint8_t byte() { return static_cast<std::uint8_t>(*take(1)); }
+
+    std::uint64_t varint() {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            std::uint8_t next = byte();
+            value |= static_cast<std::uint64_t>(next & 0x7F) << shift;
+            if (!(next & 0x80)) return value;
+        }
+        throw Corrupt{};
+    }
+
+    // A count of items that each take at least one more byte.
+    std::size_t length() {
+        std::uint64_t count = varint();
+        if (count > static_cast<std::uint64_t>(end - data)) throw Corrupt{};
+        return static_cast<std::size_t>(count);
+    }
+
+    // An index below `count`.
+    std::size_t index(std::size_t count) {
+        std::uint64_t id = varint();
+        if (id >= count) throw Corrupt{};
+        return static_cast<std::size_t>(id);
+    }
+
+    std::int64_t integer() {
+        std::uint64_t zigzag = varint();
+        return static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+    }
+
+    double real() {
+        double value;
+        std::memcpy(&value, take(sizeof(value)), sizeof(value));
+        return value;
+    }
+
+    std::string string() {
+        std::size_t size = length();
+        return std::string(take(size), size);
+    }
+
+    bool done() const { return data == end; }
+
+   private:
+    const char* data;
+    const char* end;
+};
+
+class Saver {
+   public:
+    explicit Saver(SymbolTable& _globals) : globals(_globals) {}
+
+    bool save(std::string& bytes, std::string& error) {
+        Encoder roots;
+        roots.varint(globals.get_symbols().size());
+        for (const auto& [id, value] : globals.get_symbols()) {
+            roots.string(symbol_name(id));
+            roots.varint(object(value, symbol_name(id)));
+        }
+        Encoder records;
+        if (!drain(records, error)) return false;
+
+        Encoder deferred;
+        deferred.varint(globals.get_deferred().size());
+        for (const auto& [id, read] : globals.get_deferred()) {
+            std::shared_ptr<Node> definition = read();
+            if (definition.get() == nullptr) {
+                error = "Snapshot ERROR: cannot read the definition of \"" + symbol_name(id) + "\"";
+                return false;
+            }
+            deferred.string(symbol_name(id));
+            deferred.varint(tree(definition));
+        }
+
+        Encoder memo;
+        std::vector<std::pair<std::size_t, const std::unordered_map<std::string, std::shared_ptr<Value>>*>>
+            memoized;
+        for (std::size_t i = 0; i < trees.size(); ++i) {
+            auto* results = execution_caches().memoized_results.find(*trees[i]);
+            if (results != nullptr && !results->empty()) memoized.emplace_back(i, results);
+        }
+        memo.varint(memoized.size());
+        for (const auto& [tree_id, results] : memoized) {
+            memo.varint(tree_id);
+            memo.varint(results->size());
+            for (const auto& [key, value] : *results) {
+                memo.string(key);
+                memo.varint(object(value, symbol_name(trees[tree_id]->get_symbol())));
+            }
+        }
+        if (!drain(records, error)) return false;
+
+        Encoder encoded_trees;
+        encoded_trees.varint(trees.size());
+        for (const auto& root : trees) {
+            std::string tree_bytes;
+            if (!ast_cache::encode_tree(root, tree_bytes)) {
+                error = "Snapshot ERROR: cannot save the tree of \"" + root->get_name() + "\"";
+                return false;
+            }
+            encoded_trees.varint(file(root->get_tok()->get_pos().file_id));
+            encoded_trees.string(tree_bytes);
+        }
+
+        Encoder files;
+        files.varint(file_ids.size());
+        for (std::uint32_t file_id : file_order) {
+            const SourceFile& source = source_map::get(file_id);
+            files.string(source.name);
+            files.varint(source.length);
+            files.varint(source.line_starts.size());
+            std::uint32_t previous = 0;
+            for (std::uint32_t start : source.line_starts) {
+                files.varint(start - previous);
+                previous = start;
+            }
+        }
+
+        Header header;
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.tree_fingerprint = ast_cache::tree_fingerprint();
+        bytes.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+        bytes += files.bytes;
+        bytes += encoded_trees.bytes;
+        Encoder count;
+        count.varint(objects.size());
+        bytes += count.bytes + records.bytes;
+        bytes += roots.bytes;
+        bytes += deferred.bytes;
+        bytes += memo.bytes;
+        return true;
+    }
+
+   private:
+    SymbolTable& globals;
+    std::unordered_map<Value*, std::size_t> object_ids;
+    std::vector<std::shared_ptr<Value>> objects;
+    std::vector<std::string> owners;  // the global each value was found from
+    std::size_t recorded{0};
+    std::unordered_map<Node*, std::size_t> tree_ids;
+    NodeList trees;
+    std::unordered_map<std::uint32_t, std::size_t> file_ids;
+    std::vector<std::uint32_t> file_order;
+
+    std::size_t object(const std::shared_ptr<Value>& value, const std::string& owner) {
+        auto inserted = object_ids.emplace(value.get(), objects.size());
+        if (inserted.second) {
+            objects.push_back(value);
+            owners.push_back(owner);
+        }
+        return inserted.first->second;
+    }
+
+    std::size_t tree(const std::shared_ptr<Node>& node) {
+        auto inserted = tree_ids.emplace(node.get(), trees.size());
+        if (inserted.second) trees.push_back(node);
+        return inserted.first->second;
+    }
+
+    std::size_t file(std::uint32_t file_id) {
+        auto inserted = file_ids.emplace(file_id, file_order.size());
+        if (inserted.second) file_order.push_back(file_id);
+        return inserted.first->second;
+    }
+
+    // Records every value found so far, and those they refer to.
+    bool drain(Encoder& out, std::string& error) {
+        for (; recorded < objects.size(); ++recorded) {
+            if (!record(out, objects[recorded], owners[recorded])) {
+                Value* value = objects[recorded].get();
+                std::string kind = dynamic_cast<BoundMethodValue*>(value) != nullptr
+                                       ? "bound method"
+                                       : value->get_type() + " value";
+                error = "Snapshot ERROR: cannot save \"" + owners[recorded] + "\": it holds a " +
+                        kind;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool record(Encoder& out, const std::shared_ptr<Value>& value, const std::string& owner) {
+        Value* raw = value.get();
+        switch (raw->get_kind()) {
+            case ValueKind::None:
+                out.byte(KIND_NONE);
+                return true;
+            case ValueKind::Int:
+                out.byte(KIND_INT);
+                out.integer(static_cast<TypedValue<int64_t>*>(raw)->raw());
+                return true;
+            case ValueKind::Float:
+                out.byte(KIND_FLOAT);
+                out.real(static_cast<TypedValue<double>*>(raw)->raw());
+                return true;
+            case ValueKind::String:
+                out.byte(KIND_STRING);
+                out.string(static_cast<TypedValue<std::string>*>(raw)->raw());
+                return true;
+            case ValueKind::Array: {
+                const ValueList& elements = static_cast<ArrayValue*>(raw)->elements();
+                out.byte(KIND_ARRAY);
+                out.varint(elements.size());
+                for (const auto& element : elements) out.varint(object(element, owner));
+                return true;
+            }
+            case ValueKind::HashTable: {
+                HashTableValue* table = static_cast<HashTableValue*>(raw);
+                std::shared_ptr<Value> keys = table->keys();
+                std::shared_ptr<Value> values = table->values();
+                const ValueList& key_list = static_cast<ArrayValue*>(keys.get())->elements();
+                const ValueList& value_list = static_cast<ArrayValue*>(values.get())->elements();
+                out.byte(KIND_HASH_TABLE);
+                out.varint(key_list.size());
+                for (std::size_t i = 0; i < key_list.size(); ++i) {
+                    out.varint(object(key_list[i], owner));
+                    out.varint(object(value_list[i], owner));
+                }
+                return true;
+            }
+            case ValueKind::Algo:
+                if (auto* algo = dynamic_cast<AlgoValue*>(raw)) {
+                    out.byte(KIND_ALGO);
+                    out.varint(tree(algo->get_node_ptr()));
+                    out.string(algo->get_num());
+                    out.byte(algo->get_lexical_parent() == &globals);
+                    return true;
+                }
+                if (dynamic_cast<BuiltinAlgoValue*>(raw) != nullptr) {
+                    out.byte(KIND_BUILTIN);
+                    out.string(raw->get_num());
+                    return true;
+                }
+                return false;  // a bound method
+            case ValueKind::Struct: {
+                StructValue* struct_value = static_cast<StructValue*>(raw);
+                out.byte(KIND_STRUCT);
+                out.string(struct_value->name);
+                out.varint(struct_value->members.size());
+                for (SymbolId member : struct_value->members) out.string(symbol_name(member));
+                out.varint(struct_value->methods.size());
+                for (const auto& [id, method] : struct_value->methods) {
+                    out.string(symbol_name(id));
+                    out.varint(object(method, owner));
+                }
+                return true;
+            }
+            case ValueKind::Instance: {
+                InstanceValue* instance = static_cast<InstanceValue*>(raw);
+                out.byte(KIND_INSTANCE);
+                out.varint(object(instance->struct_def, owner));
+                out.varint(instance->members.size());
+                for (const auto& [id, member] : instance->members) {
+                    out.string(symbol_name(id));
+                    out.varint(object(member, owner));
+                }
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+};
+
+// A snapshot file mapped into memory, shared by the deferred definitions
+// read from it later.
+struct Mapping {
+    void* data;
+    std::size_t size;
+    Mapping(void* _data, std::size_t _size) : data(_data), size(_size) {}
+    ~Mapping() { munmap(data, size); }
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+};
+
+// Where an encoded tree is in the mapping, and the file its positions are in.
+struct TreePlace {
+    std::size_t offset;
+    std::size_t size;
+    source_map::FileRef file;
+};
+
+class Loader {
+   public:
+    Loader(std::shared_ptr<const Mapping> _mapping, SymbolTable& _globals)
+        : mapping(std::move(_mapping)), globals(_globals) {}
+
+    // Throws Corrupt.
+    void load() {
+        const char* base = static_cast<const char*>(mapping->data);
+        Decoder in(base + sizeof(Header), base + mapping->size);
+
+        std::vector<source_map::FileRef> files(in.length());
+        for (auto& file : files) {
+            SourceFile source;
+            source.name = in.string();
+            source.length = static_cast<std::uint32_t>(in.varint());
+            source.line_starts.resize(in.length());
+            std::uint32_t start = 0;
+            for (auto& line_start : source.line_starts) {
+                start += static_cast<std::uint32_t>(in.varint());
+                line_start = start;
+            }
+            if (source.line_starts.empty() || source.line_starts[0] != 0) throw Corrupt{};
+            file = source_map::add(std::move(source));
+        }
+
+        places.resize(in.length());
+        for (auto& place : places) {
+            place.file = files[in.index(files.size())];
+            place.size = in.length();
+            place.offset = static_cast<std::size_t>(in.position() - base);
+            in.take(place.size);
+        }
+        trees.resize(places.size());
+
+        objects(in);
+
+        std::size_t global_count = in.length();
+        for (std::size_t i = 0; i < global_count; ++i) {
+            std::string name = in.string();
+            globals.set(intern_symbol(name), values[in.index(values.size())]);
+        }
+
+        std::size_t deferred_count = in.length();
+        for (std::size_t i = 0; i < deferred_count; ++i) {
+            std::string name = in.string();
+            TreePlace place = places[in.index(places.size())];
+            std::shared_ptr<const Mapping> file = mapping;
+            globals.defer(intern_symbol(name), [file, place] {
+                return ast_cache::decode_tree(static_cast<const char*>(file->data) + place.offset,
+                                              place.size, place.file.id());
+            });
+        }
+
+        std::size_t memo_count = in.length();
+        for (std::size_t i = 0; i < memo_count; ++i) {
+            auto& results = execution_caches().memoized_results[*tree(in.index(places.size()))];
+            std::size_t result_count = in.length();
+            for (std::size_t j = 0; j < result_count; ++j) {
+                std::string key = in.string();
+                results[key] = values[in.index(values.size())];
+            }
+        }
+        if (!in.done()) throw Corrupt{};
+    }
+
+   private:
+    std::shared_ptr<const Mapping> mapping;
+    SymbolTable& globals;
+    std::vector<TreePlace> places;
+    NodeList trees;
+    ValueList values;
+
+    const std::shared_ptr<Node>& tree(std::size_t index) {
+        if (trees[index].get() == nullptr) {
+            const TreePlace& place = places[index];
+            trees[index] = ast_cache::decode_tree(
+                static_cast<const char*>(mapping->data) + place.offset, place.size, place.file.id());
+            if (trees[index].get() == nullptr) throw Corrupt{};
+        }
+        return trees[index];
+    }
+
+    // Makes every value first, as containers may refer to values recorded
+    // after them, then fills the containers in.
+    void objects(Decoder& in) {
+        std::size_t count = in.length();
+        values.resize(count);
+        std::vector<const char*> records(count);
+        std::vector<std::pair<std::size_t, std::size_t>> instances;  // value, Struct
+        for (std::size_t i = 0; i < count; ++i) {
+            records[i] = in.position();
+            switch (in.byte()) {
+                case KIND_NONE:
+                    values[i] = make_pooled<Value>();
+                    break;
+                case KIND_INT:
+                    values[i] = make_pooled<TypedValue<int64_t>>(VALUE_INT, in.integer());
+                    break;
+                case KIND_FLOAT:
+                    values[i] = make_pooled<TypedValue<double>>(VALUE_FLOAT, in.real());
+                    break;
+                case KIND_STRING:
+                    values[i] = make_pooled<TypedValue<std::string>>(VALUE_STRING, in.string());
+                    break;
+                case KIND_ARRAY:
+                    values[i] = make_pooled<ArrayValue>(ValueList());
+                    skip_indices(in, in.length(), count);
+                    break;
+                case KIND_HASH_TABLE:
+                    values[i] = make_pooled<HashTableValue>();
+                    skip_indices(in, 2 * in.length(), count);
+                    break;
+                case KIND_ALGO: {
+                    std::shared_ptr<Node> node = tree(in.index(places.size()));
+                    std::string name = in.string();
+                    auto algo = make_pooled<AlgoValue>(name, node);
+                    if (in.byte() != 0) algo->set_lexical_parent(&globals);
+                    values[i] = algo;
+                    break;
+                }
+                case KIND_BUILTIN:
+                    values[i] = builtin_algo(intern_symbol(in.string()));
+                    if (values[i].get() == nullptr) throw Corrupt{};
+                    break;
+                case KIND_STRUCT: {
+                    std::string name = in.string();
+                    std::vector<SymbolId> members(in.length());
+                    for (auto& member : members) member = intern_symbol(in.string());
+                    values[i] = make_pooled<StructValue>(name, members, StructValue::MethodMap());
+                    skip_named(in, count);
+                    break;
+                }
+                case KIND_INSTANCE:
+                    instances.emplace_back(i, in.index(count));
+                    skip_named(in, count);
+                    break;
+                default:
+                    throw Corrupt{};
+            }
+        }
+        for (const auto& [i, struct_index] : instances) {
+            auto struct_def = std::dynamic_pointer_cast<StructValue>(values[struct_index]);
+            if (struct_def.get() == nullptr) throw Corrupt{};
+            values[i] = make_pooled<InstanceValue>(struct_def);
+        }
+
+        for (std::size_t i = 0; i < count; ++i) {
+            Decoder record(records[i], in.position());
+            Value* value = values[i].get();
+            switch (record.byte()) {
+                case KIND_ARRAY: {
+                    ArrayValue* array = static_cast<ArrayValue*>(value);
+                    std::size_t size = record.length();
+                    for (std::size_t j = 0; j < size; ++j) {
+                        array->push_back(values[record.index(count)]);
+                    }
+                    break;
+                }
+                case KIND_HASH_TABLE: {
+                    HashTableValue* table = static_cast<HashTableValue*>(value);
+                    std::size_t size = record.length();
+                    for (std::size_t j = 0; j < size; ++j) {
+                        std::shared_ptr<Value> key = values[record.index(count)];
+                        table->set(key, values[record.index(count)]);
+                    }
+                    break;
+                }
+                case KIND_STRUCT: {
+                    StructValue* struct_value = static_cast<StructValue*>(value);
+                    record.string();
+                    std::size_t members = record.length();
+                    for (std::size_t j = 0; j < members; ++j) record.string();
+                    std::size_t methods = record.length();
+                    for (std::size_t j = 0; j < methods; ++j) {
+                        SymbolId id = intern_symbol(record.string());
+                        struct_value->methods[id] = values[record.index(count)];
+                    }
+                    break;
+                }
+                case KIND_INSTANCE: {
+                    InstanceValue* instance = static_cast<InstanceValue*>(value);
+                    record.index(count);
+                    std::size_t members = record.length();
+                    for (std::size_t j = 0; j < members; ++j) {
+                        SymbolId id = intern_symbol(record.string());
+                        instance->set_member(id, values[record.index(count)]);
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    static void skip_indices(Decoder& in, std::size_t size, std::size_t count) {
+        for (std::size_t j = 0; j < size; ++j) in.index(count);
+    }
+
+    // Skips a count of (name, value index) pairs.
+    static void skip_named(Decoder& in, std::size_t count) {
+        std::size_t size = in.length();
+        for (std::size_t j = 0; j < size; ++j) {
+            in.string();
+            in.index(count);
+        }
+    }
+};
+
+}  // namespace
+
+bool save(const std::string& path, SymbolTable& globals, std::string& error) {
+    std::string bytes;
+    if (!Saver(globals).save(bytes, error)) return false;
+    std::ofstream output(path, std::ios::binary);
+    if (!output.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+        error = "Snapshot ERROR: cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+bool load(const std::string& path, SymbolTable& globals, std::string& error) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "Snapshot ERROR: cannot read " + path;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(Header)) {
+        close(fd);
+        error = "Snapshot ERROR: " + path + " is not a snapshot";
+        return false;
+    }
+    std::size_t size = static_cast<std::size_t>(info.st_size);
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        error = "Snapshot ERROR: cannot read " + path;
+        return false;
+    }
+    auto mapping = std::make_shared<const Mapping>(mapped, size);
+
+    Header header;
+    std::memcpy(&header, mapped, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        error = "Snapshot ERROR: " + path + " is not a snapshot";
+        return false;
+    }
+    if (header.version != VERSION || header.tree_fingerprint != ast_cache::tree_fingerprint()) {
+        error = "Snapshot ERROR: " + path + " was written by another version of pseudo";
+        return false;
+    }
+    try {
+        Loader(mapping, globals).load();
+    } catch (const Corrupt&) {
+        error = "Snapshot ERROR: " + path + " is damaged";
+        return false;
+    }
+    return true;
+}
+
+}  // namespace snapshot
@@ -0,0 +1,37 @@
+/// --------------------
+/// Snapshots
+/// --------------------
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include "symboltable.h"
+
+// `pseudo --snapshot out.snap init.ps` runs init.ps and saves the globals it
+// leaves behind; `pseudo --from-snapshot out.snap main.ps` restores them and
+// runs main.ps, without lexing, parsing or running init.ps again.
+//
+// A snapshot holds every value reachable from the globals, with its sharing
+// and cycles: numbers, strings, arrays, hash tables, Structs and their
+// instances, and Algorithms with their trees in the module cache's encoding
+// (astcache.h). Imported definitions still deferred (imports.h) and the
+// memoized results of numeric Algorithms are kept too. Compiled numeric
+// programs are not: they are rebuilt on first call. Tasks, channels, bound
+// methods and errors cannot be saved.
+//
+// A snapshot is tied to the interpreter that wrote it, like a module cache
+// file, but a mismatched one is reported rather than silently rebuilt.
+namespace snapshot {
+
+// Writes the globals of `globals`. Returns false with `error` set when a
+// value cannot be saved or the file cannot be written.
+bool save(const std::string& path, SymbolTable& globals, std::string& error);
+
+// Adds the globals saved in `path` to `globals`. Returns false with `error`
+// set when the file is missing, damaged or from another interpreter.
+bool load(const std::string& path, SymbolTable& globals, std::string& error);
+
+}  // namespace snapshot
+
+#endif
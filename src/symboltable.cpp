@@ -3,43 +3,69 @@
 /// --------------------
 
 #include "symboltable.h"
+#include "analysis.h"
 #include "color.h"
+#include "interpreter.h"
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 
-std::shared_ptr<Value> SymbolTable::get(const std::string& name) {
-    auto found = symbols.find(name);
-    if(found == symbols.end()){
-        if(parent != nullptr) {
-            return parent->get(name);
-        } else if(BUILTIN_ALGOS.count(name)) {
-            return BUILTIN_ALGOS.at(name);
-        } else {
-            return std::make_shared<ErrorValue>(
-                VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Identifier: \""+ name +"\" has not defined\n" RESET);
-        }
+std::shared_ptr<Value> builtin_algo(SymbolId id) {
+    static const std::unordered_map<SymbolId, std::shared_ptr<Value>> by_symbol = [] {
+        std::unordered_map<SymbolId, std::shared_ptr<Value>> ret;
+        for (const auto& [name, algo] : BUILTIN_ALGOS) ret.emplace(intern_symbol(name), algo);
+        return ret;
+    }();
+    auto found = by_symbol.find(id);
+    return found == by_symbol.end() ? nullptr : found->second;
+}
+
+std::shared_ptr<Value> SymbolTable::get(SymbolId id) {
+    for (SymbolTable* table = this; table != nullptr; table = table->parent) {
+        auto found = table->symbols.find(id);
+        if (found != table->symbols.end()) return found->second;
     }
-    return found->second;
+    if (std::shared_ptr<Value> builtin = builtin_algo(id)) return builtin;
+    return make_pooled<ErrorValue>(
+        VALUE_ERROR, Color(0xFF, 0x39, 0x6E).get() + "Identifier: \""+ symbol_name(id) +"\" has not defined\n" RESET);
 }
 
-void SymbolTable::set(const std::string& name, std::shared_ptr<Value> value) {
+void SymbolTable::set(SymbolId id, std::shared_ptr<Value> value) {
     if (value->get_type() == VALUE_INSTANCE) {
         contains_instance = true;
     }
-    symbols[name] = value;
+    if (!deferred.empty()) deferred.erase(id);
+    symbols[id] = std::move(value);
 }
 
-void SymbolTable::erase(const std::string& name) {
-    symbols.erase(name);
-}
+bool SymbolTable::define_deferred(SymbolId id) {
+    auto found = deferred.find(id);
+    if (found == deferred.end()) return false;
+    std::function<std::shared_ptr<Node>()> read = std::move(found->second);
+    deferred.erase(found);
+    std::shared_ptr<Node> definition = read();
+    if (definition.get() == nullptr) return false;
 
-bool SymbolTable::contains_local(const std::string& name) const {
-    return symbols.find(name) != symbols.end();
+    std::unordered_set<std::string> references;
+    collect_references(definition, references);
+    for (const auto& name : references) define_deferred(intern_symbol(name));
+    Interpreter(*this, false).visit(definition);
+    return true;
 }
 
-std::shared_ptr<Value> SymbolTable::get_local(const std::string& name) const {
-    auto found = symbols.find(name);
+std::shared_ptr<Value> SymbolTable::get_local(SymbolId id) const {
+    auto found = symbols.find(id);
     if (found == symbols.end()) {
         return nullptr;
     }
     return found->second;
 }
+
+SymbolTable* SymbolTable::get_global() {
+    SymbolTable* table = this;
+    while (table->parent != nullptr) {
+        table = table->parent;
+    }
+    return table;
+}
@@ -5,62 +5,171 @@
 #ifndef SYMBOL_H
 #define SYMBOL_H
 
+#include "intern.h"
 #include "node.h"
 #include "value.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <map>
 #include <unordered_map>
 #include <string>
 #include <memory>
 
 const std::map<std::string, std::shared_ptr<Value>> BUILTIN_ALGOS {
-    {"print", std::make_shared<BuiltinAlgoValue>("print", 
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "print"), 
-        TokenList{std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "s")}))}, 
-    {"read", std::make_shared<BuiltinAlgoValue>("read", 
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "read"), 
+    {"print", make_pooled<BuiltinAlgoValue>("print", 
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "print"), 
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "s")}))}, 
+    {"read", make_pooled<BuiltinAlgoValue>("read", 
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "read"), 
         TokenList{}))},
-    {"read_line", std::make_shared<BuiltinAlgoValue>("read_line", 
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "read_line"), 
+    {"read_line", make_pooled<BuiltinAlgoValue>("read_line", 
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "read_line"), 
         TokenList{}))},
-    {"open", std::make_shared<BuiltinAlgoValue>("open", 
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "open"), 
+    {"read_int", make_pooled<BuiltinAlgoValue>("read_int",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "read_int"),
         TokenList{}))},
-    {"clear", std::make_shared<BuiltinAlgoValue>("clear", 
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "clear"), 
+    {"read_ints", make_pooled<BuiltinAlgoValue>("read_ints",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "read_ints"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "n")}))},
+    {"read_all_lines", make_pooled<BuiltinAlgoValue>("read_all_lines",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "read_all_lines"),
         TokenList{}))},
-    {"quit", std::make_shared<BuiltinAlgoValue>("quit", 
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "quit"), 
+    {"open", make_pooled<BuiltinAlgoValue>("open", 
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "open"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "path"),
+                  make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "mode")}))},
+    {"clear", make_pooled<BuiltinAlgoValue>("clear", 
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "clear"), 
         TokenList{}))},
-    {"int", std::make_shared<BuiltinAlgoValue>("int", 
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "int"), 
-        TokenList{std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "n")}))}, 
-    {"float", std::make_shared<BuiltinAlgoValue>("float",
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "float"), 
-        TokenList{std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "n")}))}, 
-    {"string", std::make_shared<BuiltinAlgoValue>("string", 
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "string"), 
-        TokenList{std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "s")}))}, 
-    {"HashTable", std::make_shared<BuiltinAlgoValue>("HashTable",
-        std::make_shared<AlgorithmDefNode>(std::make_shared<TypedToken<std::string>>(TOKEN_STRING, Position(), "HashTable"),
+    {"quit", make_pooled<BuiltinAlgoValue>("quit", 
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "quit"), 
         TokenList{}))},
+    {"int", make_pooled<BuiltinAlgoValue>("int", 
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "int"), 
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "n")}))}, 
+    {"float", make_pooled<BuiltinAlgoValue>("float",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "float"), 
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "n")}))}, 
+    {"string", make_pooled<BuiltinAlgoValue>("string", 
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "string"), 
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "s")}))}, 
+    {"HashTable", make_pooled<BuiltinAlgoValue>("HashTable",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "HashTable"),
+        TokenList{}))},
+    {"channel", make_pooled<BuiltinAlgoValue>("channel",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "channel"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "capacity")}))},
+    {"send", make_pooled<BuiltinAlgoValue>("send",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "send"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "ch"),
+                  make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "value")}))},
+    {"receive", make_pooled<BuiltinAlgoValue>("receive",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "receive"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "ch")}))},
+    {"await", make_pooled<BuiltinAlgoValue>("await",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "await"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "task")}))},
+    {"join", make_pooled<BuiltinAlgoValue>("join",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "join"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "task")}))},
+    {"map", make_pooled<BuiltinAlgoValue>("map",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "map"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "arr"),
+                  make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "f")}))},
+    {"filter", make_pooled<BuiltinAlgoValue>("filter",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "filter"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "arr"),
+                  make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "pred")}))},
+    {"reduce", make_pooled<BuiltinAlgoValue>("reduce",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "reduce"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "arr"),
+                  make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "f"),
+                  make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "init")}))},
+    {"for_each", make_pooled<BuiltinAlgoValue>("for_each",
+        make_pooled<AlgorithmDefNode>(make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "for_each"),
+        TokenList{make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "arr"),
+                  make_pooled<TypedToken<std::string>>(TOKEN_STRING, Position(), "f")}))},
 };
 
 class SymbolTable {
 public:
     SymbolTable(SymbolTable *_parent = nullptr)
-        : parent(_parent) {}
-    std::shared_ptr<Value> get(const std::string&);
-    void set(const std::string&, std::shared_ptr<Value>);
-    void erase(const std::string&);
-    bool contains_local(const std::string&) const;
-    std::shared_ptr<Value> get_local(const std::string&) const;
-    const std::unordered_map<std::string, std::shared_ptr<Value>>& get_symbols() const { return symbols; }
+        : parent(_parent),
+          lexical_scoping(_parent && _parent->lexical_scoping),
+          table_serial(next_serial()) {}
+    // Copies own new slots, so they get a serial of their own.
+    SymbolTable(const SymbolTable& other)
+        : symbols(other.symbols),
+          parent(other.parent),
+          contains_instance(other.contains_instance),
+          lexical_scoping(other.lexical_scoping),
+          table_serial(next_serial()) {}
+    SymbolTable& operator=(const SymbolTable&) = delete;
+    std::shared_ptr<Value> get(SymbolId);
+    void set(SymbolId, std::shared_ptr<Value>);
+    void erase(SymbolId id) {
+        symbols.erase(id);
+        table_serial = next_serial();
+    }
+    bool contains_local(SymbolId id) const { return symbols.find(id) != symbols.end(); }
+    std::shared_ptr<Value> get_local(SymbolId) const;
+    // Where `id` is bound in this table, or nullptr. The slot stays valid
+    // while serial() is unchanged: tables never share a serial and erasing a
+    // name gives the table a new one.
+    std::shared_ptr<Value>* find_local_slot(SymbolId id) {
+        auto found = symbols.find(id);
+        return found == symbols.end() ? nullptr : &found->second;
+    }
+    std::uint64_t serial() const { return table_serial; }
+    std::shared_ptr<Value> get(const std::string& name) { return get(intern_symbol(name)); }
+    void set(const std::string& name, std::shared_ptr<Value> value) {
+        set(intern_symbol(name), std::move(value));
+    }
+    void erase(const std::string& name) { erase(intern_symbol(name)); }
+    bool contains_local(const std::string& name) const {
+        return contains_local(intern_symbol(name));
+    }
+    std::shared_ptr<Value> get_local(const std::string& name) const {
+        return get_local(intern_symbol(name));
+    }
+    const std::unordered_map<SymbolId, std::shared_ptr<Value>>& get_symbols() const { return symbols; }
     SymbolTable* get_parent() const { return parent; }
     bool has_instances() const { return contains_instance; }
+    SymbolTable* get_global();
+    // Opt-in: Algorithms defined in this (global) table run with it as their
+    // parent scope instead of the caller's. Inherited by child tables.
+    void set_lexical_scoping(bool enabled) { lexical_scoping = enabled; }
+    bool uses_lexical_scoping() const { return lexical_scoping; }
+    // Imported definitions nothing has referred to yet (DeferredDefinition),
+    // kept on a global table so later code can still use them. Binding the
+    // name drops its deferred definition.
+    void defer(SymbolId id, std::function<std::shared_ptr<Node>()> read) {
+        deferred[id] = std::move(read);
+    }
+    bool has_deferred() const { return !deferred.empty(); }
+    const std::unordered_map<SymbolId, std::function<std::shared_ptr<Node>()>>& get_deferred()
+        const {
+        return deferred;
+    }
+    // Reads and runs the deferred definition of `id`, after those it refers
+    // to. Returns false when `id` has none.
+    bool define_deferred(SymbolId id);
 protected:
-    std::unordered_map<std::string, std::shared_ptr<Value>> symbols;
+    std::unordered_map<SymbolId, std::shared_ptr<Value>> symbols;
     SymbolTable *parent;
     bool contains_instance{false};
+    bool lexical_scoping;
+    std::uint64_t table_serial;
+    std::unordered_map<SymbolId, std::function<std::shared_ptr<Node>()>> deferred;
+
+    static std::uint64_t next_serial() {
+        static std::atomic<std::uint64_t> serials{1};
+        return serials.fetch_add(1, std::memory_order_relaxed);
+    }
 };
 
+// BUILTIN_ALGOS keyed by interned name; nullptr when `id` is not a builtin.
+std::shared_ptr<Value> builtin_algo(SymbolId id);
+
 #endif
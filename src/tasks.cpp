@@ -0,0 +1,326 @@
+/// --------------------
+/// Tasks and channels
+/// --------------------
+
+#include "tasks.h"
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "analysis.h"
+#include "pool.h"
+#include "scheduler.h"
+
+namespace {
+
+// The global table the running task's scope copies, and that scope.
+thread_local SymbolTable* task_globals = nullptr;
+thread_local SymbolTable* task_scope = nullptr;
+
+bool is_container(const Value& value) {
+    ValueKind kind = value.get_kind();
+    return kind == ValueKind::Array || kind == ValueKind::HashTable || kind == ValueKind::Instance;
+}
+
+// Guards the frozen copies kept on containers.
+std::mutex copy_cache_mutex;
+
+// Makes frozen copies of the containers one spawn or send hands over. A
+// container reached twice is copied once, so the copies keep the sharing
+// and cycles of the originals. A copy that holds no other copies is kept on
+// its original until that changes, so spawning over the same unchanged
+// container again costs no copy.
+class FrozenCopier {
+   public:
+    std::shared_ptr<Value> copy(const std::shared_ptr<Value>& value) {
+        std::shared_ptr<Value> result = map(value);
+        // Filled after they are made, so deep structures need no recursion.
+        while (!pending.empty()) {
+            auto [original, target] = pending.back();
+            pending.pop_back();
+            if (fill(*original, *target)) keep(*original);
+        }
+        return result;
+    }
+
+   private:
+    std::shared_ptr<Value> map(const std::shared_ptr<Value>& value) {
+        if (value->get_kind() == ValueKind::Algo) {
+            // A bound method carries its receiver.
+            BoundMethodValue* bound = dynamic_cast<BoundMethodValue*>(value.get());
+            if (bound == nullptr) return value;
+            return make_pooled<BoundMethodValue>(map(bound->get_obj()), bound->get_method_symbol());
+        }
+        if (!is_container(*value)) return value;
+        ContainerValue* container = static_cast<ContainerValue*>(value.get());
+        if (container->is_frozen()) return value;
+        auto found = copies.find(container);
+        if (found != copies.end()) return found->second;
+        {
+            std::lock_guard<std::mutex> lock(copy_cache_mutex);
+            if (container->frozen_copy && container->copy_current.load(std::memory_order_relaxed)) {
+                copies.emplace(container, container->frozen_copy);
+                return container->frozen_copy;
+            }
+            // Changes from here on leave the copy made below out of date.
+            container->frozen_copy = nullptr;
+            container->copy_current.store(true, std::memory_order_relaxed);
+        }
+
+        std::shared_ptr<ContainerValue> copy;
+        if (value->get_kind() == ValueKind::Array) {
+            copy = make_pooled<ArrayValue>(static_cast<ArrayValue*>(container)->elements());
+        } else if (value->get_kind() == ValueKind::HashTable) {
+            copy = make_pooled<HashTableValue>();
+        } else {
+            copy = make_pooled<InstanceValue>(static_cast<InstanceValue*>(container)->struct_def);
+        }
+        copy->freeze();
+        copies.emplace(container, copy);
+        pending.emplace_back(container, copy.get());
+        return copy;
+    }
+
+    // Fills `copy` from `original`. Returns whether it holds no copies.
+    bool fill(ContainerValue& original, ContainerValue& copy) {
+        bool flat = true;
+        auto child = [&](const std::shared_ptr<Value>& value) {
+            std::shared_ptr<Value> mapped = map(value);
+            if (mapped.get() != value.get()) flat = false;
+            return mapped;
+        };
+        if (original.get_kind() == ValueKind::Array) {
+            ArrayValue& array = static_cast<ArrayValue&>(copy);
+            int size = static_cast<int>(array.elements().size());
+            for (int i = 1; i <= size; ++i) {
+                std::shared_ptr<Value>& element = array[i];
+                element = child(element);
+            }
+        } else if (original.get_kind() == ValueKind::HashTable) {
+            HashTableValue& table = static_cast<HashTableValue&>(original);
+            std::shared_ptr<Value> keys = table.keys(), values = table.values();
+            const ValueList& key_list = static_cast<ArrayValue*>(keys.get())->elements();
+            const ValueList& value_list = static_cast<ArrayValue*>(values.get())->elements();
+            for (std::size_t i = 0; i < key_list.size(); ++i) {
+                static_cast<HashTableValue&>(copy).set(child(key_list[i]), child(value_list[i]));
+            }
+        } else {
+            for (const auto& [id, member] : static_cast<InstanceValue&>(original).members) {
+                static_cast<InstanceValue&>(copy).set_member(id, child(member));
+            }
+        }
+        return flat;
+    }
+
+    // Keeps the copy of `original` on it, unless it changed while copied.
+    void keep(ContainerValue& original) {
+        std::lock_guard<std::mutex> lock(copy_cache_mutex);
+        if (!original.copy_current.load(std::memory_order_relaxed)) return;
+        original.frozen_copy = copies[&original];
+    }
+
+    std::unordered_map<const Value*, std::shared_ptr<Value>> copies;
+    std::vector<std::pair<ContainerValue*, ContainerValue*>> pending;
+};
+
+// Freezes `value` and every container it reaches, where they are.
+void freeze_reachable(const std::shared_ptr<Value>& value) {
+    std::vector<Value*> pending{value.get()};
+    while (!pending.empty()) {
+        Value* next = pending.back();
+        pending.pop_back();
+        if (next == nullptr) continue;
+        if (BoundMethodValue* bound = dynamic_cast<BoundMethodValue*>(next)) {
+            pending.push_back(bound->get_obj().get());
+            continue;
+        }
+        if (!is_container(*next)) continue;
+        ContainerValue* container = static_cast<ContainerValue*>(next);
+        if (container->is_frozen()) continue;
+        container->freeze();
+        container->list_children(pending);
+    }
+}
+
+// The globals a call may look up: the names its Algorithms read
+// (collect_references), following those bound to other Algorithms and to
+// Structs, whose methods may be called. `all` is set when the body of an
+// Algorithm is not known, as for compiled ones.
+struct References {
+    std::unordered_set<SymbolId> symbols;
+    std::unordered_set<const Value*> seen;
+    bool all{false};
+};
+
+void add_references(Value* value, SymbolTable& globals, References& references) {
+    if (references.all || value == nullptr || !references.seen.insert(value).second) return;
+    if (value->get_kind() == ValueKind::Struct) {
+        for (const auto& [id, method] : static_cast<StructValue*>(value)->methods) {
+            add_references(method.get(), globals, references);
+        }
+        return;
+    }
+    if (value->get_kind() == ValueKind::Instance) {
+        add_references(static_cast<InstanceValue*>(value)->struct_def.get(), globals, references);
+        return;
+    }
+    if (value->get_kind() != ValueKind::Algo) return;
+    if (BoundMethodValue* bound = dynamic_cast<BoundMethodValue*>(value)) {
+        add_references(bound->get_obj().get(), globals, references);
+    } else if (AlgoValue* algo = dynamic_cast<AlgoValue*>(value)) {
+        std::unordered_set<std::string> names;
+        collect_references(algo->get_node_ptr(), names);
+        for (const std::string& name : names) {
+            SymbolId id = intern_symbol(name);
+            if (!references.symbols.insert(id).second) continue;
+            std::shared_ptr<Value> bound = globals.get_local(id);
+            if (bound) add_references(bound.get(), globals, references);
+        }
+    } else if (dynamic_cast<BuiltinAlgoValue*>(value) == nullptr) {
+        references.all = true;
+    }
+}
+
+}  // namespace
+
+void TaskValue::finish(std::shared_ptr<Value> value) {
+    freeze_reachable(value);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result = std::move(value);
+        done = true;
+    }
+    finished.notify_all();
+}
+
+std::shared_ptr<Value> TaskValue::wait() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (done) return result;
+        }
+        if (sched::run_queued()) continue;
+        // The task runs on another thread. Tasks queued meanwhile do not wake
+        // this one, so the wait rechecks the queues now and then.
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait_for(lock, std::chrono::milliseconds(1), [this] { return done; });
+    }
+}
+
+void ChannelValue::send(std::shared_ptr<Value> value) {
+    value = FrozenCopier().copy(value);
+    std::unique_lock<std::mutex> lock(mutex);
+    if (items.size() >= capacity) {
+        lock.unlock();
+        sched::ensure_progress();
+        lock.lock();
+        not_full.wait(lock, [this] { return items.size() < capacity; });
+    }
+    items.push_back(std::move(value));
+    lock.unlock();
+    not_empty.notify_one();
+}
+
+std::shared_ptr<Value> ChannelValue::receive() {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (items.empty()) {
+        lock.unlock();
+        sched::ensure_progress();
+        lock.lock();
+        not_empty.wait(lock, [this] { return !items.empty(); });
+    }
+    std::shared_ptr<Value> value = std::move(items.front());
+    items.pop_front();
+    lock.unlock();
+    not_full.notify_one();
+    return value;
+}
+
+std::shared_ptr<Value> spawn_task(std::function<std::shared_ptr<Value>()> run) {
+    std::shared_ptr<TaskValue> task = make_pooled<TaskValue>();
+    sched::spawn([task, run = std::move(run)] { task->finish(run()); });
+    return task;
+}
+
+TaskStart start_task(SymbolTable& scope, std::shared_ptr<Value> callee, ValueList args) {
+    SymbolTable* globals = scope.get_global();
+    References references;
+    add_references(callee.get(), *globals, references);
+    for (const auto& arg : args) add_references(arg.get(), *globals, references);
+
+    FrozenCopier copier;
+    TaskStart start;
+    start.callee = copier.copy(callee);
+    for (auto& arg : args) arg = copier.copy(arg);
+    start.args = std::move(args);
+    start.scope = std::make_shared<SymbolTable>(*globals);
+    for (const auto& [id, value] : globals->get_symbols()) {
+        if (!is_container(*value) && dynamic_cast<BoundMethodValue*>(value.get()) == nullptr) {
+            continue;
+        }
+        if (references.all || references.symbols.count(id)) {
+            start.scope->set(id, copier.copy(value));
+        } else {
+            start.scope->erase(id);
+        }
+    }
+    // Spawned from a task, lexically scoped Algorithms still name the
+    // program's global table.
+    start.globals = globals == task_scope ? task_globals : globals;
+    return start;
+}
+
+TaskGlobals::TaskGlobals(const TaskStart& start)
+    : saved_globals(task_globals),
+      saved_scope(task_scope),
+      saved_chunk(ContainerValue::running_chunk) {
+    task_globals = start.globals;
+    task_scope = start.scope.get();
+    ContainerValue::running_chunk = 0;
+}
+
+TaskGlobals::~TaskGlobals() {
+    task_globals = saved_globals;
+    task_scope = saved_scope;
+    ContainerValue::running_chunk = saved_chunk;
+}
+
+SymbolTable* lexical_scope(SymbolTable* defining) {
+    return defining == task_globals ? task_scope : defining;
+}
+
+std::shared_ptr<Value> make_channel(const std::shared_ptr<Value>& capacity) {
+    if (capacity->get_kind() != ValueKind::Int || capacity->as_int() < 1) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, "Channel capacity must be a positive Int\n");
+    }
+    return make_pooled<ChannelValue>(static_cast<std::size_t>(capacity->as_int()));
+}
+
+std::shared_ptr<Value> channel_send(const std::shared_ptr<Value>& channel,
+                                    const std::shared_ptr<Value>& value) {
+    if (channel->get_kind() != ValueKind::Channel) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, "send expects a Channel\n");
+    }
+    static_cast<ChannelValue*>(channel.get())->send(value);
+    return value;
+}
+
+std::shared_ptr<Value> channel_receive(const std::shared_ptr<Value>& channel) {
+    if (channel->get_kind() != ValueKind::Channel) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, "receive expects a Channel\n");
+    }
+    return static_cast<ChannelValue*>(channel.get())->receive();
+}
+
+std::shared_ptr<Value> await_task(const std::shared_ptr<Value>& task) {
+    if (task->get_kind() != ValueKind::Task) {
+        return make_pooled<ErrorValue>(VALUE_ERROR, "Expected a Task to await\n");
+    }
+    return static_cast<TaskValue*>(task.get())->wait();
+}
@@ -0,0 +1,115 @@
+/// --------------------
+/// Tasks and channels
+/// --------------------
+
+#ifndef TASKS_H
+#define TASKS_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "symboltable.h"
+#include "value.h"
+
+// Handle of a call started with `spawn`. The result is published once, when
+// the call returns.
+class TaskValue : public Value {
+   public:
+    TaskValue() : Value(VALUE_TASK, ValueKind::Task) {}
+    std::string get_num() override { return "<Task>"; }
+    std::string repr() override { return get_num(); }
+    // Publishes `value` frozen, with every container it reaches: any task
+    // holding the handle may await it.
+    void finish(std::shared_ptr<Value> value);
+    // The call's result, or its error. Runs queued tasks while waiting.
+    std::shared_ptr<Value> wait();
+
+   private:
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done{false};
+    std::shared_ptr<Value> result;
+};
+
+// Bounded FIFO queue between tasks. send blocks while it is full, receive
+// while it is empty.
+class ChannelValue : public Value {
+   public:
+    explicit ChannelValue(std::size_t _capacity)
+        : Value(VALUE_CHANNEL, ValueKind::Channel), capacity(_capacity) {}
+    std::string get_num() override { return "<Channel>"; }
+    std::string repr() override { return get_num(); }
+    // Queues a frozen copy of `value` (see start_task); the sender's
+    // containers stay its own.
+    void send(std::shared_ptr<Value> value);
+    std::shared_ptr<Value> receive();
+
+   private:
+    std::size_t capacity;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<std::shared_ptr<Value>> items;
+};
+
+// Queues `run` on the scheduler and returns the handle of its result.
+std::shared_ptr<Value> spawn_task(std::function<std::shared_ptr<Value>()> run);
+
+// What a spawned call starts from.
+struct TaskStart {
+    std::shared_ptr<Value> callee;
+    ValueList args;
+    // A copy of the global bindings, so later assignments on either side
+    // stay private.
+    std::shared_ptr<SymbolTable> scope;
+    // The global table Algorithms defined under lexical scoping look names
+    // up in outside the task (see TaskGlobals).
+    SymbolTable* globals;
+};
+
+// Prepares a call of `callee` with `args`, spawned from `scope`. A task runs
+// alongside the code that spawned it, so it is never handed a container
+// either side could change: arrays, hash tables and instances among the
+// callee (a bound method's receiver), the arguments and the globals the call
+// may look up are replaced by frozen copies, one per container. Frozen
+// containers are shared as they are, so spawning from a task again copies
+// nothing. Global containers the call cannot look up are left out of its
+// scope.
+TaskStart start_task(SymbolTable& scope, std::shared_ptr<Value> callee, ValueList args);
+
+// Entered by the thread running a task: while alive, Algorithms defined
+// under lexical scoping look names up in the task's scope rather than in
+// the global table it copies (lexical_scope), and the task runs outside any
+// parallel loop iterations the thread was running.
+class TaskGlobals {
+   public:
+    explicit TaskGlobals(const TaskStart& start);
+    ~TaskGlobals();
+    TaskGlobals(const TaskGlobals&) = delete;
+    TaskGlobals& operator=(const TaskGlobals&) = delete;
+
+   private:
+    SymbolTable* saved_globals;
+    SymbolTable* saved_scope;
+    std::uint32_t saved_chunk;
+};
+
+// The table an Algorithm defined in `defining` looks names up in under
+// lexical scoping: `defining`, or the running task's copy of it.
+SymbolTable* lexical_scope(SymbolTable* defining);
+
+// Builtins: channel(capacity), send(ch, value), receive(ch) and
+// await(task) / join(task).
+std::shared_ptr<Value> make_channel(const std::shared_ptr<Value>& capacity);
+std::shared_ptr<Value> channel_send(const std::shared_ptr<Value>& channel,
+                                    const std::shared_ptr<Value>& value);
+std::shared_ptr<Value> channel_receive(const std::shared_ptr<Value>& channel);
+std::shared_ptr<Value> await_task(const std::shared_ptr<Value>& task);
+
+#endif
@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include "intern.h"
 #include "position.h"
 
 // Builtin
@@ -64,11 +65,23 @@ public:
     virtual std::string get_type();
     virtual std::string get_value() { return "";}
     virtual Position get_pos() { return pos;}
+    // Moves the token within its file, for a tree reused after an edit
+    // before it (imports.h).
+    void set_pos(const Position& _pos) { pos = _pos; }
     virtual inline bool isnumber() { return false;}
+    // Interned value; the lexer sets it for identifiers, other tokens intern
+    // on first use.
+    SymbolId get_symbol() {
+        if (symbol == NO_SYMBOL) symbol = intern_symbol(get_value());
+        return symbol;
+    }
+    void set_symbol(SymbolId id) { symbol = id; }
     friend std::ostream& operator<<(std::ostream &out, Token &token);
 protected:
+    static constexpr SymbolId NO_SYMBOL = ~SymbolId{0};
     std::string type;
     Position pos;
+    SymbolId symbol{NO_SYMBOL};
 };
 
 template<typename T>
@@ -79,6 +92,7 @@ public:
     virtual std::string get_tok();
     virtual std::string get_value();
     virtual inline bool isnumber() { return type == TOKEN_INT || type == TOKEN_FLOAT;}
+    const T& get_typed_value() const { return value; }
 protected:
     T value;
 };
@@ -5,14 +5,21 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <map>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+#include "gc.h"
+#include "intern.h"
 #include "node.h"
+#include "pool.h"
 
 const std::string VALUE_NONE{"NONE"};
 const std::string VALUE_INT{"Int"};
@@ -27,15 +34,41 @@ const std::string VALUE_INSTANCE{"Instance"};
 const std::string VALUE_RETURN{"Return"};
 const std::string VALUE_BREAK{"Break"};
 const std::string VALUE_CONTINUE{"Continue"};
+const std::string VALUE_TASK{"Task"};
+const std::string VALUE_CHANNEL{"Channel"};
+const std::string VALUE_FILE{"File"};
 
 const std::map<char, char> REVERSE_ESCAPE_CHAR{
     {'\n', 'n'}, {'\r', 'r'}, {'\b', 'b'}, {'\"', '\"'}, {'\'', '\''}, {'\\', '\\'}, {'\t', 't'}};
 
+// Small tag mirroring the type string, for dispatch without string compares.
+enum class ValueKind : std::uint8_t {
+    None,
+    Int,
+    Float,
+    String,
+    Algo,
+    Error,
+    Array,
+    HashTable,
+    Struct,
+    Instance,
+    Return,
+    Break,
+    Continue,
+    Task,
+    Channel,
+    File,
+    Count  // not a kind: the number of kinds above
+};
+
 class SymbolTable;
 class Interpreter;
 class Value : public std::enable_shared_from_this<Value> {
    public:
-    Value(const std::string& _type = VALUE_NONE) : type(_type) {}
+    Value() : type(VALUE_NONE), kind(ValueKind::None) {}
+    Value(const std::string& _type, ValueKind _kind) : type(_type), kind(_kind) {}
+    ValueKind get_kind() const { return kind; }
     virtual std::string get_num() { return type; }
     virtual std::string repr() { return type; }
     virtual std::string get_type() { return type; }
@@ -45,39 +78,145 @@ class Value : public std::enable_shared_from_this<Value> {
     virtual bool append_string(const std::string&) { return false; }
     virtual std::shared_ptr<Value> execute(const NodeList& args = {},
                                            SymbolTable* parent = nullptr) {
-        return std::make_shared<Value>();
+        return make_pooled<Value>();
     };
+    // True when calls to this value only touch their own scope, so several
+    // may run at once (see NODE_FLAG_PURE).
+    virtual bool is_pure() { return false; }
+    // True when this two-argument value combines Ints associatively (see
+    // NODE_FLAG_ASSOCIATIVE).
+    virtual bool is_associative() { return false; }
     friend std::ostream& operator<<(std::ostream& out, Value& token);
 
    protected:
     std::string type;
+    ValueKind kind;
 };
 
 using ValueList = std::vector<std::shared_ptr<Value>>;
 
+// Base of values that hold references to other values and so can form
+// cycles. Live containers are tracked by the cycle collector (gc.h).
+class ContainerValue : public Value {
+   public:
+    ContainerValue(const std::string& _type, ValueKind _kind)
+        : Value(_type, _kind), chunk(running_chunk) {
+        gc::track(this);
+    }
+    ContainerValue(const ContainerValue& other) : Value(other), chunk(running_chunk) {
+        gc::track(this);
+    }
+    ContainerValue& operator=(const ContainerValue&) = delete;
+    ~ContainerValue() { gc::untrack(this); }
+
+    // Appends every value this container references to `out`.
+    virtual void list_children(std::vector<Value*>& out) = 0;
+    // Moves every reference this container holds into `released`.
+    virtual void release_children(ValueList& released) = 0;
+
+    // Frozen containers are the read-only values tasks hand each other (see
+    // tasks.h); freezing is never undone. Every change is checked first: a
+    // frozen container refuses it with an error, others drop the frozen copy
+    // kept of them, if any.
+    bool is_frozen() const { return frozen; }
+    void freeze() { frozen = true; }
+    std::shared_ptr<Value> check_store() {
+        if (frozen) return frozen_error();
+        if (copy_current.load(std::memory_order_relaxed)) {
+            copy_current.store(false, std::memory_order_relaxed);
+        }
+        return nullptr;
+    }
+
+    // The chunk of parallel for iterations the calling thread runs (see
+    // run_parallel_loop), or 0. Every container made outside that chunk is
+    // shared with other iterations, so while it runs, changing one is an
+    // error, apart from storing array elements (check_store).
+    static thread_local std::uint32_t running_chunk;
+    std::shared_ptr<Value> check_change() {
+        if (running_chunk != 0 && running_chunk != chunk) return shared_error();
+        return check_store();
+    }
+
+    // The last frozen copy made of this container, current until it
+    // changes. Used by the copier in tasks.cpp, under its lock.
+    std::shared_ptr<Value> frozen_copy;
+    std::atomic<bool> copy_current{false};
+
+   private:
+    std::shared_ptr<Value> frozen_error();
+    std::shared_ptr<Value> shared_error();
+
+    friend class gc::Heap;
+    friend void gc::untrack(ContainerValue*);
+    gc::Heap* gc_heap{nullptr};
+    ContainerValue* gc_prev{nullptr};
+    ContainerValue* gc_next{nullptr};
+    std::ptrdiff_t gc_refs{0};
+    bool gc_reachable{false};
+    bool frozen{false};
+    std::uint32_t chunk;  // running_chunk when made
+};
+
+// Most arguments a builtin method takes. Method calls evaluate them into an
+// array of this size; builtin_method (pseudo.cpp) checks each table entry.
+constexpr std::size_t MAX_METHOD_ARITY = 2;
+
+// Builtin method of an array, string or hash table. `call` receives exactly
+// `arity` evaluated arguments.
+struct BuiltinMethod {
+    std::size_t arity;
+    const char* arity_error;  // followed by the method name
+    std::shared_ptr<Value> (*call)(const std::shared_ptr<Value>& obj, const std::string& name,
+                                   const std::shared_ptr<Value>* args);
+};
+
+// The method table entry for `id` on receivers of `kind`, or nullptr.
+const BuiltinMethod* find_builtin_method(ValueKind kind, MethodId id);
+
+// An Int, Float or String, by T.
 template <typename T>
 class TypedValue : public Value {
+    static_assert(std::is_same_v<T, int64_t> || std::is_same_v<T, double> ||
+                      std::is_same_v<T, std::string>,
+                  "TypedValue holds an Int, a Float or a String");
+
    public:
-    TypedValue(const std::string& _type, const T& _value) : Value(_type), value(_value) {}
+    TypedValue(const std::string& _type, const T& _value)
+        : TypedValue(_type,
+                     std::is_same_v<T, int64_t>  ? ValueKind::Int
+                     : std::is_same_v<T, double> ? ValueKind::Float
+                                                 : ValueKind::String,
+                     _value) {}
     std::string get_num() override;
     std::string repr() override;
     int64_t as_int() override;
     double as_double() override;
     std::string as_string() override;
     bool append_string(const std::string&) override;
+    const T& raw() const { return value; }
 
    protected:
+    TypedValue(const std::string& _type, ValueKind _kind, const T& _value)
+        : Value(_type, _kind), value(_value) {}
+
     T value;
 };
 
-using ErrorValue = TypedValue<std::string>;
+// A String of kind Error, holding the message.
+class ErrorValue : public TypedValue<std::string> {
+   public:
+    ErrorValue(const std::string& _type, const std::string& _message)
+        : TypedValue(_type, ValueKind::Error, _message) {}
+};
 
 class BaseAlgoValue : public Value {
    public:
     BaseAlgoValue(const std::string& _algo_name, std::shared_ptr<Node> _value)
-        : Value(VALUE_ALGO), value(_value), algo_name(_algo_name) {
+        : Value(VALUE_ALGO, ValueKind::Algo), value(_value), algo_name(_algo_name) {
         for (const auto& tok : value->get_toks()) {
             arg_names.push_back(tok->get_value());
+            arg_symbols.push_back(tok->get_symbol());
         }
     }
     std::string get_num() override { return algo_name; }
@@ -88,6 +227,7 @@ class BaseAlgoValue : public Value {
     std::string algo_name;
     std::shared_ptr<Node> value;
     std::vector<std::string> arg_names;
+    std::vector<SymbolId> arg_symbols;
 };
 
 class AlgoValue : public BaseAlgoValue {
@@ -98,12 +238,19 @@ class AlgoValue : public BaseAlgoValue {
     std::string repr() override { return get_num(); }
     std::shared_ptr<Value> execute(const NodeList& args = {},
                                    SymbolTable* parent = nullptr) override;
+    bool is_pure() override { return value->has_flag(NODE_FLAG_PURE); }
+    bool is_associative() override { return value->has_flag(NODE_FLAG_ASSOCIATIVE); }
     friend class BoundMethodValue;
     // Expose value for friends/derived or public use if needed for method binding
     std::shared_ptr<Node> get_node_ptr() { return value; }
     const std::vector<std::string>& get_arg_names() const { return arg_names; }
+    const std::vector<SymbolId>& get_arg_symbols() const { return arg_symbols; }
+    // Defining scope under lexical scoping; nullptr runs in the caller's scope.
+    void set_lexical_parent(SymbolTable* scope) { lexical_parent = scope; }
+    SymbolTable* get_lexical_parent() const { return lexical_parent; }
 
    protected:
+    SymbolTable* lexical_parent{nullptr};
 };
 
 class BuiltinAlgoValue : public BaseAlgoValue {
@@ -116,10 +263,14 @@ class BuiltinAlgoValue : public BaseAlgoValue {
     std::shared_ptr<Value> execute_print(const std::string&);
     std::shared_ptr<Value> execute_read();
     std::shared_ptr<Value> execute_read_line();
+    // read_ints(n), or read_int() with no count.
+    std::shared_ptr<Value> execute_read_ints(const std::shared_ptr<Value>& count);
+    std::shared_ptr<Value> execute_read_all_lines();
     std::shared_ptr<Value> execute_clear();
     std::shared_ptr<Value> execute_int(const std::string&);
     std::shared_ptr<Value> execute_float(const std::string&);
     std::shared_ptr<Value> execute_string(const std::string&);
+    bool is_pure() override;
     std::string repr() override { return get_num(); }
 
    protected:
@@ -128,29 +279,44 @@ class BuiltinAlgoValue : public BaseAlgoValue {
 class BoundMethodValue : public Value {
    public:
     BoundMethodValue(std::shared_ptr<Value> _obj, std::string _method_name)
-        : Value(VALUE_ALGO), obj(_obj), method_name(_method_name) {}
+        : BoundMethodValue(std::move(_obj), intern_symbol(_method_name)) {}
+    BoundMethodValue(std::shared_ptr<Value> _obj, SymbolId _method_symbol)
+        : Value(VALUE_ALGO, ValueKind::Algo),
+          obj(_obj),
+          method_name(symbol_name(_method_symbol)),
+          method_symbol(_method_symbol),
+          method_id(method_id_from_name(method_name)) {}
     std::shared_ptr<Value> execute(const NodeList& args = {},
                                    SymbolTable* parent = nullptr) override;
     std::string get_num() override { return method_name; }
     std::string repr() override { return "<Bound Method " + method_name + ">"; }
+    const std::shared_ptr<Value>& get_obj() const { return obj; }
+    SymbolId get_method_symbol() const { return method_symbol; }
 
    protected:
     std::shared_ptr<Value> obj;
     std::string method_name;
+    SymbolId method_symbol;
+    MethodId method_id;
 };
 
-class ArrayValue : public Value {
+class ArrayValue : public ContainerValue {
    public:
-    ArrayValue(ValueList _value) : Value(VALUE_ARRAY), value(_value) {}
+    ArrayValue(ValueList _value) : ContainerValue(VALUE_ARRAY, ValueKind::Array), value(_value) {}
     std::string get_num() override;
+    void list_children(std::vector<Value*>& out) override;
+    void release_children(ValueList& released) override;
+    // An index out of range refers to an error value, in a slot of the
+    // calling thread's since tasks may read one array at once.
     std::shared_ptr<Value>& operator[](int p);
     void push_back(std::shared_ptr<Value>);
     std::shared_ptr<Value> insert(int p, std::shared_ptr<Value>);
     std::shared_ptr<Value> remove(int p);
     std::shared_ptr<Value> pop_back();
     bool empty() const { return value.empty(); }
-    std::shared_ptr<Value>& size() {
-        return sz = std::make_shared<TypedValue<int64_t>>(VALUE_INT, value.size());
+    const ValueList& elements() const { return value; }
+    std::shared_ptr<Value> size() const {
+        return make_pooled<TypedValue<int64_t>>(VALUE_INT, value.size());
     };
     std::shared_ptr<Value>& back() { return value.back(); };
     std::string repr() override { return get_num(); }
@@ -165,21 +331,21 @@ class ArrayValue : public Value {
             size_t old_size = value.size();
             value.resize(new_size);
             for (size_t i = old_size; i < static_cast<size_t>(new_size); ++i) {
-                value[i] = std::make_shared<Value>();  // Fill with default Value
+                value[i] = make_pooled<Value>();  // Fill with default Value
             }
         }
     }
 
-    std::shared_ptr<Value> sz, error;
-
    protected:
     ValueList value;
 };
 
-class HashTableValue : public Value {
+class HashTableValue : public ContainerValue {
    public:
-    HashTableValue() : Value(VALUE_HASH_TABLE) {}
+    HashTableValue() : ContainerValue(VALUE_HASH_TABLE, ValueKind::HashTable) {}
     std::string get_num() override;
+    void list_children(std::vector<Value*>& out) override;
+    void release_children(ValueList& released) override;
     std::string repr() override { return get_num(); }
     std::shared_ptr<Value> get(std::shared_ptr<Value> key);
     std::shared_ptr<Value> set(std::shared_ptr<Value> key, std::shared_ptr<Value> value);
@@ -202,61 +368,75 @@ class HashTableValue : public Value {
     std::unordered_map<std::string, size_t> index;
 };
 
-std::shared_ptr<Value> operator+(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator-(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator*(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator/(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator%(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> pow(std::shared_ptr<Value>, std::shared_ptr<Value>);
+std::shared_ptr<Value> operator+(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator-(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator*(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator/(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator%(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> pow(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
 
-std::shared_ptr<Value> operator==(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator!=(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator<(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator>(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator<=(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator>=(std::shared_ptr<Value>, std::shared_ptr<Value>);
+std::shared_ptr<Value> operator==(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator!=(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator<(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator>(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator<=(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator>=(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
 
-std::shared_ptr<Value> operator&&(std::shared_ptr<Value>, std::shared_ptr<Value>);
-std::shared_ptr<Value> operator||(std::shared_ptr<Value>, std::shared_ptr<Value>);
+std::shared_ptr<Value> operator&&(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator||(const std::shared_ptr<Value>&, const std::shared_ptr<Value>&);
 
-std::shared_ptr<Value> operator-(std::shared_ptr<Value>);
-std::shared_ptr<Value> operator!(std::shared_ptr<Value>);
+std::shared_ptr<Value> operator-(const std::shared_ptr<Value>&);
+std::shared_ptr<Value> operator!(const std::shared_ptr<Value>&);
 
 class StructValue : public Value {
    public:
-    StructValue(const std::string& _name, const std::vector<std::string>& _members,
-                const std::map<std::string, std::shared_ptr<Value>>& _methods)
-        : Value(VALUE_STRUCT), name(_name), members(_members), methods(_methods) {}
+    using MethodMap = std::unordered_map<SymbolId, std::shared_ptr<Value>>;
+
+    StructValue(const std::string& _name, const std::vector<SymbolId>& _members,
+                const MethodMap& _methods)
+        : Value(VALUE_STRUCT, ValueKind::Struct),
+          name(_name),
+          members(_members),
+          methods(_methods) {}
 
     std::string get_num() override { return name; }
     std::string repr() override { return "<Struct " + name + ">"; }
 
-    std::vector<std::string> members;
-    std::map<std::string, std::shared_ptr<Value>> methods;
+    std::vector<SymbolId> members;
+    MethodMap methods;
     std::string name;
     std::shared_ptr<Value> execute(const NodeList& args = {},
                                    SymbolTable* parent = nullptr) override;
 };
 
-class InstanceValue : public Value {
+class InstanceValue : public ContainerValue {
    public:
     InstanceValue(std::shared_ptr<StructValue> _struct_def)
-        : Value(VALUE_INSTANCE), struct_def(_struct_def) {}
+        : ContainerValue(VALUE_INSTANCE, ValueKind::Instance), struct_def(_struct_def) {}
+    void list_children(std::vector<Value*>& out) override;
+    void release_children(ValueList& released) override;
 
     std::string get_num() override { return struct_def->name + " Instance"; }
     std::string repr() override { return "<Instance of " + struct_def->name + ">"; }
 
+    std::shared_ptr<Value> get_member(SymbolId id, std::shared_ptr<Value> self = nullptr);
     std::shared_ptr<Value> get_member(const std::string& name,
-                                      std::shared_ptr<Value> self = nullptr);
-    void set_member(const std::string& name, std::shared_ptr<Value> val);
+                                      std::shared_ptr<Value> self = nullptr) {
+        return get_member(intern_symbol(name), std::move(self));
+    }
+    void set_member(SymbolId id, std::shared_ptr<Value> val) { members[id] = std::move(val); }
+    // Runs struct method `id` with `self` bound; nullptr if there is none.
+    std::shared_ptr<Value> call_method(SymbolId id, std::shared_ptr<Value> self,
+                                       const NodeList& args, SymbolTable* parent);
 
     std::shared_ptr<StructValue> struct_def;
-    std::map<std::string, std::shared_ptr<Value>> members;
+    std::unordered_map<SymbolId, std::shared_ptr<Value>> members;
 };
 
 class ReturnValue : public Value {
    public:
-    ReturnValue(std::shared_ptr<Value> _value) : Value(VALUE_RETURN), value(_value) {}
+    ReturnValue(std::shared_ptr<Value> _value)
+        : Value(VALUE_RETURN, ValueKind::Return), value(_value) {}
     std::string get_num() override { return value->get_num(); }
     std::string repr() override { return value->repr(); }
     std::shared_ptr<Value> get_value() { return value; }
@@ -267,7 +447,7 @@ class ReturnValue : public Value {
 
 class ControlValue : public Value {
    public:
-    ControlValue(const std::string& _type) : Value(_type) {}
+    ControlValue(const std::string& _type, ValueKind _kind) : Value(_type, _kind) {}
 };
 
 // Wraps an already-evaluated value as an AST node so compiled code can reuse
@@ -0,0 +1,95 @@
+/// --------------------
+/// Runtime value handles
+/// --------------------
+
+#ifndef VALUEREF_H
+#define VALUEREF_H
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#include "value.h"
+
+// Handle for the compiled runtime's frame arenas (runtime.cpp). On the thread
+// that runs the compiled program, handles to one value share a pin: a count
+// in a side table of that thread, kept next to the single shared_ptr
+// reference it holds while any handle lives. Copies only bump the count
+// without atomics, so pinned values still mix with shared_ptr owners, and
+// values outside the runtime carry no pin state. Pins are not thread-safe,
+// so handles made on any other thread, such as the scheduler's workers
+// running parallel loop chunks and tasks, hold a shared_ptr instead. Copies
+// keep the kind of the handle they copy.
+class ValueRef {
+   public:
+    // Makes the calling thread the one whose handles pin.
+    static void pin_on_this_thread() { pinning = true; }
+
+    ValueRef() = default;
+    explicit ValueRef(Value* _value) : value(_value) {
+        if (value == nullptr) return;
+        if (!pinning) {
+            owner = value->shared_from_this();
+        } else if (take_pin()) {
+            pin->anchor = value->shared_from_this();
+        }
+    }
+    explicit ValueRef(std::shared_ptr<Value> _owner) : value(_owner.get()) {
+        if (value == nullptr) return;
+        if (!pinning) {
+            owner = std::move(_owner);
+        } else if (take_pin()) {
+            pin->anchor = std::move(_owner);
+        }
+    }
+    ValueRef(const ValueRef& other) : value(other.value), pin(other.pin), owner(other.owner) {
+        if (pin != nullptr) ++pin->count;
+    }
+    ValueRef(ValueRef&& other) noexcept
+        : value(other.value), pin(other.pin), owner(std::move(other.owner)) {
+        other.value = nullptr;
+        other.pin = nullptr;
+    }
+    ValueRef& operator=(ValueRef other) noexcept {
+        std::swap(value, other.value);
+        std::swap(pin, other.pin);
+        owner.swap(other.owner);
+        return *this;
+    }
+    ~ValueRef() {
+        if (pin == nullptr || --pin->count > 0) return;
+        // Dropped after the entry, as it may free values other handles pin.
+        std::shared_ptr<Value> anchor = std::move(pin->anchor);
+        pins.erase(value);
+    }
+
+    Value* get() const { return value; }
+    Value* operator->() const { return value; }
+    explicit operator bool() const { return value != nullptr; }
+    // Owning pointer, borrowed for as long as this handle lives.
+    const std::shared_ptr<Value>& shared() const {
+        return pin != nullptr ? pin->anchor : owner;
+    }
+
+   private:
+    struct Pin {
+        std::uint32_t count{0};        // live handles
+        std::shared_ptr<Value> anchor;  // the reference they share
+    };
+
+    // Counts this handle in its value's pin; true when it is the first.
+    bool take_pin() {
+        pin = &pins[value];
+        return pin->count++ == 0;
+    }
+
+    static inline thread_local bool pinning = false;
+    // Entries keep their address while others come and go.
+    static inline thread_local std::unordered_map<Value*, Pin> pins;
+    Value* value{nullptr};
+    Pin* pin{nullptr};             // set on the pinning thread
+    std::shared_ptr<Value> owner;  // set instead of a pin off the pinning thread
+};
+
+#endif
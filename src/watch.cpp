@@ -0,0 +1,119 @@
+/// --------------------
+/// Watch mode
+/// --------------------
+
+#include "watch.h"
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include "imports.h"
+#include "io.h"
+#include "pseudo.h"
+#include "scheduler.h"
+
+namespace {
+
+// How long a save may keep writing after its first event before the files
+// are read again.
+constexpr int SETTLE_MS = 50;
+
+// The text of `path` as `pseudo program.ps` reads it, or "" when it cannot
+// be read.
+std::string read_source(const std::string& path) {
+    std::ifstream input(path);
+    std::string code, line;
+    while (std::getline(input, line)) {
+        code += line + "\n";
+    }
+    return code;
+}
+
+// Blocks until a file of `texts` holds other text than it maps to. Returns
+// false with a message on stderr when the files cannot be watched.
+bool wait_for_change(const std::map<std::string, std::string>& texts) {
+    namespace fs = std::filesystem;
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Watch ERROR: cannot start inotify\n";
+        return false;
+    }
+    std::map<int, std::set<std::string>> names;  // of the files, by watched directory
+    for (const auto& entry : texts) {
+        fs::path path = fs::absolute(entry.first).lexically_normal();
+        int wd = inotify_add_watch(fd, path.parent_path().c_str(),
+                                   IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+        if (wd < 0) {
+            std::cerr << "Watch ERROR: cannot watch " << path.parent_path().string() << "\n";
+            close(fd);
+            return false;
+        }
+        names[wd].insert(path.filename().string());
+    }
+
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        if (size <= 0) {
+            if (size < 0 && errno == EINTR) continue;
+            std::cerr << "Watch ERROR: lost the inotify watch\n";
+            close(fd);
+            return false;
+        }
+        bool watched = false;
+        for (char* at = buffer; at < buffer + size;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(at);
+            if (event->len > 0 && names[event->wd].count(event->name)) watched = true;
+            at += sizeof(inotify_event) + event->len;
+        }
+        if (!watched) continue;
+
+        pollfd more{fd, POLLIN, 0};
+        while (poll(&more, 1, SETTLE_MS) > 0 && read(fd, buffer, sizeof(buffer)) > 0) {
+        }
+        for (const auto& [path, text] : texts) {
+            if (read_source(path) != text) {
+                close(fd);
+                return true;
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int watch(const std::string& file_name, bool lexical) {
+    ParseMemo memo;
+    for (;;) {
+        std::string code = read_source(file_name);
+        memo.reparsed = memo.kept = memo.invalidated = 0;
+        auto start = std::chrono::steady_clock::now();
+        {
+            SymbolTable global_symbol_table;
+            global_symbol_table.set_lexical_scoping(lexical);
+            run(file_name, code, global_symbol_table, &memo);
+            sched::wait_for_tasks();
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        io::flush();
+        std::cout.flush();
+        std::cerr << "[watch] parsed " << memo.reparsed << ", kept " << memo.kept
+                  << ", invalidated " << memo.invalidated << " pieces; ran in "
+                  << static_cast<long long>(elapsed.count()) << " ms. Waiting for changes.\n";
+
+        // The files of the last parse, and the program even when it did not
+        // parse.
+        std::map<std::string, std::string> texts{{file_name, code}};
+        for (const auto& entry : memo.files) {
+            if (!texts.count(entry.first)) texts[entry.first] = read_source(entry.first);
+        }
+        if (!wait_for_change(texts)) return 1;
+    }
+}
@@ -0,0 +1,27 @@
+/// --------------------
+/// Watch mode
+/// --------------------
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <string>
+
+// `pseudo --watch program.ps` runs the program, then runs it again each time
+// it or a module it imports changes on disk, until interrupted. Every run
+// starts from fresh globals, like `pseudo program.ps`, but stays in one
+// process: files are parsed again through a ParseMemo (imports.h), so only
+// the top-level definitions whose text changed are lexed and parsed, and
+// the others keep their compiled expressions and memoized results. After
+// each run a line on stderr says how many pieces were parsed, kept and
+// invalidated, and how long the run took.
+//
+// Changes are noticed with inotify on the directories holding the files, so
+// editors that save by replacing a file are seen too. Saves that leave the
+// text as it was do not start a run.
+
+// Returns only when the files cannot be watched, with 1 and a message on
+// stderr.
+int watch(const std::string& file_name, bool lexical);
+
+#endif
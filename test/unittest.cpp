@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstdlib>
 #include <gtest/gtest.h>
 #include <token.h>
 #include <lexer.h>
@@ -7,8 +8,35 @@
 #include <parser.h>
 #include <interpreter.h>
 #include <pseudo.h>
+#include <analysis.h>
+#include <batch.h>
+#include <binop.h>
+#include <engine.h>
+#include <error.h>
+#include <files.h>
+#include <gc.h>
+#include <imports.h>
+#include <intern.h>
+#include <io.h>
+#include <pool.h>
+#include <profile.h>
+#include <server.h>
+#include <snapshot.h>
+#include <valueref.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <map>
 #include <memory>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
 
 // Token Tests
 TEST(TokenTest, EmptyTokenInTypeNone) {
@@ -526,7 +554,1210 @@ TEST(ImportTest, TestOptimizedBTree) {
     EXPECT_EQ(st.get("tree_height")->get_num(), "4");
 }
 
+TEST(InterpreterTest, TestLoopResultUsage) {
+    Lexer lexer("test",
+                "Algorithm sum(n):\n"
+                "    s <- 0\n"
+                "    for i <- 1 to n do\n"
+                "        s <- s + i\n"
+                "    return s\n"
+                "Algorithm doubles(n):\n"
+                "    for i <- 1 to n do\n"
+                "        i * 2\n"
+                "total <- sum(100)\n"
+                "values <- doubles(3)\n");
+    NodeList ast = Parser(lexer.make_tokens()).parse();
+    ASSERT_EQ(ast.size(), 4);
+
+    AlgorithmDefNode* sum_node = dynamic_cast<AlgorithmDefNode*>(ast[0].get());
+    AlgorithmDefNode* doubles_node = dynamic_cast<AlgorithmDefNode*>(ast[1].get());
+    ASSERT_NE(sum_node, nullptr);
+    ASSERT_NE(doubles_node, nullptr);
+    EXPECT_FALSE(sum_node->get_body()[1]->has_flag(NODE_FLAG_RESULT_USED));
+    EXPECT_TRUE(doubles_node->get_body()[0]->has_flag(NODE_FLAG_RESULT_USED));
+
+    SymbolTable st;
+    Interpreter interpreter(st, false);
+    for (auto node : ast) interpreter.visit(node);
+    EXPECT_EQ(st.get("total")->get_num(), "5050");
+    EXPECT_EQ(st.get("values")->get_num(), "{2, 4, 6}");
+}
+
+TEST(ParserTest, TestNodeAnnotations) {
+    Lexer lexer("test",
+                "Algorithm fib(n):\n"
+                "    if n <= 1 then\n"
+                "        return n\n"
+                "    return fib(n - 1) + fib(n - 2)\n"
+                "Algorithm fill(arr, n):\n"
+                "    for i <- 1 to n do\n"
+                "        arr[i] <- i\n"
+                "    return arr\n"
+                "Algorithm square(x):\n"
+                "    return x * x\n"
+                "arr.push(x <- 1)\n"
+                "2 * (3 + 4)\n");
+    NodeList ast = Parser(lexer.make_tokens()).parse();
+    ASSERT_EQ(ast.size(), 5);
+
+    EXPECT_TRUE(ast[0]->has_flag(NODE_FLAG_SELF_RECURSIVE));
+    EXPECT_TRUE(ast[0]->has_flag(NODE_FLAG_MEMOIZABLE));
+    EXPECT_TRUE(ast[0]->has_flag(NODE_FLAG_PURE));
+    EXPECT_FALSE(ast[0]->has_flag(NODE_FLAG_SINGLE_RETURN));
+
+    EXPECT_FALSE(ast[1]->has_flag(NODE_FLAG_PURE));
+    EXPECT_FALSE(ast[1]->has_flag(NODE_FLAG_SELF_RECURSIVE));
+
+    EXPECT_TRUE(ast[2]->has_flag(NODE_FLAG_SINGLE_RETURN));
+    EXPECT_TRUE(ast[2]->has_flag(NODE_FLAG_PURE));
+
+    AlgorithmCallNode* call_node = dynamic_cast<AlgorithmCallNode*>(ast[3].get());
+    ASSERT_NE(call_node, nullptr);
+    EXPECT_TRUE(call_node->get_args()[0]->has_flag(NODE_FLAG_HAS_ASSIGNMENT));
+    EXPECT_FALSE(ast[3]->has_flag(NODE_FLAG_PURE));
+
+    EXPECT_TRUE(ast[4]->has_flag(NODE_FLAG_CONSTANT));
+    EXPECT_TRUE(ast[4]->has_flag(NODE_FLAG_JIT_ROOT));
+
+    // Nodes are numbered per tree from 0, callees included, so side tables
+    // stay as small as the trees they serve.
+    EXPECT_NE(ast[0]->get_tree(), 0u);
+    EXPECT_EQ(ast[0]->get_ordinal(), 0u);
+    EXPECT_EQ(call_node->get_call()->get_tree(), ast[0]->get_tree());
+    Lexer other("test", "receive(ch).push(6)\n");
+    NodeList other_ast = Parser(other.make_tokens()).parse();
+    ASSERT_EQ(other_ast.size(), 1);
+    EXPECT_NE(other_ast[0]->get_tree(), ast[0]->get_tree());
+    EXPECT_EQ(other_ast[0]->get_ordinal(), 0u);
+    auto* member = static_cast<MemberAccessNode*>(
+        static_cast<AlgorithmCallNode*>(other_ast[0].get())->get_call().get());
+    EXPECT_EQ(member->get_obj()->get_tree(), other_ast[0]->get_tree());
+    EXPECT_EQ(static_cast<AlgorithmCallNode*>(member->get_obj().get())->get_call()->get_tree(),
+              other_ast[0]->get_tree());
+}
+
+TEST(InterpreterTest, TestMethodInlineCache) {
+    Lexer lexer("test",
+                "arr <- {}\n"
+                "for i <- 1 to 3 do\n"
+                "    arr.push_back(i * 2)\n"
+                "arr.size()\n");
+    NodeList ast = Parser(lexer.make_tokens()).parse();
+    ASSERT_EQ(ast.size(), 3);
+
+    SymbolTable st;
+    Interpreter interpreter(st);
+    std::shared_ptr<Value> result;
+    for (auto node : ast) result = interpreter.visit(node);
+    EXPECT_EQ(result->get_num(), "3");
+    EXPECT_EQ(st.get("arr")->get_num(), "{2, 4, 6}");
+
+    AlgorithmCallNode* push_call = dynamic_cast<AlgorithmCallNode*>(ast[1]->get_child()[3].get());
+    ASSERT_NE(push_call, nullptr);
+    MemberAccessNode* member = dynamic_cast<MemberAccessNode*>(push_call->get_call().get());
+    ASSERT_NE(member, nullptr);
+    EXPECT_EQ(member->get_method_id(), METHOD_PUSH);
+    EXPECT_EQ(push_call->get_method_cache().method,
+              find_builtin_method(ValueKind::Array, METHOD_PUSH));
+    EXPECT_EQ(find_builtin_method(ValueKind::String, METHOD_PUSH), nullptr);
+}
+
+TEST(InterpreterTest, TestLexicalScoping) {
+    Lexer lexer("test",
+                "Algorithm helper(n):\n"
+                "    return n + offset\n"
+                "Algorithm caller():\n"
+                "    offset <- 100\n"
+                "    return helper(1)\n"
+                "offset <- 1\n"
+                "caller()\n");
+    NodeList ast = Parser(lexer.make_tokens()).parse();
+    ASSERT_EQ(ast.size(), 4);
+
+    AlgorithmDefNode* helper = dynamic_cast<AlgorithmDefNode*>(ast[0].get());
+    ASSERT_NE(helper, nullptr);
+    NodeList sum = helper->get_body()[0]->get_child()[0]->get_child();
+    EXPECT_EQ(dynamic_cast<VarAccessNode*>(sum[0].get())->get_scope(), VarScope::Local);
+    EXPECT_EQ(dynamic_cast<VarAccessNode*>(sum[1].get())->get_scope(), VarScope::Global);
+
+    std::vector<std::string> warnings = check_lexical_scoping(ast);
+    ASSERT_EQ(warnings.size(), 1);
+    EXPECT_NE(warnings[0].find("\"caller\" shadows"), std::string::npos);
+
+    SymbolTable dynamic_st;
+    Interpreter dynamic_interpreter(dynamic_st);
+    std::shared_ptr<Value> result;
+    for (auto node : ast) result = dynamic_interpreter.visit(node);
+    EXPECT_EQ(result->get_num(), "101");
+
+    SymbolTable lexical_st;
+    lexical_st.set_lexical_scoping(true);
+    Interpreter lexical_interpreter(lexical_st);
+    for (auto node : ast) result = lexical_interpreter.visit(node);
+    EXPECT_EQ(result->get_num(), "2");
+}
+
+TEST(ValueTest, TestValueRefPins) {
+    // Handles made on other threads own shared_ptrs and leave the pins alone.
+    std::shared_ptr<Value> shared = std::make_shared<TypedValue<int64_t>>(VALUE_INT, 3);
+    std::thread([&shared] {
+        ValueRef worker_ref(shared.get());
+        std::vector<ValueRef> copies(4, worker_ref);
+        EXPECT_EQ(shared.use_count(), 6);
+        EXPECT_EQ(copies.back().shared().get(), shared.get());
+    }).join();
+    EXPECT_EQ(shared.use_count(), 1);
+
+    ValueRef::pin_on_this_thread();
+    std::shared_ptr<Value> owner = std::make_shared<TypedValue<int64_t>>(VALUE_INT, 7);
+    Value* raw = owner.get();
+    ValueRef first(raw);
+    EXPECT_EQ(owner.use_count(), 2);
+    {
+        std::vector<ValueRef> copies(8, first);
+        EXPECT_EQ(owner.use_count(), 2);
+        EXPECT_EQ(copies.back().shared().get(), raw);
+    }
+    EXPECT_EQ(owner.use_count(), 2);
+
+    std::weak_ptr<Value> watch = owner;
+    owner.reset();
+    ASSERT_FALSE(watch.expired());
+    EXPECT_EQ(first->get_num(), "7");
+    first = ValueRef();
+    EXPECT_TRUE(watch.expired());
+}
+
+TEST(PoolTest, TestPooledValuesReuseBlocks) {
+    auto live_blocks = []() {
+        std::map<std::size_t, std::size_t> live;
+        for (const pool::ClassStats& cls : pool::stats()) live[cls.block_size] = cls.live;
+        return live;
+    };
+    std::map<std::size_t, std::size_t> before = live_blocks();
+    std::shared_ptr<Value> first = make_pooled<TypedValue<int64_t>>(VALUE_INT, 1);
+    Value* first_block = first.get();
+    std::map<std::size_t, std::size_t> after = live_blocks();
+    std::size_t block_size = 0;
+    for (const auto& [size, live] : after) {
+        if (live == before[size] + 1) block_size = size;
+    }
+    ASSERT_GE(block_size, sizeof(TypedValue<int64_t>));
+
+    first.reset();
+    EXPECT_EQ(live_blocks()[block_size], before[block_size]);
+    std::shared_ptr<Value> second = make_pooled<TypedValue<int64_t>>(VALUE_INT, 2);
+    EXPECT_EQ(second.get(), first_block);
+    EXPECT_EQ(second->get_num(), "2");
+}
+
+TEST(PoolTest, TestBlocksFreedElsewhereReturn) {
+    // One thread allocates what another frees, as over a channel: the freed
+    // blocks must come back instead of new slabs being carved each round.
+    constexpr std::size_t BLOCK = 7 * pool::GRANULE;
+    auto slabs = []() {
+        for (const pool::ClassStats& cls : pool::stats()) {
+            if (cls.block_size == BLOCK) return cls.slabs;
+        }
+        return std::size_t{0};
+    };
+    constexpr int ROUNDS = 20;
+    std::vector<void*> blocks(20000);
+    std::atomic<int> allocated{0}, freed{0};
+    std::thread allocator([&]() {
+        for (int round = 1; round <= ROUNDS; ++round) {
+            for (void*& block : blocks) block = pool::allocate(BLOCK);
+            allocated = round;
+            while (freed.load() < round) std::this_thread::yield();
+        }
+    });
+    std::size_t first = 0;
+    for (int round = 1; round <= ROUNDS; ++round) {
+        while (allocated.load() < round) std::this_thread::yield();
+        if (round == 1) first = slabs();
+        for (void* block : blocks) pool::deallocate(block, BLOCK);
+        freed = round;
+    }
+    allocator.join();
+    EXPECT_LE(slabs(), first + 2);
+}
+
+TEST(GcTest, TestCollectsContainerCycles) {
+    std::weak_ptr<Value> array_watch, table_watch;
+    {
+        SymbolTable st;
+        Interpreter interpreter(st);
+        Lexer lexer("test",
+                    "arr <- {1, 2}\n"
+                    "arr.push(arr)\n"
+                    "table <- HashTable()\n"
+                    "table.set(\"self\", table)\n"
+                    "keep <- {arr}\n");
+        for (auto node : Parser(lexer.make_tokens()).parse()) interpreter.visit(node);
+        array_watch = st.get("arr");
+        table_watch = st.get("table");
+        gc::collect();
+        EXPECT_FALSE(array_watch.expired());
+        st.erase("keep");
+    }
+    ASSERT_FALSE(array_watch.expired());
+    ASSERT_FALSE(table_watch.expired());
+
+    gc::Stats before = gc::stats();
+    EXPECT_GE(gc::collect(), 2);
+    EXPECT_TRUE(array_watch.expired());
+    EXPECT_TRUE(table_watch.expired());
+    EXPECT_EQ(gc::stats().collections, before.collections + 1);
+}
+
+TEST(LexerTest, TestPositionsFromLineTable) {
+    EXPECT_EQ(sizeof(Position), 8);
+    Lexer lexer("positions.ps", "a <- 1\n\nif a = 1 then\n    b <- a\n");
+    TokenList tokens = lexer.make_tokens();
+    ASSERT_GE(tokens.size(), 4);
+    Position b_pos = tokens[0]->get_pos();
+    for (const auto& tok : tokens) {
+        if (tok->get_value() == "b") b_pos = tok->get_pos();
+    }
+    EXPECT_EQ(b_pos.line(), 3);
+    EXPECT_EQ(b_pos.column(), 4);
+    EXPECT_EQ(b_pos.file_name(), "positions.ps");
+
+    std::string text = "a <- 1\n\nb <- @\n";
+    Lexer bad_lexer("positions.ps", text);
+    Position error_pos = bad_lexer.make_tokens().back()->get_pos();
+    EXPECT_EQ(error_pos.line(), 2);
+    EXPECT_EQ(error_pos.column(), 5);
+    EXPECT_EQ(error_marker(text, error_pos, error_pos), "3:    b <- @\n      -----^-\n");
+
+    // The file lexed again under the same name keeps the earlier positions
+    // on the earlier text, and the same text maps to the same file.
+    EXPECT_NE(error_pos.file_id, b_pos.file_id);
+    EXPECT_EQ(b_pos.line(), 3);
+    EXPECT_EQ(b_pos.column(), 4);
+    EXPECT_EQ(Lexer("positions.ps", text).make_tokens().back()->get_pos().file_id, error_pos.file_id);
+}
+
+TEST(LexerTest, TestFilesFreedWithTheirPositions) {
+    std::uint32_t first;
+    {
+        TokenList tokens = Lexer("versions.ps", "a <- 0\n").make_tokens();
+        first = tokens[0]->get_pos().file_id;
+    }
+    // Once no position is in a version of the file, its entry is freed and
+    // its id goes to the next version rather than the registry growing.
+    for (int i = 1; i <= 100; ++i) {
+        TokenList tokens = Lexer("versions.ps", "a <- " + std::to_string(i) + "\n").make_tokens();
+        EXPECT_EQ(tokens[0]->get_pos().file_id, first);
+        EXPECT_EQ(tokens[0]->get_pos().file_name(), "versions.ps");
+    }
+}
+
+TEST(LexerTest, TestIdentifiersInternedOnce) {
+    Lexer lexer("intern.ps", "count <- 1\ncount <- count + 1\n");
+    TokenList tokens = lexer.make_tokens();
+    std::vector<SymbolId> ids;
+    for (const auto& tok : tokens) {
+        if (tok->get_type() == TOKEN_IDENTIFIER) ids.push_back(tok->get_symbol());
+    }
+    ASSERT_EQ(ids.size(), 3);
+    EXPECT_EQ(ids[0], ids[1]);
+    EXPECT_EQ(ids[1], ids[2]);
+    EXPECT_EQ(symbol_name(ids[0]), "count");
+    EXPECT_NE(intern_symbol("counter"), ids[0]);
+
+    SymbolTable global;
+    SymbolTable local(&global);
+    global.set(ids[0], make_pooled<TypedValue<int64_t>>(VALUE_INT, 2));
+    EXPECT_EQ(local.get("count")->get_num(), "2");
+    EXPECT_FALSE(local.contains_local(ids[0]));
+    EXPECT_EQ(local.get(intern_symbol("print")).get(), builtin_algo(intern_symbol("print")).get());
+    EXPECT_EQ(local.get(intern_symbol("missing"))->get_type(), VALUE_ERROR);
+}
+
+TEST(ValueTest, TestBinaryKernelTable) {
+    std::shared_ptr<Value> two = make_pooled<TypedValue<int64_t>>(VALUE_INT, 2);
+    std::shared_ptr<Value> half = make_pooled<TypedValue<double>>(VALUE_FLOAT, 0.5);
+    std::shared_ptr<Value> zero = make_pooled<TypedValue<int64_t>>(VALUE_INT, 0);
+    std::shared_ptr<Value> ab = make_pooled<TypedValue<std::string>>(VALUE_STRING, "ab");
+    std::shared_ptr<Value> sum = apply_binary(BINARY_ADD, two, half);
+    EXPECT_EQ(sum->get_kind(), ValueKind::Float);
+    EXPECT_EQ(sum->get_num(), "2.5");
+    EXPECT_EQ(apply_binary(BINARY_POW, two, two)->get_num(), "4");
+    EXPECT_EQ(apply_binary(BINARY_LESS, half, two)->get_num(), "1");
+    EXPECT_EQ(apply_binary(BINARY_MUL, ab, two)->get_num(), "abab");
+    EXPECT_EQ(apply_binary(BINARY_ADD, ab, ab)->get_num(), "abab");
+    EXPECT_EQ(apply_binary(BINARY_GREATER, ab, ab)->get_num(), "0");
+    EXPECT_EQ(apply_binary(BINARY_DIV, two, zero)->get_kind(), ValueKind::Error);
+    EXPECT_EQ(apply_binary(BINARY_MOD, half, two)->get_kind(), ValueKind::Error);
+    EXPECT_EQ(apply_binary(BINARY_ADD, ab, two)->get_kind(), ValueKind::Error);
+    // File is the last kind; its operands get their own rows and columns.
+    std::shared_ptr<Value> file = make_pooled<FileValue>("unopened", false);
+    std::shared_ptr<Value> file_sum = apply_binary(BINARY_ADD, file, two);
+    EXPECT_EQ(file_sum->get_kind(), ValueKind::Error);
+    EXPECT_NE(file_sum->get_num().find("ADD"), std::string::npos) << file_sum->get_num();
+    EXPECT_EQ(apply_binary(BINARY_SUB, two, file)->get_kind(), ValueKind::Error);
+    EXPECT_EQ(apply_binary(BINARY_EQUAL, file, file)->get_num(), "1");
+    EXPECT_EQ(apply_binary(BINARY_GREATER_EQUAL, ab, file)->get_kind(), ValueKind::Int);
+
+    Number result;
+    ASSERT_EQ(numeric_kernel(BINARY_SUB, false, true)(Number::from_int(2),
+                                                      Number::from_float(0.5), result),
+              NumericStatus::Ok);
+    EXPECT_TRUE(result.is_float);
+    EXPECT_DOUBLE_EQ(result.float_value, 1.5);
+
+    check_interpreter("1 + 2.5 * 2", "6", VALUE_FLOAT);
+    check_interpreter("\"x\" + \"y\" = \"xy\"", "1");
+}
+
+TEST(InterpreterTest, TestAstQuickening) {
+    Lexer lexer("test", "x + 1\na[x]\n");
+    TokenList tokens = lexer.make_tokens();
+    Parser parser(tokens);
+    NodeList ast = parser.parse();
+    ASSERT_EQ(ast.size(), 2u);
+    std::shared_ptr<Node> sum = ast[0], load = ast[1];
+    std::shared_ptr<Node> x = sum->get_child()[0];
+
+    SymbolTable st;
+    Interpreter interpreter(st);
+    st.set("x", make_pooled<TypedValue<int64_t>>(VALUE_INT, 2));
+    st.set("a", make_pooled<ArrayValue>(ValueList{
+                    make_pooled<TypedValue<int64_t>>(VALUE_INT, 10),
+                    make_pooled<TypedValue<int64_t>>(VALUE_INT, 20)}));
+    EXPECT_EQ(sum->get_quickened(), Quickened::Unvisited);
+    EXPECT_EQ(interpreter.visit(sum)->get_num(), "3");
+    EXPECT_EQ(sum->get_quickened(), Quickened::IntBinOp);
+    EXPECT_EQ(x->get_quickened(), Quickened::LocalLoad);
+    EXPECT_EQ(interpreter.visit(load)->get_num(), "20");
+    EXPECT_EQ(load->get_quickened(), Quickened::ArrayLoad);
+
+    // A new binding and a new scope still read through the slot cache.
+    st.set("x", make_pooled<TypedValue<int64_t>>(VALUE_INT, 1));
+    EXPECT_EQ(interpreter.visit(sum)->get_num(), "2");
+    SymbolTable inner(&st);
+    inner.set("x", make_pooled<TypedValue<int64_t>>(VALUE_INT, 5));
+    Interpreter inner_interpreter(inner);
+    EXPECT_EQ(inner_interpreter.visit(sum)->get_num(), "6");
+    EXPECT_EQ(x->get_quickened(), Quickened::LocalLoad);
+
+    // Operands of another kind fall back to the generic nodes for good.
+    st.set("x", make_pooled<TypedValue<double>>(VALUE_FLOAT, 0.5));
+    std::shared_ptr<Value> result = interpreter.visit(sum);
+    EXPECT_EQ(result->get_type(), VALUE_FLOAT);
+    EXPECT_EQ(result->get_num(), "1.5");
+    EXPECT_EQ(sum->get_quickened(), Quickened::BinOp);
+    st.set("x", make_pooled<TypedValue<int64_t>>(VALUE_INT, 1));
+    st.set("a", make_pooled<TypedValue<std::string>>(VALUE_STRING, "pq"));
+    EXPECT_EQ(interpreter.visit(load)->get_num(), "p");
+    EXPECT_EQ(load->get_quickened(), Quickened::ArrayAccess);
+    st.erase("x");
+    EXPECT_EQ(interpreter.visit(x)->get_kind(), ValueKind::Error);
+    EXPECT_EQ(x->get_quickened(), Quickened::VarAccess);
+}
+
+TEST(InterpreterTest, TestParallelFor) {
+    check_interpreter("total <- 0\n"
+                      "parallel for i <- 1 to 1000 do\n"
+                      "    total <- total + i\n"
+                      "total",
+                      "500500");
+    check_interpreter("s <- \"\"\n"
+                      "parallel for i <- 1 to 12 do\n"
+                      "    s <- s + string(i)\n"
+                      "s",
+                      "123456789101112", VALUE_STRING);
+    check_interpreter("a <- [0]\n"
+                      "a.resize(600)\n"
+                      "parallel for i <- 600 to 1 step -1 do\n"
+                      "    a[i] <- i * i\n"
+                      "a[300]",
+                      "90000");
+    check_interpreter("parallel for i <- 1 to 10 do\n"
+                      "    tmp <- i\n"
+                      "i",
+                      "11");
+    check_interpreter("parallel for i <- 1 to 3 do\n"
+                      "    break",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("parallel for i <- 1 to 2.5 do\n"
+                      "    i",
+                      "IGNORE", VALUE_ERROR);
+    // Containers from outside the loop are shared by its iterations.
+    check_interpreter("a <- [0]\n"
+                      "parallel for i <- 1 to 100 do\n"
+                      "    a.push(i)",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("a <- [0]\n"
+                      "parallel for i <- 1 to 100 do\n"
+                      "    b <- a\n"
+                      "    b.push(i)",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("t <- HashTable()\n"
+                      "parallel for i <- 1 to 100 do\n"
+                      "    t[i] <- i",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("Struct Point:\n"
+                      "    x\n"
+                      "p <- Point()\n"
+                      "parallel for i <- 1 to 100 do\n"
+                      "    p.x <- i",
+                      "IGNORE", VALUE_ERROR);
+    // Containers an iteration makes are its chunk's own; others are shared,
+    // however the iteration reaches them.
+    check_interpreter("rows <- [0, 0]\n"
+                      "total <- 0\n"
+                      "parallel for i <- 1 to 2 do\n"
+                      "    row <- [i]\n"
+                      "    row.push(i)\n"
+                      "    rows[i] <- row\n"
+                      "    total <- total + row.size()\n"
+                      "rows[2].push(3)\n"
+                      "total + rows[2].size()",
+                      "7");
+    check_interpreter("rows <- [[0], [0]]\n"
+                      "parallel for i <- 1 to 2 do\n"
+                      "    rows[i].push(i)",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("a <- []\n"
+                      "Algorithm add(x):\n"
+                      "    return a.push(x)\n"
+                      "parallel for i <- 1 to 20000 do\n"
+                      "    add(i)",
+                      "IGNORE", VALUE_ERROR);
+    // Assignments that would not reach the enclosing code do not parse.
+    auto parses = [](const std::string& text) {
+        Lexer lexer("test", text);
+        NodeList ast = Parser(lexer.make_tokens()).parse();
+        return !ast.empty() && ast[0]->get_type() != NODE_ERROR;
+    };
+    EXPECT_FALSE(parses("last <- 0\n"
+                        "parallel for i <- 1 to 10 do\n"
+                        "    last <- i\n"));
+    EXPECT_FALSE(parses("m <- 0\n"
+                        "parallel for i <- 1 to 10 do\n"
+                        "    m <- m - i\n"));
+    EXPECT_FALSE(parses("Algorithm f(n):\n"
+                        "    parallel for i <- 1 to 10 do\n"
+                        "        n <- i\n"
+                        "    return n\n"));
+    EXPECT_TRUE(parses("for j <- 1 to 2 do\n"
+                       "    print(j)\n"
+                       "parallel for i <- 1 to 10 do\n"
+                       "    x <- i\n"
+                       "    for j <- 1 to 2 do\n"
+                       "        x <- x + j\n"
+                       "parallel for i <- 1 to 10 do\n"
+                       "    x <- i\n"));
+}
+
+TEST(InterpreterTest, TestSpawnAndChannels) {
+    check_interpreter("Algorithm sq(x):\n"
+                      "    return x * x\n"
+                      "t <- spawn sq(12)\n"
+                      "await(t) + join(t)",
+                      "288");
+    check_interpreter("Algorithm fill(ch, n):\n"
+                      "    for i <- 1 to n do\n"
+                      "        send(ch, i)\n"
+                      "    return n\n"
+                      "ch <- channel(2)\n"
+                      "t <- spawn fill(ch, 50)\n"
+                      "total <- 0\n"
+                      "for i <- 1 to 50 do\n"
+                      "    total <- total + receive(ch)\n"
+                      "total + await(t)",
+                      "1325");
+    // The task sees globals as they were when it was spawned.
+    check_interpreter("g <- 1\n"
+                      "Algorithm read_g():\n"
+                      "    return g\n"
+                      "t <- spawn read_g()\n"
+                      "g <- 2\n"
+                      "await(t)",
+                      "1");
+    check_interpreter("await(3)", "IGNORE", VALUE_ERROR);
+    check_interpreter("channel(0)", "IGNORE", VALUE_ERROR);
+}
+
+TEST(InterpreterTest, TestTaskSharing) {
+    const std::string defs = "Algorithm total(a):\n"
+                             "    s <- 0\n"
+                             "    for i <- 1 to a.size() do\n"
+                             "        s <- s + a[i]\n"
+                             "    return s\n"
+                             "a <- []\n"
+                             "for i <- 1 to 2000 do\n"
+                             "    a.push(i)\n";
+    // Tasks read copies, so the spawner may change its array meanwhile.
+    check_interpreter(defs + "ts <- []\n"
+                             "for k <- 1 to 8 do\n"
+                             "    ts.push(spawn total(a))\n"
+                             "for i <- 1 to 2000 do\n"
+                             "    a[i] <- 0\n"
+                             "a.push(5)\n"
+                             "sum <- 0\n"
+                             "for k <- 1 to 8 do\n"
+                             "    sum <- sum + await(ts[k])\n"
+                             "sum + total(a)",
+                      "16008005");
+    // A copy kept from an earlier spawn is not handed out once the array changed.
+    check_interpreter(defs + "t1 <- spawn total(a)\n"
+                             "a[1] <- 1001\n"
+                             "t2 <- spawn total(a)\n"
+                             "await(t2) - await(t1)",
+                      "1000");
+    // Nested containers and repeated references are copied once each.
+    check_interpreter("Algorithm same(rows):\n"
+                      "    seen <- HashTable()\n"
+                      "    seen[rows[1]] <- 1\n"
+                      "    return seen.contains(rows[2])\n"
+                      "row <- [1]\n"
+                      "await(spawn same([row, row]))",
+                      "1");
+    // The copies are read-only, for the task and for anyone it hands them to.
+    check_interpreter(defs + "Algorithm grow(a):\n"
+                             "    return a.push(1)\n"
+                             "await(spawn grow(a))",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("Algorithm set(h):\n"
+                      "    h[\"k\"] <- 2\n"
+                      "    return h[\"k\"]\n"
+                      "h <- HashTable()\n"
+                      "h[\"k\"] <- 1\n"
+                      "await(spawn set(h)) * 10 + h[\"k\"]",
+                      "IGNORE", VALUE_ERROR);
+    // A write the task makes as a statement fails the task, not just that statement.
+    check_interpreter("Algorithm set(x):\n"
+                      "    x[1] <- 7\n"
+                      "    return 1\n"
+                      "x <- [1]\n"
+                      "await(spawn set(x))",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("Algorithm grow(x):\n"
+                      "    x.push(5)\n"
+                      "    return 1\n"
+                      "x <- [1]\n"
+                      "await(spawn grow(x))",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("Struct P:\n"
+                      "    x\n"
+                      "Algorithm P::bump():\n"
+                      "    self.x <- self.x + 1\n"
+                      "    return self.x\n"
+                      "p <- P(1)\n"
+                      "await(spawn p.bump())",
+                      "IGNORE", VALUE_ERROR);
+    // Globals the task reads are copied when it is spawned, and those it
+    // cannot read stay the spawner's alone.
+    check_interpreter("g <- [1]\n"
+                      "Algorithm read_g():\n"
+                      "    return g.size()\n"
+                      "Algorithm grow_g():\n"
+                      "    return g.push(2)\n"
+                      "t <- spawn read_g()\n"
+                      "g.push(2)\n"
+                      "await(t) * 10 + g.size()",
+                      "12");
+    check_interpreter("g <- [1]\n"
+                      "Algorithm grow_g():\n"
+                      "    return g.push(2)\n"
+                      "await(spawn grow_g())",
+                      "IGNORE", VALUE_ERROR);
+    // Values sent on a channel, and results, are frozen too.
+    check_interpreter("Algorithm fill(ch):\n"
+                      "    x <- [5]\n"
+                      "    send(ch, x)\n"
+                      "    x.push(6)\n"
+                      "    return x\n"
+                      "ch <- channel(1)\n"
+                      "t <- spawn fill(ch)\n"
+                      "got <- receive(ch)\n"
+                      "got.size() * 10 + await(t).size()",
+                      "12");
+    check_interpreter("Algorithm fill(ch):\n"
+                      "    send(ch, [5])\n"
+                      "ch <- channel(1)\n"
+                      "spawn fill(ch)\n"
+                      "receive(ch).push(6)",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("Algorithm make():\n"
+                      "    return [1, 2]\n"
+                      "r <- await(spawn make())\n"
+                      "r.push(3)",
+                      "IGNORE", VALUE_ERROR);
+
+    // Under lexical scoping, Algorithms in a task look globals up in the
+    // task's copy.
+    Lexer lexer("test", "g <- [1]\n"
+                        "Algorithm read_g():\n"
+                        "    return g.size()\n"
+                        "t <- spawn read_g()\n"
+                        "g.push(2)\n"
+                        "await(t)\n");
+    NodeList ast = Parser(lexer.make_tokens()).parse();
+    SymbolTable lexical_st;
+    lexical_st.set_lexical_scoping(true);
+    Interpreter lexical_interpreter(lexical_st);
+    std::shared_ptr<Value> result;
+    for (auto node : ast) result = lexical_interpreter.visit(node);
+    EXPECT_EQ(result->get_num(), "1");
+}
+
+TEST(InterpreterTest, TestHigherOrderBuiltins) {
+    const std::string defs = "Algorithm sq(x):\n"
+                             "    return x * x\n"
+                             "Algorithm odd(x):\n"
+                             "    return x % 2 = 1\n"
+                             "Algorithm add(a, b):\n"
+                             "    return a + b\n"
+                             "Algorithm sub(a, b):\n"
+                             "    return a - b\n"
+                             "a <- []\n"
+                             "for i <- 1 to 3000 do\n"
+                             "    a.push(i)\n";
+    check_interpreter(defs + "m <- map(a, sq)\n"
+                             "m[1] + m[3000]",
+                      "9000001");
+    check_interpreter(defs + "f <- filter(a, odd)\n"
+                             "f.size() * 10000 + f[1500]",
+                      "15002999");
+    check_interpreter(defs + "reduce(a, add, 7)", "4501507");
+    // Not associative, so always folded in order.
+    check_interpreter(defs + "reduce(a, sub, 0)", "-4501500");
+    check_interpreter("map([1, 2], string)", "{\"1\", \"2\"}", VALUE_ARRAY);
+    check_interpreter("Algorithm g(x):\n"
+                      "    return x\n"
+                      "for_each([1], g)",
+                      "NONE", VALUE_NONE);
+    check_interpreter("Algorithm g(x):\n"
+                      "    return x\n"
+                      "map(3, g)",
+                      "IGNORE", VALUE_ERROR);
+    check_interpreter("reduce([1], 2, 0)", "IGNORE", VALUE_ERROR);
+}
+
+TEST(EngineTest, TestIsolatesRunConcurrently) {
+    const std::string program = "Algorithm fib(n):\n"
+                                "    if n < 2 then\n"
+                                "        return n\n"
+                                "    return fib(n - 1) + fib(n - 2)\n"
+                                "Algorithm ring(n):\n"
+                                "    a <- {}\n"
+                                "    for i <- 1 to n do\n"
+                                "        b <- {}\n"
+                                "        b.push(b)\n"
+                                "        a.push(b)\n"
+                                "    a <- {}\n"
+                                "    for i <- 1 to n do\n"
+                                "        a.push(i)\n"
+                                "    return fib(15) + a.size()\n"
+                                "base <- ";
+    std::string results[2];
+    std::thread workers[2];
+    for (int t = 0; t < 2; ++t) {
+        workers[t] = std::thread([&, t] {
+            Engine engine;
+            engine.load(program + std::to_string(t * 100));
+            std::shared_ptr<Value> ring = engine.call(
+                "ring", {make_pooled<TypedValue<int64_t>>(VALUE_INT, 20000)});
+            results[t] = ring->get_num() + " " + engine.globals().get("base")->get_num();
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    EXPECT_EQ(results[0], "20610 0");
+    EXPECT_EQ(results[1], "20610 100");
+
+    // Tasks running in one group leave the others single-threaded.
+    sched::TaskGroup busy;
+    std::atomic<bool> release{false};
+    sched::TaskGroup* previous = sched::use_task_group(&busy);
+    sched::spawn([&release] {
+        while (!release.load()) std::this_thread::yield();
+    });
+    EXPECT_TRUE(sched::concurrent());
+    sched::use_task_group(previous);
+    EXPECT_FALSE(sched::concurrent());
+    release.store(true);
+    sched::use_task_group(&busy);
+    sched::wait_for_tasks();
+    EXPECT_FALSE(sched::concurrent());
+    sched::use_task_group(previous);
+
+    // Lexical scoping warnings go to the diagnostics stream, not the output.
+    Engine lexical(true);
+    std::istringstream no_input;
+    std::ostringstream output, diagnostics;
+    lexical.redirect(no_input, output);
+    lexical.redirect_diagnostics(diagnostics);
+    lexical.load("Algorithm f():\n    return y\nprint(1)\n");
+    EXPECT_EQ(output.str(), "1\n");
+    EXPECT_NE(diagnostics.str().find("Warning: "), std::string::npos);
+
+    Engine engine;
+    EXPECT_EQ(engine.load("x <- 2\nx * 21")->get_num(), "42");
+    EXPECT_EQ(engine.load("x <- ")->get_type(), VALUE_ERROR);
+    EXPECT_EQ(engine.call("missing")->get_type(), VALUE_ERROR);
+    engine.reset();
+    EXPECT_EQ(engine.load("x")->get_type(), VALUE_ERROR);
+}
+
+// Tests that work with files get a directory of their own, named after the
+// test and the process so concurrent runs do not share it, removed again
+// when the test ends.
+class TempDirTest : public testing::Test {
+   protected:
+    void SetUp() override {
+        const testing::TestInfo* info = testing::UnitTest::GetInstance()->current_test_info();
+        dir = std::filesystem::temp_directory_path() /
+              ("pseudo_" + std::string(info->test_suite_name()) + "_" + info->name() + "_" +
+               std::to_string(getpid()));
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+    }
+    void TearDown() override { std::filesystem::remove_all(dir); }
+
+    std::string path(const std::string& name) const { return (dir / name).string(); }
+    void write(const std::string& name, const std::string& text) const {
+        std::ofstream(dir / name) << text;
+    }
+    std::string read(const std::string& name) const {
+        std::ifstream file(dir / name);
+        std::stringstream text;
+        text << file.rdbuf();
+        return text.str();
+    }
+
+    std::filesystem::path dir;
+};
+
+using BatchTest = TempDirTest;
+using ServerTest = TempDirTest;
+using ModuleTest = TempDirTest;
+using SnapshotTest = TempDirTest;
+using IoTest = TempDirTest;
+using FileTest = TempDirTest;
+using ProfileTest = TempDirTest;
+
+TEST_F(BatchTest, TestManifestJobsRunIsolated) {
+    write("echo.ps", "x <- read_line()\nprint(\"hello \" + x)\n");
+    write("echo.in", "world\n");
+    write("count.ps", "x <- 0\nfor i <- 1 to 1000 do\n    x <- x + i\nprint(x)\nquit()\nprint(0)\n");
+    write("broken.ps", "print(x)\n");
+    // The same work on one task and on four: pool threads' time is the job's.
+    std::string burn = "Algorithm burn(n):\n    s <- 0\n    for i <- 1 to n do\n"
+                       "        s <- s + i % 7\n    return s\nts <- []\n";
+    write("one.ps", burn + "ts.push(spawn burn(100000))\nprint(await(ts[1]))\n");
+    write("four.ps", burn + "for k <- 1 to 4 do\n    ts.push(spawn burn(100000))\n"
+                            "for k <- 1 to 4 do\n    print(await(ts[k]))\n");
+    write("jobs.txt", "# six jobs\necho.ps echo.in\n\ncount.ps - count.txt\n"
+                      "broken.ps\nabsent.ps\none.ps\nfour.ps\n");
+
+    std::string error;
+    ASSERT_TRUE(run_batch(path("jobs.txt"), path("summary.tsv"), false, error));
+    EXPECT_EQ(read("echo.ps.out"), "hello world\n");
+    EXPECT_EQ(read("count.txt"), "500500\n");
+    EXPECT_NE(read("broken.ps.out").find("x"), std::string::npos);
+    EXPECT_FALSE(std::filesystem::exists(dir / "absent.ps.out"));
+
+    std::vector<std::string> statuses;
+    std::vector<double> cpu_ms;
+    std::istringstream summary(read("summary.tsv"));
+    std::string line;
+    std::getline(summary, line);
+    EXPECT_EQ(line, "job\tprogram\tstatus\twall_ms\tcpu_ms\trunner_pool_peak_kb");
+    while (std::getline(summary, line)) {
+        std::istringstream fields(line);
+        std::string job, program, status;
+        double wall = 0, cpu = 0;
+        fields >> job >> program >> status >> wall >> cpu;
+        statuses.push_back(status);
+        cpu_ms.push_back(cpu);
+    }
+    EXPECT_EQ(statuses,
+              (std::vector<std::string>{"ok", "ok", "error", "missing", "ok", "ok"}));
+    ASSERT_EQ(cpu_ms.size(), 6);
+    EXPECT_GT(cpu_ms[5], 2.5 * cpu_ms[4]);
+
+    EXPECT_FALSE(run_batch(path("none.txt"), path("s.tsv"), false, error));
+}
+
+TEST_F(ServerTest, TestClientRunsProgramInForkedChild) {
+    std::string socket_path = path("pseudo.sock");
+    write("echo.ps", "x <- read_line()\nprint(x + \"!\")\nquit()\nprint(0)\n");
+    write("echo.in", "hi\n");
+    // The task fills the channel on a pool thread while the program waits.
+    write("channel.ps", "Algorithm fill(ch, n):\n    for i <- 1 to n do\n        send(ch, i)\n"
+                        "    return n\nch <- channel(2)\nt <- spawn fill(ch, 50)\ntotal <- 0\n"
+                        "for i <- 1 to 50 do\n    total <- total + receive(ch)\nprint(total)\n");
+    // Large enough to be parsed on the pool while the server warms up.
+    std::filesystem::create_directories(dir / "lib");
+    std::string lib;
+    for (int i = 1; lib.size() < 30 * 1024; ++i) {
+        lib += "Algorithm lib_f" + std::to_string(i) + "(x):\n    return x + 1\n";
+    }
+    write("lib/big.ps", lib);
+
+    // Pending test output would otherwise be written again by the children.
+    std::fflush(nullptr);
+    pid_t server = fork();
+    if (server == 0) {
+        std::string error;
+        if (chdir(dir.c_str()) == 0) serve(socket_path, false, error);
+        _exit(1);
+    }
+    int in = open(path("echo.in").c_str(), O_RDONLY);
+    int out = open(path("echo.out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    std::string error;
+    int status = -1;
+    // Retried while the server starts.
+    for (int attempt = 0; attempt < 500 && status < 0; ++attempt) {
+        status = run_client(socket_path, path("echo.ps"), in, out, out, error);
+        if (status < 0) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    close(in);
+    close(out);
+    out = open(path("channel.out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int channel_status = run_client(socket_path, path("channel.ps"), 0, out, out, error);
+    close(out);
+    kill(server, SIGTERM);
+    waitpid(server, nullptr, 0);
+
+    EXPECT_EQ(status, 0);
+    EXPECT_EQ(read("echo.out"), "hi!\n");
+    EXPECT_EQ(channel_status, 0);
+    EXPECT_EQ(read("channel.out"), "1275\n");
+    EXPECT_FALSE(std::filesystem::exists(socket_path));
+    EXPECT_EQ(run_client(socket_path, "echo.ps", 0, 1, 2, error), -1);
+}
+
+TEST_F(ModuleTest, TestModuleCacheReusedAndInvalidated) {
+    namespace fs = std::filesystem;
+    auto run_main = [this](const std::string& text) {
+        SymbolTable st;
+        std::string result = run(path("main.ps"), text, st);
+        std::shared_ptr<Value> value = st.get("result");
+        return result + (value.get() == nullptr ? "" : value->get_num());
+    };
+    auto inode = [](const fs::path& path) {
+        struct stat info;
+        return stat(path.c_str(), &info) == 0 ? info.st_ino : 0;
+    };
+    fs::path cache = dir / "__pscache__" / "mod.psc";
+
+    write("mod.ps", "Algorithm twice(n):\n    return n * 2\n");
+    EXPECT_EQ(run_main("import \"mod.ps\"\nresult <- twice(4)\n"), "8");
+    ASSERT_TRUE(fs::exists(cache));
+    ino_t first = inode(cache);
+    EXPECT_EQ(run_main("import \"mod.ps\"\nresult <- twice(5)\n"), "10");
+    EXPECT_EQ(inode(cache), first);  // read, not rewritten
+
+    write("mod.ps", "Algorithm twice(n):\n    return n * 3\n");
+    EXPECT_EQ(run_main("import \"mod.ps\"\nresult <- twice(5)\n"), "15");
+    EXPECT_NE(inode(cache), first);
+
+    fs::resize_file(cache, fs::file_size(cache) - 3);
+    EXPECT_EQ(run_main("import \"mod.ps\"\nresult <- twice(2)\n"), "6");
+
+    write("bad.ps", "x <- 1\nAlgorithm f(:\n    return 1\n");
+    NodeList ast;
+    std::string error;
+    EXPECT_FALSE(parse_program(path("main.ps"), "\n\nimport \"bad.ps\"\n", ast, error));
+    EXPECT_NE(error.find("line 2,"), std::string::npos);
+    EXPECT_NE(error.find("bad.ps"), std::string::npos);
+}
+
+TEST(ImportTest, TestLargeFilesParsedInPieces) {
+    std::string text;
+    for (int i = 1; i <= 400; ++i) {
+        std::string n = std::to_string(i);
+        text += "Algorithm f" + n + "(x):\n    // uses \"x\"\n    return x + " + n + "\n";
+        if (i == 150) text += "label <- \"a\\\"\nAlgorithm fake():\n\"\n";
+    }
+    text += "total <- f1(1) + f400(1)\n";
+    ASSERT_GE(text.size(), 16u * 1024);
+
+    NodeList pieces, whole;
+    std::string error;
+    ASSERT_TRUE(parse_program("pieces.ps", text, pieces, error)) << error;
+    Lexer lexer("pieces.ps", text);
+    whole = Parser(lexer.make_tokens()).parse();
+    ASSERT_EQ(pieces.size(), whole.size());
+    for (std::size_t i = 0; i < whole.size(); ++i) {
+        EXPECT_EQ(pieces[i]->get_node(), whole[i]->get_node());
+        std::shared_ptr<Token> piece_tok = pieces[i]->get_tok(), whole_tok = whole[i]->get_tok();
+        ASSERT_EQ(piece_tok.get() == nullptr, whole_tok.get() == nullptr);
+        if (piece_tok.get() != nullptr) {
+            EXPECT_EQ(piece_tok->get_pos().line(), whole_tok->get_pos().line());
+        }
+    }
+
+    SymbolTable st;
+    run("pieces.ps", text, st);
+    EXPECT_EQ(st.get("total")->get_num(), "403");
+    EXPECT_FALSE(st.contains_local("fake"));  // in a string, not a split point
+
+    std::size_t late = text.find("Algorithm f280(x):");
+    text.replace(late, 18, "Algorithm f280(x:");
+    EXPECT_FALSE(parse_program("pieces.ps", text, pieces, error));
+    std::string line = std::to_string(std::count(text.begin(), text.begin() + late, '\n') + 1);
+    EXPECT_NE(error.find("line " + line + ","), std::string::npos) << error;
+}
+
+TEST_F(ModuleTest, TestPreparsedModulesUsedWhileUnchanged) {
+    write("mod.ps", "Algorithm twice(n):\n    return n * 2\n");
+    std::string main_file = path("main.ps");
+    std::string main_text = "import \"mod.ps\"\nresult <- twice(4)\n";
+    std::shared_ptr<const PreparsedModules> modules = preparse_modules({path("mod.ps")});
+    auto parse = [&](NodeList& ast) {
+        ImportState state;
+        state.preparsed = modules.get();
+        std::string error;
+        EXPECT_TRUE(parse_with_imports(main_file, main_text, state, ast, error)) << error;
+    };
+
+    NodeList first, second, edited;
+    parse(first);
+    parse(second);
+    ASSERT_EQ(first.size(), 2);
+    ASSERT_EQ(second.size(), 2);
+    EXPECT_EQ(first[0].get(), second[0].get());
+    EXPECT_NE(first[1].get(), second[1].get());
+
+    write("mod.ps", "Algorithm twice(n):\n    return n * 3\n");
+    parse(edited);
+    ASSERT_EQ(edited.size(), 2);
+    EXPECT_NE(edited[0].get(), first[0].get());
+
+    Engine engine;
+    engine.use_modules(modules);
+    EXPECT_EQ(engine.load(main_text + "result", main_file)->get_num(), "12");
+}
+
+TEST_F(ModuleTest, TestUnreferencedDefinitionsDeferred) {
+    write("mod.ps", "Algorithm helper(n):\n    return n * 2\n"
+                    "Algorithm used(n):\n    return helper(n) + 1\n"
+                    "Algorithm unused():\n    return helper(10)\n"
+                    "Struct Point:\n    x\n    y\n");
+    std::string main_file = path("main.ps");
+    std::string main_text = "import \"mod.ps\"\nresult <- used(3)\n";
+
+    // Parsed, then read from the cache: only `used` and `helper` are built.
+    for (int pass = 0; pass < 2; ++pass) {
+        NodeList ast;
+        std::string error;
+        ASSERT_TRUE(parse_program(main_file, main_text, ast, error)) << error;
+        std::vector<std::string> defined;
+        for (const auto& node : ast) {
+            if (node->get_type() == NODE_ALGODEF || node->get_type() == NODE_STRUCTDEF) {
+                defined.push_back(node->get_name());
+            }
+        }
+        EXPECT_EQ(defined, (std::vector<std::string>{"helper", "used"}));
+    }
+
+    Engine engine;
+    EXPECT_EQ(engine.load(main_text, main_file)->get_num(), "7");
+    EXPECT_FALSE(engine.globals().contains_local("unused"));
+    EXPECT_EQ(engine.call("unused", {})->get_num(), "20");
+    EXPECT_EQ(engine.load("p <- Point()\np.x <- 4\np.x\n")->get_num(), "4");
+    EXPECT_EQ(engine.load("Point <- 1\nPoint\n")->get_num(), "1");
+}
+
+TEST_F(SnapshotTest, TestGlobalsRestoredWithSharing) {
+    std::string snap = path("globals.snap");
+    std::string error;
+    {
+        SymbolTable st;
+        run("init.ps",
+            "Struct Point:\n    x\n    Algorithm twice():\n        return self.x * 2\n"
+            "Algorithm scale(n):\n    return n * factor\n"
+            "factor <- 3\nlist <- {1, 2}\nsame <- list\nlist.push(list)\n"
+            "table <- HashTable()\ntable.set(\"k\", 1.5)\np <- Point()\np.x <- 21\n",
+            st);
+        ASSERT_TRUE(snapshot::save(snap, st, error)) << error;
+
+        run("init.ps", "ch <- channel(1)\n", st);
+        EXPECT_FALSE(snapshot::save(snap + ".bad", st, error));
+        EXPECT_NE(error.find("\"ch\""), std::string::npos);
+    }
+
+    SymbolTable st;
+    ASSERT_TRUE(snapshot::load(snap, st, error)) << error;
+    run("main.ps",
+        "same.push(5)\nresult <- {scale(2), p.twice(), table.get(\"k\"), list.size(), "
+        "list[3].size()}\n",
+        st);
+    EXPECT_EQ(st.get("result")->get_num(), "{6, 42, 1.5, 4, 4}");
+
+    write("globals.snap", "PSNP");
+    EXPECT_FALSE(snapshot::load(snap, st, error));
+}
+
+TEST(ImportTest, TestWatchReparsesOnlyChangedDefinitions) {
+    std::string text =
+        "Algorithm sq(x):\n    return x * x\n"
+        "Algorithm f(n):\n    return sq(n) + 1\n"
+        "Algorithm g(n):\n    return n + 100\n";
+    ParseMemo memo;
+    NodeList first, second;
+    std::string error;
+    SymbolTable st;
+    ASSERT_TRUE(parse_program("watched.ps", text, st, first, error, &memo)) << error;
+    ASSERT_EQ(first.size(), 3u);
+    EXPECT_EQ(memo.reparsed, 3u);
+
+    // A longer sq moves f and g down a line; f uses sq, g does not.
+    text.replace(text.find("return x * x"), 12, "y <- x * x\n    return y * x");
+    SymbolTable fresh;
+    ASSERT_TRUE(parse_program("watched.ps", text, fresh, second, error, &memo)) << error;
+    ASSERT_EQ(second.size(), 3u);
+    EXPECT_NE(second[0].get(), first[0].get());
+    EXPECT_EQ(second[1].get(), first[1].get());
+    EXPECT_EQ(second[2].get(), first[2].get());
+    EXPECT_EQ(memo.reparsed, 1u);
+    EXPECT_EQ(memo.kept, 1u);
+    EXPECT_EQ(memo.invalidated, 1u);
+
+    Lexer lexer("watched.ps", text);
+    NodeList whole = Parser(lexer.make_tokens()).parse();
+    ASSERT_EQ(whole.size(), 3u);
+    EXPECT_EQ(second[2]->get_tok()->get_pos().line(), whole[2]->get_tok()->get_pos().line());
+
+    SymbolTable globals;
+    run("watched.ps", text + "a <- f(3)\nb <- g(1)\n", globals, &memo);
+    EXPECT_EQ(globals.get("a")->get_num(), "28");
+    EXPECT_EQ(globals.get("b")->get_num(), "101");
+}
+
+TEST_F(IoTest, TestBulkReaders) {
+    std::istringstream in("3\n10 -20 30\nword\n7x\nfirst line\nsecond");
+    std::ostringstream out;
+    Engine engine;
+    engine.redirect(in, out);
+    EXPECT_EQ(engine.load("n <- read_int()\nxs <- read_ints(n)\nxs[1] + xs[2] + xs[3]")->get_num(),
+              "20");
+    EXPECT_EQ(engine.load("read()")->get_num(), "word");
+    std::shared_ptr<Value> bad = engine.load("read_int()");
+    ASSERT_EQ(bad->get_type(), VALUE_ERROR);
+    EXPECT_NE(bad->get_num().find("\"7x\""), std::string::npos);
+    EXPECT_EQ(engine.load("lines <- read_all_lines()\nlines.size()")->get_num(), "2");
+    EXPECT_EQ(engine.load("lines[1]")->get_num(), "first line");
+    EXPECT_EQ(engine.load("read_int()")->get_type(), VALUE_ERROR);
+    EXPECT_EQ(engine.load("read_ints(-1)")->get_type(), VALUE_ERROR);
+
+    // Standard input and output, which are buffered by io itself.
+    std::string numbers = "100000\n";
+    for (int i = 1; i <= 100000; ++i) numbers += std::to_string(i) + (i % 10 ? " " : "\n");
+    write("numbers.in", numbers + "name\n");
+    // Or the child inherits what earlier tests printed.
+    io::flush();
+    std::cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        int in_fd = open(path("numbers.in").c_str(), O_RDONLY);
+        int out_fd = open(path("numbers.out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(in_fd, STDIN_FILENO);
+        dup2(out_fd, STDOUT_FILENO);
+        SymbolTable st;
+        run("numbers.ps",
+            "xs <- read_ints(read_int())\ns <- 0\nfor i <- 1 to xs.size() do\n"
+            "    s <- s + xs[i]\n    print(xs[i])\nprint(s)\nprint(read_line())\n",
+            st);
+        io::flush();
+        std::cout.flush();
+        _exit(0);
+    }
+    int status = -1;
+    waitpid(child, &status, 0);
+    EXPECT_EQ(status, 0);
+    std::ifstream result(dir / "numbers.out");
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(result, line);) lines.push_back(line);
+    ASSERT_EQ(lines.size(), 100002u);
+    EXPECT_EQ(lines[99999], "100000");
+    EXPECT_EQ(lines[100000], "5000050000");
+    EXPECT_EQ(lines[100001], "name");
+}
+
+TEST_F(FileTest, TestMappedReadsAndBufferedWrites) {
+    write("data.csv", "name,qty\napple,3\npear,\nplum,7");
+    write("empty.txt", "");
+    std::string in = path("data.csv"), out = path("out.txt");
+
+    SymbolTable st;
+    run("files.ps",
+        "f <- open(\"" + in + "\", \"r\")\nbytes <- f.size()\nheader <- f.read_fields(\",\")\n"
+        "total <- 0\nrows <- 0\nwhile not f.at_end() do\n    row <- f.read_fields(\",\")\n"
+        "    rows <- rows + 1\n    if row[2].size() > 0 then\n        total <- total + int(row[2])\n"
+        "f.close()\ng <- open(\"" + in + "\", \"r\")\nhead <- g.read_bytes(4)\n"
+        "rest <- g.read_line()\nlast <- 0\nwhile not g.at_end() do\n    last <- g.read_line()\n"
+        "w <- open(\"" + out + "\", \"w\")\nw.write(rows)\nw.write_line(\" rows\")\n"
+        "w.write_line(last)\nwritten <- w.size()\nw.close()\n"
+        "a <- open(\"" + out + "\", \"a\")\na.write_line(\"more\")\n"
+        "e <- open(\"" + path("empty.txt") + "\", \"r\")\nempty <- e.at_end()\n",
+        st);
+    EXPECT_EQ(st.get("bytes")->get_num(), "29");
+    EXPECT_EQ(st.get("header")->get_num(), "{\"name\", \"qty\"}");
+    EXPECT_EQ(st.get("rows")->get_num(), "3");
+    EXPECT_EQ(st.get("total")->get_num(), "10");
+    EXPECT_EQ(st.get("head")->get_num(), "name");
+    EXPECT_EQ(st.get("rest")->get_num(), ",qty");
+    EXPECT_EQ(st.get("last")->get_num(), "plum,7");
+    EXPECT_EQ(st.get("written")->get_num(), "14");
+    EXPECT_EQ(st.get("empty")->get_num(), "1");
+
+    // `a` is still open: its write waits in the buffer until it closes.
+    EXPECT_EQ(read("out.txt"), "3 rows\nplum,7\n");
+    static_cast<FileValue*>(st.get("a").get())->close();
+    EXPECT_EQ(read("out.txt"), "3 rows\nplum,7\nmore\n");
+
+    SymbolTable errors;
+    run("errors.ps",
+        "missing <- open(\"" + path("missing.txt") + "\", \"r\")\n", errors);
+    EXPECT_FALSE(errors.contains_local("missing"));
+    std::shared_ptr<Value> file = st.get("f");
+    EXPECT_EQ(static_cast<FileValue*>(file.get())->read_line()->get_type(), VALUE_ERROR);
+    EXPECT_EQ(static_cast<FileValue*>(st.get("w").get())->read_line()->get_type(), VALUE_ERROR);
+}
+
+TEST_F(ProfileTest, TestOutcomesKeptAcrossRuns) {
+    std::string profiles = path("profiles");
+    auto expression = [](const std::string& text) {
+        Lexer lexer("prof_lib.ps", text);
+        return Parser(lexer.make_tokens()).parse()[0]->get_child()[0];
+    };
+    // `for` loops compile their bodies themselves; `while` conditions are JIT roots.
+    const std::string program = "i <- 0\nwhile i < 100 do\n    i <- i + 1\n";
+    std::string error;
+    ASSERT_TRUE(profile::open(profiles, "prof.ps", error)) << error;
+    std::shared_ptr<Node> sum = expression("x <- a + b\n");
+    EXPECT_EQ(profile::lookup(*sum), JitOutcome::Unknown);
+    profile::record(*sum, JitOutcome::Bails);
+    SymbolTable first;
+    run("prof.ps", program, first);
+    ASSERT_TRUE(profile::save(error)) << error;
+    EXPECT_FALSE(profile::active());
+
+    std::ifstream file(std::filesystem::directory_iterator(profiles)->path());
+    std::stringstream text;
+    text << file.rdbuf();
+    EXPECT_NE(text.str().find(" compiled\n"), std::string::npos) << text.str();
+    EXPECT_NE(text.str().find(" bails\n"), std::string::npos) << text.str();
+
+    ASSERT_TRUE(profile::open(profiles, "prof.ps", error)) << error;
+    EXPECT_EQ(profile::lookup(*expression("x <- a + b\n")), JitOutcome::Bails);
+    EXPECT_EQ(profile::lookup(*expression("x <- a - b\n")), JitOutcome::Unknown);
+    SymbolTable second;
+    run("prof.ps", program, second);
+    EXPECT_EQ(second.get("i")->get_num(), "100");
+    EXPECT_TRUE(profile::save(error)) << error;
+}
+
 int main(int argc, char *argv[]) {
+  // Parallel constructs take their threaded paths on any machine.
+  setenv("PSEUDO_THREADS", "4", 0);
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
 }